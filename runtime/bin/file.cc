@@ -906,9 +906,11 @@ Dart_Port File::GetServicePort() {
 
   Dart_Port result = service_ports_[service_ports_index_];
   if (result == kIllegalPort) {
+    // The requests on an open file, e.g. a sequence of writes, must be
+    // handled in order.
     result = Dart_NewNativePort("FileService",
                                 FileService,
-                                true);
+                                false);
     ASSERT(result != kIllegalPort);
     service_ports_[service_ports_index_] = result;
   }
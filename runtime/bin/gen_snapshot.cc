@@ -21,6 +21,11 @@
 static const char* snapshot_filename = NULL;
 
 
+// Global state that indicates whether the compiled code of all functions is
+// included in the snapshot.
+static bool snapshot_code = false;
+
+
 // Global state which contains a pointer to the script name for which
 // a snapshot needs to be created (NULL would result in the creation
 // of a generic snapshot that contains only the corelibs).
@@ -59,6 +64,16 @@ static bool ProcessSnapshotOption(const char* option) {
 }
 
 
+static bool ProcessSnapshotCodeOption(const char* option) {
+  const char* kSnapshotCodeOption = "--snapshot_code";
+  if (strcmp(option, kSnapshotCodeOption) == 0) {
+    snapshot_code = true;
+    return true;
+  }
+  return false;
+}
+
+
 static bool ProcessURLmappingOption(const char* option) {
   const char* kURLmappingOption = "--url_mapping=";
   const char* mapping = ProcessOption(option, kURLmappingOption);
@@ -84,7 +99,9 @@ static int ParseArguments(int argc,
 
   // Parse out the vm options.
   while ((i < argc) && IsValidFlag(argv[i], kPrefix, kPrefixLen)) {
-    if (ProcessSnapshotOption(argv[i]) || ProcessURLmappingOption(argv[i])) {
+    if (ProcessSnapshotOption(argv[i]) ||
+        ProcessSnapshotCodeOption(argv[i]) ||
+        ProcessURLmappingOption(argv[i])) {
       i += 1;
       continue;
     }
@@ -303,8 +320,16 @@ int main(int argc, char** argv) {
 
   uint8_t* buffer = NULL;
   intptr_t size = 0;
-  // First create the snapshot.
-  result = Dart_CreateSnapshot(&buffer, &size);
+  // First create the snapshot, compiling all the functions to include their
+  // code if requested.
+  if (snapshot_code) {
+    result = Dart_CompileAll();
+    if (!Dart_IsError(result)) {
+      result = Dart_CreateSnapshotWithCode(&buffer, &size);
+    }
+  } else {
+    result = Dart_CreateSnapshot(&buffer, &size);
+  }
   if (Dart_IsError(result)) {
     const char* err_msg = Dart_GetError(result);
     fprintf(stderr, "Error while creating snapshot: %s\n", err_msg);
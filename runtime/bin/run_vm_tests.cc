@@ -14,6 +14,7 @@ namespace dart {
 // tests.
 static const char* const kNoTests = "No Test";
 static const char* const kAllTests = "All Tests";
+static const char* const kAllBenchmarks = "All Benchmarks";
 static const char* const kListTests = "List Tests";
 static const char* test_filter = kNoTests;
 
@@ -27,11 +28,19 @@ void TestCase::Run() {
 }
 
 
+void Benchmark::Run() {
+  fprintf(stdout, "Running benchmark: %s\n", name());
+  (*run_)(this);
+  OS::Print("%s(RunTime): %lld us\n", name(), score());
+}
+
+
 void TestCaseBase::RunTest() {
-  if ((test_filter == kAllTests) || (strcmp(test_filter, this->name()) == 0)) {
+  const char* run_all = IsBenchmark() ? kAllBenchmarks : kAllTests;
+  if ((test_filter == run_all) || (strcmp(test_filter, this->name()) == 0)) {
     this->Run();
     test_matches++;
-  } else if (test_filter == kListTests) {
+  } else if ((test_filter == kListTests) && !IsBenchmark()) {
     fprintf(stdout, "%s\n", this->name());
     test_matches++;
   }
@@ -39,7 +48,8 @@ void TestCaseBase::RunTest() {
 
 
 static void PrintUsage() {
-  fprintf(stderr, "run_vm_tests [--list | --all | <test name>]\n");
+  fprintf(stderr,
+          "run_vm_tests [--list | --all | --benchmarks | <test name>]\n");
   fprintf(stderr, "run_vm_tests  <test name> [vm-flags ...]\n");
 }
 
@@ -61,6 +71,8 @@ static int Main(int argc, const char** argv) {
       return 0;
     } else if (strcmp(argv[1], "--all") == 0) {
       test_filter = kAllTests;
+    } else if (strcmp(argv[1], "--benchmarks") == 0) {
+      test_filter = kAllBenchmarks;
     } else {
       test_filter = argv[1];
     }
@@ -78,6 +90,7 @@ static int Main(int argc, const char** argv) {
   ASSERT(init_success);
   // Apply the test filter to all registered tests.
   TestCaseBase::RunAll();
+  Dart::Cleanup();
   // Print a warning message if no tests were matched.
   if (test_matches == 0) {
     fprintf(stderr, "No tests matched: %s\n", test_filter);
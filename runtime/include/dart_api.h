@@ -388,6 +388,89 @@ DART_EXPORT Dart_Handle Dart_AddGcEpilogueCallback(
 DART_EXPORT Dart_Handle Dart_RemoveGcEpilogueCallback(
     Dart_GcEpilogueCallback callback);
 
+/**
+ * The kind of a garbage collection.
+ */
+typedef enum {
+  kGcScavenge = 0,
+  kGcMarkSweep,
+  kGcMarkCompact
+} Dart_GcKind;
+
+/**
+ * The reason a garbage collection was started.
+ */
+typedef enum {
+  kGcNewSpaceFull = 0,
+  kGcOldSpaceFull,
+  kGcIncrementalMarkingDone,
+  kGcExplicit
+} Dart_GcReason;
+
+/**
+ * The phases of a garbage collection which are timed separately. A
+ * collection only goes through some of them.
+ */
+typedef enum {
+  kGcRootsPhase = 0,
+  kGcProcessToSpacePhase,
+  kGcMarkPhase,
+  kGcWeakHandlesPhase,
+  kGcSweepPhase,
+  kGcCompactPhase,
+  kGcNumPhases
+} Dart_GcPhase;
+
+/**
+ * A record of a finished garbage collection.
+ *
+ * Times are in microseconds, sizes in bytes and refer to the collected
+ * space. Fragmentation is the percentage of the capacity of the space
+ * which is not in use after the collection.
+ */
+typedef struct {
+  Dart_GcKind kind;
+  Dart_GcReason reason;
+  int64_t start_time;
+  int64_t duration;
+  int64_t phase_durations[kGcNumPhases];
+  intptr_t used_before;
+  intptr_t used_after;
+  intptr_t capacity;
+  intptr_t promoted;
+  intptr_t freed;
+  intptr_t fragmentation;
+} Dart_GcEvent;
+
+/**
+ * A callback invoked with the record of each garbage collection once it
+ * has finished. The callback must not call back into the VM.
+ */
+typedef void (*Dart_GcEventCallback)(const Dart_GcEvent* event);
+
+/**
+ * Sets the garbage collection event callback of the current isolate.
+ *
+ * \param callback A function pointer to an event callback function or
+ *   NULL to remove the current callback.
+ *
+ * \return Success if the callback was set.  Otherwise, returns an
+ *   error handle.
+ */
+DART_EXPORT Dart_Handle Dart_SetGcEventCallback(Dart_GcEventCallback callback);
+
+/**
+ * Gets the records of the most recent garbage collections of the current
+ * isolate as a JSON document.
+ *
+ * \param json Returns a pointer to a NUL terminated string containing
+ *   an object with an array of events, oldest first. This buffer is scope
+ *   allocated and is only valid until the next call to Dart_ExitScope.
+ *
+ * \return A valid handle if no error occurs during the operation.
+ */
+DART_EXPORT Dart_Handle Dart_GetGcEventsAsJSON(const char** json);
+
 // --- Initialization and Globals ---
 
 /**
@@ -442,6 +525,14 @@ typedef bool (*Dart_IsolateInterruptCallback)();
 DART_EXPORT bool Dart_Initialize(Dart_IsolateCreateCallback create,
                                  Dart_IsolateInterruptCallback interrupt);
 
+/**
+ * Stops the worker threads of the VM.
+ *
+ * Must be called after all isolates have been shut down, and once no
+ * more messages are posted to the native ports.
+ */
+DART_EXPORT void Dart_Cleanup();
+
 /**
  * Sets command line flags. Should be called before Dart_Initialize.
  *
@@ -550,6 +641,28 @@ DART_EXPORT void Dart_ExitIsolate();
 DART_EXPORT Dart_Handle Dart_CreateSnapshot(uint8_t** buffer,
                                             intptr_t* size);
 
+/**
+ * Creates a full snapshot of the current isolate heap which also includes
+ * the compiled code of the functions.
+ *
+ * An isolate created from this snapshot runs the included code without
+ * compiling the functions again. Code which cannot be relocated into
+ * another process, e.g. optimized code or code calling native functions,
+ * is not included and is compiled lazily as usual. Use Dart_CompileAll
+ * before creating the snapshot to include the code of all functions.
+ *
+ * Requires there to be a current isolate.
+ *
+ * \param buffer Returns a pointer to a buffer containing the
+ *   snapshot. This buffer is scope allocated and is only valid
+ *   until the next call to Dart_ExitScope.
+ * \param size Returns the size of the buffer.
+ *
+ * \return A valid handle if no error occurs during the operation.
+ */
+DART_EXPORT Dart_Handle Dart_CreateSnapshotWithCode(uint8_t** buffer,
+                                                    intptr_t* size);
+
 /**
  * Creates a snapshot of the application script loaded in the isolate.
  *
@@ -602,8 +715,8 @@ const Dart_Port kIllegalPort = 0;
  *
  * This callback allows the embedder to provide an alternate wakeup
  * mechanism for the delivery of inter-isolate messages.  It is the
- * responsibility of the embedder to call Dart_HandleMessage to
- * process the message.
+ * responsibility of the embedder to call Dart_HandleMessage or
+ * Dart_HandleMessages to process the message.
  */
 typedef void (*Dart_MessageNotifyCallback)(Dart_Isolate dest_isolate);
 
@@ -630,6 +743,25 @@ DART_EXPORT void Dart_SetMessageNotifyCallback(
  */
 DART_EXPORT Dart_Handle Dart_HandleMessage();
 
+/**
+ * Handles the pending messages for the current isolate in a single
+ * entry into the isolate, which saves the per call overhead of
+ * Dart_HandleMessage when many small messages are pending.
+ *
+ * All pending OOB messages are handled, and normal messages until
+ * there is no message left, 'max_messages' messages have been handled
+ * or 'max_micros' microseconds have passed. A limit of 0 means no
+ * limit, but at least one of the limits must be non-zero so that the
+ * call returns while messages keep arriving. Does not wait for
+ * messages.
+ *
+ * May generate an unhandled exception error.
+ *
+ * \return A valid handle if no error occurs during the operation.
+ */
+DART_EXPORT Dart_Handle Dart_HandleMessages(intptr_t max_messages,
+                                            int64_t max_micros);
+
 /**
  * Processes any incoming messages for the current isolate.
  *
@@ -674,6 +806,25 @@ DART_EXPORT bool Dart_HasLivePorts();
  */
 DART_EXPORT bool Dart_Post(Dart_Port port_id, Dart_Handle object);
 
+/**
+ * Posts a message for some isolate like Dart_Post, but hands the data
+ * of the external byte arrays in the message over to the receiver
+ * instead of copying it. The external byte arrays of the sender are
+ * left empty, and the receiver gets external byte arrays with the same
+ * data, peers and finalizers. The data of the internal byte arrays is
+ * copied once, and the receiver gets external byte arrays for them as
+ * well. The data of a message which is never delivered is released
+ * through the finalizers.
+ *
+ * Requires there to be a current isolate.
+ *
+ * \param port The destination port.
+ * \param object An object from the current isolate.
+ *
+ * \return True if the message was posted.
+ */
+DART_EXPORT bool Dart_PostTransfer(Dart_Port port_id, Dart_Handle object);
+
 // --- Message sending/receiving from native code ----
 
 /**
@@ -755,7 +906,9 @@ typedef void (*Dart_NativeMessageHandler)(Dart_Port dest_port_id,
  * \param name The name of this port in debugging messages.
  * \param handler The C handler to run when messages arrive on the port.
  * \param handle_concurrently Is it okay to process requests on this
- *                            native port concurrently?
+ *                            native port concurrently?  If not, the
+ *                            messages are handled one at a time, in the
+ *                            order they were posted.
  *
  * \return If successful, returns the port id for the native port.  In
  *   case of error, returns kIllegalPort.
@@ -763,7 +916,6 @@ typedef void (*Dart_NativeMessageHandler)(Dart_Port dest_port_id,
 DART_EXPORT Dart_Port Dart_NewNativePort(const char* name,
                                          Dart_NativeMessageHandler handler,
                                          bool handle_concurrently);
-// TODO(turnidge): Currently handle_concurrently is ignored.
 
 /**
  * Closes the native port with the given id.
@@ -16,7 +16,6 @@
 #include "vm/port.h"
 #include "vm/resolver.h"
 #include "vm/snapshot.h"
-#include "vm/thread.h"
 
 namespace dart {
 
@@ -44,12 +43,19 @@ static uint8_t* allocator(uint8_t* ptr, intptr_t old_size, intptr_t new_size) {
 }
 
 
-static uint8_t* SerializeObject(const Instance& obj) {
-  uint8_t* result = NULL;
-  SnapshotWriter writer(Snapshot::kMessage, &result, &allocator);
+static Message* SerializeObject(Dart_Port dest_port,
+                                Dart_Port reply_port,
+                                const Instance& obj,
+                                bool transfer_byte_arrays) {
+  uint8_t* data = NULL;
+  SnapshotWriter writer(Snapshot::kMessage, &data, &allocator);
+  writer.AllowTransfers(transfer_byte_arrays);
   writer.WriteObject(obj.raw());
   writer.FinalizeBuffer();
-  return result;
+  Message* message =
+      new Message(dest_port, reply_port, data, Message::kNormalPriority);
+  writer.AttachTransfers(message);
+  return message;
 }
 
 
@@ -113,13 +119,28 @@ RawObject* ReceivePortCreate(intptr_t port_id) {
 }
 
 
-static void RunIsolate(uword parameter) {
+// Shut the spawned isolate down once its message handler stops.
+static void ShutdownSpawnedIsolate(Isolate* isolate) {
+  Isolate::SetCurrent(isolate);
+  {
+    Zone zone(isolate);
+    HandleScope handle_scope(isolate);
+    const Error& error =
+        Error::Handle(isolate->object_store()->sticky_error());
+    if (!error.IsNull()) {
+      ProcessError(error);
+    }
+  }
+  Dart::ShutdownIsolate();
+}
+
+
+static bool RunIsolate(uword parameter) {
   IsolateStartData* data = reinterpret_cast<IsolateStartData*>(parameter);
   Isolate* isolate = data->isolate_;
   char* library_url = data->library_url_;
   char* class_name = data->class_name_;
   intptr_t port_id = data->port_id_;
-  delete data;
 
   Isolate::SetCurrent(isolate);
   // Intialize stack limit in case we are running isolate in a
@@ -186,12 +207,6 @@ static void RunIsolate(uword parameter) {
     ASSERT(result.IsNull());
     free(class_name);
     free(library_url);
-    result = isolate->StandardRunLoop();
-    if (result.IsError()) {
-      ProcessError(result);
-    }
-    ASSERT(result.IsNull());
-
   } else {
     Zone zone(isolate);
     HandleScope handle_scope(isolate);
@@ -202,7 +217,17 @@ static void RunIsolate(uword parameter) {
     exit(255);
   }
   isolate->set_long_jump_base(base);
-  Dart::ShutdownIsolate();
+  // The messages of the isolate are handled by its message handler.
+  Isolate::SetCurrent(NULL);
+  return true;
+}
+
+
+static void ShutdownIsolate(uword parameter) {
+  IsolateStartData* data = reinterpret_cast<IsolateStartData*>(parameter);
+  Isolate* isolate = data->isolate_;
+  delete data;
+  ShutdownSpawnedIsolate(isolate);
 }
 
 
@@ -279,6 +304,7 @@ DEFINE_NATIVE_ENTRY(IsolateNatives_start, 2) {
   LongJump jump;
   bool init_successful = true;
   Isolate* spawned_isolate = NULL;
+  IsolateStartData* start_data = NULL;
   void* callback_data = preserved_isolate->init_callback_data();
   char* error = NULL;
   Dart_IsolateCreateCallback callback = Isolate::CreateCallback();
@@ -292,15 +318,10 @@ DEFINE_NATIVE_ENTRY(IsolateNatives_start, 2) {
     // loaded, this check will throw an exception if they are not loaded.
     if (init_successful && CheckArguments(library_url, class_name)) {
       port_id = spawned_isolate->main_port();
-      uword data = reinterpret_cast<uword>(
-          new IsolateStartData(spawned_isolate,
-                               strdup(library_url),
-                               strdup(class_name),
-                               port_id));
-      int result = Thread::Start(RunIsolate, data);
-      if (result != 0) {
-        FATAL1("Failed to start isolate thread %d", result);
-      }
+      start_data = new IsolateStartData(spawned_isolate,
+                                        strdup(library_url),
+                                        strdup(class_name),
+                                        port_id);
     } else {
       // Error spawning the isolate, maybe due to initialization errors or
       // errors while loading the application into spawned isolate, shut
@@ -329,8 +350,16 @@ DEFINE_NATIVE_ENTRY(IsolateNatives_start, 2) {
                         class_name);
   }
 
-  // TODO(turnidge): Move this code up before we launch the new
-  // thread.  That way we won't have a thread hanging around that we
+  // Start the new isolate on a worker of the isolate thread pool, now that
+  // this thread is back in the spawning isolate.
+  spawned_isolate->message_handler()->Run(
+      Dart::message_handler_pool(),
+      RunIsolate,
+      ShutdownIsolate,
+      reinterpret_cast<uword>(start_data));
+
+  // TODO(turnidge): Move this code up before we start the new
+  // isolate.  That way we won't have an isolate hanging around that we
   // can't talk to.
   const Object& port = Object::Handle(DartLibraryCalls::NewSendPort(port_id));
   if (port.IsError()) {
@@ -358,16 +387,17 @@ DEFINE_NATIVE_ENTRY(ReceivePortImpl_closeInternal, 1) {
 }
 
 
-DEFINE_NATIVE_ENTRY(SendPortImpl_sendInternal_, 3) {
+DEFINE_NATIVE_ENTRY(SendPortImpl_sendInternal_, 4) {
   GET_NATIVE_ARGUMENT(Smi, send_id, arguments->At(0));
   GET_NATIVE_ARGUMENT(Smi, reply_id, arguments->At(1));
   // TODO(iposva): Allow for arbitrary messages to be sent.
   GET_NATIVE_ARGUMENT(Instance, obj, arguments->At(2));
-  uint8_t* data = SerializeObject(obj);
+  GET_NATIVE_ARGUMENT(Bool, transfer, arguments->At(3));
+  Message* message = SerializeObject(
+      send_id.Value(), reply_id.Value(), obj, transfer.value());
 
   // TODO(turnidge): Throw an exception when the return value is false?
-  PortMap::PostMessage(new Message(
-      send_id.Value(), reply_id.Value(), data, Message::kNormalPriority));
+  PortMap::PostMessage(message);
 }
 
 
@@ -479,7 +509,7 @@ static bool CreateIsolate(SpawnState* state, char** error) {
 }
 
 
-static void RunIsolate2(uword parameter) {
+static bool RunIsolate2(uword parameter) {
   SpawnState* state = reinterpret_cast<SpawnState*>(parameter);
   Isolate* isolate = state->isolate();
 
@@ -495,8 +525,6 @@ static void RunIsolate2(uword parameter) {
     Object& result = Object::Handle();
 
     const Function& func = Function::Handle(state->ResolveFunction());
-    delete state;
-    state = NULL;
     ASSERT(!func.IsNull());
 
     GrowableArray<const Object*> args(0);
@@ -505,14 +533,18 @@ static void RunIsolate2(uword parameter) {
     if (result.IsError()) {
       ProcessError(result);
     }
-
-    result = isolate->StandardRunLoop();
-    if (result.IsError()) {
-      ProcessError(result);
-    }
-    ASSERT(result.IsNull());
   }
-  Dart::ShutdownIsolate();
+  // The messages of the isolate are handled by its message handler.
+  Isolate::SetCurrent(NULL);
+  return true;
+}
+
+
+static void ShutdownIsolate2(uword parameter) {
+  SpawnState* state = reinterpret_cast<SpawnState*>(parameter);
+  Isolate* isolate = state->isolate();
+  delete state;
+  ShutdownSpawnedIsolate(isolate);
 }
 
 
@@ -550,16 +582,12 @@ DEFINE_NATIVE_ENTRY(isolate_spawnFunction, 1) {
     Exceptions::PropagateError(port);
   }
 
-  // Start the new isolate.
-  int result = Thread::Start(RunIsolate2, reinterpret_cast<uword>(state));
-  if (result != 0) {
-    const String& msg = String::Handle(String::NewFormatted(
-        "Failed to start thread for isolate '%s'.  Error code '%d'.",
-        state->isolate()->name(), result));
-    state->Cleanup();
-    delete state;
-    ThrowIsolateSpawnException(msg);
-  }
+  // Start the new isolate on a worker of the isolate thread pool.
+  state->isolate()->message_handler()->Run(
+      Dart::message_handler_pool(),
+      RunIsolate2,
+      ShutdownIsolate2,
+      reinterpret_cast<uword>(state));
 
   arguments->SetReturn(port);
 }
@@ -65,13 +65,17 @@ class _ReceivePortImpl implements ReceivePort {
 
 class _SendPortImpl implements SendPort {
   /*--- public interface ---*/
-  void send(var message, [SendPort replyTo = null]) {
-    this._sendNow(message, replyTo);
+  // With [transfer], the data of the byte arrays in the message is handed
+  // over to the receiver instead of being copied into the message and out
+  // of it again.  The receiver gets external byte arrays, the external byte
+  // arrays of the sender are left empty.
+  void send(var message, [SendPort replyTo = null, bool transfer = false]) {
+    this._sendNow(message, replyTo, transfer);
   }
 
-  void _sendNow(var message, SendPort replyTo) {
+  void _sendNow(var message, SendPort replyTo, [bool transfer = false]) {
     int replyId = (replyTo === null) ? 0 : replyTo._id;
-    _sendInternal(_id, replyId, message);
+    _sendInternal(_id, replyId, message, transfer);
   }
 
   Future call(var message) {
@@ -108,7 +112,7 @@ class _SendPortImpl implements SendPort {
 
   // Forward the implementation of sending messages to the VM. Only port ids
   // are being handed to the VM.
-  static _sendInternal(int sendId, int replyId, var message)
+  static _sendInternal(int sendId, int replyId, var message, bool transfer)
       native "SendPortImpl_sendInternal_";
 
   final int _id;
@@ -44,12 +44,15 @@ DEFINE_NATIVE_ENTRY(Mirrors_send, 3) {
   // Construct the message.
   uint8_t* data = NULL;
   SnapshotWriter writer(Snapshot::kMessage, &data, &allocator);
+  writer.AllowTransfers(false);
   writer.WriteObject(message.raw());
   writer.FinalizeBuffer();
+  Message* oob_message = new Message(
+      send_port_id, reply_port_id, data, Message::kOOBPriority);
+  writer.AttachTransfers(oob_message);
 
   // Post the message.
-  bool retval = PortMap::PostMessage(new Message(
-      send_port_id, reply_port_id, data, Message::kOOBPriority));
+  bool retval = PortMap::PostMessage(oob_message);
   const Bool& retval_obj = Bool::Handle(Bool::Get(retval));
   arguments->SetReturn(retval_obj);
 }
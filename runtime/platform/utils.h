@@ -79,6 +79,21 @@ class Utils {
   static uint32_t RoundUpToPowerOfTwo(uint32_t x);
   static int CountOneBits(uint32_t x);
 
+  // Returns the index of the lowest set bit. The value must not be zero.
+  static inline int CountTrailingZeros(uword x) {
+    ASSERT(x != 0);
+#if defined(__GNUC__)
+    return __builtin_ctzl(x);
+#else
+    int result = 0;
+    while ((x & 1) == 0) {
+      x >>= 1;
+      result++;
+    }
+    return result;
+#endif
+  }
+
   // Computes a hash value for the given string.
   static uint32_t StringHash(const char* data, int length);
 
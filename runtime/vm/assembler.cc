@@ -55,7 +55,8 @@ AssemblerBuffer::EnsureCapacity::~EnsureCapacity() {
 
 
 AssemblerBuffer::AssemblerBuffer()
-    : pointer_offsets_(new ZoneGrowableArray<int>(16)) {
+    : pointer_offsets_(new ZoneGrowableArray<int>(16)),
+      immediate_offsets_(new ZoneGrowableArray<int>(16)) {
   static const int kInitialBufferCapacity = 4 * KB;
   contents_ = NewContents(kInitialBufferCapacity);
   cursor_ = contents_;
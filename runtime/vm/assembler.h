@@ -97,9 +97,21 @@ class AssemblerBuffer : public ValueObject {
     return *pointer_offsets_;
   }
 
+  // Positions of the 64-bit immediates which may be absolute addresses, see
+  // Code::GetImmediateOffsetAt. The low bit of each entry is set if the
+  // immediate is the target of a call or jump.
+  const ZoneGrowableArray<int>& immediate_offsets() const {
+    return *immediate_offsets_;
+  }
+
   // Emit an object pointer directly in the code.
   void EmitObject(const Object& object);
 
+  // Record that the next word emitted is a 64-bit immediate.
+  void RecordImmediate(bool is_call_target) {
+    immediate_offsets_->Add((Size() << 1) | (is_call_target ? 1 : 0));
+  }
+
   // Emit a fixup at the current location.
   void EmitFixup(AssemblerFixup* fixup) {
     fixup->set_previous(fixup_);
@@ -166,6 +178,7 @@ class AssemblerBuffer : public ValueObject {
   uword limit_;
   AssemblerFixup* fixup_;
   ZoneGrowableArray<int>* pointer_offsets_;
+  ZoneGrowableArray<int>* immediate_offsets_;
 #if defined(DEBUG)
   bool fixups_processed_;
 #endif
@@ -94,6 +94,10 @@ class Assembler {
     UNIMPLEMENTED();
     return *pointer_offsets_;
   }
+  const ZoneGrowableArray<int>& GetImmediateOffsets() const {
+    UNIMPLEMENTED();
+    return *pointer_offsets_;
+  }
   void FinalizeInstructions(const MemoryRegion& region) {
     UNIMPLEMENTED();
   }
@@ -8,6 +8,7 @@
 #include "vm/assembler.h"
 #include "vm/heap.h"
 #include "vm/memory_region.h"
+#include "vm/pages.h"
 #include "vm/runtime_entry.h"
 #include "vm/stub_code.h"
 
@@ -1343,8 +1344,39 @@ void Assembler::CompareObject(Register reg, const Object& object) {
 void Assembler::StoreIntoObject(Register object,
                                 const FieldAddress& dest,
                                 Register value) {
-  // TODO(iposva): Add write barrier.
+  // While old space is marked incrementally, the overwritten value of a field
+  // of an old object has to be shaded to preserve the marking snapshot.
+  Label no_marking;
+  cmpl(Address::Absolute(PageSpace::num_marking_spaces_address()), Immediate(0));
+  j(EQUAL, &no_marking);
+  testl(object, Immediate(kNewObjectAlignmentOffset));
+  j(NOT_ZERO, &no_marking);
+  // The marking barrier stub expects the overwritten value in EDX.
+  pushl(EDX);
+  movl(EDX, dest);
+  call(&StubCode::MarkingBarrierLabel());
+  popl(EDX);
+  Bind(&no_marking);
   movl(dest, value);
+  // Only stores of new objects into old objects need to be remembered.
+  Label done;
+  testl(value, Immediate(kSmiTagMask));
+  j(ZERO, &done, kNearJump);
+  testl(value, Immediate(kNewObjectAlignmentOffset));
+  j(ZERO, &done, kNearJump);
+  testl(object, Immediate(kNewObjectAlignmentOffset));
+  j(NOT_ZERO, &done, kNearJump);
+  // The store buffer update stub expects the object in EDX and the address of
+  // the updated slot in ECX.
+  pushl(EDX);
+  pushl(ECX);
+  pushl(object);
+  leal(ECX, dest);
+  popl(EDX);
+  call(&StubCode::UpdateStoreBufferLabel());
+  popl(ECX);
+  popl(EDX);
+  Bind(&done);
 }
 
 
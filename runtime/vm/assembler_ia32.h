@@ -549,6 +549,9 @@ class Assembler : public ValueObject {
   const ZoneGrowableArray<int>& GetPointerOffsets() const {
     return buffer_.pointer_offsets();
   }
+  const ZoneGrowableArray<int>& GetImmediateOffsets() const {
+    return buffer_.immediate_offsets();
+  }
 
   void FinalizeInstructions(const MemoryRegion& region) {
     buffer_.FinalizeInstructions(region);
@@ -22,7 +22,6 @@ void AssemblerMacros::TryAllocate(Assembler* assembler,
                                   Label* failure,
                                   Register instance_reg) {
 #if defined(DEBUG)
-  __ Untested("AssemblerMacros::TryAllocate");
   Label ok;
   __ LoadObject(instance_reg, cls);
   __ cmpq(instance_reg, class_reg);
@@ -41,7 +40,8 @@ void AssemblerMacros::TryAllocate(Assembler* assembler,
     // instance_reg: potential next object start.
     __ movq(TMP, Immediate(heap->EndAddress()));
     __ cmpq(instance_reg, Address(TMP, 0));
-    __ j(ABOVE_EQUAL, failure, Assembler::kNearJump);
+    // Not a near jump: the write barrier below takes more than 127 bytes.
+    __ j(ABOVE_EQUAL, failure);
     // Successfully allocated the object, now update top to point to
     // next object start and store the class in the class field of object.
     __ movq(TMP, Immediate(heap->TopAddress()));
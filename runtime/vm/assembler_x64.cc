@@ -8,6 +8,7 @@
 #include "vm/assembler.h"
 #include "vm/heap.h"
 #include "vm/memory_region.h"
+#include "vm/pages.h"
 #include "vm/runtime_entry.h"
 #include "vm/stub_code.h"
 
@@ -53,6 +54,7 @@ void Assembler::call(const ExternalLabel* label) {
   // Encode movq(TMP, Immediate(label->address())), but always as imm64.
   EmitRegisterREX(TMP, REX_W);
   EmitUint8(0xB8 | (TMP & 7));
+  buffer_.RecordImmediate(true);
   EmitInt64(label->address());
 
   // Encode call(TMP).
@@ -387,6 +389,30 @@ void Assembler::movd(Register dst, XmmRegister src) {
 }
 
 
+void Assembler::movq(XmmRegister dst, Register src) {
+  ASSERT(dst <= XMM7);
+  AssemblerBuffer::EnsureCapacity ensured(&buffer_);
+  Operand operand(src);
+  EmitUint8(0x66);
+  EmitOperandREX(0, operand, REX_W);
+  EmitUint8(0x0F);
+  EmitUint8(0x6E);
+  EmitOperand(dst & 7, operand);
+}
+
+
+void Assembler::movq(Register dst, XmmRegister src) {
+  ASSERT(src <= XMM7);
+  AssemblerBuffer::EnsureCapacity ensured(&buffer_);
+  Operand operand(dst);
+  EmitUint8(0x66);
+  EmitOperandREX(0, operand, REX_W);
+  EmitUint8(0x0F);
+  EmitUint8(0x7E);
+  EmitOperand(src & 7, operand);
+}
+
+
 void Assembler::addss(XmmRegister dst, XmmRegister src) {
   // TODO(srdjan): implement and test XMM8 - XMM15.
   ASSERT(src <= XMM7);
@@ -519,6 +545,18 @@ void Assembler::divsd(XmmRegister dst, XmmRegister src) {
 }
 
 
+void Assembler::cvtsi2sd(XmmRegister dst, Register src) {
+  ASSERT(dst <= XMM7);
+  AssemblerBuffer::EnsureCapacity ensured(&buffer_);
+  Operand operand(src);
+  EmitUint8(0xF2);
+  EmitOperandREX(0, operand, REX_W);
+  EmitUint8(0x0F);
+  EmitUint8(0x2A);
+  EmitOperand(dst & 7, operand);
+}
+
+
 void Assembler::xchgl(Register dst, Register src) {
   AssemblerBuffer::EnsureCapacity ensured(&buffer_);
   Operand operand(src);
@@ -1208,6 +1246,7 @@ void Assembler::jmp(const ExternalLabel* label) {
   // Encode movq(TMP, Immediate(label->address())), but always as imm64.
   EmitRegisterREX(TMP, REX_W);
   EmitUint8(0xB8 | (TMP & 7));
+  buffer_.RecordImmediate(true);
   EmitInt64(label->address());
 
   // Encode jmp(TMP).
@@ -1276,6 +1315,12 @@ void Assembler::LoadObject(Register dst, const Object& object) {
 }
 
 
+void Assembler::LoadDoubleConstant(XmmRegister dst, double value) {
+  movq(TMP, Immediate(bit_cast<int64_t, double>(value)));
+  movq(dst, TMP);
+}
+
+
 void Assembler::PushObject(const Object& object) {
   if (object.IsSmi()) {
     pushq(Immediate(reinterpret_cast<int64_t>(object.raw())));
@@ -1300,8 +1345,40 @@ void Assembler::CompareObject(Register reg, const Object& object) {
 void Assembler::StoreIntoObject(Register object,
                                 const FieldAddress& dest,
                                 Register value) {
-  // TODO(iposva): Add write barrier.
+  // While old space is marked incrementally, the overwritten value of a field
+  // of an old object has to be shaded to preserve the marking snapshot.
+  Label no_marking;
+  movq(TMP, Immediate(PageSpace::num_marking_spaces_address()));
+  cmpq(Address(TMP, 0), Immediate(0));
+  j(EQUAL, &no_marking);
+  testq(object, Immediate(kNewObjectAlignmentOffset));
+  j(NOT_ZERO, &no_marking);
+  // The marking barrier stub expects the overwritten value in RDX.
+  pushq(RDX);
+  movq(RDX, dest);
+  call(&StubCode::MarkingBarrierLabel());
+  popq(RDX);
+  Bind(&no_marking);
   movq(dest, value);
+  // Only stores of new objects into old objects need to be remembered.
+  Label done;
+  testq(value, Immediate(kSmiTagMask));
+  j(ZERO, &done, kNearJump);
+  testq(value, Immediate(kNewObjectAlignmentOffset));
+  j(ZERO, &done, kNearJump);
+  testq(object, Immediate(kNewObjectAlignmentOffset));
+  j(NOT_ZERO, &done, kNearJump);
+  // The store buffer update stub expects the object in RDX and the address of
+  // the updated slot in RCX.
+  pushq(RDX);
+  pushq(RCX);
+  pushq(object);
+  leaq(RCX, dest);
+  popq(RDX);
+  call(&StubCode::UpdateStoreBufferLabel());
+  popq(RCX);
+  popq(RDX);
+  Bind(&done);
 }
 
 
@@ -1417,6 +1494,7 @@ void Assembler::EmitImmediate(const Immediate& imm) {
   if (imm.is_int32()) {
     EmitInt32(static_cast<int32_t>(imm.value()));
   } else {
+    buffer_.RecordImmediate(false);
     EmitInt64(imm.value());
   }
 }
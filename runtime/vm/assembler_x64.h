@@ -356,6 +356,10 @@ class Assembler : public ValueObject {
   void movd(XmmRegister dst, Register src);
   void movd(Register dst, XmmRegister src);
 
+  // Move the 64 bits of a register into or out of an XMM register.
+  void movq(XmmRegister dst, Register src);
+  void movq(Register dst, XmmRegister src);
+
   void addss(XmmRegister dst, XmmRegister src);
   void subss(XmmRegister dst, XmmRegister src);
   void mulss(XmmRegister dst, XmmRegister src);
@@ -370,6 +374,8 @@ class Assembler : public ValueObject {
   void mulsd(XmmRegister dst, XmmRegister src);
   void divsd(XmmRegister dst, XmmRegister src);
 
+  void cvtsi2sd(XmmRegister dst, Register src);
+
   void xchgl(Register dst, Register src);
   void xchgq(Register dst, Register src);
 
@@ -534,6 +540,9 @@ class Assembler : public ValueObject {
   const ZoneGrowableArray<int>& GetPointerOffsets() const {
     return buffer_.pointer_offsets();
   }
+  const ZoneGrowableArray<int>& GetImmediateOffsets() const {
+    return buffer_.immediate_offsets();
+  }
 
   void FinalizeInstructions(const MemoryRegion& region) {
     buffer_.FinalizeInstructions(region);
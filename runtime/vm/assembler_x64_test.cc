@@ -1107,6 +1107,33 @@ ASSEMBLER_TEST_RUN(DoubleFPOperations, entry) {
 }
 
 
+ASSEMBLER_TEST_GENERATE(DoubleFPRegisterMoves, assembler) {
+  __ pushq(R12);  // Callee saved.
+  __ movq(R10, Immediate(bit_cast<int64_t, double>(2.5)));
+  __ movq(XMM1, R10);
+  __ movq(R12, XMM1);
+  __ movq(XMM2, R12);
+  __ movq(RAX, Immediate(-3));
+  __ cvtsi2sd(XMM3, RAX);
+  __ movq(R10, Immediate(1LL << 40));
+  __ cvtsi2sd(XMM4, R10);
+  __ mulsd(XMM2, XMM3);  // -7.5
+  __ addsd(XMM2, XMM4);  // 2^40 - 7.5
+  __ LoadDoubleConstant(XMM5, 0.5);
+  __ addsd(XMM2, XMM5);  // 2^40 - 7
+  __ movsd(XMM0, XMM2);
+  __ popq(R12);
+  __ ret();
+}
+
+
+ASSEMBLER_TEST_RUN(DoubleFPRegisterMoves, entry) {
+  typedef double (*DoubleFPRegisterMovesCode)();
+  double res = reinterpret_cast<DoubleFPRegisterMovesCode>(entry)();
+  EXPECT_EQ((1LL << 40) - 7, static_cast<int64_t>(res));
+}
+
+
 ASSEMBLER_TEST_GENERATE(TestObjectCompare, assembler) {
   ObjectStore* object_store = Isolate::Current()->object_store();
   const Object& obj = Object::ZoneHandle(object_store->smi_class());
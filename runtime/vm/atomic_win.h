@@ -0,0 +1,47 @@
+// Copyright (c) 2012, the Dart project authors.  Please see the AUTHORS file
+// for details. All rights reserved. Use of this source code is governed by a
+// BSD-style license that can be found in the LICENSE file.
+
+#ifndef VM_ATOMIC_WIN_H_
+#define VM_ATOMIC_WIN_H_
+
+#if !defined(VM_ATOMIC_H_)
+#error Do not include atomic_win.h directly. Use atomic.h instead.
+#endif
+
+#if !defined(TARGET_OS_WINDOWS)
+#error This file should only be included on Windows builds.
+#endif
+
+namespace dart {
+
+
+inline intptr_t AtomicOperations::FetchAndIncrementBy(intptr_t* p,
+                                                      intptr_t value) {
+#if defined(TARGET_ARCH_X64)
+  return static_cast<intptr_t>(
+      InterlockedExchangeAdd64(reinterpret_cast<LONGLONG*>(p),
+                               static_cast<LONGLONG>(value)));
+#elif defined(TARGET_ARCH_IA32)
+  return static_cast<intptr_t>(
+      InterlockedExchangeAdd(reinterpret_cast<LONG*>(p),
+                             static_cast<LONG>(value)));
+#else
+  UNIMPLEMENTED();
+  return 0;
+#endif
+}
+
+
+inline uword AtomicOperations::CompareAndSwapWord(uword* ptr,
+                                                  uword old_value,
+                                                  uword new_value) {
+  return reinterpret_cast<uword>(InterlockedCompareExchangePointer(
+      reinterpret_cast<PVOID*>(ptr),
+      reinterpret_cast<PVOID>(new_value),
+      reinterpret_cast<PVOID>(old_value)));
+}
+
+}  // namespace dart
+
+#endif  // VM_ATOMIC_WIN_H_
@@ -0,0 +1,348 @@
+// Copyright (c) 2012, the Dart project authors.  Please see the AUTHORS file
+// for details. All rights reserved. Use of this source code is governed by a
+// BSD-style license that can be found in the LICENSE file.
+
+#include "platform/assert.h"
+#include "vm/flags.h"
+#include "vm/globals.h"
+#include "vm/heap.h"
+#include "vm/message.h"
+#include "vm/object.h"
+#include "vm/port.h"
+#include "vm/thread.h"
+#include "vm/timer.h"
+#include "vm/unit_test.h"
+
+namespace dart {
+
+DECLARE_FLAG(int, compaction_threshold);
+DECLARE_FLAG(bool, lazy_sweep);
+DECLARE_FLAG(int, marker_tasks);
+DECLARE_FLAG(int, tenuring_age);
+
+// Measure the time of a scavenge while the size of old space grows. With a
+// remembered set the scavenge time only depends on the number of remembered
+// old objects and the surviving new objects, not on the size of old space.
+BENCHMARK(ScavengeOldSpaceGrowth) {
+  Heap* heap = Isolate::Current()->heap();
+  const intptr_t kArraySize = 64 * KB;
+  const intptr_t kArraysPerStep = 256;  // 16MB of old arrays per step.
+  const intptr_t kNumSteps = 4;
+  const intptr_t kNumScavenges = 10;
+  const intptr_t kNumSurvivors = 1000;
+
+  const GrowableObjectArray& old_arrays =
+      GrowableObjectArray::Handle(GrowableObjectArray::New(Heap::kOld));
+  Array& old_array = Array::Handle();
+  Array& survivors = Array::Handle();
+  String& str = String::Handle();
+  int64_t elapsed = 0;
+  for (intptr_t step = 0; step <= kNumSteps; step++) {
+    if (step > 0) {
+      for (intptr_t i = 0; i < kArraysPerStep; i++) {
+        old_array = Array::New(kArraySize / kWordSize, Heap::kOld);
+        old_arrays.Add(old_array);
+      }
+    }
+    Timer timer(true, "ScavengeOldSpaceGrowth");
+    for (intptr_t i = 0; i < kNumScavenges; i++) {
+      // A fixed amount of new objects survives each scavenge, they are only
+      // reachable through an old object.
+      survivors = Array::New(kNumSurvivors);
+      for (intptr_t j = 0; j < kNumSurvivors; j++) {
+        str = String::New("survivor");
+        survivors.SetAt(j, str);
+      }
+      if (!old_array.IsNull()) {
+        old_array.SetAt(0, survivors);
+        survivors = Array::null();
+      }
+      timer.Start();
+      heap->CollectGarbage(Heap::kNew);
+      timer.Stop();
+    }
+    elapsed = timer.TotalElapsedTime() / kNumScavenges;
+    OS::Print("ScavengeOldSpaceGrowth: %dMB old arrays, %lldus per scavenge\n",
+              (step * kArraysPerStep * kArraySize) / MB, elapsed);
+  }
+  benchmark->set_score(elapsed);
+}
+
+
+// Measure the time of a scavenge after a single store of a new object into a
+// large old array. Card marking limits the scavenge to the dirty card instead
+// of the whole array.
+BENCHMARK(ScavengeLargeArrayStore) {
+  Heap* heap = Isolate::Current()->heap();
+  const intptr_t kLength = 1 * MB;
+  const intptr_t kNumScavenges = 100;
+  const Array& large_array = Array::Handle(Array::New(kLength, Heap::kOld));
+  String& str = String::Handle();
+  Timer timer(true, "ScavengeLargeArrayStore");
+  for (intptr_t i = 0; i < kNumScavenges; i++) {
+    str = String::New("new string");
+    large_array.SetAt((i * 7919) % kLength, str);
+    timer.Start();
+    heap->CollectGarbage(Heap::kNew);
+    timer.Stop();
+  }
+  benchmark->set_score(timer.TotalElapsedTime() / kNumScavenges);
+}
+
+
+// Measure the time of an old space collection of a wide object graph with an
+// increasing number of marking tasks.  The tasks only run in parallel on a
+// machine with several cores: on a single core the times stay flat and only
+// show the overhead of the tasks.
+BENCHMARK(MarkSweepParallelScaling) {
+  Heap* heap = Isolate::Current()->heap();
+  const intptr_t kNumArrays = 256 * KB;
+  const intptr_t kNumCollections = 5;
+  const intptr_t kMaxMarkerTasks = 8;
+
+  const Array& root = Array::Handle(Array::New(kNumArrays, Heap::kOld));
+  Array& array = Array::Handle();
+  String& str = String::Handle();
+  for (intptr_t i = 0; i < kNumArrays; i++) {
+    array = Array::New(2, Heap::kOld);
+    str = String::New("first", Heap::kOld);
+    array.SetAt(0, str);
+    str = String::New("second", Heap::kOld);
+    array.SetAt(1, str);
+    root.SetAt(i, array);
+  }
+  const intptr_t saved_marker_tasks = FLAG_marker_tasks;
+  int64_t elapsed = 0;
+  for (intptr_t tasks = 1; tasks <= kMaxMarkerTasks; tasks *= 2) {
+    FLAG_marker_tasks = tasks;
+    Timer timer(true, "MarkSweepParallelScaling");
+    for (intptr_t i = 0; i < kNumCollections; i++) {
+      timer.Start();
+      heap->CollectGarbage(Heap::kOld);
+      timer.Stop();
+    }
+    elapsed = timer.TotalElapsedTime() / kNumCollections;
+    OS::Print("MarkSweepParallelScaling: %d marker tasks, %lldus per GC\n",
+              tasks, elapsed);
+  }
+  FLAG_marker_tasks = saved_marker_tasks;
+  benchmark->set_score(elapsed);
+}
+
+
+// Measure the MarkSweep pause of a heap with mostly garbage, with the pages
+// swept during the pause and lazily during allocation.
+BENCHMARK(MarkSweepLazySweepPause) {
+  Isolate* isolate = Isolate::Current();
+  Heap* heap = isolate->heap();
+  const intptr_t kNumArrays = 256 * KB;
+  const intptr_t kNumCollections = 5;
+
+  const Array& root = Array::Handle(Array::New(kNumArrays / 8, Heap::kOld));
+  const bool saved_lazy_sweep = FLAG_lazy_sweep;
+  int64_t elapsed = 0;
+  for (intptr_t lazy = 0; lazy < 2; lazy++) {
+    FLAG_lazy_sweep = (lazy != 0);
+    Timer timer(true, "MarkSweepLazySweepPause");
+    for (intptr_t i = 0; i < kNumCollections; i++) {
+      {
+        // Only every eighth array survives the collection.
+        HandleScope scope(isolate);
+        Array& array = Array::Handle();
+        for (intptr_t j = 0; j < kNumArrays; j++) {
+          array = Array::New(4, Heap::kOld);
+          if ((j % 8) == 0) {
+            root.SetAt(j / 8, array);
+          }
+        }
+      }
+      timer.Start();
+      heap->CollectGarbage(Heap::kOld);
+      timer.Stop();
+    }
+    elapsed = timer.TotalElapsedTime() / kNumCollections;
+    OS::Print("MarkSweepLazySweepPause: lazy_sweep %s, %lldus per GC\n",
+              FLAG_lazy_sweep ? "true" : "false", elapsed);
+  }
+  FLAG_lazy_sweep = saved_lazy_sweep;
+  benchmark->set_score(elapsed);
+}
+
+
+// Measure the time of scavenges which promote all surviving objects into a
+// fragmented old space. The old space is swept eagerly, so that the scavenges
+// only allocate from the freelist.
+BENCHMARK(ScavengePromotion) {
+  Isolate* isolate = Isolate::Current();
+  Heap* heap = isolate->heap();
+  const intptr_t kNumArrays = 256 * KB;
+  const intptr_t kNumScavenges = 20;
+  const intptr_t kNumSurvivors = 10000;
+
+  const intptr_t saved_compaction_threshold = FLAG_compaction_threshold;
+  const bool saved_lazy_sweep = FLAG_lazy_sweep;
+  const intptr_t saved_tenuring_age = FLAG_tenuring_age;
+  FLAG_compaction_threshold = 100;
+  FLAG_lazy_sweep = false;
+  FLAG_tenuring_age = 0;
+
+  // Only every 64th array survives, the free memory is left between them.
+  const Array& root = Array::Handle(Array::New(kNumArrays / 64, Heap::kOld));
+  {
+    HandleScope scope(isolate);
+    Array& array = Array::Handle();
+    for (intptr_t i = 0; i < kNumArrays; i++) {
+      array = Array::New(2, Heap::kOld);
+      if ((i % 64) == 0) {
+        root.SetAt(i / 64, array);
+      }
+    }
+  }
+  heap->CollectGarbage(Heap::kOld);
+
+  Array& survivors = Array::Handle();
+  String& str = String::Handle();
+  Timer timer(true, "ScavengePromotion");
+  for (intptr_t i = 0; i < kNumScavenges; i++) {
+    survivors = Array::New(kNumSurvivors);
+    for (intptr_t j = 0; j < kNumSurvivors; j++) {
+      str = String::New("survivor");
+      survivors.SetAt(j, str);
+    }
+    timer.Start();
+    heap->CollectGarbage(Heap::kNew);
+    timer.Stop();
+  }
+  FLAG_compaction_threshold = saved_compaction_threshold;
+  FLAG_lazy_sweep = saved_lazy_sweep;
+  FLAG_tenuring_age = saved_tenuring_age;
+  benchmark->set_score(timer.TotalElapsedTime() / kNumScavenges);
+}
+
+
+// A handler whose messages are received by the benchmark below.
+class FanInMessageHandler : public MessageHandler {
+ public:
+  FanInMessageHandler() { }
+};
+
+
+static const intptr_t kFanInMessagesPerSender = 100000;
+static Dart_Port fan_in_port = 0;
+static Monitor* fan_in_sync = NULL;
+static intptr_t fan_in_senders_done = 0;
+
+
+static void FanInSender(uword unused) {
+  for (intptr_t i = 0; i < kFanInMessagesPerSender; i++) {
+    PortMap::PostMessage(
+        new Message(fan_in_port, 0, NULL, Message::kNormalPriority));
+  }
+  MonitorLocker ml(fan_in_sync);
+  fan_in_senders_done++;
+  ml.Notify();
+}
+
+
+// Measure the time it takes an increasing number of threads to send a
+// fixed number of messages each to a single port, received by one thread.
+BENCHMARK(MessageFanIn) {
+  const intptr_t kMaxSenders = 8;
+  FanInMessageHandler handler;
+  fan_in_port = PortMap::CreatePort(&handler);
+  fan_in_sync = new Monitor();
+  int64_t elapsed = 0;
+  for (intptr_t senders = 1; senders <= kMaxSenders; senders *= 2) {
+    fan_in_senders_done = 0;
+    Timer timer(true, "MessageFanIn");
+    timer.Start();
+    for (intptr_t i = 0; i < senders; i++) {
+      int result = Thread::Start(FanInSender, 0);
+      ASSERT(result == 0);
+    }
+    for (intptr_t received = 0;
+         received < senders * kFanInMessagesPerSender; ) {
+      Message* message = handler.queue()->Dequeue(0);
+      if (message != NULL) {
+        delete message;
+        received++;
+      }
+    }
+    timer.Stop();
+    {
+      // Wait for the senders to be done with the port.
+      MonitorLocker ml(fan_in_sync);
+      while (fan_in_senders_done < senders) {
+        ml.Wait();
+      }
+    }
+    elapsed = timer.TotalElapsedTime();
+    OS::Print("MessageFanIn: %d senders, %lldus for %d messages\n",
+              senders, elapsed, senders * kFanInMessagesPerSender);
+  }
+  PortMap::ClosePort(fan_in_port);
+  delete fan_in_sync;
+  fan_in_sync = NULL;
+  benchmark->set_score(elapsed);
+}
+
+
+static void PostSmallMessages(Dart_Port port_id, intptr_t count) {
+  Dart_CObject message;
+  message.type = Dart_CObject::kInt32;
+  message.value.as_int32 = 1;
+  for (intptr_t i = 0; i < count; i++) {
+    Dart_PostCObject(port_id, &message);
+  }
+}
+
+
+// Measure the time it takes to deliver small messages to an isolate, one
+// message per call of Dart_HandleMessage and in a single batch.
+BENCHMARK(MessageBatchedDelivery) {
+  const char* kScriptChars =
+      "#import('dart:isolate');\n"
+      "var received = 0;\n"
+      "void receiveMessages() {\n"
+      "  port.receive((message, replyTo) {\n"
+      "    received += message;\n"
+      "  });\n"
+      "}\n";
+  const intptr_t kNumMessages = 10000;
+  const intptr_t kNumRounds = 10;
+  Dart_Handle lib = TestCase::LoadTestScript(kScriptChars, NULL);
+  Dart_Handle result = Dart_InvokeStatic(lib,
+                                         Dart_NewString(""),
+                                         Dart_NewString("receiveMessages"),
+                                         0,
+                                         NULL);
+  ASSERT(!Dart_IsError(result));
+  Dart_Port port_id = Dart_GetMainPortId();
+
+  // Alternate the two ways of delivery, so that both see the same heap.
+  Timer single_timer(true, "MessageBatchedDelivery");
+  Timer batch_timer(true, "MessageBatchedDelivery");
+  for (intptr_t round = 0; round < kNumRounds; round++) {
+    PostSmallMessages(port_id, kNumMessages);
+    single_timer.Start();
+    for (intptr_t i = 0; i < kNumMessages; i++) {
+      result = Dart_HandleMessage();
+      ASSERT(!Dart_IsError(result));
+    }
+    single_timer.Stop();
+
+    PostSmallMessages(port_id, kNumMessages);
+    batch_timer.Start();
+    result = Dart_HandleMessages(kNumMessages, 0);
+    ASSERT(!Dart_IsError(result));
+    batch_timer.Stop();
+  }
+  const int64_t single_elapsed = single_timer.TotalElapsedTime();
+  const int64_t batch_elapsed = batch_timer.TotalElapsedTime();
+  OS::Print("MessageBatchedDelivery: %lldus single, %lldus batched, "
+            "for %d messages\n",
+            single_elapsed, batch_elapsed, kNumRounds * kNumMessages);
+  benchmark->set_score(batch_elapsed);
+}
+
+}  // namespace dart
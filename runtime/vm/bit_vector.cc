@@ -0,0 +1,47 @@
+// Copyright (c) 2012, the Dart project authors.  Please see the AUTHORS file
+// for details. All rights reserved. Use of this source code is governed by a
+// BSD-style license that can be found in the LICENSE file.
+
+#include "vm/bit_vector.h"
+
+namespace dart {
+
+void BitVector::Clear() {
+  for (intptr_t i = 0; i < data_length_; i++) {
+    data_[i] = 0;
+  }
+}
+
+
+bool BitVector::AddAll(const BitVector* from) {
+  ASSERT(data_length_ == from->data_length_);
+  bool changed = false;
+  for (intptr_t i = 0; i < data_length_; i++) {
+    const uword before = data_[i];
+    const uword after = data_[i] | from->data_[i];
+    if (before != after) {
+      changed = true;
+      data_[i] = after;
+    }
+  }
+  return changed;
+}
+
+
+void BitVector::RemoveAll(const BitVector* kill) {
+  ASSERT(data_length_ == kill->data_length_);
+  for (intptr_t i = 0; i < data_length_; i++) {
+    data_[i] &= ~kill->data_[i];
+  }
+}
+
+
+bool BitVector::Equals(const BitVector& other) const {
+  if (length_ != other.length_) return false;
+  for (intptr_t i = 0; i < data_length_; i++) {
+    if (data_[i] != other.data_[i]) return false;
+  }
+  return true;
+}
+
+}  // namespace dart
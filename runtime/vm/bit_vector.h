@@ -0,0 +1,70 @@
+// Copyright (c) 2012, the Dart project authors.  Please see the AUTHORS file
+// for details. All rights reserved. Use of this source code is governed by a
+// BSD-style license that can be found in the LICENSE file.
+
+#ifndef VM_BIT_VECTOR_H_
+#define VM_BIT_VECTOR_H_
+
+#include "vm/allocation.h"
+#include "vm/isolate.h"
+#include "vm/zone.h"
+
+namespace dart {
+
+// A set of small non-negative integers of a fixed maximum size, e.g., the
+// sets of live values used by the register allocator.
+class BitVector: public ZoneAllocated {
+ public:
+  explicit BitVector(intptr_t length)
+      : length_(length),
+        data_length_(SizeFor(length)),
+        data_(reinterpret_cast<uword*>(
+            Isolate::Current()->current_zone()->Allocate(
+                data_length_ * kWordSize))) {
+    Clear();
+  }
+
+  intptr_t length() const { return length_; }
+
+  void Add(intptr_t i) {
+    ASSERT((i >= 0) && (i < length_));
+    data_[i / kBitsPerWord] |= (static_cast<uword>(1) << (i % kBitsPerWord));
+  }
+
+  void Remove(intptr_t i) {
+    ASSERT((i >= 0) && (i < length_));
+    data_[i / kBitsPerWord] &= ~(static_cast<uword>(1) << (i % kBitsPerWord));
+  }
+
+  bool Contains(intptr_t i) const {
+    ASSERT((i >= 0) && (i < length_));
+    uword block = data_[i / kBitsPerWord];
+    return (block & (static_cast<uword>(1) << (i % kBitsPerWord))) != 0;
+  }
+
+  void Clear();
+
+  // Add all elements of 'from' to this set.  Returns true if this set
+  // changed.
+  bool AddAll(const BitVector* from);
+
+  // Remove all elements of 'kill' from this set.
+  void RemoveAll(const BitVector* kill);
+
+  bool Equals(const BitVector& other) const;
+
+ private:
+  static intptr_t SizeFor(intptr_t length) {
+    return 1 + ((length - 1) / kBitsPerWord);
+  }
+
+  const intptr_t length_;
+  const intptr_t data_length_;
+  uword* data_;
+
+  DISALLOW_COPY_AND_ASSIGN(BitVector);
+};
+
+}  // namespace dart
+
+#endif  // VM_BIT_VECTOR_H_
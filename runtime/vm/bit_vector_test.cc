@@ -0,0 +1,47 @@
+// Copyright (c) 2012, the Dart project authors.  Please see the AUTHORS file
+// for details. All rights reserved. Use of this source code is governed by a
+// BSD-style license that can be found in the LICENSE file.
+
+#include "platform/assert.h"
+#include "vm/bit_vector.h"
+#include "vm/unit_test.h"
+
+namespace dart {
+
+TEST_CASE(BitVector) {
+  BitVector* set = new BitVector(130);
+  EXPECT_EQ(130, set->length());
+  for (intptr_t i = 0; i < 130; i++) {
+    EXPECT(!set->Contains(i));
+  }
+  set->Add(0);
+  set->Add(64);
+  set->Add(129);
+  EXPECT(set->Contains(0));
+  EXPECT(set->Contains(64));
+  EXPECT(set->Contains(129));
+  EXPECT(!set->Contains(1));
+  EXPECT(!set->Contains(63));
+  set->Remove(64);
+  EXPECT(!set->Contains(64));
+
+  BitVector* other = new BitVector(130);
+  other->Add(0);
+  EXPECT(!set->Equals(*other));
+  EXPECT(!other->AddAll(other));
+  EXPECT(other->AddAll(set));
+  EXPECT(!other->AddAll(set));
+  EXPECT(other->Contains(129));
+  EXPECT(set->Equals(*other));
+
+  BitVector* kill = new BitVector(130);
+  kill->Add(0);
+  kill->Add(5);
+  other->RemoveAll(kill);
+  EXPECT(!other->Contains(0));
+  EXPECT(other->Contains(129));
+  other->Clear();
+  EXPECT(!other->Contains(129));
+}
+
+}  // namespace dart
@@ -29,7 +29,7 @@ namespace dart {
   V(IsolateNatives_start, 2)                                                   \
   V(ReceivePortImpl_factory, 1)                                                \
   V(ReceivePortImpl_closeInternal, 1)                                          \
-  V(SendPortImpl_sendInternal_, 3)                                             \
+  V(SendPortImpl_sendInternal_, 4)                                             \
   V(Smi_shlFromInt, 2)                                                         \
   V(Smi_shrFromInt, 2)                                                         \
   V(Smi_bitNegate, 1)                                                          \
@@ -4,6 +4,7 @@
 
 #include "vm/class_finalizer.h"
 
+#include "vm/compiler.h"
 #include "vm/flags.h"
 #include "vm/heap.h"
 #include "vm/isolate.h"
@@ -16,6 +17,8 @@ namespace dart {
 DEFINE_FLAG(bool, print_classes, false, "Prints details about loaded classes.");
 DEFINE_FLAG(bool, trace_class_finalization, false, "Trace class finalization.");
 DEFINE_FLAG(bool, trace_type_finalization, false, "Trace type finalization.");
+DEFINE_FLAG(bool, trace_cha, false,
+    "Trace the optimized code discarded by class hierarchy analysis.");
 DEFINE_FLAG(bool, verify_implements, false,
     "Verify that all classes implement their interface.");
 DECLARE_FLAG(bool, enable_type_checks);
@@ -1039,6 +1042,213 @@ void ClassFinalizer::FinalizeClass(const Class& cls, bool generating_snapshot) {
                   cls_name.ToCString(), lib_name.ToCString());
     }
   }
+  if (!cls.is_interface()) {
+    AddImplementations(cls);
+  }
+}
+
+
+// The implementations of the selectors are recorded in an open addressed
+// table, indexed by the hash of the selector and probed linearly.  The table
+// is an array holding the number of selectors, followed by the buckets of
+// kSelectorBucketSize entries: the selector, its implementation or null if
+// there are several, and a growable array of the functions depending on the
+// implementation being unique or null.  At most half of the buckets are
+// filled, so the probing always terminates.
+enum {
+  kSelectorCount = 0,
+  kFirstSelectorBucket = 1,
+};
+enum {
+  kSelector = 0,
+  kImplementation = 1,
+  kDependentFunctions = 2,
+  kSelectorBucketSize = 3,
+};
+static const intptr_t kInitialSelectorCapacity = 1024;
+
+
+// Returns the index of the bucket of the selector, or of the empty bucket
+// where it would be inserted.
+static intptr_t ProbeSelector(const Array& table, const String& selector) {
+  const intptr_t mask =
+      ((table.Length() - kFirstSelectorBucket) / kSelectorBucketSize) - 1;
+  String& entry = String::Handle();
+  intptr_t index = selector.Hash() & mask;
+  while (true) {
+    const intptr_t bucket = kFirstSelectorBucket + index * kSelectorBucketSize;
+    entry ^= table.At(bucket + kSelector);
+    if (entry.IsNull() || entry.Equals(selector)) {
+      return bucket;
+    }
+    index = (index + 1) & mask;
+  }
+}
+
+
+static RawArray* NewSelectorTable(intptr_t capacity) {
+  const Array& table = Array::Handle(
+      Array::New(kFirstSelectorBucket + capacity * kSelectorBucketSize,
+                 Heap::kOld));
+  table.SetAt(kSelectorCount, Smi::Handle(Smi::New(0)));
+  return table.raw();
+}
+
+
+// Returns the table of the isolate, grown if needed to add a selector.
+static RawArray* SelectorTableForInsertion() {
+  ObjectStore* object_store = Isolate::Current()->object_store();
+  Array& table = Array::Handle(object_store->selector_implementations());
+  if (table.IsNull()) {
+    table = NewSelectorTable(kInitialSelectorCapacity);
+    object_store->set_selector_implementations(table);
+    return table.raw();
+  }
+  Smi& count = Smi::Handle();
+  count ^= table.At(kSelectorCount);
+  const intptr_t capacity =
+      (table.Length() - kFirstSelectorBucket) / kSelectorBucketSize;
+  if (2 * (count.Value() + 1) <= capacity) {
+    return table.raw();
+  }
+  const Array& new_table = Array::Handle(NewSelectorTable(2 * capacity));
+  String& selector = String::Handle();
+  Object& entry = Object::Handle();
+  for (intptr_t i = 0; i < capacity; i++) {
+    const intptr_t bucket = kFirstSelectorBucket + i * kSelectorBucketSize;
+    selector ^= table.At(bucket + kSelector);
+    if (selector.IsNull()) continue;
+    const intptr_t new_bucket = ProbeSelector(new_table, selector);
+    for (intptr_t j = 0; j < kSelectorBucketSize; j++) {
+      entry = table.At(bucket + j);
+      new_table.SetAt(new_bucket + j, entry);
+    }
+  }
+  new_table.SetAt(kSelectorCount, count);
+  object_store->set_selector_implementations(new_table);
+  return new_table.raw();
+}
+
+
+RawFunction* ClassFinalizer::UniqueImplementation(const String& selector) {
+  const Array& table = Array::Handle(
+      Isolate::Current()->object_store()->selector_implementations());
+  if (table.IsNull()) {
+    return Function::null();
+  }
+  Function& function = Function::Handle();
+  function ^= table.At(ProbeSelector(table, selector) + kImplementation);
+  return function.raw();
+}
+
+
+void ClassFinalizer::AddDependentFunction(const String& selector,
+                                          const Function& function) {
+  const Array& table = Array::Handle(
+      Isolate::Current()->object_store()->selector_implementations());
+  ASSERT(!table.IsNull());
+  const intptr_t bucket = ProbeSelector(table, selector);
+  ASSERT(table.At(bucket + kImplementation) != Object::null());
+  GrowableObjectArray& dependents = GrowableObjectArray::Handle();
+  dependents ^= table.At(bucket + kDependentFunctions);
+  if (dependents.IsNull()) {
+    dependents = GrowableObjectArray::New(Heap::kOld);
+    table.SetAt(bucket + kDependentFunctions, dependents);
+  }
+  for (intptr_t i = 0; i < dependents.Length(); i++) {
+    if (dependents.At(i) == function.raw()) {
+      return;
+    }
+  }
+  dependents.Add(function, Heap::kOld);
+}
+
+
+void ClassFinalizer::AddImplementation(const Function& function) {
+  const String& selector = String::Handle(function.name());
+  const Array& table = Array::Handle(SelectorTableForInsertion());
+  const intptr_t bucket = ProbeSelector(table, selector);
+  if (table.At(bucket + kSelector) == Object::null()) {
+    Smi& count = Smi::Handle();
+    count ^= table.At(kSelectorCount);
+    table.SetAt(bucket + kSelector, selector);
+    table.SetAt(bucket + kImplementation, function);
+    table.SetAt(kSelectorCount, Smi::Handle(Smi::New(count.Value() + 1)));
+    return;
+  }
+  if ((table.At(bucket + kImplementation) == Object::null()) ||
+      (table.At(bucket + kImplementation) == function.raw())) {
+    return;
+  }
+  // The selector is no longer implemented by a single function.  The
+  // activations of the discarded optimized code keep running it: its calls
+  // were only bound on the receiver of the activation, whose class was
+  // finalized before the new implementation.
+  GrowableObjectArray& dependents = GrowableObjectArray::Handle();
+  dependents ^= table.At(bucket + kDependentFunctions);
+  table.SetAt(bucket + kImplementation, Object::Handle());
+  table.SetAt(bucket + kDependentFunctions, Object::Handle());
+  if (dependents.IsNull()) {
+    return;
+  }
+  Function& dependent = Function::Handle();
+  for (intptr_t i = 0; i < dependents.Length(); i++) {
+    dependent ^= dependents.At(i);
+    if (!dependent.HasOptimizedCode()) continue;
+    if (FLAG_trace_cha) {
+      OS::Print("Discarding optimized code of '%s': '%s' is implemented by "
+                "'%s'\n",
+                dependent.ToFullyQualifiedCString(),
+                selector.ToCString(),
+                function.ToFullyQualifiedCString());
+    }
+    // Collect type feedback again before optimizing the function.
+    dependent.set_usage_counter(0);
+    const Error& error = Error::Handle(Compiler::CompileFunction(dependent));
+    ASSERT(error.IsNull());
+    ASSERT(!dependent.HasOptimizedCode());
+  }
+}
+
+
+void ClassFinalizer::AddImplementations(const Class& cls) {
+  const Array& functions = Array::Handle(cls.functions());
+  if (functions.IsNull()) {
+    return;
+  }
+  Function& function = Function::Handle();
+  for (intptr_t i = 0; i < functions.Length(); i++) {
+    function ^= functions.At(i);
+    if (function.is_static()) continue;
+    switch (function.kind()) {
+      case RawFunction::kFunction:
+      case RawFunction::kGetterFunction:
+      case RawFunction::kSetterFunction:
+      case RawFunction::kImplicitGetter:
+      case RawFunction::kImplicitSetter:
+        AddImplementation(function);
+        break;
+      default:
+        break;
+    }
+  }
+}
+
+
+void ClassFinalizer::AddImplementationsOfLibraries() {
+  Library& lib = Library::Handle(
+      Isolate::Current()->object_store()->registered_libraries());
+  Class& cls = Class::Handle();
+  while (!lib.IsNull()) {
+    ClassDictionaryIterator it(lib);
+    while (it.HasNext()) {
+      cls ^= it.GetNextClass();
+      if (cls.is_finalized() && !cls.is_interface()) {
+        AddImplementations(cls);
+      }
+    }
+    lib = lib.next_registered();
+  }
 }
 
 
@@ -18,8 +18,10 @@ class Function;
 class GrowableObjectArray;
 class RawAbstractType;
 class RawClass;
+class RawFunction;
 class RawType;
 class Script;
+class String;
 class Type;
 class UnresolvedClass;
 
@@ -86,6 +88,24 @@ class ClassFinalizer : public AllStatic {
   // needed during bootstrapping where the classes have been preloaded.
   static void VerifyBootstrapClasses();
 
+  // Class hierarchy analysis: the instance functions of the finalized classes
+  // are recorded by name, the selector of the instance calls they implement.
+
+  // Return the only instance function named 'selector' in the finalized
+  // classes, or null if there is none or several.
+  static RawFunction* UniqueImplementation(const String& selector);
+
+  // Record that the optimized code of 'function' relies on the selector
+  // having a unique implementation.  The function is switched back to its
+  // unoptimized code when another implementation is finalized.
+  static void AddDependentFunction(const String& selector,
+                                   const Function& function);
+
+  // Record the implementations of the classes of the registered libraries.
+  // Needed for the classes read from a script snapshot, which are already
+  // finalized.
+  static void AddImplementationsOfLibraries();
+
  private:
   static bool FinalizePendingClasses(bool generating_snapshot);
   static void FinalizeClass(const Class& cls, bool generating_snapshot);
@@ -109,6 +129,8 @@ class ClassFinalizer : public AllStatic {
                                           const Function& function);
   static void ResolveAndFinalizeMemberTypes(const Class& cls);
   static void PrintClassInformation(const Class& cls);
+  static void AddImplementations(const Class& cls);
+  static void AddImplementation(const Function& function);
   static void VerifyClassImplements(const Class& cls);
   static void CollectInterfaces(const Class& cls,
                                 const GrowableObjectArray& interfaces);
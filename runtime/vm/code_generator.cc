@@ -7,9 +7,11 @@
 #include "vm/code_index_table.h"
 #include "vm/code_patcher.h"
 #include "vm/compiler.h"
+#include "vm/compiler_stats.h"
 #include "vm/dart_api_impl.h"
 #include "vm/dart_entry.h"
 #include "vm/debugger.h"
+#include "vm/deferred_optimizer.h"
 #include "vm/exceptions.h"
 #include "vm/object_store.h"
 #include "vm/message.h"
@@ -27,9 +29,14 @@ DEFINE_FLAG(bool, trace_patching, false, "Trace patching of code.");
 DEFINE_FLAG(bool, trace_runtime_calls, false, "Trace runtime calls.");
 DEFINE_FLAG(int, optimization_counter_threshold, 2000,
     "function's usage-counter value before it is optimized, -1 means never.");
+DEFINE_FLAG(int, max_polymorphic_checks, 8,
+    "Number of receiver classes recorded by an inline cache before its call "
+    "switches to the megamorphic cache of the selector, -1 means never.");
 DECLARE_FLAG(bool, enable_type_checks);
 DECLARE_FLAG(bool, trace_type_checks);
 DECLARE_FLAG(bool, report_usage_count);
+DECLARE_FLAG(bool, deferred_optimization);
+DECLARE_FLAG(bool, compiler_stats);
 DECLARE_FLAG(int, deoptimization_counter_threshold);
 
 
@@ -718,6 +725,47 @@ DEFINE_RUNTIME_ENTRY(BreakpointDynamicHandler, 0) {
 }
 
 
+// Redirect the instance call at the return address to the MegamorphicCall
+// stub, with the cache of its selector filled from the checks of its inline
+// cache.  The checks are kept as the type feedback of the optimizer.
+// The call is left alone when the debugger is active, since it may have been
+// patched to a breakpoint stub.
+static void SwitchToMegamorphicCall(uword return_address,
+                                    const ICData& ic_data) {
+  int num_arguments = -1;
+  int num_named_arguments = -1;
+  uword target = 0;
+  String& function_name = String::Handle();
+  CodePatcher::GetInstanceCallAt(return_address,
+                                 &function_name,
+                                 &num_arguments,
+                                 &num_named_arguments,
+                                 &target);
+  const Array& cache = Array::Handle(
+      MegamorphicCache::ForSelector(function_name,
+                                    num_arguments,
+                                    num_named_arguments));
+  MegamorphicCache megamorphic_cache(cache);
+  for (intptr_t i = 0; i < ic_data.NumberOfChecks(); i++) {
+    GrowableArray<const Class*> classes;
+    Function& target_function = Function::Handle();
+    ic_data.GetCheckAt(i, &classes, &target_function);
+    megamorphic_cache.Insert(*classes[0], target_function);
+  }
+  ic_data.set_megamorphic_cache(cache);
+  CodePatcher::PatchInstanceCallAt(return_address,
+                                   StubCode::MegamorphicCallEntryPoint());
+  if (FLAG_compiler_stats) {
+    CompilerStats::num_polymorphic_call_sites--;
+    CompilerStats::num_megamorphic_call_sites++;
+  }
+  if (FLAG_trace_ic) {
+    OS::Print("InlineCacheMissHandler call at 0x%x' is megamorphic: %s\n",
+        return_address, function_name.ToCString());
+  }
+}
+
+
 static RawFunction* InlineCacheMissHandler(
     Isolate* isolate, const GrowableArray<const Instance*>& args) {
   const Instance& receiver = *args[0];
@@ -750,6 +798,14 @@ static RawFunction* InlineCacheMissHandler(
   DartFrame* caller_frame = iterator.NextFrame();
   ICData& ic_data = ICData::Handle(
       CodePatcher::GetInstanceCallIcDataAt(caller_frame->pc()));
+  if (ic_data.IsMegamorphic()) {
+    // The call was redirected to the inline cache stub after switching, e.g.,
+    // by the removal of a breakpoint.
+    const Array& cache = Array::Handle(ic_data.megamorphic_cache());
+    MegamorphicCache(cache).Insert(Class::Handle(receiver.clazz()),
+                                   target_function);
+    return target_function.raw();
+  }
 #if defined(DEBUG)
   for (intptr_t i = 0; i < ic_data.NumberOfChecks(); i++) {
     GrowableArray<const Class*> classes;
@@ -773,6 +829,14 @@ static RawFunction* InlineCacheMissHandler(
     classes.Add(&Class::ZoneHandle(args[i]->clazz()));
   }
   ic_data.AddCheck(classes, target_function);
+  if (FLAG_compiler_stats) {
+    if (ic_data.NumberOfChecks() == 1) {
+      CompilerStats::num_monomorphic_call_sites++;
+    } else if (ic_data.NumberOfChecks() == 2) {
+      CompilerStats::num_monomorphic_call_sites--;
+      CompilerStats::num_polymorphic_call_sites++;
+    }
+  }
   if (FLAG_trace_ic) {
     OS::Print("InlineCacheMissHandler %d call at 0x%x' adding <%s> -> <%s>\n",
         args.length(),
@@ -780,6 +844,11 @@ static RawFunction* InlineCacheMissHandler(
         Class::Handle(receiver.clazz()).ToCString(),
         target_function.ToCString());
   }
+  if ((FLAG_max_polymorphic_checks >= 0) &&
+      (ic_data.NumberOfChecks() > FLAG_max_polymorphic_checks) &&
+      !isolate->debugger()->IsActive()) {
+    SwitchToMegamorphicCall(caller_frame->pc(), ic_data);
+  }
   return target_function.raw();
 }
 
@@ -821,6 +890,46 @@ DEFINE_RUNTIME_ENTRY(InlineCacheMissHandlerTwoArgs, 2) {
 }
 
 
+// Handles misses of the megamorphic cache of a call's selector by resolving
+// the target of the receiver's class and adding it to the cache.
+//   Arg0: Receiver object.
+//   Returns: target function with compiled code or null.
+// The MegamorphicCall stub continues in the megamorphic lookup when the
+// target is null (noSuchMethod, closure calls).
+DEFINE_RUNTIME_ENTRY(MegamorphicCacheMissHandler, 1) {
+  ASSERT(arguments.Count() ==
+      kMegamorphicCacheMissHandlerRuntimeEntry.argument_count());
+  const Instance& receiver = Instance::CheckedHandle(arguments.At(0));
+  const Code& target_code =
+      Code::Handle(ResolveCompileInstanceCallTarget(isolate, receiver));
+  if (target_code.IsNull()) {
+    arguments.SetReturn(Function::Handle());
+    return;
+  }
+  const Function& target_function = Function::Handle(target_code.function());
+  ASSERT(!target_function.IsNull());
+  // As in the inline caches, the null class is not cached.
+  if (!receiver.IsNull()) {
+    DartFrameIterator iterator;
+    DartFrame* caller_frame = iterator.NextFrame();
+    const ICData& ic_data = ICData::Handle(
+        CodePatcher::GetInstanceCallIcDataAt(caller_frame->pc()));
+    ASSERT(ic_data.IsMegamorphic());
+    const Array& cache = Array::Handle(ic_data.megamorphic_cache());
+    MegamorphicCache(cache).Insert(Class::Handle(receiver.clazz()),
+                                   target_function);
+    if (FLAG_trace_ic) {
+      OS::Print("MegamorphicCacheMissHandler call at 0x%x' adding <%s> -> "
+          "<%s>\n",
+          caller_frame->pc(),
+          Class::Handle(receiver.clazz()).ToCString(),
+          target_function.ToCString());
+    }
+  }
+  arguments.SetReturn(target_function);
+}
+
+
 static RawFunction* LookupDynamicFunction(Isolate* isolate,
                                           const Class& in_cls,
                                           const String& name) {
@@ -1090,13 +1199,14 @@ DEFINE_RUNTIME_ENTRY(ClosureArgumentMismatch, 0) {
 }
 
 
-static RawInstance* DeserializeMessage(void* data) {
+static RawInstance* DeserializeMessage(Message* message) {
   // Create a snapshot object using the buffer.
-  const Snapshot* snapshot = Snapshot::SetupFromBuffer(data);
+  const Snapshot* snapshot = Snapshot::SetupFromBuffer(message->data());
   ASSERT(snapshot->IsMessageSnapshot());
 
   // Read object back from the snapshot.
   SnapshotReader reader(snapshot, Isolate::Current());
+  reader.set_message(message);
   Instance& instance = Instance::Handle();
   instance ^= reader.ReadObject();
   return instance.raw();
@@ -1132,7 +1242,7 @@ DEFINE_RUNTIME_ENTRY(StackOverflow, 0) {
         break;
       }
       const Instance& msg =
-          Instance::Handle(DeserializeMessage(message->data()));
+          Instance::Handle(DeserializeMessage(message));
       // For now the only OOB messages are Mirrors messages.
       const Object& result = Object::Handle(
           DartLibraryCalls::HandleMirrorsMessage(
@@ -1145,6 +1255,13 @@ DEFINE_RUNTIME_ENTRY(StackOverflow, 0) {
       ASSERT(result.IsNull());
     }
   }
+  if (interrupt_bits & Isolate::kOptimizeInterrupt) {
+    const Error& error = Error::Handle(
+        isolate->deferred_optimizer()->OptimizeQueuedFunctions());
+    if (!error.IsNull()) {
+      Exceptions::PropagateError(error);
+    }
+  }
   if (interrupt_bits & Isolate::kApiInterrupt) {
     Dart_IsolateInterruptCallback callback = isolate->InterruptCallback();
     if (callback) {
@@ -1159,6 +1276,50 @@ DEFINE_RUNTIME_ENTRY(StackOverflow, 0) {
 }
 
 
+// Unoptimized code counts loop iterations as well as invocations.  Once the
+// threshold is reached at a loop back edge, the loop continues in optimized
+// code entered at its header, which takes over the unoptimized frame.  The
+// function itself is optimized too, for its next invocations.
+// Arg0: function running the loop.
+// Arg1: index of the loop, as a Smi.
+// Return value: the code to continue the loop in, or null to stay in the
+// unoptimized code.
+DEFINE_RUNTIME_ENTRY(OnStackReplacement, 2) {
+  ASSERT(arguments.Count() ==
+         kOnStackReplacementRuntimeEntry.argument_count());
+  const Function& function = Function::CheckedHandle(arguments.At(0));
+  const Smi& loop_index = Smi::CheckedHandle(arguments.At(1));
+  arguments.SetReturn(Code::Handle());
+  // Count again from zero, whether the loop moves to optimized code or not,
+  // so that other activations of the unoptimized code do not recompile on
+  // every iteration.
+  function.set_usage_counter(0);
+  if (isolate->debugger()->IsActive() ||
+      !function.is_optimizable() ||
+      (function.deoptimization_counter() >=
+       FLAG_deoptimization_counter_threshold)) {
+    return;
+  }
+  if (FLAG_deferred_optimization) {
+    // The loop cannot wait, but the function can.
+    if (!function.HasOptimizedCode()) {
+      isolate->deferred_optimizer()->EnqueueFunction(function);
+    }
+  } else if (!function.HasOptimizedCode()) {
+    const Error& error =
+        Error::Handle(Compiler::CompileOptimizedFunction(function));
+    if (!error.IsNull()) {
+      Exceptions::PropagateError(error);
+    }
+    // The optimizing compiler bails out on the same code for both entries.
+    if (!function.HasOptimizedCode()) return;
+  }
+  const Code& osr_code = Code::Handle(
+      Compiler::CompileOsrFunction(function, loop_index.Value()));
+  arguments.SetReturn(osr_code);
+}
+
+
 // Only unoptimized code has invocation counter threshold checking.
 // Once the invocation counter threshold is reached any entry into the
 // unoptimized code is redirected to this function.
@@ -1189,6 +1350,13 @@ DEFINE_RUNTIME_ENTRY(OptimizeInvokedFunction, 1) {
   }
   if (function.is_optimizable()) {
     ASSERT(!function.HasOptimizedCode());
+    if (FLAG_deferred_optimization) {
+      // Keep running the unoptimized code until the isolate compiles the
+      // function at a safepoint.
+      function.set_usage_counter(0);
+      isolate->deferred_optimizer()->EnqueueFunction(function);
+      return;
+    }
     const Code& unoptimized_code = Code::Handle(function.unoptimized_code());
     // Compilation patches the entry of unoptimized code.
     const Error& error =
@@ -1402,4 +1570,115 @@ RawCode* FunctionsCache::LookupCode(const String& function_name,
   return Code::null();
 }
 
+RawArray* MegamorphicCache::ForSelector(const String& function_name,
+                                        int num_arguments,
+                                        int num_named_arguments) {
+  ASSERT(function_name.IsSymbol());
+  ObjectStore* object_store = Isolate::Current()->object_store();
+  GrowableObjectArray& table =
+      GrowableObjectArray::Handle(object_store->megamorphic_cache_table());
+  if (table.IsNull()) {
+    table = GrowableObjectArray::New(Heap::kOld);
+    object_store->set_megamorphic_cache_table(table);
+  }
+  // The table holds groups of selector name, argument counts and cache.
+  Smi& smi = Smi::Handle();
+  Array& cache = Array::Handle();
+  for (intptr_t i = 0; i < table.Length(); i += 4) {
+    if (table.At(i) != function_name.raw()) continue;
+    smi ^= table.At(i + 1);
+    if (smi.Value() != num_arguments) continue;
+    smi ^= table.At(i + 2);
+    if (smi.Value() != num_named_arguments) continue;
+    cache ^= table.At(i + 3);
+    return cache.raw();
+  }
+  cache = Array::New(kNumEntries, Heap::kOld);
+  cache.SetAt(kBuckets, Array::Handle(
+      Array::New(kInitialCapacity * kBucketSize, Heap::kOld)));
+  cache.SetAt(kMask, Smi::Handle(Smi::New(kInitialCapacity - 1)));
+  cache.SetAt(kFilledCount, Smi::Handle(Smi::New(0)));
+  table.Add(function_name, Heap::kOld);
+  table.Add(Smi::Handle(Smi::New(num_arguments)), Heap::kOld);
+  table.Add(Smi::Handle(Smi::New(num_named_arguments)), Heap::kOld);
+  table.Add(cache, Heap::kOld);
+  return cache.raw();
+}
+
+
+// Returns the index of the bucket holding the class, or of the empty bucket
+// where it would be inserted.  The stub hashes the same, but from the raw
+// hash field: the name of a class is a symbol, whose hash is always set.
+// The stub misses on the few VM classes which are named lazily.
+intptr_t MegamorphicCache::Probe(const Array& buckets,
+                                 intptr_t mask,
+                                 const Class& cls) {
+  const String& name = String::Handle(cls.Name());
+  intptr_t index = name.Hash() & mask;
+  while (true) {
+    const RawObject* entry = buckets.At(index * kBucketSize + kClass);
+    if ((entry == Object::null()) || (entry == cls.raw())) {
+      return index;
+    }
+    index = (index + 1) & mask;
+  }
+}
+
+
+void MegamorphicCache::Insert(const Class& cls, const Function& target) const {
+  ASSERT(!cls.IsNull() && !cls.IsNullClass());
+  ASSERT(target.HasCode());
+  Array& buckets = Array::Handle();
+  buckets ^= cache_.At(kBuckets);
+  Smi& smi = Smi::Handle();
+  smi ^= cache_.At(kMask);
+  intptr_t mask = smi.Value();
+  intptr_t filled_count = this->filled_count();
+  // Keep at most half of the buckets filled.
+  if (2 * (filled_count + 1) > (mask + 1)) {
+    const intptr_t capacity = 2 * (mask + 1);
+    const Array& new_buckets =
+        Array::Handle(Array::New(capacity * kBucketSize, Heap::kOld));
+    Class& entry_class = Class::Handle();
+    Object& entry_target = Object::Handle();
+    for (intptr_t i = 0; i <= mask; i++) {
+      entry_class ^= buckets.At(i * kBucketSize + kClass);
+      if (entry_class.IsNull()) continue;
+      entry_target = buckets.At(i * kBucketSize + kTarget);
+      const intptr_t index = Probe(new_buckets, capacity - 1, entry_class);
+      new_buckets.SetAt(index * kBucketSize + kClass, entry_class);
+      new_buckets.SetAt(index * kBucketSize + kTarget, entry_target);
+    }
+    buckets = new_buckets.raw();
+    mask = capacity - 1;
+    cache_.SetAt(kBuckets, buckets);
+    cache_.SetAt(kMask, Smi::Handle(Smi::New(mask)));
+  }
+  const intptr_t index = Probe(buckets, mask, cls);
+  if (buckets.At(index * kBucketSize + kClass) == Object::null()) {
+    buckets.SetAt(index * kBucketSize + kClass, cls);
+    cache_.SetAt(kFilledCount, Smi::Handle(Smi::New(filled_count + 1)));
+  }
+  buckets.SetAt(index * kBucketSize + kTarget, target);
+}
+
+
+RawFunction* MegamorphicCache::Lookup(const Class& cls) const {
+  Array& buckets = Array::Handle();
+  buckets ^= cache_.At(kBuckets);
+  Smi& smi = Smi::Handle();
+  smi ^= cache_.At(kMask);
+  const intptr_t index = Probe(buckets, smi.Value(), cls);
+  Function& target = Function::Handle();
+  target ^= buckets.At(index * kBucketSize + kTarget);
+  return target.raw();
+}
+
+
+intptr_t MegamorphicCache::filled_count() const {
+  Smi& smi = Smi::Handle();
+  smi ^= cache_.At(kFilledCount);
+  return smi.Value();
+}
+
 }  // namespace dart
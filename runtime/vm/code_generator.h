@@ -40,6 +40,8 @@ DECLARE_RUNTIME_ENTRY(Instanceof);
 DECLARE_RUNTIME_ENTRY(InstantiateTypeArguments);
 DECLARE_RUNTIME_ENTRY(InvokeImplicitClosureFunction);
 DECLARE_RUNTIME_ENTRY(InvokeNoSuchMethodFunction);
+DECLARE_RUNTIME_ENTRY(MegamorphicCacheMissHandler);
+DECLARE_RUNTIME_ENTRY(OnStackReplacement);
 DECLARE_RUNTIME_ENTRY(OptimizeInvokedFunction);
 DECLARE_RUNTIME_ENTRY(PatchStaticCall);
 DECLARE_RUNTIME_ENTRY(ReportObjectNotClosure);
@@ -124,6 +126,51 @@ class FunctionsCache : public ValueObject {
 };
 
 
+// This class wraps around the cache of the targets of a selector, shared by
+// the instance calls of the selector which have gone megamorphic.  The cache
+// is an array specified by MegamorphicCache::Entries.  Its buckets form an
+// open addressed hash table of (class, target function) pairs, indexed by
+// the hash of the class name masked by the Smi kMask and probed linearly.
+// An empty bucket has a null class; at most half of the buckets are filled,
+// so the probing in the MegamorphicCall stub always terminates.
+class MegamorphicCache : public ValueObject {
+ public:
+  enum Entries {
+    kBuckets = 0,
+    kMask = 1,
+    kFilledCount = 2,
+    kNumEntries = 3
+  };
+
+  enum BucketEntries {
+    kClass = 0,
+    kTarget = 1,
+    kBucketSize = 2
+  };
+
+  static const intptr_t kInitialCapacity = 16;
+
+  explicit MegamorphicCache(const Array& cache) : cache_(cache) {}
+
+  // Returns the cache of the selector, which is created on first use.
+  static RawArray* ForSelector(const String& function_name,
+                               int num_arguments,
+                               int num_named_arguments);
+
+  void Insert(const Class& cls, const Function& target) const;
+
+  // This is a testing function, the lookup occurs in stub code.
+  RawFunction* Lookup(const Class& cls) const;
+
+  intptr_t filled_count() const;
+
+ private:
+  static intptr_t Probe(const Array& buckets, intptr_t mask, const Class& cls);
+
+  const Array& cache_;
+};
+
+
 RawCode* ResolveCompileInstanceCallTarget(Isolate* isolate,
                                           const Instance& receiver);
 
@@ -11,6 +11,8 @@
 #include "vm/class_finalizer.h"
 #include "vm/code_generator.h"
 #include "vm/compiler.h"
+#include "vm/compiler_stats.h"
+#include "vm/dart_api_impl.h"
 #include "vm/dart_entry.h"
 #include "vm/native_entry.h"
 #include "vm/native_entry_test.h"
@@ -19,6 +21,9 @@
 
 namespace dart {
 
+DECLARE_FLAG(bool, compiler_stats);
+DECLARE_FLAG(int, max_polymorphic_checks);
+
 static const intptr_t kPos = Scanner::kDummyTokenIndex;
 
 
@@ -492,6 +497,93 @@ CODEGEN_TEST_RAW_RUN(AllocateNewObjectCodegen, function) {
   EXPECT_EQ(cls.raw(), result.clazz());
 }
 
+
+// Run a call site with more receiver classes than an inline cache records.
+TEST_CASE(MegamorphicCall) {
+  const char* kScriptChars =
+      "class C0 { f() { return 0; } }\n"
+      "class C1 { f() { return 1; } }\n"
+      "class C2 { f() { return 2; } }\n"
+      "class C3 { f() { return 3; } }\n"
+      "class C4 { f() { return 4; } }\n"
+      "class C5 { f() { return 5; } }\n"
+      "class C6 { f() { return 6; } }\n"
+      "class C7 { f() { return 7; } }\n"
+      "class C8 { f() { return 8; } }\n"
+      "class C9 { f() { return 9; } }\n"
+      "class C10 { f() { return 10; } }\n"
+      "class C11 { f() { return 11; } }\n"
+      "class C12 { f() { return 12; } }\n"
+      "class C13 { f() { return 13; } }\n"
+      "class C14 { f() { return 14; } }\n"
+      "class C15 { f() { return 15; } }\n"
+      "class C16 { f() { return 16; } }\n"
+      "class C17 { f() { return 17; } }\n"
+      "class C18 { f() { return 18; } }\n"
+      "class C19 { f() { return 19; } }\n"
+      "class C20 { f() { return 20; } }\n"
+      "class C21 { f() { return 21; } }\n"
+      "class C22 { f() { return 22; } }\n"
+      "class C23 { f() { return 23; } }\n"
+      "main() {\n"
+      "  var list = [new C0(), new C1(), new C2(), new C3(), new C4(),\n"
+      "      new C5(), new C6(), new C7(), new C8(), new C9(), new C10(),\n"
+      "      new C11(), new C12(), new C13(), new C14(), new C15(),\n"
+      "      new C16(), new C17(), new C18(), new C19(), new C20(),\n"
+      "      new C21(), new C22(), new C23()];\n"
+      "  var s = 0;\n"
+      "  for (var j = 0; j < 3; j++) {\n"
+      "    for (var i = 0; i < list.length; i++) {\n"
+      "      s = s + list[i].f();\n"
+      "    }\n"
+      "  }\n"
+      "  return s;\n"
+      "}\n";
+  const bool saved_compiler_stats = FLAG_compiler_stats;
+  FLAG_compiler_stats = true;
+  const intptr_t num_megamorphic_call_sites =
+      CompilerStats::num_megamorphic_call_sites;
+  Dart_Handle lib = TestCase::LoadTestScript(kScriptChars, NULL);
+  Dart_Handle result = Dart_InvokeStatic(lib,
+                                         Dart_NewString(""),
+                                         Dart_NewString("main"),
+                                         0,
+                                         NULL);
+  FLAG_compiler_stats = saved_compiler_stats;
+  EXPECT_VALID(result);
+  int64_t value = 0;
+  EXPECT_VALID(Dart_IntegerToInt64(result, &value));
+  EXPECT_EQ(3 * (23 * 24 / 2), value);
+  EXPECT_LT(num_megamorphic_call_sites,
+            CompilerStats::num_megamorphic_call_sites);
+
+  // The classes went through the cache of the selector, except for those
+  // tested by the inlined bodies of optimized code.
+  Library& library = Library::Handle();
+  library ^= Api::UnwrapHandle(lib);
+  const Array& cache = Array::Handle(MegamorphicCache::ForSelector(
+      String::Handle(String::NewSymbol("f")), 1, 0));
+  MegamorphicCache megamorphic_cache(cache);
+  Class& cls = Class::Handle();
+  Function& target = Function::Handle();
+  intptr_t num_cached_classes = 0;
+  char name[8];
+  for (intptr_t i = 0; i < 24; i++) {
+    OS::SNPrint(name, sizeof(name), "C%d", static_cast<int>(i));
+    cls = library.LookupClass(String::Handle(String::NewSymbol(name)));
+    EXPECT(!cls.IsNull());
+    target = megamorphic_cache.Lookup(cls);
+    if (!target.IsNull()) {
+      EXPECT_EQ(cls.raw(), target.owner());
+      num_cached_classes++;
+    }
+  }
+  EXPECT_EQ(num_cached_classes, megamorphic_cache.filled_count());
+  EXPECT_LT(FLAG_max_polymorphic_checks, num_cached_classes);
+  cls = Isolate::Current()->object_store()->object_class();
+  EXPECT(megamorphic_cache.Lookup(cls) == Function::null());
+}
+
 }  // namespace dart
 
 #endif  // defined TARGET_ARCH_IA32 || defined(TARGET_ARCH_X64)
@@ -115,10 +115,6 @@ NODE_LIST(DEFINE_VISITOR_FUNCTION)
   static bool CanOptimize();
 
  private:
-  // TODO(srdjan): Remove the friendship once the two compilers are properly
-  // structured.
-  friend class OptimizingCodeGenerator;
-
   // Forward declarations.
   class HandlerList;
 
@@ -16,6 +16,8 @@
 #include "vm/flags.h"
 #include "vm/flow_graph_builder.h"
 #include "vm/flow_graph_compiler.h"
+#include "vm/flow_graph_inliner.h"
+#include "vm/flow_graph_optimizer.h"
 #include "vm/longjump.h"
 #include "vm/object.h"
 #include "vm/object_store.h"
@@ -40,6 +42,8 @@ DEFINE_FLAG(bool, use_new_compiler, false,
     "Try to use the new compiler backend.");
 #endif
 DEFINE_FLAG(bool, trace_bailout, false, "Print bailout from new compiler.");
+DEFINE_FLAG(bool, use_osr, true,
+    "Continue hot loops of unoptimized code in optimized code.");
 
 
 // Compile a function. Should call only if the function has not been compiled.
@@ -109,6 +113,54 @@ RawError* Compiler::Compile(const Library& library, const Script& script) {
 }
 
 
+static void DisassembleCode(const char* function_fullname,
+                            const Code& code) {
+  OS::Print("Code for %sfunction '%s' {\n",
+            code.is_optimized() ? "optimized " : "", function_fullname);
+  const Instructions& instructions =
+      Instructions::Handle(code.instructions());
+  uword start = instructions.EntryPoint();
+  Disassembler::Disassemble(start, start + instructions.size());
+  OS::Print("}\n");
+  OS::Print("Pointer offsets for function: {\n");
+  for (intptr_t i = 0; i < code.pointer_offsets_length(); i++) {
+    const uword addr = code.GetPointerOffsetAt(i) + code.EntryPoint();
+    Object& obj = Object::Handle();
+    obj = *reinterpret_cast<RawObject**>(addr);
+    OS::Print(" %d : 0x%x '%s'\n",
+              code.GetPointerOffsetAt(i), addr, obj.ToCString());
+  }
+  OS::Print("}\n");
+  OS::Print("PC Descriptors for function '%s' {\n", function_fullname);
+  OS::Print("(pc, kind, id, try-index, token-index)\n");
+  const PcDescriptors& descriptors =
+      PcDescriptors::Handle(code.pc_descriptors());
+  OS::Print("%s", descriptors.ToCString());
+  OS::Print("}\n");
+  OS::Print("Variable Descriptors for function '%s' {\n",
+            function_fullname);
+  const LocalVarDescriptors& var_descriptors =
+      LocalVarDescriptors::Handle(code.var_descriptors());
+  intptr_t var_desc_length =
+      var_descriptors.IsNull() ? 0 : var_descriptors.Length();
+  String& var_name = String::Handle();
+  for (intptr_t i = 0; i < var_desc_length; i++) {
+    var_name = var_descriptors.GetName(i);
+    intptr_t scope_id, begin_pos, end_pos;
+    var_descriptors.GetScopeInfo(i, &scope_id, &begin_pos, &end_pos);
+    intptr_t slot = var_descriptors.GetSlotIndex(i);
+    OS::Print("  var %s scope %ld (valid %d-%d) offset %ld\n",
+              var_name.ToCString(), scope_id, begin_pos, end_pos, slot);
+  }
+  OS::Print("}\n");
+  OS::Print("Exception Handlers for function '%s' {\n", function_fullname);
+  const ExceptionHandlers& handlers =
+      ExceptionHandlers::Handle(code.exception_handlers());
+  OS::Print("%s", handlers.ToCString());
+  OS::Print("}\n");
+}
+
+
 static RawError* CompileFunctionHelper(const Function& function,
                                        bool optimized) {
   Isolate* isolate = Isolate::Current();
@@ -133,13 +185,25 @@ static RawError* CompileFunctionHelper(const Function& function,
     ASSERT(code_index_table != NULL);
     bool is_compiled = false;
     if (FLAG_use_new_compiler) {
-      ASSERT(!optimized);
       LongJump* old_base = isolate->long_jump_base();
       LongJump bailout_jump;
       isolate->set_long_jump_base(&bailout_jump);
       if (setjmp(*bailout_jump.Set()) == 0) {
-        FlowGraphBuilder graph_builder(parsed_function);
+        FlowGraphBuilder graph_builder(parsed_function, -1);
         graph_builder.BuildGraph();
+        if (optimized) {
+          // Transition to optimized code only from unoptimized code.
+          ASSERT(function.HasCode());
+          ASSERT(!function.HasOptimizedCode());
+          graph_builder.ComputeSSA();
+          FlowGraphInliner inliner(&graph_builder);
+          inliner.Inline();
+          FlowGraphOptimizer optimizer(&graph_builder);
+          optimizer.EliminateCommonSubexpressions();
+          optimizer.HoistLoopInvariants();
+          optimizer.EliminateBoundsChecks();
+          optimizer.UnboxDoubles();
+        }
 
         Assembler assembler;
         // The non-optimizing compiler compiles blocks in reverse postorder,
@@ -151,18 +215,31 @@ static RawError* CompileFunctionHelper(const Function& function,
           block_order.Add(graph_builder.postorder_block_entries()[i]);
         }
         FlowGraphCompiler graph_compiler(&assembler, parsed_function,
-                                         block_order);
+                                         block_order,
+                                         optimized,
+                                         false);  // Not OSR.
         graph_compiler.CompileGraph();
         const Code& code =
             Code::Handle(Code::FinalizeCode(function_fullname, &assembler));
-        code.set_is_optimized(false);
+        code.set_is_optimized(optimized);
         graph_compiler.FinalizePcDescriptors(code);
         graph_compiler.FinalizeVarDescriptors(code);
         graph_compiler.FinalizeExceptionHandlers(code);
-        function.set_unoptimized_code(code);
-        function.SetCode(code);
-        ASSERT(CodePatcher::CodeIsPatchable(code));
-        code_index_table->AddCode(code);
+        graph_compiler.FinalizeInlinedFrames(code);
+        if (optimized) {
+          function.SetCode(code);
+          code_index_table->AddCode(code);
+          CodePatcher::PatchEntry(Code::Handle(function.unoptimized_code()));
+          if (FLAG_trace_compiler) {
+            OS::Print("--> patching entry 0x%x\n",
+                      Code::Handle(function.unoptimized_code()).EntryPoint());
+          }
+        } else {
+          function.set_unoptimized_code(code);
+          function.SetCode(code);
+          ASSERT(CodePatcher::CodeIsPatchable(code));
+          code_index_table->AddCode(code);
+        }
         is_compiled = true;
       } else {
         // We bailed out.
@@ -172,6 +249,12 @@ static RawError* CompileFunctionHelper(const Function& function,
         if (FLAG_trace_bailout) {
           OS::Print("%s\n", bailout_error.ToErrorCString());
         }
+        if (optimized) {
+          // Keep running the unoptimized code.
+          function.set_is_optimizable(false);
+          function.set_usage_counter(0);
+          is_compiled = true;
+        }
       }
       isolate->set_long_jump_base(old_base);
     }
@@ -179,6 +262,11 @@ static RawError* CompileFunctionHelper(const Function& function,
     if (!is_compiled) {
       Assembler assembler;
       if (optimized) {
+#if defined(TARGET_ARCH_X64)
+        // Optimized code is only generated from the flow graph, which keeps
+        // the unoptimized code when it bails out.
+        UNREACHABLE();
+#else
         // Transition to optimized code only from unoptimized code ...
         // for now.
         ASSERT(function.HasCode());
@@ -206,6 +294,7 @@ static RawError* CompileFunctionHelper(const Function& function,
           OS::Print("--> patching entry 0x%x\n",
                     Code::Handle(function.unoptimized_code()).EntryPoint());
         }
+#endif  // defined(TARGET_ARCH_X64)
       } else {
         // Unoptimized code.
         if (Code::Handle(function.unoptimized_code()).IsNull()) {
@@ -252,50 +341,8 @@ static RawError* CompileFunctionHelper(const Function& function,
       Isolate::Current()->debugger()->NotifyCompilation(function);
     }
     if (FLAG_disassemble) {
-      OS::Print("Code for %sfunction '%s' {\n",
-                optimized ? "optimized " : "", function_fullname);
-      const Code& code = Code::Handle(function.CurrentCode());
-      const Instructions& instructions =
-          Instructions::Handle(code.instructions());
-      uword start = instructions.EntryPoint();
-      Disassembler::Disassemble(start, start + instructions.size());
-      OS::Print("}\n");
-      OS::Print("Pointer offsets for function: {\n");
-      for (intptr_t i = 0; i < code.pointer_offsets_length(); i++) {
-        const uword addr = code.GetPointerOffsetAt(i) + code.EntryPoint();
-        Object& obj = Object::Handle();
-        obj = *reinterpret_cast<RawObject**>(addr);
-        OS::Print(" %d : 0x%x '%s'\n",
-                  code.GetPointerOffsetAt(i), addr, obj.ToCString());
-      }
-      OS::Print("}\n");
-      OS::Print("PC Descriptors for function '%s' {\n", function_fullname);
-      OS::Print("(pc, kind, id, try-index, token-index)\n");
-      const PcDescriptors& descriptors =
-          PcDescriptors::Handle(code.pc_descriptors());
-      OS::Print("%s", descriptors.ToCString());
-      OS::Print("}\n");
-      OS::Print("Variable Descriptors for function '%s' {\n",
-                function_fullname);
-      const LocalVarDescriptors& var_descriptors =
-          LocalVarDescriptors::Handle(code.var_descriptors());
-      intptr_t var_desc_length =
-          var_descriptors.IsNull() ? 0 : var_descriptors.Length();
-      String& var_name = String::Handle();
-      for (intptr_t i = 0; i < var_desc_length; i++) {
-        var_name = var_descriptors.GetName(i);
-        intptr_t scope_id, begin_pos, end_pos;
-        var_descriptors.GetScopeInfo(i, &scope_id, &begin_pos, &end_pos);
-        intptr_t slot = var_descriptors.GetSlotIndex(i);
-        OS::Print("  var %s scope %ld (valid %d-%d) offset %ld\n",
-                  var_name.ToCString(), scope_id, begin_pos, end_pos, slot);
-      }
-      OS::Print("}\n");
-      OS::Print("Exception Handlers for function '%s' {\n", function_fullname);
-      const ExceptionHandlers& handlers =
-          ExceptionHandlers::Handle(code.exception_handlers());
-      OS::Print("%s", handlers.ToCString());
-      OS::Print("}\n");
+      DisassembleCode(function_fullname,
+                      Code::Handle(function.CurrentCode()));
     }
   } else {
     // We got an error during compilation.
@@ -317,6 +364,81 @@ RawError* Compiler::CompileOptimizedFunction(const Function& function) {
 }
 
 
+RawCode* Compiler::CompileOsrFunction(const Function& function,
+                                      intptr_t loop_index) {
+  Isolate* isolate = Isolate::Current();
+  Code& code = Code::Handle();
+  LongJump* base = isolate->long_jump_base();
+  LongJump jump;
+  isolate->set_long_jump_base(&jump);
+  if (setjmp(*jump.Set()) == 0) {
+    TIMERSCOPE(time_compilation);
+    ParsedFunction parsed_function(function);
+    const char* function_fullname = function.ToFullyQualifiedCString();
+    if (FLAG_trace_compiler) {
+      OS::Print("Compiling OSR function: '%s' @ loop %d\n",
+                function_fullname,
+                loop_index);
+    }
+    Parser::ParseFunction(&parsed_function);
+    parsed_function.AllocateVariables();
+
+    FlowGraphBuilder graph_builder(parsed_function, loop_index);
+    graph_builder.BuildGraph();
+    graph_builder.ComputeSSA();
+    FlowGraphInliner inliner(&graph_builder);
+    inliner.Inline();
+    FlowGraphOptimizer optimizer(&graph_builder);
+    optimizer.EliminateCommonSubexpressions();
+    optimizer.HoistLoopInvariants();
+    optimizer.EliminateBoundsChecks();
+    optimizer.UnboxDoubles();
+
+    Assembler assembler;
+    GrowableArray<BlockEntryInstr*> block_order;
+    intptr_t length = graph_builder.postorder_block_entries().length();
+    for (intptr_t i = length - 1; i >= 0; --i) {
+      block_order.Add(graph_builder.postorder_block_entries()[i]);
+    }
+    FlowGraphCompiler graph_compiler(&assembler,
+                                     parsed_function,
+                                     block_order,
+                                     true,  // Optimizing.
+                                     true);  // OSR.
+    graph_compiler.CompileGraph();
+    code = Code::FinalizeCode(function_fullname, &assembler);
+    code.set_is_optimized(true);
+    graph_compiler.FinalizePcDescriptors(code);
+    graph_compiler.FinalizeVarDescriptors(code);
+    graph_compiler.FinalizeExceptionHandlers(code);
+    graph_compiler.FinalizeInlinedFrames(code);
+    // The code is not installed in the function, but its frames are found
+    // by their return addresses and map back to the function.
+    code.set_function(function);
+    isolate->code_index_table()->AddCode(code);
+    if (FLAG_trace_compiler) {
+      OS::Print("--> '%s' OSR entry: 0x%x\n",
+                function_fullname,
+                code.EntryPoint());
+    }
+    if (FLAG_disassemble) {
+      DisassembleCode(function_fullname, code);
+    }
+  } else {
+    // We bailed out, keep running the unoptimized code.
+    const Error& bailout_error =
+        Error::Handle(isolate->object_store()->sticky_error());
+    isolate->object_store()->clear_sticky_error();
+    if (FLAG_trace_bailout) {
+      OS::Print("%s\n", bailout_error.ToErrorCString());
+    }
+    code = Code::null();
+  }
+  isolate->set_long_jump_base(base);
+  return code.raw();
+}
+
+
 RawError* Compiler::CompileAllFunctions(const Class& cls) {
   Error& error = Error::Handle();
   Array& functions = Array::Handle(cls.functions());
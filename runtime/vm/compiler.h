@@ -39,6 +39,15 @@ class Compiler : public AllStatic {
   // Returns Error::null() if there is no compilation error.
   static RawError* CompileOptimizedFunction(const Function& function);
 
+  // Generates optimized code for function which is entered at the header
+  // of the loop with the given index, for on-stack replacement of the
+  // unoptimized code running the loop.  The code is not installed in the
+  // function.
+  //
+  // Returns Code::null() if the function cannot be compiled this way.
+  static RawCode* CompileOsrFunction(const Function& function,
+                                     intptr_t loop_index);
+
   // Generates and executes code for a given code fragment, e.g. a
   // compile time constant expression. Returns the result returned
   // by the fragment.
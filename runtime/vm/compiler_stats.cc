@@ -32,6 +32,10 @@ intptr_t CompilerStats::num_token_checks = 0;
 intptr_t CompilerStats::num_tokens_rewind = 0;
 intptr_t CompilerStats::num_tokens_lookahead = 0;
 
+intptr_t CompilerStats::num_monomorphic_call_sites = 0;
+intptr_t CompilerStats::num_polymorphic_call_sites = 0;
+intptr_t CompilerStats::num_megamorphic_call_sites = 0;
+
 void CompilerStats::Print() {
   if (!FLAG_compiler_stats) {
     return;
@@ -63,6 +67,9 @@ void CompilerStats::Print() {
             code_allocated / 1024);
   OS::Print("Code density:       %ld tokens per KB\n",
             num_tokens_total * 1024 / code_allocated);
+  OS::Print("Monomorphic calls:  %ld\n", num_monomorphic_call_sites);
+  OS::Print("Polymorphic calls:  %ld\n", num_polymorphic_call_sites);
+  OS::Print("Megamorphic calls:  %ld\n", num_megamorphic_call_sites);
 }
 
 }  // namespace dart
@@ -26,6 +26,11 @@ class CompilerStats : AllStatic {
   static intptr_t num_tokens_rewind;
   static intptr_t num_tokens_lookahead;
 
+  // Instance calls by the state of their inline cache.
+  static intptr_t num_monomorphic_call_sites;
+  static intptr_t num_polymorphic_call_sites;
+  static intptr_t num_megamorphic_call_sites;
+
   static intptr_t src_length;        // Total number of characters in source.
   static intptr_t code_allocated;    // Bytes allocated for generated code.
   static Timer    parser_timer;      // Cumulative runtime of parser.
@@ -3,12 +3,16 @@
 // BSD-style license that can be found in the LICENSE file.
 
 #include "platform/assert.h"
+#include "vm/class_finalizer.h"
 #include "vm/compiler.h"
+#include "vm/dart_api_impl.h"
 #include "vm/object.h"
 #include "vm/unit_test.h"
 
 namespace dart {
 
+DECLARE_FLAG(int, optimization_counter_threshold);
+
 // Compiler only implemented on IA32 and X64 now.
 #if defined(TARGET_ARCH_IA32) || defined(TARGET_ARCH_X64)
 
@@ -60,4 +64,408 @@ TEST_CASE(CompileFunction) {
 
 #endif  // TARGET_ARCH_IA32 || TARGET_ARCH_X64
 
+
+// Only the x64 flow graph compiler allocates registers.
+#if defined(TARGET_ARCH_X64)
+
+TEST_CASE(CompileOptimizedLoop) {
+  const char* kScriptChars =
+      "sum(n) {\n"
+      "  var s = 0;\n"
+      "  var i = 0;\n"
+      "  while (i < n) {\n"
+      "    s = s + i * 3 - 1;\n"
+      "    i = i + 1;\n"
+      "  }\n"
+      "  return s;\n"
+      "}\n"
+      "main() {\n"
+      "  var result = 0;\n"
+      "  var i = 0;\n"
+      "  while (i < 20) {\n"
+      "    result = result + sum(100);\n"
+      "    i = i + 1;\n"
+      "  }\n"
+      "  return result;\n"
+      "}\n";
+  const intptr_t saved_threshold = FLAG_optimization_counter_threshold;
+  FLAG_optimization_counter_threshold = 5;
+  Dart_Handle lib = TestCase::LoadTestScript(kScriptChars, NULL);
+  Dart_Handle result = Dart_InvokeStatic(lib,
+                                         Dart_NewString(""),
+                                         Dart_NewString("main"),
+                                         0,
+                                         NULL);
+  FLAG_optimization_counter_threshold = saved_threshold;
+  EXPECT_VALID(result);
+  int64_t value = 0;
+  EXPECT_VALID(Dart_IntegerToInt64(result, &value));
+  // sum(100) = 3 * 4950 - 100.
+  EXPECT_EQ(20 * 14750, value);
+
+  Library& library = Library::Handle();
+  library ^= Api::UnwrapHandle(lib);
+  const Function& sum = Function::Handle(
+      library.LookupLocalFunction(String::Handle(String::NewSymbol("sum"))));
+  EXPECT(!sum.IsNull());
+  EXPECT(sum.HasOptimizedCode());
+}
+
+
+TEST_CASE(CompileOsrLoop) {
+  // The loop is entered once and continues in optimized code, which reads
+  // the copied parameter and the locals from the unoptimized frame.
+  const char* kScriptChars =
+      "loop(n, [k = 2]) {\n"
+      "  var s = 0;\n"
+      "  for (var i = 0; i < n; i++) {\n"
+      "    var j = 0;\n"
+      "    do {\n"
+      "      s = s + k * j;\n"
+      "      j = j + 1;\n"
+      "    } while (j < 3);\n"
+      "  }\n"
+      "  return s;\n"
+      "}\n"
+      "main() {\n"
+      "  return loop(1000);\n"
+      "}\n";
+  const intptr_t saved_threshold = FLAG_optimization_counter_threshold;
+  FLAG_optimization_counter_threshold = 100;
+  Dart_Handle lib = TestCase::LoadTestScript(kScriptChars, NULL);
+  Dart_Handle result = Dart_InvokeStatic(lib,
+                                         Dart_NewString(""),
+                                         Dart_NewString("main"),
+                                         0,
+                                         NULL);
+  FLAG_optimization_counter_threshold = saved_threshold;
+  EXPECT_VALID(result);
+  int64_t value = 0;
+  EXPECT_VALID(Dart_IntegerToInt64(result, &value));
+  EXPECT_EQ(1000 * 2 * (0 + 1 + 2), value);
+
+  // Reaching the threshold in the loop also optimizes the function for its
+  // next invocation.
+  Library& library = Library::Handle();
+  library ^= Api::UnwrapHandle(lib);
+  const Function& loop = Function::Handle(
+      library.LookupLocalFunction(String::Handle(String::NewSymbol("loop"))));
+  EXPECT(!loop.IsNull());
+  EXPECT(loop.HasOptimizedCode());
+}
+
+
+TEST_CASE(CompileInlinedCalls) {
+  // The getters and the operator are inlined for the two receiver classes
+  // seen before optimization; the third class runs the instance calls.
+  const char* kScriptChars =
+      "class Point {\n"
+      "  Point(this.x, this.y);\n"
+      "  var x;\n"
+      "  var y;\n"
+      "  get sum() { return x + y; }\n"
+      "  operator +(other) { return new Point(x + other.x, y + other.y); }\n"
+      "}\n"
+      "class Pair {\n"
+      "  Pair(this.x, this.y);\n"
+      "  var x;\n"
+      "  var y;\n"
+      "  get sum() { return x > y ? x - y : y - x; }\n"
+      "  operator +(other) { return new Pair(x + other.x, y); }\n"
+      "}\n"
+      "class Triple {\n"
+      "  Triple(this.x);\n"
+      "  var x;\n"
+      "  get sum() { return 3 * x; }\n"
+      "  operator +(other) { return this; }\n"
+      "}\n"
+      "twice(v) { return v + v; }\n"
+      "total(a, b) {\n"
+      "  var s = 0;\n"
+      "  for (var i = 0; i < 10; i++) {\n"
+      "    var p = (i % 2 == 0) ? a : b;\n"
+      "    s = s + twice((p + p).sum);\n"
+      "  }\n"
+      "  return s;\n"
+      "}\n"
+      "main() {\n"
+      "  var s = 0;\n"
+      "  for (var i = 0; i < 20; i++) {\n"
+      "    s = s + total(new Point(1, 2), new Pair(i, 1));\n"
+      "  }\n"
+      "  return s + total(new Triple(1), new Triple(2));\n"
+      "}\n";
+  const intptr_t saved_threshold = FLAG_optimization_counter_threshold;
+  FLAG_optimization_counter_threshold = 5;
+  Dart_Handle lib = TestCase::LoadTestScript(kScriptChars, NULL);
+  Dart_Handle result = Dart_InvokeStatic(lib,
+                                         Dart_NewString(""),
+                                         Dart_NewString("main"),
+                                         0,
+                                         NULL);
+  FLAG_optimization_counter_threshold = saved_threshold;
+  EXPECT_VALID(result);
+  int64_t value = 0;
+  EXPECT_VALID(Dart_IntegerToInt64(result, &value));
+  // Point: 20 * 5 * 2 * 6.  Pair: 5 * 2 * (1 + 1 + 3 + ... + 37).
+  // Triple: 5 * 2 * (3 + 6).
+  EXPECT_EQ(1200 + 3620 + 90, value);
+
+  Library& library = Library::Handle();
+  library ^= Api::UnwrapHandle(lib);
+  const Function& total = Function::Handle(
+      library.LookupLocalFunction(String::Handle(String::NewSymbol("total"))));
+  EXPECT(!total.IsNull());
+  EXPECT(total.HasOptimizedCode());
+}
+
+
+TEST_CASE(CompileInlinedCallsKeepFrames) {
+  // The getter is inlined into the optimized function, and its frame is
+  // rebuilt in the stack trace of the exception thrown by its operator.
+  const char* kScriptChars =
+      "class A {\n"
+      "  A(this.x);\n"
+      "  var x;\n"
+      "  get twice() { return x + x; }\n"
+      "}\n"
+      "total(a) { return a.twice; }\n"
+      "main() {\n"
+      "  for (var i = 0; i < 20; i++) {\n"
+      "    total(new A(i));\n"
+      "  }\n"
+      "  return total(new A(null));\n"
+      "}\n";
+  const intptr_t saved_threshold = FLAG_optimization_counter_threshold;
+  FLAG_optimization_counter_threshold = 5;
+  Dart_Handle lib = TestCase::LoadTestScript(kScriptChars, NULL);
+  Dart_Handle result = Dart_InvokeStatic(lib,
+                                         Dart_NewString(""),
+                                         Dart_NewString("main"),
+                                         0,
+                                         NULL);
+  FLAG_optimization_counter_threshold = saved_threshold;
+  EXPECT(Dart_IsError(result));
+  EXPECT_SUBSTRING("A.get:twice", Dart_GetError(result));
+  EXPECT_SUBSTRING("total", Dart_GetError(result));
+
+  Library& library = Library::Handle();
+  library ^= Api::UnwrapHandle(lib);
+  const Function& total = Function::Handle(
+      library.LookupLocalFunction(String::Handle(String::NewSymbol("total"))));
+  EXPECT(!total.IsNull());
+  EXPECT(total.HasOptimizedCode());
+  const Code& code = Code::Handle(total.CurrentCode());
+  EXPECT(!Array::Handle(code.inlined_frames()).IsNull());
+}
+
+
+TEST_CASE(CompileUnboxedDoubles) {
+  // The sum stays unboxed in the loop, the products of the boxed parameters
+  // are computed inline, and the last call passes a Smi operand.
+  const char* kScriptChars =
+      "dot(x, y, n) {\n"
+      "  var s = 0.0;\n"
+      "  var t = 1.0;\n"
+      "  for (var i = 0; i < n; i++) {\n"
+      "    s = s + x * y;\n"
+      "    t = t * 0.5 + s / 4;\n"
+      "    if (i % 2 == 0) {\n"
+      "      var u = s;\n"
+      "      s = t - 1;\n"
+      "      t = u;\n"
+      "    }\n"
+      "  }\n"
+      "  return s - t;\n"
+      "}\n"
+      "main() {\n"
+      "  var r = 0.0;\n"
+      "  for (var i = 0; i < 20; i++) {\n"
+      "    r = r + dot(1.5, 2.0, 10);\n"
+      "  }\n"
+      "  return r + dot(3, 2, 10);\n"
+      "}\n";
+  const intptr_t saved_threshold = FLAG_optimization_counter_threshold;
+  FLAG_optimization_counter_threshold = 5;
+  Dart_Handle lib = TestCase::LoadTestScript(kScriptChars, NULL);
+  Dart_Handle result = Dart_InvokeStatic(lib,
+                                         Dart_NewString(""),
+                                         Dart_NewString("main"),
+                                         0,
+                                         NULL);
+  FLAG_optimization_counter_threshold = saved_threshold;
+  EXPECT_VALID(result);
+  double value = 0.0;
+  EXPECT_VALID(Dart_DoubleValue(result, &value));
+  // Computed in the unoptimized code.
+  double expected = 0.0;
+  for (intptr_t k = 0; k < 21; k++) {
+    const double p = (k < 20) ? 1.5 * 2.0 : 3.0 * 2.0;
+    double s = 0.0;
+    double t = 1.0;
+    for (intptr_t i = 0; i < 10; i++) {
+      s = s + p;
+      t = t * 0.5 + s / 4;
+      if (i % 2 == 0) {
+        const double u = s;
+        s = t - 1;
+        t = u;
+      }
+    }
+    expected += s - t;
+  }
+  EXPECT_EQ(expected, value);
+
+  Library& library = Library::Handle();
+  library ^= Api::UnwrapHandle(lib);
+  const Function& dot = Function::Handle(
+      library.LookupLocalFunction(String::Handle(String::NewSymbol("dot"))));
+  EXPECT(!dot.IsNull());
+  EXPECT(dot.HasOptimizedCode());
+}
+
+
+TEST_CASE(CompileUniqueImplementations) {
+  // The getter and the method have a single implementation until the
+  // subclass is loaded, which discards the optimized code of 'sum'.
+  const char* kScriptChars =
+      "class A {\n"
+      "  A(this.x);\n"
+      "  var x;\n"
+      "  get bias() { return x + 1; }\n"
+      "  step(i) {\n"
+      "    var s = 0;\n"
+      "    for (var j = 0; j < i; j++) {\n"
+      "      s = s + j * x;\n"
+      "    }\n"
+      "    return s;\n"
+      "  }\n"
+      "  sum(n) {\n"
+      "    var s = 0;\n"
+      "    for (var i = 0; i < n; i++) {\n"
+      "      s = s + bias + step(i);\n"
+      "    }\n"
+      "    return s;\n"
+      "  }\n"
+      "}\n"
+      "main() {\n"
+      "  var a = new A(2);\n"
+      "  var s = 0;\n"
+      "  for (var i = 0; i < 20; i++) {\n"
+      "    s = s + a.sum(10);\n"
+      "  }\n"
+      "  return s;\n"
+      "}\n";
+  const char* kSubclassChars =
+      "class B extends A {\n"
+      "  B(x) : super(x);\n"
+      "  get bias() { return 100; }\n"
+      "}\n"
+      "mainB() {\n"
+      "  return new B(2).sum(10);\n"
+      "}\n";
+  const intptr_t saved_threshold = FLAG_optimization_counter_threshold;
+  FLAG_optimization_counter_threshold = 5;
+  Dart_Handle lib = TestCase::LoadTestScript(kScriptChars, NULL);
+  Dart_Handle result = Dart_InvokeStatic(lib,
+                                         Dart_NewString(""),
+                                         Dart_NewString("main"),
+                                         0,
+                                         NULL);
+  FLAG_optimization_counter_threshold = saved_threshold;
+  EXPECT_VALID(result);
+  int64_t value = 0;
+  EXPECT_VALID(Dart_IntegerToInt64(result, &value));
+  // sum(10) = 10 * 3 + 2 * (0 + 0 + 1 + 3 + ... + 36).
+  EXPECT_EQ(20 * (30 + 2 * 120), value);
+
+  Library& library = Library::Handle();
+  library ^= Api::UnwrapHandle(lib);
+  const Class& cls = Class::Handle(
+      library.LookupClass(String::Handle(String::NewSymbol("A"))));
+  EXPECT(!cls.IsNull());
+  const Function& sum = Function::Handle(
+      cls.LookupDynamicFunction(String::Handle(String::NewSymbol("sum"))));
+  EXPECT(!sum.IsNull());
+  EXPECT(sum.HasOptimizedCode());
+  const String& getter_name =
+      String::Handle(String::NewSymbol("get:bias"));
+  EXPECT(!Function::Handle(
+      ClassFinalizer::UniqueImplementation(getter_name)).IsNull());
+
+  EXPECT_VALID(Dart_LoadSource(lib,
+                               Dart_NewString("test-lib-subclass"),
+                               Dart_NewString(kSubclassChars)));
+  result = Dart_InvokeStatic(lib,
+                             Dart_NewString(""),
+                             Dart_NewString("mainB"),
+                             0,
+                             NULL);
+  EXPECT_VALID(result);
+  EXPECT_VALID(Dart_IntegerToInt64(result, &value));
+  EXPECT_EQ(10 * 100 + 2 * 120, value);
+  EXPECT(Function::Handle(
+      ClassFinalizer::UniqueImplementation(getter_name)).IsNull());
+  EXPECT(!sum.HasOptimizedCode());
+}
+
+
+TEST_CASE(CompileArrayLoops) {
+  // The loads from the arrays in 'sum' are in bounds, the load in 'at'
+  // falls back to the index operator, which throws.
+  const char* kScriptChars =
+      "sum(a) {\n"
+      "  var s = 0;\n"
+      "  for (var i = 0; i < a.length; i++) {\n"
+      "    s = s + a[i];\n"
+      "  }\n"
+      "  return s;\n"
+      "}\n"
+      "at(a, i) {\n"
+      "  return a[i];\n"
+      "}\n"
+      "main() {\n"
+      "  var a = new List(10);\n"
+      "  for (var i = 0; i < 10; i++) {\n"
+      "    a[i] = i;\n"
+      "  }\n"
+      "  var b = const [1, 2, 3];\n"
+      "  var s = 0;\n"
+      "  for (var i = 0; i < 20; i++) {\n"
+      "    s = s + sum(a) + sum(b) + at(a, i % 10);\n"
+      "  }\n"
+      "  try {\n"
+      "    s = s + at(a, 10);\n"
+      "  } catch (IndexOutOfRangeException e) {\n"
+      "    s = s + 1000;\n"
+      "  }\n"
+      "  return s;\n"
+      "}\n";
+  const intptr_t saved_threshold = FLAG_optimization_counter_threshold;
+  FLAG_optimization_counter_threshold = 5;
+  Dart_Handle lib = TestCase::LoadTestScript(kScriptChars, NULL);
+  Dart_Handle result = Dart_InvokeStatic(lib,
+                                         Dart_NewString(""),
+                                         Dart_NewString("main"),
+                                         0,
+                                         NULL);
+  FLAG_optimization_counter_threshold = saved_threshold;
+  EXPECT_VALID(result);
+  int64_t value = 0;
+  EXPECT_VALID(Dart_IntegerToInt64(result, &value));
+  EXPECT_EQ(20 * (45 + 6) + 2 * 45 + 1000, value);
+
+  Library& library = Library::Handle();
+  library ^= Api::UnwrapHandle(lib);
+  const char* kNames[] = { "sum", "at" };
+  for (intptr_t i = 0; i < 2; i++) {
+    const Function& function = Function::Handle(library.LookupLocalFunction(
+        String::Handle(String::NewSymbol(kNames[i]))));
+    EXPECT(!function.IsNull());
+    EXPECT(function.HasOptimizedCode());
+  }
+}
+
+#endif  // TARGET_ARCH_X64
+
 }  // namespace dart
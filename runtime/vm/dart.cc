@@ -16,14 +16,20 @@
 #include "vm/port.h"
 #include "vm/snapshot.h"
 #include "vm/stub_code.h"
+#include "vm/thread_pool.h"
 #include "vm/virtual_memory.h"
 #include "vm/zone.h"
 
 namespace dart {
 
+DEFINE_FLAG(int, message_handler_workers, 0,
+            "Maximum number of threads running the spawned isolates and the "
+            "native ports (0 means no limit).");
 DECLARE_FLAG(bool, trace_isolates);
 
 Isolate* Dart::vm_isolate_ = NULL;
+ThreadPool* Dart::thread_pool_ = NULL;
+ThreadPool* Dart::message_handler_pool_ = NULL;
 DebugInfo* Dart::pprof_symbol_generator_ = NULL;
 
 bool Dart::InitOnce(Dart_IsolateCreateCallback create,
@@ -38,6 +44,14 @@ bool Dart::InitOnce(Dart_IsolateCreateCallback create,
   PortMap::InitOnce();
   FreeListElement::InitOnce();
   Api::InitOnce();
+  // Create the thread pool shared by the VM for its helper tasks.
+  ASSERT(thread_pool_ == NULL);
+  thread_pool_ = new ThreadPool();
+  // Create the thread pool running the spawned isolates and the native
+  // ports.  It is separate from the helper pool, whose tasks must not wait
+  // behind busy message handlers.
+  ASSERT(message_handler_pool_ == NULL);
+  message_handler_pool_ = new ThreadPool(FLAG_message_handler_workers);
   // Create the VM isolate and finish the VM initialization.
   {
     ASSERT(vm_isolate_ == NULL);
@@ -58,6 +72,16 @@ bool Dart::InitOnce(Dart_IsolateCreateCallback create,
 }
 
 
+void Dart::Cleanup() {
+  // Stop the workers of the thread pools, all the isolates have been shut
+  // down and no message is posted anymore.
+  delete message_handler_pool_;
+  message_handler_pool_ = NULL;
+  delete thread_pool_;
+  thread_pool_ = NULL;
+}
+
+
 Isolate* Dart::CreateIsolate(const char* name_prefix) {
   // Create a new isolate.
   Isolate* isolate = Isolate::Init(name_prefix);
@@ -81,6 +105,8 @@ RawError* Dart::InitializeIsolate(const uint8_t* snapshot_buffer, void* data) {
     if (!error.IsNull()) {
       return error.raw();
     }
+    StubCode::Init(isolate);
+    CodeIndexTable::Init(isolate);
   } else {
     // Initialize from snapshot (this should replicate the functionality
     // of Object::Init(..) in a regular isolate creation path.
@@ -91,10 +117,13 @@ RawError* Dart::InitializeIsolate(const uint8_t* snapshot_buffer, void* data) {
     }
     SnapshotReader reader(snapshot, isolate);
     reader.ReadFullSnapshot();
+    // The code read from the snapshot calls the isolate stubs and is looked
+    // up by pc.
+    StubCode::Init(isolate);
+    CodeIndexTable::Init(isolate);
+    reader.InstallCode();
   }
 
-  StubCode::Init(isolate);
-  CodeIndexTable::Init(isolate);
   isolate->set_init_callback_data(data);
   return Error::null();
 }
@@ -14,17 +14,21 @@ namespace dart {
 class DebugInfo;
 class Isolate;
 class RawError;
+class ThreadPool;
 
 class Dart : public AllStatic {
  public:
   static bool InitOnce(Dart_IsolateCreateCallback create,
                        Dart_IsolateInterruptCallback interrupt);
+  static void Cleanup();
 
   static Isolate* CreateIsolate(const char* name_prefix);
   static RawError* InitializeIsolate(const uint8_t* snapshot, void* data);
   static void ShutdownIsolate();
 
   static Isolate* vm_isolate() { return vm_isolate_; }
+  static ThreadPool* thread_pool() { return thread_pool_; }
+  static ThreadPool* message_handler_pool() { return message_handler_pool_; }
 
   static void set_pprof_symbol_generator(DebugInfo* value) {
     pprof_symbol_generator_ = value;
@@ -33,6 +37,8 @@ class Dart : public AllStatic {
 
  private:
   static Isolate* vm_isolate_;
+  static ThreadPool* thread_pool_;
+  static ThreadPool* message_handler_pool_;
   static DebugInfo* pprof_symbol_generator_;
 };
 
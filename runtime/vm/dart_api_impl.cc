@@ -607,6 +607,27 @@ DART_EXPORT Dart_Handle Dart_RemoveGcEpilogueCallback(
 }
 
 
+DART_EXPORT Dart_Handle Dart_SetGcEventCallback(
+    Dart_GcEventCallback callback) {
+  Isolate* isolate = Isolate::Current();
+  CHECK_ISOLATE(isolate);
+  isolate->heap()->tracer()->set_callback(callback);
+  return Api::Success();
+}
+
+
+DART_EXPORT Dart_Handle Dart_GetGcEventsAsJSON(const char** json) {
+  Isolate* isolate = Isolate::Current();
+  CHECK_ISOLATE_SCOPE(isolate);
+  if (json == NULL) {
+    return Api::NewError("%s expects argument 'json' to be non-null.",
+                         CURRENT_FUNC);
+  }
+  *json = isolate->heap()->tracer()->PrintJSON(&Api::Allocate);
+  return Api::Success();
+}
+
+
 // --- Initialization and Globals ---
 
 
@@ -615,6 +636,10 @@ DART_EXPORT bool Dart_Initialize(Dart_IsolateCreateCallback create,
   return Dart::InitOnce(create, interrupt);
 }
 
+DART_EXPORT void Dart_Cleanup() {
+  Dart::Cleanup();
+}
+
 DART_EXPORT bool Dart_SetVMFlags(int argc, const char** argv) {
   return Flags::ProcessCommandLineFlags(argc, argv);
 }
@@ -685,18 +710,18 @@ static uint8_t* ApiAllocator(uint8_t* ptr,
 }
 
 
-DART_EXPORT Dart_Handle Dart_CreateSnapshot(uint8_t** buffer,
-                                            intptr_t* size) {
-  Isolate* isolate = Isolate::Current();
-  DARTSCOPE(isolate);
-  TIMERSCOPE(time_creating_snapshot);
+static Dart_Handle CreateFullSnapshot(Isolate* isolate,
+                                      const char* current_func,
+                                      Snapshot::Kind kind,
+                                      uint8_t** buffer,
+                                      intptr_t* size) {
   if (buffer == NULL) {
     return Api::NewError("%s expects argument 'buffer' to be non-null.",
-                         CURRENT_FUNC);
+                         current_func);
   }
   if (size == NULL) {
     return Api::NewError("%s expects argument 'size' to be non-null.",
-                         CURRENT_FUNC);
+                         current_func);
   }
   const char* msg = CheckIsolateState(isolate,
                                       ClassFinalizer::kGeneratingSnapshot);
@@ -705,13 +730,33 @@ DART_EXPORT Dart_Handle Dart_CreateSnapshot(uint8_t** buffer,
   }
   // Since this is only a snapshot the root library should not be set.
   isolate->object_store()->set_root_library(Library::Handle());
-  SnapshotWriter writer(Snapshot::kFull, buffer, ApiAllocator);
+  SnapshotWriter writer(kind, buffer, ApiAllocator);
   writer.WriteFullSnapshot();
   *size = writer.BytesWritten();
   return Api::Success();
 }
 
 
+DART_EXPORT Dart_Handle Dart_CreateSnapshot(uint8_t** buffer,
+                                            intptr_t* size) {
+  Isolate* isolate = Isolate::Current();
+  DARTSCOPE(isolate);
+  TIMERSCOPE(time_creating_snapshot);
+  return CreateFullSnapshot(isolate, CURRENT_FUNC, Snapshot::kFull,
+                            buffer, size);
+}
+
+
+DART_EXPORT Dart_Handle Dart_CreateSnapshotWithCode(uint8_t** buffer,
+                                                    intptr_t* size) {
+  Isolate* isolate = Isolate::Current();
+  DARTSCOPE(isolate);
+  TIMERSCOPE(time_creating_snapshot);
+  return CreateFullSnapshot(isolate, CURRENT_FUNC, Snapshot::kFullWithCode,
+                            buffer, size);
+}
+
+
 DART_EXPORT Dart_Handle Dart_CreateScriptSnapshot(uint8_t** buffer,
                                                   intptr_t* size) {
   Isolate* isolate = Isolate::Current();
@@ -774,56 +819,39 @@ DART_EXPORT Dart_Handle Dart_RunLoop() {
 }
 
 
-static RawInstance* DeserializeMessage(void* data) {
-  // Create a snapshot object using the buffer.
-  const Snapshot* snapshot = Snapshot::SetupFromBuffer(data);
-  ASSERT(snapshot->IsMessageSnapshot());
-
-  // Read object back from the snapshot.
-  SnapshotReader reader(snapshot, Isolate::Current());
-  Instance& instance = Instance::Handle();
-  instance ^= reader.ReadObject();
-  return instance.raw();
+DART_EXPORT Dart_Handle Dart_HandleMessage() {
+  Isolate* isolate = Isolate::Current();
+  DARTSCOPE(isolate);
+  // Process all OOB messages and at most one normal message.
+  const Error& error = Error::Handle(isolate->HandleMessages(1, 0));
+  if (!error.IsNull()) {
+    return Api::NewLocalHandle(error);
+  }
+  return Api::Success();
 }
 
 
-DART_EXPORT Dart_Handle Dart_HandleMessage() {
+DART_EXPORT Dart_Handle Dart_HandleMessages(intptr_t max_messages,
+                                            int64_t max_micros) {
   Isolate* isolate = Isolate::Current();
-  // Process all OOB messages and at most one normal message.
-  Message* message = NULL;
-  Message::Priority priority = Message::kNormalPriority;
-  do {
-    DARTSCOPE(isolate);
-    // TODO(turnidge): This code is duplicated elsewhere.  Consolidate.
-    message = isolate->message_handler()->queue()->DequeueNoWait();
-    if (message == NULL) {
-      break;
-    }
-    const Instance& msg =
-        Instance::Handle(DeserializeMessage(message->data()));
-    priority = message->priority();
-    if (priority == Message::kOOBPriority) {
-      // For now the only OOB messages are Mirrors messages.
-      const Object& result = Object::Handle(
-          DartLibraryCalls::HandleMirrorsMessage(
-              message->dest_port(), message->reply_port(), msg));
-      delete message;
-      if (result.IsError()) {
-        // TODO(turnidge): Propagating the error is probably wrong here.
-        return Api::NewLocalHandle(result);
-      }
-      ASSERT(result.IsNull());
-    } else {
-      const Object& result = Object::Handle(
-          DartLibraryCalls::HandleMessage(
-              message->dest_port(), message->reply_port(), msg));
-      delete message;
-      if (result.IsError()) {
-        return Api::NewLocalHandle(result);
-      }
-      ASSERT(result.IsNull());
-    }
-  } while (priority >= Message::kOOBPriority);
+  DARTSCOPE(isolate);
+  if (max_messages < 0) {
+    return Api::NewError("%s expects argument 'max_messages' to be "
+                         "non-negative.", CURRENT_FUNC);
+  }
+  if (max_micros < 0) {
+    return Api::NewError("%s expects argument 'max_micros' to be "
+                         "non-negative.", CURRENT_FUNC);
+  }
+  if ((max_messages == 0) && (max_micros == 0)) {
+    return Api::NewError("%s expects 'max_messages' or 'max_micros' to be "
+                         "non-zero.", CURRENT_FUNC);
+  }
+  const Error& error =
+      Error::Handle(isolate->HandleMessages(max_messages, max_micros));
+  if (!error.IsNull()) {
+    return Api::NewLocalHandle(error);
+  }
   return Api::Success();
 }
 
@@ -867,17 +895,36 @@ DART_EXPORT bool Dart_PostCObject(Dart_Port port_id, Dart_CObject* message) {
 }
 
 
+static bool PostObject(Dart_Port port_id,
+                       const Object& object,
+                       bool transfer_byte_arrays) {
+  uint8_t* data = NULL;
+  SnapshotWriter writer(Snapshot::kMessage, &data, &allocator);
+  writer.AllowTransfers(transfer_byte_arrays);
+  writer.WriteObject(object.raw());
+  writer.FinalizeBuffer();
+  Message* message = new Message(
+      port_id, Message::kIllegalPort, data, Message::kNormalPriority);
+  writer.AttachTransfers(message);
+  return PortMap::PostMessage(message);
+}
+
+
 DART_EXPORT bool Dart_Post(Dart_Port port_id, Dart_Handle handle) {
   Isolate* isolate = Isolate::Current();
   CHECK_ISOLATE(isolate);
   DARTSCOPE_NOCHECKS(isolate);
   const Object& object = Object::Handle(Api::UnwrapHandle(handle));
-  uint8_t* data = NULL;
-  SnapshotWriter writer(Snapshot::kMessage, &data, &allocator);
-  writer.WriteObject(object.raw());
-  writer.FinalizeBuffer();
-  return PortMap::PostMessage(new Message(
-      port_id, Message::kIllegalPort, data, Message::kNormalPriority));
+  return PostObject(port_id, object, false);
+}
+
+
+DART_EXPORT bool Dart_PostTransfer(Dart_Port port_id, Dart_Handle handle) {
+  Isolate* isolate = Isolate::Current();
+  CHECK_ISOLATE(isolate);
+  DARTSCOPE_NOCHECKS(isolate);
+  const Object& object = Object::Handle(Api::UnwrapHandle(handle));
+  return PostObject(port_id, object, true);
 }
 
 
@@ -897,7 +944,7 @@ DART_EXPORT Dart_Port Dart_NewNativePort(const char* name,
 
   NativeMessageHandler* nmh = new NativeMessageHandler(name, handler);
   Dart_Port port_id = PortMap::CreatePort(nmh);
-  nmh->StartWorker();
+  nmh->Start(handle_concurrently);
   return port_id;
 }
 
@@ -3042,6 +3089,8 @@ DART_EXPORT Dart_Handle Dart_LoadScriptFromSnapshot(const uint8_t* buffer) {
   }
   library ^= tmp.raw();
   isolate->object_store()->set_root_library(library);
+  // The classes of the script are read finalized.
+  ClassFinalizer::AddImplementationsOfLibraries();
   return Api::NewLocalHandle(library);
 }
 
@@ -1953,6 +1953,39 @@ TEST_CASE(MultipleGarbageCollectionCallbacks) {
   EXPECT_EQ(7, global_epilogue_callback_status);
 }
 
+
+static Dart_GcKind global_gc_event_kind;
+static int global_gc_event_count;
+
+
+static void GcEventCallback(const Dart_GcEvent* event) {
+  global_gc_event_kind = event->kind;
+  global_gc_event_count++;
+}
+
+
+TEST_CASE(GarbageCollectionEvents) {
+  EXPECT_VALID(Dart_SetGcEventCallback(&GcEventCallback));
+  global_gc_event_count = 0;
+  Isolate::Current()->heap()->CollectGarbage(Heap::kNew);
+  EXPECT_EQ(1, global_gc_event_count);
+  EXPECT_EQ(kGcScavenge, global_gc_event_kind);
+  Isolate::Current()->heap()->CollectGarbage(Heap::kOld);
+  EXPECT_EQ(2, global_gc_event_count);
+  EXPECT(global_gc_event_kind != kGcScavenge);
+
+  // No events are passed on once the callback is removed.
+  EXPECT_VALID(Dart_SetGcEventCallback(NULL));
+  Isolate::Current()->heap()->CollectGarbage(Heap::kNew);
+  EXPECT_EQ(2, global_gc_event_count);
+
+  const char* json = NULL;
+  EXPECT_VALID(Dart_GetGcEventsAsJSON(&json));
+  EXPECT(strstr(json, "{\"events\":[") == json);
+  EXPECT(strstr(json, "\"kind\":\"scavenge\",\"reason\":\"explicit\"") != NULL);
+  EXPECT(Dart_IsError(Dart_GetGcEventsAsJSON(NULL)));
+}
+
 #endif
 
 
@@ -4485,6 +4518,76 @@ UNIT_TEST_CASE(NewNativePort) {
 }
 
 
+static void PostIntMessage(Dart_Port port_id, int32_t value) {
+  Dart_CObject message;
+  message.type = Dart_CObject::kInt32;
+  message.value.as_int32 = value;
+  EXPECT(Dart_PostCObject(port_id, &message));
+}
+
+
+static int64_t GetReceived(Dart_Handle lib) {
+  Dart_Handle result = Dart_InvokeStatic(lib,
+                                         Dart_NewString(""),
+                                         Dart_NewString("getReceived"),
+                                         0,
+                                         NULL);
+  EXPECT_VALID(result);
+  int64_t value = 0;
+  EXPECT_VALID(Dart_IntegerToInt64(result, &value));
+  return value;
+}
+
+
+TEST_CASE(HandleMessages) {
+  const char* kScriptChars =
+      "#import('dart:isolate');\n"
+      "var received = 0;\n"
+      "void receiveMessages() {\n"
+      "  port.receive((message, replyTo) {\n"
+      "    received += message;\n"
+      "  });\n"
+      "}\n"
+      "getReceived() => received;\n";
+  Dart_Handle lib = TestCase::LoadTestScript(kScriptChars, NULL);
+  Dart_Handle result = Dart_InvokeStatic(lib,
+                                         Dart_NewString(""),
+                                         Dart_NewString("receiveMessages"),
+                                         0,
+                                         NULL);
+  EXPECT_VALID(result);
+  Dart_Port port_id = Dart_GetMainPortId();
+  for (int i = 1; i <= 10; i++) {
+    PostIntMessage(port_id, i);
+  }
+
+  // Handle a batch of three messages.
+  EXPECT_VALID(Dart_HandleMessages(3, 0));
+  EXPECT_EQ(1 + 2 + 3, GetReceived(lib));
+
+  // Handle a single message.
+  EXPECT_VALID(Dart_HandleMessage());
+  EXPECT_EQ(1 + 2 + 3 + 4, GetReceived(lib));
+
+  // Handle the remaining messages, the limit is larger than needed.
+  EXPECT_VALID(Dart_HandleMessages(100, 0));
+  EXPECT_EQ(55, GetReceived(lib));
+
+  // A time budget handles at least one message.
+  PostIntMessage(port_id, 100);
+  EXPECT_VALID(Dart_HandleMessages(0, 1));
+  EXPECT_EQ(155, GetReceived(lib));
+
+  result = Dart_HandleMessages(-1, 0);
+  EXPECT(Dart_IsError(result));
+  result = Dart_HandleMessages(0, -1);
+  EXPECT(Dart_IsError(result));
+  // At least one of the limits has to be set.
+  result = Dart_HandleMessages(0, 0);
+  EXPECT(Dart_IsError(result));
+}
+
+
 static bool RunLoopTestCallback(const char* name_prefix,
                                 void* data, char** error) {
   const char* kScriptChars =
@@ -4511,6 +4614,31 @@ static bool RunLoopTestCallback(const char* name_prefix,
       "      if (exc_parent) throw new Exception('MakeParentExit');\n"
       "    });\n"
       "  });\n"
+      "}\n"
+      "\n"
+      "void replyPlusOne() {\n"
+      "  port.receive((message, replyTo) {\n"
+      "    replyTo.send(message + 1);\n"
+      "    port.close();\n"
+      "  });\n"
+      "}\n"
+      "\n"
+      "void spawnMany(count) {\n"
+      "  var sum = 0;\n"
+      "  var replies = 0;\n"
+      "  var reply = new ReceivePort();\n"
+      "  reply.receive((message, replyTo) {\n"
+      "    sum += message;\n"
+      "    if (++replies == count) {\n"
+      "      reply.close();\n"
+      "      if (sum != count * (count + 1) ~/ 2) {\n"
+      "        throw new Exception('ShouldNotHappen');\n"
+      "      }\n"
+      "    }\n"
+      "  });\n"
+      "  for (var i = 0; i < count; i++) {\n"
+      "    spawnFunction(replyPlusOne).send(i, reply.toSendPort());\n"
+      "  }\n"
       "}\n";
 
   if (Dart_CurrentIsolate() != NULL) {
@@ -4584,6 +4712,35 @@ UNIT_TEST_CASE(RunLoop_ExceptionParent) {
 }
 
 
+// The spawned isolates run on the workers of the isolate thread pool.
+UNIT_TEST_CASE(RunLoop_SpawnFunctions) {
+  Dart_IsolateCreateCallback saved = Isolate::CreateCallback();
+  Isolate::SetCreateCallback(RunLoopTestCallback);
+  RunLoopTestCallback(NULL, NULL, NULL);
+
+  Dart_EnterScope();
+  Dart_Handle lib = Dart_LookupLibrary(Dart_NewString(TestCase::url()));
+  EXPECT_VALID(lib);
+
+  const int kIsolateCount = 50;
+  Dart_Handle args[1];
+  args[0] = Dart_NewInteger(kIsolateCount);
+  Dart_Handle result = Dart_InvokeStatic(lib,
+                                         Dart_NewString(""),
+                                         Dart_NewString("spawnMany"),
+                                         1,
+                                         args);
+  EXPECT_VALID(result);
+  result = Dart_RunLoop();
+  EXPECT_VALID(result);
+
+  Dart_ExitScope();
+  Dart_ShutdownIsolate();
+
+  Isolate::SetCreateCallback(saved);
+}
+
+
 // Utility functions and variables for test case IsolateInterrupt starts here.
 static Monitor* sync = NULL;
 static Dart_Isolate shared_isolate = NULL;
@@ -288,6 +288,18 @@ Dart_CObject* ApiMessageReader::ReadInlinedObject(intptr_t object_id) {
       }
       return object;
     }
+    case ObjectStore::kExternalByteArrayClass: {
+      // Copy the data handed over by the sender, the message releases it.
+      intptr_t len = ReadSmiValue();
+      Message::Transfer* transfer = TransferAt(ReadIntptrValue());
+      ASSERT(transfer->length == len);
+      Dart_CObject* object = AllocateDartCObjectByteArray(len);
+      AddBackwardReference(object_id, object);
+      if (len > 0) {
+        memmove(object->value.as_byte_array.values, transfer->data, len);
+      }
+      return object;
+    }
     default:
       // Everything else not supported.
       return NULL;
@@ -190,9 +190,7 @@ RawObject* DartLibraryCalls::Equals(const Instance& left,
 }
 
 
-RawObject* DartLibraryCalls::HandleMessage(Dart_Port dest_port_id,
-                                           Dart_Port reply_port_id,
-                                           const Instance& message) {
+RawFunction* DartLibraryCalls::HandleMessageFunction() {
   Library& isolate_lib = Library::Handle(Library::IsolateLibrary());
   ASSERT(!isolate_lib.IsNull());
   const String& public_class_name =
@@ -203,19 +201,35 @@ RawObject* DartLibraryCalls::HandleMessage(Dart_Port dest_port_id,
       String::Handle(String::NewSymbol("_handleMessage"));
   const int kNumArguments = 3;
   const Array& kNoArgumentNames = Array::Handle();
-  const Function& function = Function::Handle(
-      Resolver::ResolveStatic(isolate_lib,
-                              class_name,
-                              function_name,
-                              kNumArguments,
-                              kNoArgumentNames,
-                              Resolver::kIsQualified));
+  return Resolver::ResolveStatic(isolate_lib,
+                                 class_name,
+                                 function_name,
+                                 kNumArguments,
+                                 kNoArgumentNames,
+                                 Resolver::kIsQualified);
+}
+
+
+RawObject* DartLibraryCalls::HandleMessage(Dart_Port dest_port_id,
+                                           Dart_Port reply_port_id,
+                                           const Instance& message) {
+  const Function& function = Function::Handle(HandleMessageFunction());
+  return HandleMessage(function, dest_port_id, reply_port_id, message);
+}
+
+
+RawObject* DartLibraryCalls::HandleMessage(const Function& handle_message,
+                                           Dart_Port dest_port_id,
+                                           Dart_Port reply_port_id,
+                                           const Instance& message) {
+  const int kNumArguments = 3;
+  const Array& kNoArgumentNames = Array::Handle();
   GrowableArray<const Object*> arguments(kNumArguments);
   arguments.Add(&Integer::Handle(Integer::New(dest_port_id)));
   arguments.Add(&Integer::Handle(Integer::New(reply_port_id)));
   arguments.Add(&message);
   const Object& result = Object::Handle(
-      DartEntry::InvokeStatic(function, arguments, kNoArgumentNames));
+      DartEntry::InvokeStatic(handle_message, arguments, kNoArgumentNames));
   ASSERT(result.IsNull() || result.IsError());
   return result.raw();
 }
@@ -19,6 +19,7 @@ class Instance;
 class Integer;
 class Library;
 class Object;
+class RawFunction;
 class RawInstance;
 class RawObject;
 class String;
@@ -78,6 +79,16 @@ class DartLibraryCalls : public AllStatic {
                                   Dart_Port reply_port_id,
                                   const Instance& dart_message);
 
+  // Same as above, with the function returned by HandleMessageFunction,
+  // which saves its lookup when delivering several messages.
+  static RawObject* HandleMessage(const Function& handle_message,
+                                  Dart_Port dest_port_id,
+                                  Dart_Port reply_port_id,
+                                  const Instance& dart_message);
+
+  // Returns the function which delivers a message to its receive port.
+  static RawFunction* HandleMessageFunction();
+
   // Returns null on success, a RawError on failure.
   static RawObject* HandleMirrorsMessage(Dart_Port dest_port_id,
                                          Dart_Port reply_port_id,
@@ -94,11 +94,20 @@ ActivationFrame::ActivationFrame(uword pc, uword fp, uword sp)
       function_(Function::ZoneHandle()),
       token_index_(-1),
       line_number_(-1),
+      is_optimized_(false),
       var_descriptors_(NULL),
       desc_indices_(8) {
 }
 
 
+void ActivationFrame::SetOptimizedFrame(const Function& function,
+                                        intptr_t token_index) {
+  function_ = function.raw();
+  token_index_ = token_index;
+  is_optimized_ = true;
+}
+
+
 const Function& ActivationFrame::DartFunction() {
   if (function_.IsNull()) {
     ASSERT(Isolate::Current() != NULL);
@@ -152,7 +161,7 @@ RawScript* ActivationFrame::SourceScript() {
 
 
 intptr_t ActivationFrame::TokenIndex() {
-  if (token_index_ < 0) {
+  if (!is_optimized_ && (token_index_ < 0)) {
     const Function& func = DartFunction();
     ASSERT(!func.HasOptimizedCode());
     Code& code = Code::Handle(func.unoptimized_code());
@@ -172,7 +181,7 @@ intptr_t ActivationFrame::TokenIndex() {
 
 intptr_t ActivationFrame::LineNumber() {
   // Compute line number lazily since it causes scanning of the script.
-  if (line_number_ < 0) {
+  if ((line_number_ < 0) && (TokenIndex() >= 0)) {
     const Script& script = Script::Handle(SourceScript());
     intptr_t ignore_column;
     script.GetTokenLocation(TokenIndex(), &line_number_, &ignore_column);
@@ -182,6 +191,7 @@ intptr_t ActivationFrame::LineNumber() {
 
 
 void ActivationFrame::GetDescIndices() {
+  if (is_optimized_) return;
   if (var_descriptors_ == NULL) {
     ASSERT(!DartFunction().HasOptimizedCode());
     const Code& code = Code::Handle(DartFunction().unoptimized_code());
@@ -867,12 +877,32 @@ void Debugger::BreakpointCallback() {
               frame->pc());
   }
   DebuggerStackTrace* stack_trace = new DebuggerStackTrace(8);
+  Code& code = Code::Handle();
+  GrowableObjectArray& functions = GrowableObjectArray::Handle();
+  GrowableArray<intptr_t> token_indices;
+  Function& function = Function::Handle();
   while (frame != NULL) {
     ASSERT(frame->IsValid());
     ASSERT(frame->IsDartFrame());
-    ActivationFrame* activation =
-        new ActivationFrame(frame->pc(), frame->fp(), frame->sp());
-    stack_trace->AddActivation(activation);
+    code = frame->LookupDartCode();
+    if (code.is_optimized()) {
+      // The callers optimized before the breakpoint was set also stand for
+      // the functions inlined at the pc.
+      functions = GrowableObjectArray::New();
+      token_indices.Clear();
+      code.GetInlinedFramesAtPC(frame->pc(), functions, &token_indices);
+      for (intptr_t i = 0; i < functions.Length(); i++) {
+        function ^= functions.At(i);
+        ActivationFrame* activation =
+            new ActivationFrame(frame->pc(), frame->fp(), frame->sp());
+        activation->SetOptimizedFrame(function, token_indices[i]);
+        stack_trace->AddActivation(activation);
+      }
+    } else {
+      ActivationFrame* activation =
+          new ActivationFrame(frame->pc(), frame->fp(), frame->sp());
+      stack_trace->AddActivation(activation);
+    }
     frame = iterator.NextFrame();
   }
 
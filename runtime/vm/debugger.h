@@ -141,6 +141,11 @@ class ActivationFrame : public ZoneAllocated {
   RawArray* GetLocalVariables();
 
  private:
+  // The frames of optimized code and of the functions inlined into it are
+  // rebuilt from the code at the pc.  Optimized code does not keep the
+  // local variables in the frame, so they are not shown.
+  void SetOptimizedFrame(const Function& function, intptr_t token_index);
+
   void GetDescIndices();
   RawInstance* GetLocalVarValue(intptr_t slot_index);
   RawInstance* GetInstanceCallReceiver(intptr_t num_actual_args);
@@ -151,6 +156,7 @@ class ActivationFrame : public ZoneAllocated {
   Function& function_;
   intptr_t token_index_;
   intptr_t line_number_;
+  bool is_optimized_;
 
   LocalVarDescriptors* var_descriptors_;
   ZoneGrowableArray<intptr_t> desc_indices_;
@@ -0,0 +1,175 @@
+// Copyright (c) 2012, the Dart project authors.  Please see the AUTHORS file
+// for details. All rights reserved. Use of this source code is governed by a
+// BSD-style license that can be found in the LICENSE file.
+
+#include "vm/deferred_optimizer.h"
+
+#include "vm/compiler.h"
+#include "vm/dart.h"
+#include "vm/debugger.h"
+#include "vm/flags.h"
+#include "vm/isolate.h"
+#include "vm/object.h"
+#include "vm/os.h"
+#include "vm/thread.h"
+#include "vm/thread_pool.h"
+#include "vm/visitor.h"
+
+namespace dart {
+
+DEFINE_FLAG(bool, deferred_optimization, false,
+    "Queue hot functions and optimize them on the isolate's own thread "
+    "when it is idle or interrupted, instead of when they become hot.");
+DEFINE_FLAG(int, deferred_optimization_delay, 100,
+    "Interrupt a busy isolate to optimize the queued functions after this "
+    "many milliseconds.");
+DEFINE_FLAG(bool, trace_deferred_optimization, false,
+    "Trace the functions queued for optimization.");
+
+
+class DeferredOptimizer::InterruptTask : public ThreadPool::Task {
+ public:
+  explicit InterruptTask(DeferredOptimizer* optimizer)
+      : optimizer_(optimizer) { }
+
+  virtual void Run() {
+    optimizer_->RunInterruptTask();
+  }
+
+ private:
+  DeferredOptimizer* optimizer_;
+
+  DISALLOW_COPY_AND_ASSIGN(InterruptTask);
+};
+
+
+DeferredOptimizer::DeferredOptimizer(Isolate* isolate)
+    : isolate_(isolate),
+      queue_(GrowableObjectArray::null()),
+      monitor_(),
+      queue_pending_(false),
+      task_running_(false),
+      shutting_down_(false) {
+}
+
+
+DeferredOptimizer::~DeferredOptimizer() {
+  ASSERT(!task_running_);
+}
+
+
+void DeferredOptimizer::EnqueueFunction(const Function& function) {
+  ASSERT(isolate_ == Isolate::Current());
+  if (queue_ == GrowableObjectArray::null()) {
+    queue_ = GrowableObjectArray::New(Heap::kOld);
+  }
+  if (function.is_queued_for_optimization()) {
+    return;
+  }
+  if (FLAG_trace_deferred_optimization) {
+    OS::Print("Queueing for optimization: '%s'\n",
+              function.ToFullyQualifiedCString());
+  }
+  const GrowableObjectArray& queue = GrowableObjectArray::Handle(queue_);
+  queue.Add(function);
+  function.set_is_queued_for_optimization(true);
+
+  MonitorLocker ml(&monitor_);
+  if (queue_pending_ || shutting_down_) {
+    return;
+  }
+  queue_pending_ = true;
+  if (!task_running_) {
+    task_running_ = true;
+    Dart::thread_pool()->Run(new InterruptTask(this));
+  }
+}
+
+
+RawError* DeferredOptimizer::OptimizeQueuedFunctions() {
+  ASSERT(isolate_ == Isolate::Current());
+  {
+    MonitorLocker ml(&monitor_);
+    if (!queue_pending_) {
+      return Error::null();
+    }
+    queue_pending_ = false;
+    // The worker does not need to interrupt the isolate anymore.
+    ml.Notify();
+  }
+  // Functions becoming hot while compiling are queued anew.
+  const GrowableObjectArray& queue = GrowableObjectArray::Handle(queue_);
+  queue_ = GrowableObjectArray::null();
+  if (queue.IsNull()) {
+    return Error::null();
+  }
+  Function& function = Function::Handle();
+  for (intptr_t i = 0; i < queue.Length(); i++) {
+    function ^= queue.At(i);
+    function.set_is_queued_for_optimization(false);
+  }
+  if (isolate_->debugger()->IsActive()) {
+    // We cannot set breakpoints in optimized code.
+    return Error::null();
+  }
+  Error& error = Error::Handle();
+  for (intptr_t i = 0; i < queue.Length(); i++) {
+    function ^= queue.At(i);
+    // The function may have been optimized or given up on since it was
+    // queued, e.g., by on-stack replacement.
+    if (function.HasOptimizedCode() || !function.is_optimizable()) {
+      continue;
+    }
+    if (FLAG_trace_deferred_optimization) {
+      OS::Print("Optimizing queued function: '%s'\n",
+                function.ToFullyQualifiedCString());
+    }
+    // Compilation patches the entry of the unoptimized code.
+    error = Compiler::CompileOptimizedFunction(function);
+    if (!error.IsNull()) {
+      return error.raw();
+    }
+  }
+  return Error::null();
+}
+
+
+void DeferredOptimizer::RunInterruptTask() {
+  MonitorLocker ml(&monitor_);
+  while (queue_pending_ && !shutting_down_) {
+    const int64_t start = OS::GetCurrentTimeMillis();
+    if (FLAG_deferred_optimization_delay > 0) {
+      ml.Wait(FLAG_deferred_optimization_delay);
+    }
+    if (!queue_pending_ || shutting_down_) {
+      break;
+    }
+    // Spurious wakeups wait again.
+    if ((OS::GetCurrentTimeMillis() - start) >=
+        FLAG_deferred_optimization_delay) {
+      // The isolate compiles the queued functions at its next stack
+      // overflow check, and clears queue_pending_.
+      isolate_->ScheduleInterrupts(Isolate::kOptimizeInterrupt);
+      break;
+    }
+  }
+  task_running_ = false;
+  ml.NotifyAll();
+}
+
+
+void DeferredOptimizer::Shutdown() {
+  MonitorLocker ml(&monitor_);
+  shutting_down_ = true;
+  ml.NotifyAll();
+  while (task_running_) {
+    ml.Wait();
+  }
+}
+
+
+void DeferredOptimizer::VisitObjectPointers(ObjectPointerVisitor* visitor) {
+  visitor->VisitPointer(reinterpret_cast<RawObject**>(&queue_));
+}
+
+}  // namespace dart
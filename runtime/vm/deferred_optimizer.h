@@ -0,0 +1,70 @@
+// Copyright (c) 2012, the Dart project authors.  Please see the AUTHORS file
+// for details. All rights reserved. Use of this source code is governed by a
+// BSD-style license that can be found in the LICENSE file.
+
+#ifndef VM_DEFERRED_OPTIMIZER_H_
+#define VM_DEFERRED_OPTIMIZER_H_
+
+#include "platform/thread.h"
+#include "vm/allocation.h"
+#include "vm/globals.h"
+
+namespace dart {
+
+// Forward declarations.
+class Function;
+class Isolate;
+class ObjectPointerVisitor;
+class RawError;
+class RawGrowableObjectArray;
+
+// Queues the functions of an isolate which became hot, so that the mutator
+// keeps running their unoptimized code instead of stalling in the optimizing
+// compiler where they crossed the threshold.  Nothing is compiled in the
+// background: the compiler allocates in the heap of the isolate and is not
+// thread-safe, so the mutator optimizes the queued functions itself at a
+// safepoint, i.e., when the isolate runs out of messages to handle, or at
+// the next stack overflow check once a worker of the thread pool interrupts
+// a busy isolate after --deferred_optimization_delay milliseconds.  The
+// isolate still pauses for the whole compile, only later.  Installing
+// optimized code patches the entry of the unoptimized code, and its callers
+// are redirected through the FixCallersTarget stub.
+class DeferredOptimizer {
+ public:
+  explicit DeferredOptimizer(Isolate* isolate);
+  ~DeferredOptimizer();
+
+  // Queues the function for optimization, unless it is queued already.
+  void EnqueueFunction(const Function& function);
+
+  // Optimizes the queued functions.  Called by the mutator at a safepoint.
+  //
+  // Returns Error::null() if there is no compilation error.
+  RawError* OptimizeQueuedFunctions();
+
+  // Stops the worker before the isolate shuts down.
+  void Shutdown();
+
+  void VisitObjectPointers(ObjectPointerVisitor* visitor);
+
+ private:
+  class InterruptTask;
+
+  // Waits for the mutator to compile the queued functions, and interrupts
+  // it when the delay has passed.  Runs on a worker of the thread pool.
+  void RunInterruptTask();
+
+  Isolate* isolate_;
+  RawGrowableObjectArray* queue_;  // Functions to optimize, or null.
+
+  Monitor monitor_;
+  bool queue_pending_;  // Protected by monitor_.
+  bool task_running_;   // Protected by monitor_.
+  bool shutting_down_;  // Protected by monitor_.
+
+  DISALLOW_COPY_AND_ASSIGN(DeferredOptimizer);
+};
+
+}  // namespace dart
+
+#endif  // VM_DEFERRED_OPTIMIZER_H_
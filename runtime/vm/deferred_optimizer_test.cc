@@ -0,0 +1,115 @@
+// Copyright (c) 2012, the Dart project authors.  Please see the AUTHORS file
+// for details. All rights reserved. Use of this source code is governed by a
+// BSD-style license that can be found in the LICENSE file.
+
+#include "platform/assert.h"
+#include "vm/deferred_optimizer.h"
+#include "vm/dart_api_impl.h"
+#include "vm/isolate.h"
+#include "vm/object.h"
+#include "vm/os.h"
+#include "vm/unit_test.h"
+
+namespace dart {
+
+DECLARE_FLAG(bool, deferred_optimization);
+DECLARE_FLAG(int, deferred_optimization_delay);
+DECLARE_FLAG(int, optimization_counter_threshold);
+
+// Only the x64 flow graph compiler is known to optimize the test functions.
+#if defined(TARGET_ARCH_X64)
+
+static const char* kScriptChars =
+    "inc(x) {\n"
+    "  return x + 1;\n"
+    "}\n"
+    "main() {\n"
+    "  var s = 0;\n"
+    "  for (var i = 0; i < 20; i++) {\n"
+    "    s = inc(s);\n"
+    "  }\n"
+    "  return s;\n"
+    "}\n";
+
+
+static void RunMain(Dart_Handle lib) {
+  Dart_Handle result = Dart_InvokeStatic(lib,
+                                         Dart_NewString(""),
+                                         Dart_NewString("main"),
+                                         0,
+                                         NULL);
+  EXPECT_VALID(result);
+  int64_t value = 0;
+  EXPECT_VALID(Dart_IntegerToInt64(result, &value));
+  EXPECT_EQ(20, value);
+}
+
+
+static RawFunction* LookupFunction(Dart_Handle lib, const char* name) {
+  Library& library = Library::Handle();
+  library ^= Api::UnwrapHandle(lib);
+  return library.LookupLocalFunction(String::Handle(String::NewSymbol(name)));
+}
+
+
+TEST_CASE(DeferredOptimizer_OptimizeWhenIdle) {
+  const bool saved_deferred_optimization = FLAG_deferred_optimization;
+  const intptr_t saved_delay = FLAG_deferred_optimization_delay;
+  const intptr_t saved_threshold = FLAG_optimization_counter_threshold;
+  FLAG_deferred_optimization = true;
+  FLAG_deferred_optimization_delay = 60 * 1000;  // Never interrupt.
+  FLAG_optimization_counter_threshold = 5;
+  Dart_Handle lib = TestCase::LoadTestScript(kScriptChars, NULL);
+
+  // The hot function keeps running unoptimized code.
+  RunMain(lib);
+  const Function& inc = Function::Handle(LookupFunction(lib, "inc"));
+  EXPECT(!inc.IsNull());
+  EXPECT(!inc.HasOptimizedCode());
+  EXPECT(inc.is_queued_for_optimization());
+
+  // Running out of messages optimizes the queued functions.
+  EXPECT_VALID(Dart_HandleMessage());
+  EXPECT(inc.HasOptimizedCode());
+  EXPECT(!inc.is_queued_for_optimization());
+  RunMain(lib);
+
+  FLAG_deferred_optimization = saved_deferred_optimization;
+  FLAG_deferred_optimization_delay = saved_delay;
+  FLAG_optimization_counter_threshold = saved_threshold;
+}
+
+
+TEST_CASE(DeferredOptimizer_OptimizeWhenInterrupted) {
+  const bool saved_deferred_optimization = FLAG_deferred_optimization;
+  const intptr_t saved_delay = FLAG_deferred_optimization_delay;
+  const intptr_t saved_threshold = FLAG_optimization_counter_threshold;
+  FLAG_deferred_optimization = true;
+  FLAG_deferred_optimization_delay = 0;
+  FLAG_optimization_counter_threshold = 5;
+  Dart_Handle lib = TestCase::LoadTestScript(kScriptChars, NULL);
+
+  RunMain(lib);
+  const Function& inc = Function::Handle(LookupFunction(lib, "inc"));
+  EXPECT(!inc.IsNull());
+
+  // Wait for the worker to interrupt the isolate.
+  Isolate* isolate = Isolate::Current();
+  for (intptr_t i = 0; i < 1000; i++) {
+    if (isolate->stack_limit() != isolate->saved_stack_limit()) break;
+    OS::Sleep(1);
+  }
+  EXPECT(isolate->stack_limit() != isolate->saved_stack_limit());
+
+  // The next stack overflow check optimizes the queued functions.
+  RunMain(lib);
+  EXPECT(inc.HasOptimizedCode());
+
+  FLAG_deferred_optimization = saved_deferred_optimization;
+  FLAG_deferred_optimization_delay = saved_delay;
+  FLAG_optimization_counter_threshold = saved_threshold;
+}
+
+#endif  // TARGET_ARCH_X64
+
+}  // namespace dart
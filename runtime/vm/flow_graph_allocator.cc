@@ -0,0 +1,524 @@
+// Copyright (c) 2012, the Dart project authors.  Please see the AUTHORS file
+// for details. All rights reserved. Use of this source code is governed by a
+// BSD-style license that can be found in the LICENSE file.
+
+#include "vm/flow_graph_allocator.h"
+
+#include "vm/bit_vector.h"
+#include "vm/flags.h"
+#include "vm/object.h"
+#include "vm/os.h"
+
+namespace dart {
+
+DEFINE_FLAG(bool, trace_register_allocation, false,
+            "Print the live ranges and locations of the register allocator.");
+
+
+// The lifetime of a definition: the positions from its definition to its
+// last use, including the ends of the blocks where it is live out.
+class LiveRange : public ZoneAllocated {
+ public:
+  explicit LiveRange(Definition* definition)
+      : definition_(definition), start_(-1), end_(-1) { }
+
+  Definition* definition() const { return definition_; }
+
+  intptr_t start() const { return start_; }
+  intptr_t end() const { return end_; }
+
+  void DefineAt(intptr_t position) {
+    start_ = position;
+    end_ = Utils::Maximum(end_, position);
+  }
+  void ExtendTo(intptr_t position) {
+    end_ = Utils::Maximum(end_, position);
+  }
+  void ExtendBackTo(intptr_t position) {
+    start_ = Utils::Minimum(start_, position);
+  }
+
+ private:
+  Definition* const definition_;
+  intptr_t start_;
+  intptr_t end_;
+
+  DISALLOW_COPY_AND_ASSIGN(LiveRange);
+};
+
+
+FlowGraphAllocator::FlowGraphAllocator(
+    const GrowableArray<BlockEntryInstr*>& block_order,
+    const Register* registers,
+    intptr_t register_count,
+    const XmmRegister* xmm_registers,
+    intptr_t xmm_register_count,
+    intptr_t first_spill_slot_index)
+    : block_order_(block_order),
+      ssa_temp_count_(ComputeSSATempCount(block_order)),
+      registers_(registers),
+      register_count_(register_count),
+      xmm_registers_(xmm_registers),
+      xmm_register_count_(xmm_register_count),
+      first_spill_slot_index_(first_spill_slot_index),
+      ranges_(ssa_temp_count_),
+      block_entry_positions_(block_order.length()),
+      block_end_positions_(block_order.length()),
+      call_counts_(),
+      xmm_clobber_counts_(),
+      live_in_(block_order.length()),
+      live_out_(block_order.length()),
+      spill_slot_ends_(),
+      spill_slot_is_double_() {
+  for (intptr_t i = 0; i < ssa_temp_count_; ++i) {
+    ranges_.Add(NULL);
+  }
+  for (intptr_t i = 0; i < block_order.length(); ++i) {
+    block_entry_positions_.Add(-1);
+    block_end_positions_.Add(-1);
+    live_in_.Add(new BitVector(ssa_temp_count_));
+    live_out_.Add(new BitVector(ssa_temp_count_));
+  }
+}
+
+
+intptr_t FlowGraphAllocator::ComputeSSATempCount(
+    const GrowableArray<BlockEntryInstr*>& block_order) {
+  intptr_t count = 0;
+  for (intptr_t i = 0; i < block_order.length(); ++i) {
+    JoinEntryInstr* join = block_order[i]->AsJoinEntry();
+    if ((join != NULL) && (join->phis() != NULL)) {
+      for (intptr_t j = 0; j < join->phis()->length(); ++j) {
+        count = Utils::Maximum(count,
+                               (*join->phis())[j]->ssa_temp_index() + 1);
+      }
+    }
+    Instruction* current = block_order[i]->StraightLineSuccessor();
+    while ((current != NULL) && !current->IsBlockEntry()) {
+      BindInstr* bind = current->AsBind();
+      if (bind != NULL) {
+        count = Utils::Maximum(count, bind->ssa_temp_index() + 1);
+      }
+      current = current->StraightLineSuccessor();
+    }
+  }
+  return count;
+}
+
+
+bool FlowGraphAllocator::IsSmiFastPathCall(Computation* computation) {
+  InstanceCallComp* call = computation->AsInstanceCall();
+  if ((call == NULL) ||
+      (call->ArgumentCount() != 2) ||
+      !call->argument_names().IsNull()) {
+    return false;
+  }
+  const String& name = call->function_name();
+  return name.Equals(Token::Str(Token::kADD)) ||
+      name.Equals(Token::Str(Token::kSUB)) ||
+      name.Equals(Token::Str(Token::kMUL)) ||
+      name.Equals(Token::Str(Token::kLT)) ||
+      name.Equals(Token::Str(Token::kGT)) ||
+      name.Equals(Token::Str(Token::kLTE)) ||
+      name.Equals(Token::Str(Token::kGTE)) ||
+      name.Equals(Token::Str(Token::kEQ));
+}
+
+
+bool FlowGraphAllocator::HasSlowPathCall(Computation* computation) {
+  if (computation->IsUnboxedDoubleBinaryOp()) {
+    return computation->AsUnboxedDoubleBinaryOp()->HasSlowPath();
+  }
+  if (computation->IsLoadIndexed()) {
+    return computation->AsLoadIndexed()->needs_bounds_check();
+  }
+  return IsSmiFastPathCall(computation) || computation->IsBoxDouble();
+}
+
+
+bool FlowGraphAllocator::IsCall(Instruction* instr) {
+  if (instr->IsBind()) {
+    Computation* computation = instr->AsBind()->computation();
+    // A bound Smi operation only calls on its slow path.
+    return !IsSmiFastPathCall(computation) && IsCallComputation(computation);
+  }
+  if (instr->IsDo()) {
+    return IsCallComputation(instr->AsDo()->computation());
+  }
+  return instr->IsThrow() || instr->IsReThrow();
+}
+
+
+bool FlowGraphAllocator::IsCallComputation(Computation* computation) {
+  return !(computation->IsTemp() ||
+           computation->IsConstant() ||
+           computation->IsUse() ||
+           computation->IsStrictCompare() ||
+           computation->IsBooleanNegate() ||
+           computation->IsLoadLocal() ||
+           computation->IsStoreLocal() ||
+           computation->IsLoadInstanceField() ||
+           computation->IsStoreInstanceField() ||
+           computation->IsLoadStaticField() ||
+           computation->IsStoreStaticField() ||
+           computation->IsCurrentContext() ||
+           computation->IsStoreContext() ||
+           computation->IsChainContext() ||
+           computation->IsNativeLoadField() ||
+           computation->IsTestClass() ||
+           computation->IsUnboxedDoubleBinaryOp() ||
+           computation->IsBoxDouble() ||
+           computation->IsLoadIndexed());
+}
+
+
+LiveRange* FlowGraphAllocator::RangeFor(Value* value) const {
+  UseVal* use = value->AsUse();
+  if (use == NULL) return NULL;
+  // Parameters have no live range.
+  Definition* definition = use->definition();
+  return definition->IsParameter()
+      ? NULL
+      : ranges_[definition->ssa_temp_index()];
+}
+
+
+void FlowGraphAllocator::CreateLiveRanges() {
+  for (intptr_t i = 0; i < block_order_.length(); ++i) {
+    JoinEntryInstr* join = block_order_[i]->AsJoinEntry();
+    if ((join != NULL) && (join->phis() != NULL)) {
+      for (intptr_t j = 0; j < join->phis()->length(); ++j) {
+        PhiInstr* phi = (*join->phis())[j];
+        ranges_[phi->ssa_temp_index()] = new LiveRange(phi);
+      }
+    }
+    Instruction* current = block_order_[i]->StraightLineSuccessor();
+    while ((current != NULL) && !current->IsBlockEntry()) {
+      BindInstr* bind = current->AsBind();
+      if ((bind != NULL) && bind->HasSSATemp()) {
+        ranges_[bind->ssa_temp_index()] = new LiveRange(bind);
+      }
+      current = current->StraightLineSuccessor();
+    }
+  }
+}
+
+
+// Number the instructions in block order, starting with the block entry.
+// The block end gets a position of its own, for the phi moves.  Record the
+// definitions and uses in the live ranges and the local liveness sets: the
+// live in set of a block starts out as the set of values used before (or
+// without) being defined in the block, its live out set holds the values
+// defined in the block until the liveness is computed.
+void FlowGraphAllocator::NumberInstructions() {
+  intptr_t position = 0;
+  intptr_t call_count = 0;
+  intptr_t xmm_clobber_count = 0;
+  for (intptr_t i = 0; i < block_order_.length(); ++i) {
+    BlockEntryInstr* block = block_order_[i];
+    const intptr_t block_number = block->postorder_number();
+    BitVector* gen = live_in_[block_number];
+    BitVector* kill = live_out_[block_number];
+
+    block_entry_positions_[block_number] = position;
+    JoinEntryInstr* join = block->AsJoinEntry();
+    if ((join != NULL) && (join->phis() != NULL)) {
+      for (intptr_t j = 0; j < join->phis()->length(); ++j) {
+        PhiInstr* phi = (*join->phis())[j];
+        ranges_[phi->ssa_temp_index()]->DefineAt(position);
+        kill->Add(phi->ssa_temp_index());
+      }
+    }
+    call_counts_.Add(call_count);
+    xmm_clobber_counts_.Add(xmm_clobber_count);
+    ++position;
+
+    Instruction* current = block->StraightLineSuccessor();
+    while ((current != NULL) && !current->IsBlockEntry()) {
+      for (intptr_t j = 0; j < current->InputCount(); ++j) {
+        LiveRange* range = RangeFor(current->InputAt(j));
+        if (range != NULL) {
+          range->ExtendTo(position);
+          intptr_t index = range->definition()->ssa_temp_index();
+          if (!kill->Contains(index)) gen->Add(index);
+        }
+      }
+      BindInstr* bind = current->AsBind();
+      if ((bind != NULL) && bind->HasSSATemp()) {
+        ranges_[bind->ssa_temp_index()]->DefineAt(position);
+        kill->Add(bind->ssa_temp_index());
+      }
+      if (IsCall(current)) {
+        ++call_count;
+        ++xmm_clobber_count;
+      } else if ((bind != NULL) && HasSlowPathCall(bind->computation())) {
+        ++xmm_clobber_count;
+      }
+      call_counts_.Add(call_count);
+      xmm_clobber_counts_.Add(xmm_clobber_count);
+      ++position;
+      current = current->StraightLineSuccessor();
+    }
+
+    block_end_positions_[block_number] = position;
+    call_counts_.Add(call_count);
+    xmm_clobber_counts_.Add(xmm_clobber_count);
+    ++position;
+  }
+}
+
+
+void FlowGraphAllocator::ComputeLiveness() {
+  // Move the kill sets out of the live out sets.
+  const intptr_t block_count = block_order_.length();
+  GrowableArray<BitVector*> kill(block_count);
+  for (intptr_t i = 0; i < block_count; ++i) {
+    kill.Add(live_out_[i]);
+    live_out_[i] = new BitVector(ssa_temp_count_);
+  }
+
+  // Iterate to a fixed point over the blocks in postorder:
+  //   live_out(B) = union of live_in(S) and the phi inputs from B, for the
+  //                 successors S of B
+  //   live_in(B) = gen(B) + (live_out(B) - kill(B))
+  BitVector* temp = new BitVector(ssa_temp_count_);
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    for (intptr_t i = block_count - 1; i >= 0; --i) {
+      BlockEntryInstr* block = block_order_[i];
+      const intptr_t block_number = block->postorder_number();
+      BitVector* live_out = live_out_[block_number];
+      for (intptr_t j = 0; j < block->SuccessorCount(); ++j) {
+        BlockEntryInstr* successor = block->SuccessorAt(j);
+        live_out->AddAll(live_in_[successor->postorder_number()]);
+        JoinEntryInstr* join = successor->AsJoinEntry();
+        if ((join != NULL) && (join->phis() != NULL)) {
+          intptr_t pred_index = join->IndexOfPredecessor(block);
+          for (intptr_t k = 0; k < join->phis()->length(); ++k) {
+            LiveRange* range =
+                RangeFor((*join->phis())[k]->InputAt(pred_index));
+            if (range != NULL) {
+              live_out->Add(range->definition()->ssa_temp_index());
+            }
+          }
+        }
+      }
+      temp->Clear();
+      temp->AddAll(live_out);
+      temp->RemoveAll(kill[block_number]);
+      if (live_in_[block_number]->AddAll(temp)) changed = true;
+    }
+  }
+}
+
+
+void FlowGraphAllocator::BuildLiveRanges() {
+  for (intptr_t i = 0; i < block_order_.length(); ++i) {
+    BlockEntryInstr* block = block_order_[i];
+    const intptr_t block_number = block->postorder_number();
+    const intptr_t block_end = block_end_positions_[block_number];
+    // Values live out of a block are live up to its end.
+    BitVector* live_out = live_out_[block_number];
+    for (intptr_t j = 0; j < ssa_temp_count_; ++j) {
+      if (live_out->Contains(j) && (ranges_[j] != NULL)) {
+        ranges_[j]->ExtendTo(block_end);
+      }
+    }
+    // The phi moves at the ends of the predecessors use the inputs and
+    // define the phis.
+    JoinEntryInstr* join = block->AsJoinEntry();
+    if ((join == NULL) || (join->phis() == NULL)) continue;
+    for (intptr_t j = 0; j < join->PredecessorCount(); ++j) {
+      const intptr_t pred_end =
+          block_end_positions_[join->PredecessorAt(j)->postorder_number()];
+      for (intptr_t k = 0; k < join->phis()->length(); ++k) {
+        PhiInstr* phi = (*join->phis())[k];
+        LiveRange* phi_range = ranges_[phi->ssa_temp_index()];
+        phi_range->ExtendBackTo(pred_end);
+        phi_range->ExtendTo(pred_end);
+        LiveRange* input_range = RangeFor(phi->InputAt(j));
+        if (input_range != NULL) input_range->ExtendTo(pred_end);
+      }
+    }
+  }
+}
+
+
+static int CompareStarts(LiveRange* const* a, LiveRange* const* b) {
+  return (*a)->start() - (*b)->start();
+}
+
+
+intptr_t FlowGraphAllocator::AllocateSpillSlot(LiveRange* range,
+                                               bool is_double) {
+  // Reuse spill slots which are free for the whole range.  A slot may be
+  // shared by a phi and its input, which are moved at the same position, if
+  // they are moved together: doubles use aligned pairs of slots, so the
+  // pairs of two doubles are either the same or disjoint.
+  const intptr_t slot_count = is_double ? 2 : 1;
+  intptr_t index = 0;
+  for (; index < spill_slot_ends_.length(); index += slot_count) {
+    bool is_free = true;
+    for (intptr_t i = index;
+         (i < index + slot_count) && (i < spill_slot_ends_.length());
+         ++i) {
+      if ((spill_slot_ends_[i] > range->start()) ||
+          ((spill_slot_ends_[i] == range->start()) &&
+           (spill_slot_is_double_[i] != is_double))) {
+        is_free = false;
+        break;
+      }
+    }
+    if (is_free) break;
+  }
+  // An aligned pair may leave a free slot before it.
+  while (spill_slot_ends_.length() < index) {
+    spill_slot_ends_.Add(0);
+    spill_slot_is_double_.Add(false);
+  }
+  for (intptr_t i = index; i < index + slot_count; ++i) {
+    if (i == spill_slot_ends_.length()) {
+      spill_slot_ends_.Add(range->end());
+      spill_slot_is_double_.Add(is_double);
+    } else {
+      spill_slot_ends_[i] = range->end();
+      spill_slot_is_double_[i] = is_double;
+    }
+  }
+  return first_spill_slot_index_ - index;
+}
+
+
+void FlowGraphAllocator::AllocateLiveRanges() {
+  GrowableArray<LiveRange*> tagged;
+  GrowableArray<LiveRange*> unboxed;
+  for (intptr_t i = 0; i < ssa_temp_count_; ++i) {
+    LiveRange* range = ranges_[i];
+    if (range == NULL) continue;
+    if (range->definition()->representation() == kUnboxedDouble) {
+      unboxed.Add(range);
+    } else {
+      tagged.Add(range);
+    }
+  }
+  AllocateLiveRanges(tagged, register_count_, call_counts_, false);
+  AllocateLiveRanges(unboxed, xmm_register_count_, xmm_clobber_counts_, true);
+}
+
+
+void FlowGraphAllocator::AllocateLiveRanges(
+    const GrowableArray<LiveRange*>& ranges,
+    intptr_t register_count,
+    const GrowableArray<intptr_t>& clobber_counts,
+    bool is_double) {
+  GrowableArray<LiveRange*> unallocated;
+  for (intptr_t i = 0; i < ranges.length(); ++i) {
+    unallocated.Add(ranges[i]);
+  }
+  unallocated.Sort(CompareStarts);
+
+  // The ranges currently assigned to each register, or NULL.
+  GrowableArray<LiveRange*> active(register_count);
+  for (intptr_t i = 0; i < register_count; ++i) {
+    active.Add(NULL);
+  }
+
+  for (intptr_t i = 0; i < unallocated.length(); ++i) {
+    LiveRange* range = unallocated[i];
+    // A value live across a call is spilled.  A range ending at a call is
+    // only used as an operand of the call.
+    if ((range->end() - 1 > range->start()) &&
+        (clobber_counts[range->end() - 1] > clobber_counts[range->start()])) {
+      Spill(range, is_double);
+      continue;
+    }
+    // Free the registers of the expired ranges and look for a free register
+    // and the active range ending last.
+    intptr_t free_index = -1;
+    intptr_t last_index = -1;
+    for (intptr_t j = 0; j < register_count; ++j) {
+      if ((active[j] != NULL) && (active[j]->end() <= range->start())) {
+        active[j] = NULL;
+      }
+      if (active[j] == NULL) {
+        if (free_index < 0) free_index = j;
+      } else if ((last_index < 0) ||
+                 (active[j]->end() > active[last_index]->end())) {
+        last_index = j;
+      }
+    }
+    if (free_index < 0) {
+      if (active[last_index]->end() <= range->end()) {
+        Spill(range, is_double);
+        continue;
+      }
+      // Spill the range ending last.  The locations are fixed for the whole
+      // lifetime, so it is spilled from its start on.
+      Spill(active[last_index], is_double);
+      free_index = last_index;
+    }
+    active[free_index] = range;
+    range->definition()->set_location(is_double
+        ? Location::XmmRegisterLocation(xmm_registers_[free_index])
+        : Location::RegisterLocation(registers_[free_index]));
+  }
+}
+
+
+void FlowGraphAllocator::Spill(LiveRange* range, bool is_double) {
+  const intptr_t index = AllocateSpillSlot(range, is_double);
+  range->definition()->set_location(is_double
+      ? Location::DoubleStackSlot(index)
+      : Location::StackSlot(index));
+}
+
+
+void FlowGraphAllocator::AllocateRegisters() {
+  CreateLiveRanges();
+  NumberInstructions();
+  ComputeLiveness();
+  BuildLiveRanges();
+  AllocateLiveRanges();
+
+  if (FLAG_trace_register_allocation) {
+    for (intptr_t i = 0; i < ssa_temp_count_; ++i) {
+      LiveRange* range = ranges_[i];
+      if (range == NULL) continue;
+      const Location& location = range->definition()->location();
+      if (location.IsRegister()) {
+        OS::Print("v%d [%d, %d]: r%d\n", i, range->start(), range->end(),
+                  location.reg());
+      } else if (location.IsXmmRegister()) {
+        OS::Print("v%d [%d, %d]: xmm%d\n", i, range->start(), range->end(),
+                  location.xmm_reg());
+      } else if (location.IsDoubleStackSlot()) {
+        OS::Print("v%d [%d, %d]: fp[%d, %d]\n", i, range->start(),
+                  range->end(), location.stack_index(),
+                  location.stack_index() - 1);
+      } else {
+        OS::Print("v%d [%d, %d]: fp[%d]\n", i, range->start(), range->end(),
+                  location.stack_index());
+      }
+    }
+    OS::Print("spill slots: %d\n", spill_slot_count());
+  }
+}
+
+
+void FlowGraphAllocator::GetLiveRegistersAt(
+    Definition* definition,
+    GrowableArray<Register>* registers) const {
+  const intptr_t position = ranges_[definition->ssa_temp_index()]->start();
+  for (intptr_t i = 0; i < ssa_temp_count_; ++i) {
+    LiveRange* range = ranges_[i];
+    if ((range != NULL) &&
+        (range->start() < position) &&
+        (range->end() > position) &&
+        range->definition()->location().IsRegister()) {
+      registers->Add(range->definition()->location().reg());
+    }
+  }
+}
+
+}  // namespace dart
@@ -0,0 +1,123 @@
+// Copyright (c) 2012, the Dart project authors.  Please see the AUTHORS file
+// for details. All rights reserved. Use of this source code is governed by a
+// BSD-style license that can be found in the LICENSE file.
+
+#ifndef VM_FLOW_GRAPH_ALLOCATOR_H_
+#define VM_FLOW_GRAPH_ALLOCATOR_H_
+
+#include "vm/allocation.h"
+#include "vm/growable_array.h"
+#include "vm/intermediate_language.h"
+
+namespace dart {
+
+class BitVector;
+class LiveRange;
+
+// A linear scan register allocator for flow graphs in SSA form.  Each
+// definition gets a single location, a register or a spill slot in the
+// frame, for its whole lifetime.  The lifetime is approximated by one
+// interval of instruction positions in the block order of the compiler.
+// Calls clobber all registers, so values live across a call are spilled.
+// Unboxed doubles are allocated to XMM registers, which are not preserved
+// by the slow paths of the inlined computations either, and spilled to two
+// frame slots.
+class FlowGraphAllocator : public ZoneAllocated {
+ public:
+  FlowGraphAllocator(const GrowableArray<BlockEntryInstr*>& block_order,
+                     const Register* registers,
+                     intptr_t register_count,
+                     const XmmRegister* xmm_registers,
+                     intptr_t xmm_register_count,
+                     intptr_t first_spill_slot_index);
+
+  void AllocateRegisters();
+
+  // The number of frame slots used for spilled values.  Spill slot i is at
+  // frame index first_spill_slot_index - i.
+  intptr_t spill_slot_count() const { return spill_slot_ends_.length(); }
+
+  // Collect the registers holding values which are defined before and used
+  // after the definition, e.g., to preserve them around the slow path of an
+  // inlined call.
+  void GetLiveRegistersAt(Definition* definition,
+                          GrowableArray<Register>* registers) const;
+
+  // True if the instruction calls out of the function and clobbers all
+  // registers.
+  static bool IsCall(Instruction* instr);
+
+  // True if the computation calls out of the function.  The arguments of
+  // calls are passed on the stack.
+  static bool IsCallComputation(Computation* computation);
+
+  // True if the computation is an instance call compiled inline for Smi
+  // operands, which only calls on a slow path preserving the live registers.
+  static bool IsSmiFastPathCall(Computation* computation);
+
+  // True if the computation is compiled inline but may call on a slow path,
+  // which preserves the live registers but not the XMM registers.
+  static bool HasSlowPathCall(Computation* computation);
+
+ private:
+  // The number of SSA temporaries defined by phis and instructions in the
+  // graph.  Parameters are numbered first and do not need live ranges.
+  static intptr_t ComputeSSATempCount(
+      const GrowableArray<BlockEntryInstr*>& block_order);
+
+  void CreateLiveRanges();
+  void NumberInstructions();
+  void ComputeLiveness();
+  void BuildLiveRanges();
+  void AllocateLiveRanges();
+  // Allocate the ranges of one representation to the given registers, or
+  // spill them if they are live across an instruction clobbering them.
+  void AllocateLiveRanges(const GrowableArray<LiveRange*>& ranges,
+                          intptr_t register_count,
+                          const GrowableArray<intptr_t>& clobber_counts,
+                          bool is_double);
+  // Assign the range to a spill slot, or to two for a double.
+  void Spill(LiveRange* range, bool is_double);
+  intptr_t AllocateSpillSlot(LiveRange* range, bool is_double);
+
+  LiveRange* RangeFor(Value* value) const;
+
+  const GrowableArray<BlockEntryInstr*>& block_order_;
+  const intptr_t ssa_temp_count_;
+  const Register* registers_;
+  const intptr_t register_count_;
+  const XmmRegister* xmm_registers_;
+  const intptr_t xmm_register_count_;
+  const intptr_t first_spill_slot_index_;
+
+  // Live ranges indexed by SSA temporary index, NULL for parameters which
+  // stay in their frame slots.
+  GrowableArray<LiveRange*> ranges_;
+
+  // Positions of the block entries and block ends, indexed by postorder
+  // block number.  The phi moves are at the end of the predecessor.
+  GrowableArray<intptr_t> block_entry_positions_;
+  GrowableArray<intptr_t> block_end_positions_;
+
+  // Number of calls at or before each position.
+  GrowableArray<intptr_t> call_counts_;
+
+  // Number of calls and slow path calls at or before each position.
+  GrowableArray<intptr_t> xmm_clobber_counts_;
+
+  // Sets of SSA temporaries live on entry to and on exit from each block,
+  // indexed by postorder block number.
+  GrowableArray<BitVector*> live_in_;
+  GrowableArray<BitVector*> live_out_;
+
+  // The end of the last live range assigned to each spill slot, and whether
+  // it holds half of a double.
+  GrowableArray<intptr_t> spill_slot_ends_;
+  GrowableArray<bool> spill_slot_is_double_;
+
+  DISALLOW_COPY_AND_ASSIGN(FlowGraphAllocator);
+};
+
+}  // namespace dart
+
+#endif  // VM_FLOW_GRAPH_ALLOCATOR_H_
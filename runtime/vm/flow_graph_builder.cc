@@ -5,6 +5,7 @@
 #include "vm/flow_graph_builder.h"
 
 #include "vm/ast_printer.h"
+#include "vm/bit_vector.h"
 #include "vm/flags.h"
 #include "vm/intermediate_language.h"
 #include "vm/longjump.h"
@@ -103,6 +104,7 @@ void EffectGraphVisitor::TieLoop(const TestGraphVisitor& test_fragment,
     Append(test_fragment);
   } else {
     JoinEntryInstr* join = new JoinEntryInstr();
+    owner()->AddLoopHeader(join);
     AddInstruction(join);
     join->SetSuccessor(test_fragment.entry());
     body_exit->SetSuccessor(join);
@@ -170,11 +172,12 @@ void EffectGraphVisitor::VisitReturnNode(ReturnNode* node) {
   intptr_t current_context_level = owner()->context_level();
   ASSERT(current_context_level >= 0);
   if (owner()->parsed_function().saved_context_var() != NULL) {
-    // CTX on entry was saved, but not linked as context parent.
+    // CTX on entry was saved, but not linked as context parent.  Load it
+    // into the temporary above the return value, which is still live.
     LoadLocalComp* load_comp =
         new LoadLocalComp(*owner()->parsed_function().saved_context_var(), 0);
-    AddInstruction(new BindInstr(temp_index(), load_comp));
-    TempVal* local_value = new TempVal(temp_index());
+    AddInstruction(new BindInstr(temp_index() + 1, load_comp));
+    TempVal* local_value = new TempVal(temp_index() + 1);
     StoreContextComp* store_context = new StoreContextComp(local_value);
     AddInstruction(new DoInstr(store_context));
   } else {
@@ -738,6 +741,7 @@ void EffectGraphVisitor::VisitDoWhileNode(DoWhileNode* node) {
 
   // Tie do-while loop (test is after the body).
   JoinEntryInstr* join = new JoinEntryInstr();
+  owner()->AddLoopHeader(join);
   AddInstruction(join);
   join->SetSuccessor(for_body.entry());
   Instruction* body_exit = for_body.is_empty() ? join : for_body.exit();
@@ -799,6 +803,7 @@ void EffectGraphVisitor::VisitForNode(ForNode* node) {
   // body is not open, i.e., no backward branch exists.
   if (loop_increment_end != NULL) {
     JoinEntryInstr* loop_start = new JoinEntryInstr();
+    owner()->AddLoopHeader(loop_start);
     AddInstruction(loop_start);
     loop_increment_end->SetSuccessor(loop_start);
   }
@@ -909,11 +914,14 @@ void EffectGraphVisitor::VisitClosureNode(ClosureNode* node) {
 
   int next_index = temp_index();
   if (function.IsNonImplicitClosureFunction()) {
-    const ContextScope& context_scope = ContextScope::ZoneHandle(
-        node->scope()->PreserveOuterScope(owner()->context_level()));
-    ASSERT(!function.HasCode());
-    ASSERT(function.context_scope() == ContextScope::null());
-    function.set_context_scope(context_scope);
+    // The context scope is already set when the enclosing function is
+    // recompiled, e.g., optimized.
+    if (function.context_scope() == ContextScope::null()) {
+      const ContextScope& context_scope = ContextScope::ZoneHandle(
+          node->scope()->PreserveOuterScope(owner()->context_level()));
+      ASSERT(!function.HasCode());
+      function.set_context_scope(context_scope);
+    }
   } else if (function.IsImplicitInstanceClosureFunction()) {
     ValueGraphVisitor for_receiver(owner(), temp_index());
     node->receiver()->Visit(&for_receiver);
@@ -1649,6 +1657,11 @@ void FlowGraphPrinter::VisitConstant(ConstantVal* val) {
 }
 
 
+void FlowGraphPrinter::VisitUse(UseVal* val) {
+  OS::Print("v%d", val->definition()->ssa_temp_index());
+}
+
+
 void FlowGraphPrinter::VisitAssertAssignable(AssertAssignableComp* comp) {
   OS::Print("AssertAssignable(");
   comp->value()->Accept(this);
@@ -1872,8 +1885,48 @@ void FlowGraphPrinter::VisitStoreContext(StoreContextComp* comp) {
 }
 
 
+void FlowGraphPrinter::VisitTestClass(TestClassComp* comp) {
+  OS::Print("TestClass(");
+  comp->value()->Accept(this);
+  OS::Print(", %s)", comp->cls().ToCString());
+}
+
+
+void FlowGraphPrinter::VisitUnboxedDoubleBinaryOp(
+    UnboxedDoubleBinaryOpComp* comp) {
+  OS::Print("UnboxedDoubleBinaryOp(%s, ", Token::Str(comp->op_kind()));
+  comp->left()->Accept(this);
+  OS::Print(", ");
+  comp->right()->Accept(this);
+  OS::Print(")");
+}
+
+
+void FlowGraphPrinter::VisitBoxDouble(BoxDoubleComp* comp) {
+  OS::Print("BoxDouble(");
+  comp->value()->Accept(this);
+  OS::Print(")");
+}
+
+
+void FlowGraphPrinter::VisitLoadIndexed(LoadIndexedComp* comp) {
+  OS::Print("LoadIndexed(");
+  comp->array()->Accept(this);
+  OS::Print(", ");
+  comp->index()->Accept(this);
+  OS::Print(comp->needs_bounds_check() ? ")" : ", in bounds)");
+}
+
+
 void FlowGraphPrinter::VisitJoinEntry(JoinEntryInstr* instr) {
   OS::Print("%2d: [join]", reverse_index(instr->postorder_number()));
+  ZoneGrowableArray<PhiInstr*>* phis = instr->phis();
+  if (phis != NULL) {
+    for (intptr_t i = 0; i < phis->length(); ++i) {
+      OS::Print("\n");
+      (*phis)[i]->Accept(this);
+    }
+  }
 }
 
 
@@ -1899,7 +1952,11 @@ void FlowGraphPrinter::VisitDo(DoInstr* instr) {
 
 
 void FlowGraphPrinter::VisitBind(BindInstr* instr) {
-  OS::Print("    t%d <- ", instr->temp_index());
+  if (instr->HasSSATemp()) {
+    OS::Print("    v%d <- ", instr->ssa_temp_index());
+  } else {
+    OS::Print("    t%d <- ", instr->temp_index());
+  }
   instr->computation()->Accept(this);
 }
 
@@ -1935,39 +1992,100 @@ void FlowGraphPrinter::VisitBranch(BranchInstr* instr) {
 }
 
 
+void FlowGraphPrinter::VisitPhi(PhiInstr* instr) {
+  OS::Print("    v%d <- %sphi(",
+            instr->ssa_temp_index(),
+            (instr->representation() == kUnboxedDouble) ? "unboxed " : "");
+  for (intptr_t i = 0; i < instr->InputCount(); ++i) {
+    if (i != 0) OS::Print(", ");
+    instr->InputAt(i)->Accept(this);
+  }
+  OS::Print(")");
+}
+
+
+void FlowGraphPrinter::VisitParameter(ParameterInstr* instr) {
+  OS::Print("Parameter(%d)", instr->index());
+}
+
+
 void FlowGraphBuilder::BuildGraph() {
   if (FLAG_print_ast) {
     // Print the function ast before IL generation.
     AstPrinter::PrintFunctionNodes(parsed_function());
   }
-  const Function& function = parsed_function().function();
   EffectGraphVisitor for_effect(this, 0);
   for_effect.AddInstruction(new TargetEntryInstr());
   parsed_function().node_sequence()->Visit(&for_effect);
   // Check that the graph is properly terminated.
   ASSERT(!for_effect.is_open());
-  if (for_effect.entry() != NULL) {
-    // Perform a depth-first traversal of the graph to build preorder and
-    // postorder block orders.
-    GrowableArray<intptr_t> parent;
-    for_effect.entry()->DiscoverBlocks(NULL,  // Entry block predecessor.
-                                       &preorder_block_entries_,
-                                       &postorder_block_entries_,
-                                       &parent);
-    ComputeDominators(&preorder_block_entries_, &parent);
+  Instruction* graph_entry = for_effect.entry();
+  if (is_osr()) {
+    if (osr_loop_header_ == NULL) {
+      Bailout("FlowGraphBuilder::BuildGraph: loop for OSR not found");
+    }
+    // The code before the loop has already run in the unoptimized code and
+    // is unreachable from the OSR entry.
+    TargetEntryInstr* osr_entry = new TargetEntryInstr();
+    osr_entry->SetSuccessor(osr_loop_header_);
+    graph_entry = osr_entry;
+  }
+  if (graph_entry != NULL) {
+    DiscoverBlocks(graph_entry->AsBlockEntry());
   }
   if (FLAG_print_flow_graph) {
-    intptr_t length = postorder_block_entries_.length();
-    GrowableArray<BlockEntryInstr*> reverse_postorder(length);
-    for (intptr_t i = length - 1; i >= 0; --i) {
-      reverse_postorder.Add(postorder_block_entries_[i]);
-    }
-    FlowGraphPrinter printer(function, reverse_postorder);
-    printer.VisitBlocks();
+    PrintGraph();
   }
 }
 
 
+void FlowGraphBuilder::DiscoverBlocks(BlockEntryInstr* graph_entry) {
+  // Perform a depth-first traversal of the graph to build preorder and
+  // postorder block orders.
+  ASSERT(graph_entry != NULL);
+  preorder_block_entries_.Clear();
+  postorder_block_entries_.Clear();
+  GrowableArray<intptr_t> parent;
+  graph_entry->DiscoverBlocks(NULL,  // Entry block predecessor.
+                              &preorder_block_entries_,
+                              &postorder_block_entries_,
+                              &parent);
+  ComputeDominators(&preorder_block_entries_, &parent);
+}
+
+
+void FlowGraphBuilder::RediscoverBlocks(
+    const GrowableArray<BlockEntryInstr*>& added_blocks) {
+  BlockEntryInstr* graph_entry = preorder_block_entries_[0];
+  for (intptr_t i = 0; i < preorder_block_entries_.length(); ++i) {
+    preorder_block_entries_[i]->ClearDiscovery();
+  }
+  for (intptr_t i = 0; i < added_blocks.length(); ++i) {
+    added_blocks[i]->ClearDiscovery();
+  }
+  DiscoverBlocks(graph_entry);
+}
+
+
+void FlowGraphBuilder::AddLoopHeader(JoinEntryInstr* join) {
+  join->set_loop_index(loop_count_++);
+  if (join->loop_index() == osr_loop_index_) {
+    osr_loop_header_ = join;
+  }
+}
+
+
+void FlowGraphBuilder::PrintGraph() const {
+  intptr_t length = postorder_block_entries_.length();
+  GrowableArray<BlockEntryInstr*> reverse_postorder(length);
+  for (intptr_t i = length - 1; i >= 0; --i) {
+    reverse_postorder.Add(postorder_block_entries_[i]);
+  }
+  FlowGraphPrinter printer(parsed_function().function(), reverse_postorder);
+  printer.VisitBlocks();
+}
+
+
 void FlowGraphBuilder::ComputeDominators(
     GrowableArray<BlockEntryInstr*>* preorder,
     GrowableArray<intptr_t>* parent) {
@@ -2037,6 +2155,7 @@ void FlowGraphBuilder::ComputeDominators(
     }
     idom[block_index] = dom_index;
     (*preorder)[block_index]->set_dominator((*preorder)[dom_index]);
+    (*preorder)[dom_index]->AddDominatedBlock((*preorder)[block_index]);
   }
 }
 
@@ -2055,6 +2174,395 @@ void FlowGraphBuilder::CompressPath(intptr_t start_index,
 }
 
 
+// The variables renamed by the SSA construction are numbered as follows:
+// first the parameters passed in the caller's frame (only present when they
+// are not copied to the local frame), then the parameters copied to the
+// local frame and the stack-allocated locals, then the temporaries.
+intptr_t FlowGraphBuilder::LocalVariableIndex(
+    const LocalVariable& local) const {
+  ASSERT(!local.is_captured());
+  const intptr_t index = local.index();
+  if (index > 0) {
+    // Parameter i is at fp[1 + parameter_count - i].
+    ASSERT(index - 2 < frame_parameter_count_);
+    return index - 2;
+  }
+  ASSERT(index < 0);
+  return frame_parameter_count_ - index - 1;
+}
+
+
+intptr_t FlowGraphBuilder::TempVariableIndex(intptr_t temp_index) const {
+  return frame_parameter_count_ +
+      parsed_function().stack_local_count() +
+      parsed_function().copied_parameter_count() +
+      temp_index;
+}
+
+
+static void UpdateTempCount(Value* value, intptr_t* count) {
+  if ((value != NULL) && value->IsTemp()) {
+    *count = Utils::Maximum(*count, value->AsTemp()->index() + 1);
+  }
+}
+
+
+intptr_t FlowGraphBuilder::ComputeTempCount() const {
+  intptr_t count = 0;
+  for (intptr_t i = 0; i < preorder_block_entries_.length(); ++i) {
+    Instruction* current = preorder_block_entries_[i]->StraightLineSuccessor();
+    while ((current != NULL) && !current->IsBlockEntry()) {
+      for (intptr_t j = 0; j < current->InputCount(); ++j) {
+        UpdateTempCount(current->InputAt(j), &count);
+      }
+      if (current->IsBind()) {
+        BindInstr* bind = current->AsBind();
+        count = Utils::Maximum(count, bind->temp_index() + 1);
+        UpdateTempCount(bind->computation()->AsTemp(), &count);
+      } else if (current->IsPickTemp()) {
+        PickTempInstr* pick = current->AsPickTemp();
+        count = Utils::Maximum(count, pick->destination() + 1);
+        count = Utils::Maximum(count, pick->source() + 1);
+      } else if (current->IsTuckTemp()) {
+        TuckTempInstr* tuck = current->AsTuckTemp();
+        count = Utils::Maximum(count, tuck->destination() + 1);
+        count = Utils::Maximum(count, tuck->source() + 1);
+      }
+      current = current->StraightLineSuccessor();
+    }
+  }
+  return count;
+}
+
+
+void FlowGraphBuilder::ComputeSSA() {
+  ComputeSSA(NULL);
+}
+
+
+void FlowGraphBuilder::ComputeInlinedSSA(
+    intptr_t first_ssa_temp_index,
+    const GrowableArray<Value*>& arguments) {
+  ASSERT(parsed_function().copied_parameter_count() == 0);
+  ASSERT(arguments.length() ==
+         parsed_function().function().num_fixed_parameters());
+  current_ssa_temp_index_ = first_ssa_temp_index;
+  ComputeSSA(&arguments);
+}
+
+
+// Uses of a definition are not shared between instructions.
+static Value* CopyValue(Value* value) {
+  UseVal* use = value->AsUse();
+  return (use == NULL) ? value : new UseVal(use->definition());
+}
+
+
+void FlowGraphBuilder::ComputeSSA(const GrowableArray<Value*>* arguments) {
+  ASSERT(!preorder_block_entries_.is_empty());
+  const intptr_t copied_parameter_count =
+      parsed_function().copied_parameter_count();
+  frame_parameter_count_ = (copied_parameter_count == 0)
+      ? parsed_function().function().num_fixed_parameters()
+      : 0;
+  const intptr_t first_temp_index = TempVariableIndex(0);
+  variable_count_ = first_temp_index + ComputeTempCount();
+
+  GrowableArray<BitVector*> dominance_frontier;
+  ComputeDominanceFrontiers(&dominance_frontier);
+  InsertPhis(dominance_frontier);
+
+  // The initial definitions of the variables: the parameters stay in their
+  // slots in the frame, everything else is null.  When entering a loop by
+  // on-stack replacement, the locals are in their slots in the unoptimized
+  // frame as well.  The parameters of an inlined function are the
+  // arguments of the call.
+  GrowableArray<Value*> env(variable_count_);
+  for (intptr_t i = 0; i < frame_parameter_count_; ++i) {
+    if (arguments != NULL) {
+      // The parameters are numbered from the last one, which is at the
+      // lowest address above the frame pointer.
+      env.Add(CopyValue((*arguments)[frame_parameter_count_ - 1 - i]));
+      continue;
+    }
+    ParameterInstr* param = new ParameterInstr(i + 2);
+    param->set_ssa_temp_index(current_ssa_temp_index_++);
+    env.Add(new UseVal(param));
+  }
+  const intptr_t frame_local_count = is_osr()
+      ? copied_parameter_count + parsed_function().stack_local_count()
+      : copied_parameter_count;
+  for (intptr_t i = 0; i < frame_local_count; ++i) {
+    ParameterInstr* param = new ParameterInstr(-1 - i);
+    param->set_ssa_temp_index(current_ssa_temp_index_++);
+    env.Add(new UseVal(param));
+  }
+  Value* null_value = new ConstantVal(Object::ZoneHandle());
+  while (env.length() < variable_count_) {
+    env.Add(null_value);
+  }
+
+  Rename(preorder_block_entries_[0], &env);
+  EliminateDeadPhis();
+
+  if (FLAG_print_flow_graph) {
+    OS::Print("SSA form:\n");
+    PrintGraph();
+  }
+}
+
+
+void FlowGraphBuilder::ComputeDominanceFrontiers(
+    GrowableArray<BitVector*>* frontiers) {
+  // Use the algorithm of Cooper, Harvey, and Kennedy, "A Simple, Fast
+  // Dominance Algorithm": a block is in the dominance frontier of each
+  // block on the dominator tree paths from its predecessors up to (but not
+  // including) its immediate dominator.  All sets are indexed by preorder
+  // block number.
+  const intptr_t size = preorder_block_entries_.length();
+  for (intptr_t i = 0; i < size; ++i) {
+    frontiers->Add(new BitVector(size));
+  }
+  for (intptr_t i = 0; i < size; ++i) {
+    BlockEntryInstr* block = preorder_block_entries_[i];
+    if (block->PredecessorCount() < 2) continue;
+    for (intptr_t j = 0; j < block->PredecessorCount(); ++j) {
+      BlockEntryInstr* runner = block->PredecessorAt(j);
+      while (runner != block->dominator()) {
+        (*frontiers)[runner->preorder_number()]->Add(i);
+        runner = runner->dominator();
+      }
+    }
+  }
+}
+
+
+intptr_t FlowGraphBuilder::DefinedVariable(Instruction* instr) const {
+  Computation* computation = NULL;
+  if (instr->IsBind()) {
+    computation = instr->AsBind()->computation();
+  } else if (instr->IsDo()) {
+    computation = instr->AsDo()->computation();
+  } else if (instr->IsPickTemp()) {
+    return TempVariableIndex(instr->AsPickTemp()->destination());
+  } else if (instr->IsTuckTemp()) {
+    return TempVariableIndex(instr->AsTuckTemp()->destination());
+  }
+  if (computation == NULL) return -1;
+  // A bound store defines both the local and the temporary, the caller
+  // handles the temporary.
+  StoreLocalComp* store = computation->AsStoreLocal();
+  if ((store != NULL) && !store->local().is_captured()) {
+    return LocalVariableIndex(store->local());
+  }
+  return -1;
+}
+
+
+void FlowGraphBuilder::InsertPhis(
+    const GrowableArray<BitVector*>& dominance_frontier) {
+  const intptr_t block_count = preorder_block_entries_.length();
+
+  // Collect the blocks assigning each variable.
+  GrowableArray<BitVector*> assigned_vars(variable_count_);
+  for (intptr_t i = 0; i < variable_count_; ++i) {
+    assigned_vars.Add(new BitVector(block_count));
+  }
+  for (intptr_t i = 0; i < block_count; ++i) {
+    Instruction* current = preorder_block_entries_[i]->StraightLineSuccessor();
+    while ((current != NULL) && !current->IsBlockEntry()) {
+      if (current->IsBind()) {
+        intptr_t temp_index = current->AsBind()->temp_index();
+        assigned_vars[TempVariableIndex(temp_index)]->Add(i);
+      }
+      intptr_t var_index = DefinedVariable(current);
+      if (var_index >= 0) assigned_vars[var_index]->Add(i);
+      current = current->StraightLineSuccessor();
+    }
+  }
+
+  // Place phis at the iterated dominance frontier of the assignments, as
+  // described by Cytron et al.  The arrays record the last variable for
+  // which a block got a phi or was added to the worklist.
+  GrowableArray<intptr_t> has_already(block_count);
+  GrowableArray<intptr_t> work(block_count);
+  for (intptr_t i = 0; i < block_count; ++i) {
+    has_already.Add(-1);
+    work.Add(-1);
+  }
+  GrowableArray<BlockEntryInstr*> worklist;
+  for (intptr_t var_index = 0; var_index < variable_count_; ++var_index) {
+    for (intptr_t i = 0; i < block_count; ++i) {
+      if (assigned_vars[var_index]->Contains(i)) {
+        work[i] = var_index;
+        worklist.Add(preorder_block_entries_[i]);
+      }
+    }
+    while (!worklist.is_empty()) {
+      BlockEntryInstr* current = worklist.Last();
+      worklist.RemoveLast();
+      BitVector* frontier = dominance_frontier[current->preorder_number()];
+      for (intptr_t i = 0; i < block_count; ++i) {
+        if (!frontier->Contains(i) || (has_already[i] >= var_index)) continue;
+        JoinEntryInstr* join = preorder_block_entries_[i]->AsJoinEntry();
+        ASSERT(join != NULL);
+        join->InsertPhi(new PhiInstr(join, var_index));
+        has_already[i] = var_index;
+        if (work[i] < var_index) {
+          work[i] = var_index;
+          worklist.Add(join);
+        }
+      }
+    }
+  }
+}
+
+
+// Rename the operands of a computation and return the value it reduces to
+// if it only moves a value between variables, NULL otherwise.
+Value* FlowGraphBuilder::RenameComputation(Computation* computation,
+                                           GrowableArray<Value*>* env) {
+  for (intptr_t i = 0; i < computation->InputCount(); ++i) {
+    TempVal* temp = computation->InputAt(i)->AsTemp();
+    if (temp != NULL) {
+      computation->SetInputAt(
+          i, CopyValue((*env)[TempVariableIndex(temp->index())]));
+    }
+  }
+  if (computation->IsTemp()) {
+    return CopyValue(
+        (*env)[TempVariableIndex(computation->AsTemp()->index())]);
+  }
+  if (computation->IsConstant()) return computation->AsConstant();
+  LoadLocalComp* load = computation->AsLoadLocal();
+  if ((load != NULL) && !load->local().is_captured()) {
+    return CopyValue((*env)[LocalVariableIndex(load->local())]);
+  }
+  StoreLocalComp* store = computation->AsStoreLocal();
+  if ((store != NULL) && !store->local().is_captured()) {
+    (*env)[LocalVariableIndex(store->local())] = store->value();
+    return store->value();
+  }
+  CreateClosureComp* closure = computation->AsCreateClosure();
+  if ((closure != NULL) &&
+      closure->function().IsImplicitInstanceClosureFunction()) {
+    // The receiver is passed on the stack but is not an operand.
+    Bailout("ComputeSSA implicit instance closure");
+  }
+  return NULL;
+}
+
+
+void FlowGraphBuilder::Rename(BlockEntryInstr* block,
+                              GrowableArray<Value*>* env) {
+  // The phis of a join are the new definitions of their variables.
+  JoinEntryInstr* join = block->AsJoinEntry();
+  if ((join != NULL) && (join->phis() != NULL)) {
+    ZoneGrowableArray<PhiInstr*>* phis = join->phis();
+    for (intptr_t i = 0; i < phis->length(); ++i) {
+      PhiInstr* phi = (*phis)[i];
+      phi->set_ssa_temp_index(current_ssa_temp_index_++);
+      (*env)[phi->variable_index()] = new UseVal(phi);
+    }
+  }
+
+  Instruction* current = block->StraightLineSuccessor();
+  while ((current != NULL) && !current->IsBlockEntry()) {
+    if (current->IsBind()) {
+      BindInstr* bind = current->AsBind();
+      Value* value = RenameComputation(bind->computation(), env);
+      intptr_t var_index = TempVariableIndex(bind->temp_index());
+      if (value != NULL) {
+        // The bind is a copy, its uses are replaced by the value.
+        bind->set_computation(value);
+        (*env)[var_index] = value;
+      } else {
+        bind->set_ssa_temp_index(current_ssa_temp_index_++);
+        (*env)[var_index] = new UseVal(bind);
+      }
+    } else if (current->IsDo()) {
+      DoInstr* do_instr = current->AsDo();
+      Value* value = RenameComputation(do_instr->computation(), env);
+      if (value != NULL) do_instr->set_computation(value);
+    } else if (current->IsPickTemp()) {
+      PickTempInstr* pick = current->AsPickTemp();
+      (*env)[TempVariableIndex(pick->destination())] =
+          (*env)[TempVariableIndex(pick->source())];
+    } else if (current->IsTuckTemp()) {
+      TuckTempInstr* tuck = current->AsTuckTemp();
+      (*env)[TempVariableIndex(tuck->destination())] =
+          (*env)[TempVariableIndex(tuck->source())];
+    } else {
+      for (intptr_t i = 0; i < current->InputCount(); ++i) {
+        TempVal* temp = current->InputAt(i)->AsTemp();
+        if (temp != NULL) {
+          current->SetInputAt(
+              i, CopyValue((*env)[TempVariableIndex(temp->index())]));
+        }
+      }
+    }
+    current = current->StraightLineSuccessor();
+  }
+
+  // Pass the current definitions to the phis of the successors.
+  for (intptr_t i = 0; i < block->SuccessorCount(); ++i) {
+    JoinEntryInstr* successor = block->SuccessorAt(i)->AsJoinEntry();
+    if ((successor == NULL) || (successor->phis() == NULL)) continue;
+    intptr_t pred_index = successor->IndexOfPredecessor(block);
+    ZoneGrowableArray<PhiInstr*>* phis = successor->phis();
+    for (intptr_t j = 0; j < phis->length(); ++j) {
+      PhiInstr* phi = (*phis)[j];
+      phi->SetInputAt(pred_index, CopyValue((*env)[phi->variable_index()]));
+    }
+  }
+
+  // Rename the blocks dominated by this one, each in a copy of the
+  // environment.
+  for (intptr_t i = 0; i < block->dominated_blocks().length(); ++i) {
+    GrowableArray<Value*> child_env(variable_count_);
+    child_env.AddArray(*env);
+    Rename(block->dominated_blocks()[i], &child_env);
+  }
+}
+
+
+static void MarkPhiAlive(Value* value, GrowableArray<PhiInstr*>* worklist) {
+  UseVal* use = value->AsUse();
+  if (use == NULL) return;
+  PhiInstr* phi = use->definition()->AsPhi();
+  if ((phi != NULL) && !phi->is_alive()) {
+    phi->mark_alive();
+    worklist->Add(phi);
+  }
+}
+
+
+void FlowGraphBuilder::EliminateDeadPhis() {
+  // Phis are live if they are used by an instruction or by a live phi.
+  GrowableArray<PhiInstr*> worklist;
+  for (intptr_t i = 0; i < preorder_block_entries_.length(); ++i) {
+    Instruction* current = preorder_block_entries_[i]->StraightLineSuccessor();
+    while ((current != NULL) && !current->IsBlockEntry()) {
+      for (intptr_t j = 0; j < current->InputCount(); ++j) {
+        MarkPhiAlive(current->InputAt(j), &worklist);
+      }
+      current = current->StraightLineSuccessor();
+    }
+  }
+  while (!worklist.is_empty()) {
+    PhiInstr* phi = worklist.Last();
+    worklist.RemoveLast();
+    for (intptr_t i = 0; i < phi->InputCount(); ++i) {
+      MarkPhiAlive(phi->InputAt(i), &worklist);
+    }
+  }
+  for (intptr_t i = 0; i < preorder_block_entries_.length(); ++i) {
+    JoinEntryInstr* join = preorder_block_entries_[i]->AsJoinEntry();
+    if (join != NULL) join->RemoveDeadPhis();
+  }
+}
+
+
 void FlowGraphBuilder::Bailout(const char* reason) {
   const char* kFormat = "FlowGraphBuilder Bailout: %s %s";
   const char* function_name = parsed_function_.function().ToCString();
@@ -12,20 +12,56 @@
 
 namespace dart {
 
+class BitVector;
 class Instruction;
+class LocalVariable;
 class ParsedFunction;
 
 // Build a flow graph from a parsed function's AST.
 class FlowGraphBuilder: public ValueObject {
  public:
-  explicit FlowGraphBuilder(const ParsedFunction& parsed_function)
+  // The graph of a function compiled for on-stack replacement is entered
+  // at the header of the loop with the given index; osr_loop_index is -1
+  // for the graph of the whole function.
+  FlowGraphBuilder(const ParsedFunction& parsed_function,
+                   intptr_t osr_loop_index)
       : parsed_function_(parsed_function),
         preorder_block_entries_(),
         postorder_block_entries_(),
-        context_level_(0) { }
+        context_level_(0),
+        frame_parameter_count_(0),
+        variable_count_(0),
+        current_ssa_temp_index_(0),
+        loop_count_(0),
+        osr_loop_index_(osr_loop_index),
+        osr_loop_header_(NULL) { }
 
   void BuildGraph();
 
+  bool is_osr() const { return osr_loop_index_ >= 0; }
+
+  // Number the loop headed by the join, and record it if it is the loop
+  // entered by on-stack replacement.
+  void AddLoopHeader(JoinEntryInstr* join);
+
+  // Convert the graph built by BuildGraph to SSA form for the optimizing
+  // compiler.  The temporaries and the stack-allocated local variables are
+  // replaced by uses of their definitions, and phis are inserted at the
+  // joins where different definitions of a variable meet.
+  void ComputeSSA();
+
+  // Convert the graph of a function inlined at a call to SSA form.  The
+  // parameters are the arguments of the call instead of the incoming values
+  // in the frame, and the SSA temporaries are numbered from the given index
+  // on, after the temporaries of the caller.
+  void ComputeInlinedSSA(intptr_t first_ssa_temp_index,
+                         const GrowableArray<Value*>& arguments);
+
+  // Recompute the block orders, the predecessors and the dominators after
+  // the graph was transformed.  The added blocks are blocks of the graph
+  // which were discovered before as part of another graph, or not at all.
+  void RediscoverBlocks(const GrowableArray<BlockEntryInstr*>& added_blocks);
+
   const ParsedFunction& parsed_function() const { return parsed_function_; }
 
   const GrowableArray<BlockEntryInstr*>& postorder_block_entries() const {
@@ -34,10 +70,20 @@ class FlowGraphBuilder: public ValueObject {
 
   void Bailout(const char* reason);
 
+  void PrintGraph() const;
+
   void set_context_level(intptr_t value) { context_level_ = value; }
   intptr_t context_level() const { return context_level_; }
 
+  // The number of SSA temporary indices used by the definitions.
+  intptr_t current_ssa_temp_index() const { return current_ssa_temp_index_; }
+  void set_current_ssa_temp_index(intptr_t index) {
+    current_ssa_temp_index_ = index;
+  }
+
  private:
+  void DiscoverBlocks(BlockEntryInstr* graph_entry);
+  void ComputeSSA(const GrowableArray<Value*>* arguments);
   void ComputeDominators(GrowableArray<BlockEntryInstr*>* preorder,
                          GrowableArray<intptr_t>* parent);
   void CompressPath(intptr_t start_index,
@@ -45,10 +91,31 @@ class FlowGraphBuilder: public ValueObject {
                     GrowableArray<intptr_t>* parent,
                     GrowableArray<intptr_t>* label);
 
+  // Helpers for the SSA construction.  The renamed variables are the
+  // parameters passed on the stack, the stack-allocated locals and the
+  // temporaries, each numbered by a variable index.
+  intptr_t LocalVariableIndex(const LocalVariable& local) const;
+  intptr_t TempVariableIndex(intptr_t temp_index) const;
+  intptr_t ComputeTempCount() const;
+  // Returns the local variable assigned by the instruction, or -1.
+  intptr_t DefinedVariable(Instruction* instr) const;
+  void ComputeDominanceFrontiers(GrowableArray<BitVector*>* frontiers);
+  void InsertPhis(const GrowableArray<BitVector*>& dominance_frontier);
+  void Rename(BlockEntryInstr* block, GrowableArray<Value*>* env);
+  Value* RenameComputation(Computation* computation,
+                           GrowableArray<Value*>* env);
+  void EliminateDeadPhis();
+
   const ParsedFunction& parsed_function_;
   GrowableArray<BlockEntryInstr*> preorder_block_entries_;
   GrowableArray<BlockEntryInstr*> postorder_block_entries_;
   intptr_t context_level_;
+  intptr_t frame_parameter_count_;
+  intptr_t variable_count_;
+  intptr_t current_ssa_temp_index_;
+  intptr_t loop_count_;
+  const intptr_t osr_loop_index_;
+  JoinEntryInstr* osr_loop_header_;
 };
 
 
@@ -24,8 +24,11 @@ class FlowGraphCompiler : public FlowGraphVisitor {
  public:
   FlowGraphCompiler(Assembler* assembler,
                     const ParsedFunction& parsed_function,
-                    const GrowableArray<BlockEntryInstr*>& blocks)
+                    const GrowableArray<BlockEntryInstr*>& blocks,
+                    bool is_optimizing,
+                    bool is_osr)
       : FlowGraphVisitor(blocks), parsed_function_(parsed_function) {
+    ASSERT(!is_optimizing && !is_osr);
   }
 
   virtual ~FlowGraphCompiler() { }
@@ -36,6 +39,7 @@ class FlowGraphCompiler : public FlowGraphVisitor {
   void FinalizePcDescriptors(const Code& code);
   void FinalizeVarDescriptors(const Code& code);
   void FinalizeExceptionHandlers(const Code& code);
+  void FinalizeInlinedFrames(const Code& code);
 
  private:
   // Bail out of the flow graph compiler.  Does not return to the caller.
@@ -43,6 +43,11 @@ void FlowGraphCompiler::FinalizeExceptionHandlers(const Code& code) {
 }
 
 
+void FlowGraphCompiler::FinalizeInlinedFrames(const Code& code) {
+  UNIMPLEMENTED();
+}
+
+
 }  // namespace dart
 
 #endif  // defined TARGET_ARCH_IA32
@@ -7,10 +7,12 @@
 
 #include "vm/flow_graph_compiler.h"
 
+#include "vm/assembler_macros.h"
 #include "vm/ast_printer.h"
 #include "vm/code_descriptors.h"
 #include "vm/code_generator.h"
 #include "vm/disassembler.h"
+#include "vm/flow_graph_allocator.h"
 #include "vm/longjump.h"
 #include "vm/object_store.h"
 #include "vm/parser.h"
@@ -18,20 +20,48 @@
 
 namespace dart {
 
+DECLARE_FLAG(int, optimization_counter_threshold);
 DECLARE_FLAG(bool, print_ast);
 DECLARE_FLAG(bool, print_scopes);
 DECLARE_FLAG(bool, trace_functions);
+DECLARE_FLAG(bool, use_osr);
+
+// Registers available to the register allocator.  RAX, RCX and RDX are
+// used as scratch registers by the code for the computations, R10 holds the
+// arguments descriptor at calls, R11 (TMP) and R15 (CTX) are reserved.
+static const Register kAllocatableRegisters[] = {
+  RBX, RSI, RDI, R8, R9, R12, R13, R14
+};
+static const intptr_t kNumberOfAllocatableRegisters =
+    sizeof(kAllocatableRegisters) / sizeof(kAllocatableRegisters[0]);
+
+// XMM registers available to the register allocator for unboxed doubles.
+// XMM0 and XMM1 are used as scratch registers.
+static const XmmRegister kAllocatableXmmRegisters[] = {
+  XMM2, XMM3, XMM4, XMM5, XMM6, XMM7
+};
+static const intptr_t kNumberOfAllocatableXmmRegisters =
+    sizeof(kAllocatableXmmRegisters) / sizeof(kAllocatableXmmRegisters[0]);
 
 FlowGraphCompiler::FlowGraphCompiler(
     Assembler* assembler,
     const ParsedFunction& parsed_function,
-    const GrowableArray<BlockEntryInstr*>& block_order)
+    const GrowableArray<BlockEntryInstr*>& block_order,
+    bool is_optimizing,
+    bool is_osr)
     : FlowGraphVisitor(block_order),
       assembler_(assembler),
       parsed_function_(parsed_function),
       block_info_(block_order.length()),
       current_block_(NULL),
-      pc_descriptors_list_(new DescriptorList()) {
+      pc_descriptors_list_(new DescriptorList()),
+      current_inlined_function_(NULL),
+      inlined_pc_offsets_(),
+      inlined_functions_at_pcs_(),
+      is_optimizing_(is_optimizing),
+      is_osr_(is_osr),
+      allocator_(NULL) {
+  ASSERT(!is_osr || is_optimizing);
   for (int i = 0; i < block_order.length(); ++i) {
     block_info_.Add(new BlockInfo());
   }
@@ -54,6 +84,12 @@ intptr_t FlowGraphCompiler::StackSize() const {
 }
 
 
+intptr_t FlowGraphCompiler::FrameSize() const {
+  return StackSize() +
+      ((allocator_ == NULL) ? 0 : allocator_->spill_slot_count());
+}
+
+
 void FlowGraphCompiler::Bailout(const char* reason) {
   const char* kFormat = "FlowGraphCompiler Bailout: %s %s.";
   const char* function_name = parsed_function_.function().ToCString();
@@ -86,6 +122,14 @@ void FlowGraphCompiler::LoadValue(Register dst, Value* value) {
     } else {
       __ LoadObject(dst, value->AsConstant()->value());
     }
+  } else if (value->IsUse()) {
+    ASSERT(is_optimizing());
+    const Location& location = value->AsUse()->definition()->location();
+    if (location.IsRegister()) {
+      if (location.reg() != dst) __ movq(dst, location.reg());
+    } else {
+      __ movq(dst, Address(RBP, location.stack_index() * kWordSize));
+    }
   } else {
     ASSERT(value->IsTemp());
     __ popq(dst);
@@ -93,6 +137,23 @@ void FlowGraphCompiler::LoadValue(Register dst, Value* value) {
 }
 
 
+void FlowGraphCompiler::PushInputs(Computation* computation) {
+  for (intptr_t i = 0; i < computation->InputCount(); ++i) {
+    Value* value = computation->InputAt(i);
+    if (value->IsConstant()) {
+      __ PushObject(value->AsConstant()->value());
+    } else {
+      const Location& location = value->AsUse()->definition()->location();
+      if (location.IsRegister()) {
+        __ pushq(location.reg());
+      } else {
+        __ pushq(Address(RBP, location.stack_index() * kWordSize));
+      }
+    }
+  }
+}
+
+
 void FlowGraphCompiler::VisitTemp(TempVal* val) {
   LoadValue(RAX, val);
 }
@@ -103,6 +164,11 @@ void FlowGraphCompiler::VisitConstant(ConstantVal* val) {
 }
 
 
+void FlowGraphCompiler::VisitUse(UseVal* val) {
+  LoadValue(RAX, val);
+}
+
+
 void FlowGraphCompiler::VisitAssertAssignable(AssertAssignableComp* comp) {
   Bailout("AssertAssignableComp");
 }
@@ -166,7 +232,11 @@ void FlowGraphCompiler::EmitInstanceCall(intptr_t node_id,
   }
   ExternalLabel target_label("InlineCache", label_address);
   __ call(&target_label);
-  AddCurrentDescriptor(PcDescriptors::kIcCall, node_id, token_index);
+  // Optimized code does not deoptimize to the node ids of its calls, which
+  // are not unique once the calls of inlined functions are compiled in.
+  AddCurrentDescriptor(PcDescriptors::kIcCall,
+                       is_optimizing() ? AstNode::kNoId : node_id,
+                       token_index);
   __ addq(RSP, Immediate(argument_count * kWordSize));
 }
 
@@ -198,8 +268,8 @@ void FlowGraphCompiler::VisitStoreContext(StoreContextComp* comp) {
 
 
 void FlowGraphCompiler::VisitClosureCall(ClosureCallComp* comp) {
-  ASSERT(comp->context()->IsTemp());
-  ASSERT(VerifyCallComputation(comp));
+  ASSERT(is_optimizing() || comp->context()->IsTemp());
+  ASSERT(is_optimizing() || VerifyCallComputation(comp));
   // The arguments to the stub include the closure.  The arguments
   // descriptor describes the closure's arguments (and so does not include
   // the closure).
@@ -218,7 +288,7 @@ void FlowGraphCompiler::VisitClosureCall(ClosureCallComp* comp) {
 
 
 void FlowGraphCompiler::VisitInstanceCall(InstanceCallComp* comp) {
-  ASSERT(VerifyCallComputation(comp));
+  ASSERT(is_optimizing() || VerifyCallComputation(comp));
   EmitInstanceCall(comp->node_id(),
                    comp->token_index(),
                    comp->function_name(),
@@ -249,7 +319,7 @@ void FlowGraphCompiler::VisitStrictCompare(StrictCompareComp* comp) {
 
 
 void FlowGraphCompiler::VisitStaticCall(StaticCallComp* comp) {
-  ASSERT(VerifyCallComputation(comp));
+  ASSERT(is_optimizing() || VerifyCallComputation(comp));
   EmitStaticCall(comp->token_index(),
                  comp->function(),
                  comp->ArgumentCount(),
@@ -616,7 +686,7 @@ void FlowGraphCompiler::VisitCreateArray(CreateArrayComp* comp) {
   // 2. Initialize the array in RAX with the element values.
   __ leaq(RCX, FieldAddress(RAX, Array::data_offset()));
   for (int i = comp->ElementCount() - 1; i >= 0; --i) {
-    if (comp->ElementAt(i)->IsTemp()) {
+    if (comp->ElementAt(i)->IsTemp() || is_optimizing()) {
       __ popq(Address(RCX, i * kWordSize));
     } else {
       LoadValue(RDX, comp->ElementAt(i));
@@ -645,7 +715,7 @@ void FlowGraphCompiler::VisitCreateClosure(CreateClosureComp* comp) {
 
 
 void FlowGraphCompiler::VisitNativeLoadField(NativeLoadFieldComp* comp) {
-  __ popq(RAX);
+  LoadValue(RAX, comp->value());
   __ movq(RAX, FieldAddress(RAX, comp->offset_in_bytes()));
 }
 
@@ -804,7 +874,7 @@ void FlowGraphCompiler::VisitAllocateContext(AllocateContextComp* comp) {
 
 
 void FlowGraphCompiler::VisitChainContext(ChainContextComp* comp) {
-  __ popq(RAX);
+  LoadValue(RAX, comp->context_value());
   // Chain the new context in RAX to its parent in CTX.
   __ StoreIntoObject(RAX,
                      FieldAddress(RAX, Context::parent_offset()),
@@ -814,19 +884,74 @@ void FlowGraphCompiler::VisitChainContext(ChainContextComp* comp) {
 }
 
 
+void FlowGraphCompiler::VisitTestClass(TestClassComp* comp) {
+  const Bool& bool_true = Bool::ZoneHandle(Bool::True());
+  const Bool& bool_false = Bool::ZoneHandle(Bool::False());
+  LoadValue(RAX, comp->value());
+  Label load_false, done;
+  __ testq(RAX, Immediate(kSmiTagMask));
+  if (comp->cls().raw() == Smi::Class()) {
+    __ j(NOT_ZERO, &load_false, Assembler::kNearJump);
+  } else {
+    __ j(ZERO, &load_false, Assembler::kNearJump);
+    __ movq(RCX, FieldAddress(RAX, Object::class_offset()));
+    __ CompareObject(RCX, comp->cls());
+    __ j(NOT_EQUAL, &load_false, Assembler::kNearJump);
+  }
+  __ LoadObject(RAX, bool_true);
+  __ jmp(&done, Assembler::kNearJump);
+  __ Bind(&load_false);
+  __ LoadObject(RAX, bool_false);
+  __ Bind(&done);
+}
+
+
+void FlowGraphCompiler::VisitUnboxedDoubleBinaryOp(
+    UnboxedDoubleBinaryOpComp* comp) {
+  // Only optimized code computes on unboxed values, see VisitBind.
+  UNREACHABLE();
+}
+
+
+void FlowGraphCompiler::VisitBoxDouble(BoxDoubleComp* comp) {
+  UNREACHABLE();
+}
+
+
+void FlowGraphCompiler::VisitLoadIndexed(LoadIndexedComp* comp) {
+  // Only optimized code inlines the index operator of arrays.
+  UNREACHABLE();
+}
+
+
 void FlowGraphCompiler::VisitBlocks() {
   for (intptr_t i = 0; i < block_order_.length(); ++i) {
     // Compile the block entry.
     current_block_ = block_order_[i];
+    current_inlined_function_ = current_block()->inlined_function();
     Instruction* instr = current_block()->Accept(this);
     // Compile all successors until an exit, branch, or a block entry.
     while ((instr != NULL) && !instr->IsBlockEntry()) {
+      current_inlined_function_ = instr->inlined_function();
       instr = instr->Accept(this);
     }
+    current_inlined_function_ = NULL;
 
     BlockEntryInstr* successor =
         (instr == NULL) ? NULL : instr->AsBlockEntry();
     if (successor != NULL) {
+      JoinEntryInstr* join = successor->AsJoinEntry();
+      if (is_optimizing() && (join != NULL)) {
+        EmitPhiMoves(join);
+      }
+      // A goto to a loop header which precedes the block in the block order
+      // is a back edge.
+      if (!is_optimizing() &&
+          (join != NULL) &&
+          (join->loop_index() >= 0) &&
+          (join->postorder_number() >= current_block()->postorder_number())) {
+        EmitOsrCheck(join);
+      }
       // Block ended with a "goto".  We can fall through if it is the
       // next block in the list.  Otherwise, we need a jump.
       if ((i == block_order_.length() - 1) ||
@@ -838,6 +963,53 @@ void FlowGraphCompiler::VisitBlocks() {
 }
 
 
+// The loop header is at the same expression stack height as the back edge,
+// where the expression stack is empty.  Code compiled for on-stack
+// replacement reads the locals from their slots in the unoptimized frame.
+void FlowGraphCompiler::EmitOsrCheck(JoinEntryInstr* loop_header) {
+  if (!FLAG_use_osr || !CodeGenerator::CanOptimize()) return;
+  const Function& function =
+      Function::ZoneHandle(parsed_function_.function().raw());
+  __ LoadObject(RBX, function);
+  __ incq(FieldAddress(RBX, Function::usage_counter_offset()));
+  __ cmpq(FieldAddress(RBX, Function::usage_counter_offset()),
+          Immediate(FLAG_optimization_counter_threshold));
+  Label not_yet_hot;
+  __ j(LESS_EQUAL, &not_yet_hot);
+  const Immediate raw_null =
+      Immediate(reinterpret_cast<intptr_t>(Object::null()));
+  __ pushq(raw_null);  // Space for the result: the code to continue in.
+  __ pushq(RBX);  // Function.
+  __ pushq(Immediate(Smi::RawValue(loop_header->loop_index())));
+  GenerateCallRuntime(AstNode::kNoId,
+                      function.token_index(),
+                      kOnStackReplacementRuntimeEntry);
+  __ popq(RAX);  // Remove arguments.
+  __ popq(RAX);
+  __ popq(RAX);  // Code compiled for on-stack replacement, or null.
+  __ cmpq(RAX, raw_null);
+  __ j(EQUAL, &not_yet_hot);
+  __ movq(RAX, FieldAddress(RAX, Code::instructions_offset()));
+  __ addq(RAX, Immediate(Instructions::HeaderSize() - kHeapObjectTag));
+  __ jmp(RAX);
+  __ Bind(&not_yet_hot);
+}
+
+
+// The unoptimized code jumps here from a back edge, leaving the return
+// address, the saved frame pointer, the parameters and the locals in place.
+// The optimized frame is the unoptimized one extended by the spill slots.
+void FlowGraphCompiler::EmitOsrEntry() {
+  __ leaq(RSP, Address(RBP, -FrameSize() * kWordSize));
+  if (allocator_->spill_slot_count() > 0) {
+    __ movq(RAX, Immediate(reinterpret_cast<intptr_t>(Object::null())));
+    for (intptr_t i = 0; i < allocator_->spill_slot_count(); ++i) {
+      __ movq(Address(RBP, (-1 - StackSize() - i) * kWordSize), RAX);
+    }
+  }
+}
+
+
 void FlowGraphCompiler::VisitJoinEntry(JoinEntryInstr* instr) {
   __ Bind(&block_info_[instr->postorder_number()]->label);
 }
@@ -849,6 +1021,8 @@ void FlowGraphCompiler::VisitTargetEntry(TargetEntryInstr* instr) {
 
 
 void FlowGraphCompiler::VisitPickTemp(PickTempInstr* instr) {
+  // Optimized code copies the SSA values instead of the stack slots.
+  if (is_optimizing()) return;
   // Semantics is to copy a stack-allocated temporary to the top of stack.
   // Destination index d is assumed the new top of stack after the
   // operation, so d-1 is the current top of stack and so d-s-1 is the
@@ -860,6 +1034,7 @@ void FlowGraphCompiler::VisitPickTemp(PickTempInstr* instr) {
 
 
 void FlowGraphCompiler::VisitTuckTemp(TuckTempInstr* instr) {
+  if (is_optimizing()) return;
   // Semantics is to assign to a stack-allocated temporary a copy of the top
   // of stack.  Source index s is assumed the top of stack, s-d is the
   // offset to destination index d.
@@ -871,16 +1046,625 @@ void FlowGraphCompiler::VisitTuckTemp(TuckTempInstr* instr) {
 
 
 void FlowGraphCompiler::VisitDo(DoInstr* instr) {
+  if (is_optimizing()) {
+    EmitOptimizedComputation(instr->computation(), NULL);
+    return;
+  }
   instr->computation()->Accept(this);
 }
 
 
 void FlowGraphCompiler::VisitBind(BindInstr* instr) {
+  if (is_optimizing()) {
+    Computation* computation = instr->computation();
+    if (computation->IsUnboxedDoubleBinaryOp()) {
+      EmitUnboxedDoubleBinaryOp(computation->AsUnboxedDoubleBinaryOp(), instr);
+    } else if (computation->IsBoxDouble()) {
+      EmitBoxDouble(computation->AsBoxDouble(), instr);
+    } else if (computation->IsLoadIndexed()) {
+      EmitLoadIndexed(computation->AsLoadIndexed(), instr);
+    } else if (FlowGraphAllocator::IsSmiFastPathCall(computation)) {
+      EmitSmiFastPath(computation->AsInstanceCall(), instr);
+    } else {
+      EmitOptimizedComputation(instr->computation(),
+                               instr->HasSSATemp() ? instr : NULL);
+    }
+    return;
+  }
   instr->computation()->Accept(this);
   __ pushq(RAX);
 }
 
 
+void FlowGraphCompiler::EmitOptimizedComputation(Computation* computation,
+                                                 Definition* definition) {
+  // Values were propagated to their uses when renaming the graph.
+  if (computation->IsTemp() ||
+      computation->IsConstant() ||
+      computation->IsUse()) {
+    return;
+  }
+  // Calls consume their inputs from the stack, the other computations load
+  // them from their locations.
+  if (FlowGraphAllocator::IsCallComputation(computation)) {
+    PushInputs(computation);
+  }
+  computation->Accept(this);
+  if (definition != NULL) {
+    const Location& location = definition->location();
+    if (location.IsRegister()) {
+      __ movq(location.reg(), RAX);
+    } else {
+      __ movq(Address(RBP, location.stack_index() * kWordSize), RAX);
+    }
+  }
+}
+
+
+// Emit the inlined Smi operation, leaving the result in RAX, or fall back
+// to the instance call if an operand is not a Smi or the result overflows.
+// The registers live across the computation are preserved around the call.
+void FlowGraphCompiler::EmitSmiFastPath(InstanceCallComp* comp,
+                                        BindInstr* instr) {
+  const Token::Kind kKinds[] = {
+    Token::kADD, Token::kSUB, Token::kMUL, Token::kLT, Token::kGT,
+    Token::kLTE, Token::kGTE, Token::kEQ
+  };
+  const Token::Kind kind = comp->OperatorKind(kKinds, ARRAY_SIZE(kKinds));
+  ASSERT(kind != Token::kILLEGAL);
+
+  // Arithmetic operations which have seen Double receivers are also
+  // computed inline on boxed doubles.
+  const Class& double_class = Class::ZoneHandle(
+      Isolate::Current()->object_store()->double_class());
+  const bool has_double_path =
+      ((kind == Token::kADD) || (kind == Token::kSUB) ||
+       (kind == Token::kMUL)) &&
+      comp->HasReceiverClass(double_class);
+
+  Label slow_path, double_path, done;
+  LoadValue(RAX, comp->ArgumentAt(0));
+  LoadValue(RCX, comp->ArgumentAt(1));
+  __ movq(RDX, RAX);
+  __ orq(RDX, RCX);
+  __ testq(RDX, Immediate(kSmiTagMask));
+  __ j(NOT_ZERO, has_double_path ? &double_path : &slow_path);
+  if (Token::IsRelationalOperator(kind) || (kind == Token::kEQ)) {
+    Condition condition = EQUAL;
+    switch (kind) {
+      case Token::kLT: condition = LESS; break;
+      case Token::kGT: condition = GREATER; break;
+      case Token::kLTE: condition = LESS_EQUAL; break;
+      case Token::kGTE: condition = GREATER_EQUAL; break;
+      default: break;
+    }
+    Label load_true;
+    __ cmpq(RAX, RCX);
+    __ j(condition, &load_true, Assembler::kNearJump);
+    __ LoadObject(RAX, Bool::ZoneHandle(Bool::False()));
+    __ jmp(&done);
+    __ Bind(&load_true);
+    __ LoadObject(RAX, Bool::ZoneHandle(Bool::True()));
+    __ jmp(&done);
+  } else {
+    // Compute into RDX to keep the operands for the slow path.
+    __ movq(RDX, RAX);
+    switch (kind) {
+      case Token::kADD:
+        __ addq(RDX, RCX);
+        break;
+      case Token::kSUB:
+        __ subq(RDX, RCX);
+        break;
+      case Token::kMUL:
+        __ SmiUntag(RDX);
+        __ imulq(RDX, RCX);
+        break;
+      default:
+        UNREACHABLE();
+    }
+    __ j(OVERFLOW, &slow_path);
+    __ movq(RAX, RDX);
+    __ jmp(&done);
+  }
+
+  if (has_double_path) {
+    // The receiver must be a Double, the argument a Smi or a Double.
+    Label convert_smi, compute;
+    __ Bind(&double_path);
+    __ testq(RAX, Immediate(kSmiTagMask));
+    __ j(ZERO, &slow_path);
+    __ movq(RDX, FieldAddress(RAX, Object::class_offset()));
+    __ CompareObject(RDX, double_class);
+    __ j(NOT_EQUAL, &slow_path);
+    __ movsd(XMM0, FieldAddress(RAX, Double::value_offset()));
+    __ testq(RCX, Immediate(kSmiTagMask));
+    __ j(ZERO, &convert_smi, Assembler::kNearJump);
+    __ movq(RDX, FieldAddress(RCX, Object::class_offset()));
+    __ CompareObject(RDX, double_class);
+    __ j(NOT_EQUAL, &slow_path);
+    __ movsd(XMM1, FieldAddress(RCX, Double::value_offset()));
+    __ jmp(&compute, Assembler::kNearJump);
+    __ Bind(&convert_smi);
+    __ movq(RDX, RCX);
+    __ SmiUntag(RDX);
+    __ cvtsi2sd(XMM1, RDX);
+    __ Bind(&compute);
+    switch (kind) {
+      case Token::kADD: __ addsd(XMM0, XMM1); break;
+      case Token::kSUB: __ subsd(XMM0, XMM1); break;
+      case Token::kMUL: __ mulsd(XMM0, XMM1); break;
+      default: UNREACHABLE();
+    }
+    // R10 is free outside of calls.  Without space for the result, the
+    // slow path computes it again.
+    __ LoadObject(RDX, double_class);
+    AssemblerMacros::TryAllocate(assembler_,
+                                 double_class,
+                                 RDX,
+                                 &slow_path,
+                                 R10);
+    __ movsd(FieldAddress(R10, Double::value_offset()), XMM0);
+    __ movq(RAX, R10);
+    __ jmp(&done);
+  }
+
+  __ Bind(&slow_path);
+  GrowableArray<Register> live_registers;
+  allocator_->GetLiveRegistersAt(instr, &live_registers);
+  for (intptr_t i = 0; i < live_registers.length(); ++i) {
+    __ pushq(live_registers[i]);
+  }
+  __ pushq(RAX);
+  __ pushq(RCX);
+  EmitInstanceCall(comp->node_id(),
+                   comp->token_index(),
+                   comp->function_name(),
+                   comp->ArgumentCount(),
+                   comp->argument_names(),
+                   comp->checked_argument_count());
+  for (intptr_t i = live_registers.length() - 1; i >= 0; --i) {
+    __ popq(live_registers[i]);
+  }
+  __ Bind(&done);
+
+  const Location& location = instr->location();
+  if (location.IsRegister()) {
+    __ movq(location.reg(), RAX);
+  } else {
+    __ movq(Address(RBP, location.stack_index() * kWordSize), RAX);
+  }
+}
+
+
+void FlowGraphCompiler::LoadDoubleValue(XmmRegister dst, Value* value) {
+  if (value->IsConstant()) {
+    const Object& constant = value->AsConstant()->value();
+    if (constant.IsSmi()) {
+      __ movq(RAX, Immediate(reinterpret_cast<int64_t>(constant.raw())));
+      __ SmiUntag(RAX);
+      __ cvtsi2sd(dst, RAX);
+    } else {
+      Double& dbl = Double::Handle();
+      dbl ^= constant.raw();
+      __ LoadDoubleConstant(dst, dbl.value());
+    }
+    return;
+  }
+  const Location& location = value->AsUse()->definition()->location();
+  if (location.IsXmmRegister()) {
+    if (location.xmm_reg() != dst) __ movsd(dst, location.xmm_reg());
+  } else {
+    ASSERT(location.IsDoubleStackSlot());
+    __ movq(RAX, Address(RBP, location.stack_index() * kWordSize));
+    __ movq(TMP, Address(RBP, (location.stack_index() - 1) * kWordSize));
+    EmitJoinDouble(dst, RAX, TMP);
+  }
+}
+
+
+void FlowGraphCompiler::StoreDoubleValue(Definition* definition,
+                                         XmmRegister src) {
+  const Location& location = definition->location();
+  if (location.IsXmmRegister()) {
+    if (location.xmm_reg() != src) __ movsd(location.xmm_reg(), src);
+  } else {
+    ASSERT(location.IsDoubleStackSlot());
+    EmitSplitDouble(RAX, TMP, src);
+    __ movq(Address(RBP, location.stack_index() * kWordSize), RAX);
+    __ movq(Address(RBP, (location.stack_index() - 1) * kWordSize), TMP);
+  }
+}
+
+
+void FlowGraphCompiler::EmitSplitDouble(Register hi,
+                                        Register lo,
+                                        XmmRegister src) {
+  __ movq(hi, src);
+  __ movq(lo, hi);
+  __ shrq(hi, Immediate(32));
+  __ shlq(hi, Immediate(kSmiTagSize));
+  __ shlq(lo, Immediate(32));
+  __ shrq(lo, Immediate(32 - kSmiTagSize));
+}
+
+
+void FlowGraphCompiler::EmitJoinDouble(XmmRegister dst,
+                                       Register hi,
+                                       Register lo) {
+  __ shlq(hi, Immediate(32 - kSmiTagSize));
+  __ shrq(lo, Immediate(kSmiTagSize));
+  __ orq(hi, lo);
+  __ movq(dst, hi);
+}
+
+
+void FlowGraphCompiler::EmitAllocateDouble(BindInstr* instr,
+                                           intptr_t token_index) {
+  const Class& double_class = Class::ZoneHandle(
+      Isolate::Current()->object_store()->double_class());
+  Label slow_path, done;
+  __ LoadObject(RCX, double_class);
+  AssemblerMacros::TryAllocate(assembler_, double_class, RCX, &slow_path, RAX);
+  __ jmp(&done);
+
+  __ Bind(&slow_path);
+  GrowableArray<Register> live_registers;
+  if (instr != NULL) allocator_->GetLiveRegistersAt(instr, &live_registers);
+  for (intptr_t i = 0; i < live_registers.length(); ++i) {
+    __ pushq(live_registers[i]);
+  }
+  // The allocation stub may call into the runtime, which does not preserve
+  // XMM0.  Keep the double on the stack, where the garbage collector finds
+  // two Smis.
+  EmitSplitDouble(RCX, RDX, XMM0);
+  __ pushq(RCX);
+  __ pushq(RDX);
+  const Code& stub =
+      Code::Handle(StubCode::GetAllocationStubForClass(double_class));
+  const ExternalLabel label(double_class.ToCString(), stub.EntryPoint());
+  GenerateCall(token_index, &label, PcDescriptors::kOther);
+  __ popq(RDX);
+  __ popq(RCX);
+  EmitJoinDouble(XMM0, RCX, RDX);
+  for (intptr_t i = live_registers.length() - 1; i >= 0; --i) {
+    __ popq(live_registers[i]);
+  }
+
+  __ Bind(&done);
+  __ movsd(FieldAddress(RAX, Double::value_offset()), XMM0);
+}
+
+
+// Compute into XMM0 with the right operand in XMM1.  A right operand which
+// is not unboxed is converted if it is a Smi, loaded if it is a Double, and
+// otherwise passed to the instance call with the boxed receiver.  Its result
+// is a Double since the receiver is.
+void FlowGraphCompiler::EmitUnboxedDoubleBinaryOp(
+    UnboxedDoubleBinaryOpComp* comp, BindInstr* instr) {
+  Label slow_path, done;
+  LoadDoubleValue(XMM0, comp->left());
+  if (!comp->HasSlowPath()) {
+    LoadDoubleValue(XMM1, comp->right());
+  } else {
+    const Class& double_class = Class::ZoneHandle(
+        Isolate::Current()->object_store()->double_class());
+    Label convert_smi, compute;
+    LoadValue(RCX, comp->right());
+    __ testq(RCX, Immediate(kSmiTagMask));
+    __ j(ZERO, &convert_smi, Assembler::kNearJump);
+    __ movq(RAX, FieldAddress(RCX, Object::class_offset()));
+    __ CompareObject(RAX, double_class);
+    __ j(NOT_EQUAL, &slow_path);
+    __ movsd(XMM1, FieldAddress(RCX, Double::value_offset()));
+    __ jmp(&compute, Assembler::kNearJump);
+    __ Bind(&convert_smi);
+    __ movq(RAX, RCX);
+    __ SmiUntag(RAX);
+    __ cvtsi2sd(XMM1, RAX);
+    __ Bind(&compute);
+  }
+  switch (comp->op_kind()) {
+    case Token::kADD: __ addsd(XMM0, XMM1); break;
+    case Token::kSUB: __ subsd(XMM0, XMM1); break;
+    case Token::kMUL: __ mulsd(XMM0, XMM1); break;
+    case Token::kDIV: __ divsd(XMM0, XMM1); break;
+    default: UNREACHABLE();
+  }
+
+  if (comp->HasSlowPath()) {
+    __ jmp(&done);
+    __ Bind(&slow_path);
+    InstanceCallComp* call = comp->instance_call();
+    GrowableArray<Register> live_registers;
+    allocator_->GetLiveRegistersAt(instr, &live_registers);
+    for (intptr_t i = 0; i < live_registers.length(); ++i) {
+      __ pushq(live_registers[i]);
+    }
+    __ pushq(RCX);
+    EmitAllocateDouble(NULL, call->token_index());
+    __ popq(RCX);
+    __ pushq(RAX);
+    __ pushq(RCX);
+    EmitInstanceCall(call->node_id(),
+                     call->token_index(),
+                     call->function_name(),
+                     call->ArgumentCount(),
+                     call->argument_names(),
+                     call->checked_argument_count());
+    __ movsd(XMM0, FieldAddress(RAX, Double::value_offset()));
+    for (intptr_t i = live_registers.length() - 1; i >= 0; --i) {
+      __ popq(live_registers[i]);
+    }
+    __ Bind(&done);
+  }
+  StoreDoubleValue(instr, XMM0);
+}
+
+
+void FlowGraphCompiler::EmitBoxDouble(BoxDoubleComp* comp, BindInstr* instr) {
+  LoadDoubleValue(XMM0, comp->value());
+  // The box has no source position of its own.
+  EmitAllocateDouble(instr, parsed_function_.function().token_index());
+  const Location& location = instr->location();
+  if (location.IsRegister()) {
+    __ movq(location.reg(), RAX);
+  } else {
+    __ movq(Address(RBP, location.stack_index() * kWordSize), RAX);
+  }
+}
+
+
+// Emit a parallel move of the phi inputs from the current block to the
+// locations of the phis.  Register to register moves forming a cycle are
+// resolved by swapping, the other moves go through RAX and TMP.
+// Load the element of the array, or pass an index which is not a Smi or is
+// out of bounds to the instance call.  Negative Smis are above the length
+// when compared unsigned.
+void FlowGraphCompiler::EmitLoadIndexed(LoadIndexedComp* comp,
+                                        BindInstr* instr) {
+  Label slow_path, done;
+  LoadValue(RAX, comp->array());
+  LoadValue(RCX, comp->index());
+  if (comp->needs_bounds_check()) {
+    __ testq(RCX, Immediate(kSmiTagMask));
+    __ j(NOT_ZERO, &slow_path);
+    __ cmpq(RCX, FieldAddress(RAX, Array::length_offset()));
+    __ j(ABOVE_EQUAL, &slow_path);
+  }
+  // The index is a Smi, i.e., times 2.
+  ASSERT(kSmiTagShift == 1);
+  __ movq(RAX, FieldAddress(RAX, RCX, TIMES_4, Array::data_offset()));
+
+  if (comp->needs_bounds_check()) {
+    __ jmp(&done);
+    __ Bind(&slow_path);
+    InstanceCallComp* call = comp->instance_call();
+    GrowableArray<Register> live_registers;
+    allocator_->GetLiveRegistersAt(instr, &live_registers);
+    for (intptr_t i = 0; i < live_registers.length(); ++i) {
+      __ pushq(live_registers[i]);
+    }
+    __ pushq(RAX);
+    __ pushq(RCX);
+    EmitInstanceCall(call->node_id(),
+                     call->token_index(),
+                     call->function_name(),
+                     call->ArgumentCount(),
+                     call->argument_names(),
+                     call->checked_argument_count());
+    for (intptr_t i = live_registers.length() - 1; i >= 0; --i) {
+      __ popq(live_registers[i]);
+    }
+    __ Bind(&done);
+  }
+
+  const Location& location = instr->location();
+  if (location.IsRegister()) {
+    __ movq(location.reg(), RAX);
+  } else {
+    __ movq(Address(RBP, location.stack_index() * kWordSize), RAX);
+  }
+}
+
+
+void FlowGraphCompiler::EmitPhiMoves(JoinEntryInstr* join) {
+  if (join->phis() == NULL) return;
+  const intptr_t pred_index = join->IndexOfPredecessor(current_block());
+  GrowableArray<Location> sources;
+  GrowableArray<Location> destinations;
+  GrowableArray<Value*> values;
+  for (intptr_t i = 0; i < join->phis()->length(); ++i) {
+    PhiInstr* phi = (*join->phis())[i];
+    if (phi->representation() == kUnboxedDouble) continue;
+    Value* value = phi->InputAt(pred_index);
+    Location source = value->IsUse()
+        ? value->AsUse()->definition()->location()
+        : Location::Constant(value->AsConstant()->value());
+    if (source.Equals(phi->location())) continue;
+    sources.Add(source);
+    destinations.Add(phi->location());
+    values.Add(value);
+  }
+
+  // Repeatedly emit a move whose destination is not the source of a pending
+  // move.  When only cycles are left, swap the ends of one move.
+  GrowableArray<bool> done;
+  for (intptr_t i = 0; i < sources.length(); ++i) done.Add(false);
+  intptr_t pending = sources.length();
+  while (pending > 0) {
+    bool progress = false;
+    for (intptr_t i = 0; i < sources.length(); ++i) {
+      if (done[i]) continue;
+      bool blocked = false;
+      for (intptr_t j = 0; j < sources.length(); ++j) {
+        if (!done[j] && (j != i) && sources[j].Equals(destinations[i])) {
+          blocked = true;
+          break;
+        }
+      }
+      if (blocked) continue;
+      const Location& source = sources[i];
+      const Location& destination = destinations[i];
+      const Register dst = destination.IsRegister() ? destination.reg() : RAX;
+      if (source.IsConstant()) {
+        LoadValue(dst, values[i]);
+      } else if (source.IsRegister()) {
+        __ movq(dst, source.reg());
+      } else {
+        __ movq(dst, Address(RBP, source.stack_index() * kWordSize));
+      }
+      if (!destination.IsRegister()) {
+        __ movq(Address(RBP, destination.stack_index() * kWordSize), RAX);
+      }
+      done[i] = true;
+      --pending;
+      progress = true;
+    }
+    if (progress) continue;
+    // Break a cycle: swap the source and destination of a pending move and
+    // redirect the moves reading either of them.
+    for (intptr_t i = 0; i < sources.length(); ++i) {
+      if (done[i]) continue;
+      const Location source = sources[i];
+      const Location destination = destinations[i];
+      if (source.IsRegister() && destination.IsRegister()) {
+        __ xchgq(source.reg(), destination.reg());
+      } else if (source.IsRegister() || destination.IsRegister()) {
+        const Register reg =
+            source.IsRegister() ? source.reg() : destination.reg();
+        const Address address(RBP, (source.IsRegister()
+                                        ? destination.stack_index()
+                                        : source.stack_index()) * kWordSize);
+        __ movq(TMP, address);
+        __ movq(address, reg);
+        __ movq(reg, TMP);
+      } else {
+        const Address source_address(RBP, source.stack_index() * kWordSize);
+        const Address destination_address(
+            RBP, destination.stack_index() * kWordSize);
+        __ movq(RAX, source_address);
+        __ movq(TMP, destination_address);
+        __ movq(destination_address, RAX);
+        __ movq(source_address, TMP);
+      }
+      done[i] = true;
+      --pending;
+      for (intptr_t j = 0; j < sources.length(); ++j) {
+        if (done[j]) continue;
+        if (sources[j].Equals(source)) {
+          sources[j] = destination;
+        } else if (sources[j].Equals(destination)) {
+          sources[j] = source;
+        }
+      }
+      break;
+    }
+  }
+  EmitDoublePhiMoves(join);
+}
+
+
+// The parallel move to the unboxed double phis, which are disjoint from the
+// tagged locations.  Cycles are broken by moving a source to XMM0, the
+// other moves go through XMM1, RAX and TMP.
+void FlowGraphCompiler::EmitDoublePhiMoves(JoinEntryInstr* join) {
+  const intptr_t pred_index = join->IndexOfPredecessor(current_block());
+  GrowableArray<Location> sources;
+  GrowableArray<Location> destinations;
+  GrowableArray<Value*> values;
+  for (intptr_t i = 0; i < join->phis()->length(); ++i) {
+    PhiInstr* phi = (*join->phis())[i];
+    if (phi->representation() != kUnboxedDouble) continue;
+    Value* value = phi->InputAt(pred_index);
+    Location source = value->IsUse()
+        ? value->AsUse()->definition()->location()
+        : Location::Constant(value->AsConstant()->value());
+    if (source.Equals(phi->location())) continue;
+    sources.Add(source);
+    destinations.Add(phi->location());
+    values.Add(value);
+  }
+
+  GrowableArray<bool> done;
+  for (intptr_t i = 0; i < sources.length(); ++i) done.Add(false);
+  intptr_t pending = sources.length();
+  while (pending > 0) {
+    bool progress = false;
+    for (intptr_t i = 0; i < sources.length(); ++i) {
+      if (done[i]) continue;
+      bool blocked = false;
+      for (intptr_t j = 0; j < sources.length(); ++j) {
+        if (!done[j] && (j != i) && sources[j].Equals(destinations[i])) {
+          blocked = true;
+          break;
+        }
+      }
+      if (blocked) continue;
+      const Location& source = sources[i];
+      const Location& destination = destinations[i];
+      if (source.IsDoubleStackSlot() && destination.IsDoubleStackSlot()) {
+        for (intptr_t k = 0; k < 2; ++k) {
+          __ movq(RAX, Address(RBP, (source.stack_index() - k) * kWordSize));
+          __ movq(Address(RBP, (destination.stack_index() - k) * kWordSize),
+                  RAX);
+        }
+      } else {
+        XmmRegister dst =
+            destination.IsXmmRegister() ? destination.xmm_reg() : XMM1;
+        if (source.IsXmmRegister()) {
+          __ movsd(dst, source.xmm_reg());
+        } else if (source.IsConstant()) {
+          LoadDoubleValue(dst, values[i]);
+        } else {
+          __ movq(RAX, Address(RBP, source.stack_index() * kWordSize));
+          __ movq(TMP, Address(RBP, (source.stack_index() - 1) * kWordSize));
+          EmitJoinDouble(dst, RAX, TMP);
+        }
+        if (!destination.IsXmmRegister()) {
+          EmitSplitDouble(RAX, TMP, XMM1);
+          __ movq(Address(RBP, destination.stack_index() * kWordSize), RAX);
+          __ movq(Address(RBP, (destination.stack_index() - 1) * kWordSize),
+                  TMP);
+        }
+      }
+      done[i] = true;
+      --pending;
+      progress = true;
+    }
+    if (progress) continue;
+    // Break a cycle: the move of a source saved in XMM0 no longer blocks
+    // the move to its location, and completes the cycle.
+    for (intptr_t i = 0; i < sources.length(); ++i) {
+      if (done[i]) continue;
+      const Location source = sources[i];
+      const Location saved = Location::XmmRegisterLocation(XMM0);
+      if (source.IsXmmRegister()) {
+        __ movsd(XMM0, source.xmm_reg());
+      } else {
+        __ movq(RAX, Address(RBP, source.stack_index() * kWordSize));
+        __ movq(TMP, Address(RBP, (source.stack_index() - 1) * kWordSize));
+        EmitJoinDouble(XMM0, RAX, TMP);
+      }
+      for (intptr_t j = 0; j < sources.length(); ++j) {
+        if (!done[j] && sources[j].Equals(source)) sources[j] = saved;
+      }
+      break;
+    }
+  }
+}
+
+
+void FlowGraphCompiler::VisitPhi(PhiInstr* instr) {
+  UNREACHABLE();
+}
+
+
+void FlowGraphCompiler::VisitParameter(ParameterInstr* instr) {
+  UNREACHABLE();
+}
+
+
 void FlowGraphCompiler::VisitReturn(ReturnInstr* instr) {
   LoadValue(RAX, instr->value());
 
@@ -888,13 +1672,36 @@ void FlowGraphCompiler::VisitReturn(ReturnInstr* instr) {
   // Check that the entry stack size matches the exit stack size.
   __ movq(R10, RBP);
   __ subq(R10, RSP);
-  __ cmpq(R10, Immediate(StackSize() * kWordSize));
+  __ cmpq(R10, Immediate(FrameSize() * kWordSize));
   Label stack_ok;
   __ j(EQUAL, &stack_ok, Assembler::kNearJump);
   __ Stop("Exit stack size does not match the entry stack size.");
   __ Bind(&stack_ok);
 #endif  // DEBUG.
 
+  if (!is_optimizing()) {
+    // Count only in unoptimized code.
+    const Function& function =
+        Function::ZoneHandle(parsed_function_.function().raw());
+    __ LoadObject(RBX, function);
+    __ incq(FieldAddress(RBX, Function::usage_counter_offset()));
+    if (CodeGenerator::CanOptimize()) {
+      // Do not optimize if usage count must be reported.
+      __ cmpq(FieldAddress(RBX, Function::usage_counter_offset()),
+          Immediate(FLAG_optimization_counter_threshold));
+      Label not_yet_hot;
+      __ j(LESS_EQUAL, &not_yet_hot);
+      __ pushq(RAX);  // Preserve result.
+      __ pushq(RBX);  // Argument for runtime: function to optimize.
+      GenerateCallRuntime(AstNode::kNoId,
+                          instr->token_index(),
+                          kOptimizeInvokedFunctionRuntimeEntry);
+      __ popq(RBX);  // Remove argument.
+      __ popq(RAX);  // Restore result.
+      __ Bind(&not_yet_hot);
+    }
+  }
+
   if (FLAG_trace_functions) {
     __ pushq(RAX);  // Preserve result.
     const Function& function =
@@ -1157,7 +1964,23 @@ void FlowGraphCompiler::CompileGraph() {
   const int parameter_count = function.num_fixed_parameters();
   const int num_copied_params = parsed_function_.copied_parameter_count();
   const int local_count = parsed_function_.stack_local_count();
-  __ EnterFrame(StackSize() * kWordSize);
+  if (is_optimizing()) {
+    // The spill slots are allocated below the locals and copied parameters.
+    allocator_ = new FlowGraphAllocator(block_order_,
+                                        kAllocatableRegisters,
+                                        kNumberOfAllocatableRegisters,
+                                        kAllocatableXmmRegisters,
+                                        kNumberOfAllocatableXmmRegisters,
+                                        -1 - StackSize());
+    allocator_->AllocateRegisters();
+  }
+  if (is_osr()) {
+    EmitOsrEntry();
+    VisitBlocks();
+    __ int3();
+    return;
+  }
+  __ EnterFrame(FrameSize() * kWordSize);
 
   // We check the number of passed arguments when we have to copy them due to
   // the presence of optional named parameters.
@@ -1198,6 +2021,13 @@ void FlowGraphCompiler::CompileGraph() {
       __ movq(Address(RBP, (base - i) * kWordSize), RAX);
     }
   }
+  // Initialize the spill slots to null, the GC visits them.
+  if ((allocator_ != NULL) && (allocator_->spill_slot_count() > 0)) {
+    __ movq(RAX, Immediate(reinterpret_cast<intptr_t>(Object::null())));
+    for (intptr_t i = 0; i < allocator_->spill_slot_count(); ++i) {
+      __ movq(Address(RBP, (-1 - StackSize() - i) * kWordSize), RAX);
+    }
+  }
 
   // Generate stack overflow check.
   __ movq(TMP, Immediate(Isolate::Current()->stack_limit_address()));
@@ -1250,7 +2080,8 @@ void FlowGraphCompiler::GenerateCallRuntime(intptr_t node_id,
 }
 
 
-// Uses current pc position and try-index.
+// Uses current pc position and try-index.  The token index of a call
+// compiled from an inlined function is in the inlined function.
 void FlowGraphCompiler::AddCurrentDescriptor(PcDescriptors::Kind kind,
                                              intptr_t node_id,
                                              intptr_t token_index) {
@@ -1259,6 +2090,10 @@ void FlowGraphCompiler::AddCurrentDescriptor(PcDescriptors::Kind kind,
                                       node_id,
                                       token_index,
                                       CatchClauseNode::kInvalidTryIndex);
+  if (current_inlined_function_ != NULL) {
+    inlined_pc_offsets_.Add(assembler_->CodeSize());
+    inlined_functions_at_pcs_.Add(current_inlined_function_);
+  }
 }
 
 
@@ -1285,6 +2120,53 @@ void FlowGraphCompiler::FinalizeExceptionHandlers(const Code& code) {
 }
 
 
+// Number the inlined function and the functions it is inlined in, callers
+// first.  Returns -1 for the optimized function.
+static intptr_t InlinedFunctionIndex(
+    InlinedFunction* inlined_function,
+    GrowableArray<InlinedFunction*>* inlined_functions) {
+  if (inlined_function == NULL) return -1;
+  for (intptr_t i = 0; i < inlined_functions->length(); ++i) {
+    if ((*inlined_functions)[i] == inlined_function) return i;
+  }
+  InlinedFunctionIndex(inlined_function->caller(), inlined_functions);
+  inlined_functions->Add(inlined_function);
+  return inlined_functions->length() - 1;
+}
+
+
+// Record the inlined functions of the calls, see Code::inlined_frames.
+void FlowGraphCompiler::FinalizeInlinedFrames(const Code& code) {
+  if (inlined_pc_offsets_.is_empty()) return;
+  GrowableArray<InlinedFunction*> inlined_functions;
+  const Array& pc_offsets =
+      Array::Handle(Array::New(2 * inlined_pc_offsets_.length()));
+  for (intptr_t i = 0; i < inlined_pc_offsets_.length(); ++i) {
+    const intptr_t index =
+        InlinedFunctionIndex(inlined_functions_at_pcs_[i], &inlined_functions);
+    pc_offsets.SetAt(2 * i,
+                     Smi::Handle(Smi::New(inlined_pc_offsets_[i])));
+    pc_offsets.SetAt((2 * i) + 1, Smi::Handle(Smi::New(index)));
+  }
+  const Array& functions =
+      Array::Handle(Array::New(3 * inlined_functions.length()));
+  for (intptr_t i = 0; i < inlined_functions.length(); ++i) {
+    InlinedFunction* inlined_function = inlined_functions[i];
+    const intptr_t caller_index =
+        InlinedFunctionIndex(inlined_function->caller(), &inlined_functions);
+    const intptr_t call_token_index = inlined_function->call_token_index();
+    functions.SetAt(3 * i, inlined_function->function());
+    functions.SetAt((3 * i) + 1, Smi::Handle(Smi::New(caller_index)));
+    functions.SetAt((3 * i) + 2, Smi::Handle(Smi::New(call_token_index)));
+  }
+  const Array& inlined_frames =
+      Array::Handle(Array::New(Code::kInlinedFramesLength));
+  inlined_frames.SetAt(Code::kInlinedFunctionsIndex, functions);
+  inlined_frames.SetAt(Code::kInlinedPcOffsetsIndex, pc_offsets);
+  code.set_inlined_frames(inlined_frames);
+}
+
+
 }  // namespace dart
 
 #endif  // defined TARGET_ARCH_X64
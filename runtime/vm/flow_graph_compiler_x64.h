@@ -17,6 +17,7 @@
 namespace dart {
 
 class Code;
+class FlowGraphAllocator;
 template <typename T> class GrowableArray;
 class ParsedFunction;
 
@@ -24,7 +25,9 @@ class FlowGraphCompiler : public FlowGraphVisitor {
  public:
   FlowGraphCompiler(Assembler* assembler,
                     const ParsedFunction& parsed_function,
-                    const GrowableArray<BlockEntryInstr*>& block_order);
+                    const GrowableArray<BlockEntryInstr*>& block_order,
+                    bool is_optimizing,
+                    bool is_osr);
 
   virtual ~FlowGraphCompiler();
 
@@ -34,6 +37,7 @@ class FlowGraphCompiler : public FlowGraphVisitor {
   void FinalizePcDescriptors(const Code& code);
   void FinalizeVarDescriptors(const Code& code);
   void FinalizeExceptionHandlers(const Code& code);
+  void FinalizeInlinedFrames(const Code& code);
 
  private:
   struct BlockInfo : public ZoneAllocated {
@@ -45,6 +49,14 @@ class FlowGraphCompiler : public FlowGraphVisitor {
 
   BlockEntryInstr* current_block() const { return current_block_; }
 
+  // Optimized code keeps the SSA values in the locations assigned by the
+  // register allocator rather than on the expression stack.
+  bool is_optimizing() const { return is_optimizing_; }
+
+  // Code compiled for on-stack replacement is entered from a loop back edge
+  // in the unoptimized code, with the unoptimized frame in place.
+  bool is_osr() const { return is_osr_; }
+
   // Bail out of the flow graph compiler.  Does not return to the caller.
   void Bailout(const char* reason);
 
@@ -67,6 +79,67 @@ class FlowGraphCompiler : public FlowGraphVisitor {
   // Emit code to load a Value into register 'dst'.
   void LoadValue(Register dst, Value* value);
 
+  // Emit code to push the inputs of a call in optimized code, where the
+  // calling convention still passes arguments on the stack.
+  void PushInputs(Computation* computation);
+
+  // Emit code for a computation in optimized code and move its result to
+  // the location of the definition, if any.
+  void EmitOptimizedComputation(Computation* computation,
+                                Definition* definition);
+
+  // Emit an inlined Smi fast path for a binary operation or comparison,
+  // falling back to an instance call.
+  void EmitSmiFastPath(InstanceCallComp* comp, BindInstr* instr);
+
+  // Emit code to load an operand of an unboxed double computation, a Smi or
+  // double constant or an unboxed value, into 'dst'.  Destroys RAX and TMP.
+  void LoadDoubleValue(XmmRegister dst, Value* value);
+
+  // Emit code to move the unboxed double in 'src' to the location of the
+  // definition.  Destroys RAX and TMP.
+  void StoreDoubleValue(Definition* definition, XmmRegister src);
+
+  // Emit code to split the double in 'src' into two Smis, the high and the
+  // low 32 bits shifted left by the Smi tag, which can be stored in frame
+  // slots visited by the garbage collector.
+  void EmitSplitDouble(Register hi, Register lo, XmmRegister src);
+
+  // Emit code to join the two Smis of a split double into 'dst'.  Destroys
+  // 'hi' and 'lo'.
+  void EmitJoinDouble(XmmRegister dst, Register hi, Register lo);
+
+  // Emit code to box the double in XMM0, leaving the Double in RAX.  The
+  // registers live across 'instr' are preserved around the allocation stub
+  // unless 'instr' is NULL.  Destroys RCX and RDX.
+  void EmitAllocateDouble(BindInstr* instr, intptr_t token_index);
+
+  // Emit an arithmetic operation on unboxed doubles, falling back to the
+  // instance call if the right operand is neither a Smi nor a Double.
+  void EmitUnboxedDoubleBinaryOp(UnboxedDoubleBinaryOpComp* comp,
+                                 BindInstr* instr);
+
+  // Emit the box of an unboxed double.
+  void EmitBoxDouble(BoxDoubleComp* comp, BindInstr* instr);
+
+  // Emit the load of an array element, falling back to the instance call
+  // unless the index is known to be in bounds.
+  void EmitLoadIndexed(LoadIndexedComp* comp, BindInstr* instr);
+
+  // Emit the moves to the phis of 'join' at the end of a predecessor.
+  void EmitPhiMoves(JoinEntryInstr* join);
+
+  // Emit the moves to the unboxed double phis of 'join'.
+  void EmitDoublePhiMoves(JoinEntryInstr* join);
+
+  // Emit the check at a loop back edge in unoptimized code which counts the
+  // iteration and, once the function is hot, continues the loop in code
+  // compiled for on-stack replacement.
+  void EmitOsrCheck(JoinEntryInstr* loop_header);
+
+  // Emit the entry of code compiled for on-stack replacement.
+  void EmitOsrEntry();
+
   // Emit an instance call.
   void EmitInstanceCall(intptr_t node_id,
                         intptr_t token_index,
@@ -108,6 +181,9 @@ class FlowGraphCompiler : public FlowGraphVisitor {
 
   intptr_t StackSize() const;
 
+  // The frame size of the function including the spill slots, in words.
+  intptr_t FrameSize() const;
+
   Assembler* assembler_;
   const ParsedFunction& parsed_function_;
 
@@ -120,6 +196,17 @@ class FlowGraphCompiler : public FlowGraphVisitor {
 
   DescriptorList* pc_descriptors_list_;
 
+  // The inlined function of the instruction being compiled, and the pc
+  // offsets of the calls compiled from inlined functions with the inlined
+  // function of each.
+  InlinedFunction* current_inlined_function_;
+  GrowableArray<intptr_t> inlined_pc_offsets_;
+  GrowableArray<InlinedFunction*> inlined_functions_at_pcs_;
+
+  const bool is_optimizing_;
+  const bool is_osr_;
+  FlowGraphAllocator* allocator_;
+
   DISALLOW_COPY_AND_ASSIGN(FlowGraphCompiler);
 };
 
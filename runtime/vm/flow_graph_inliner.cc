@@ -0,0 +1,837 @@
+// Copyright (c) 2012, the Dart project authors.  Please see the AUTHORS file
+// for details. All rights reserved. Use of this source code is governed by a
+// BSD-style license that can be found in the LICENSE file.
+
+#include "vm/flow_graph_inliner.h"
+
+#include "vm/class_finalizer.h"
+#include "vm/flags.h"
+#include "vm/flow_graph_allocator.h"
+#include "vm/flow_graph_builder.h"
+#include "vm/flow_graph_optimizer.h"
+#include "vm/intermediate_language.h"
+#include "vm/isolate.h"
+#include "vm/longjump.h"
+#include "vm/object.h"
+#include "vm/object_store.h"
+#include "vm/os.h"
+#include "vm/parser.h"
+
+namespace dart {
+
+DECLARE_FLAG(bool, print_flow_graph);
+
+DEFINE_FLAG(bool, use_inlining, true,
+    "Inline small functions in optimized code.");
+DEFINE_FLAG(int, inlining_size_threshold, 25,
+    "Inline functions whose graph has at most this many instructions.");
+DEFINE_FLAG(int, inlining_depth_threshold, 3,
+    "Inline calls nested at most this deep in inlined functions.");
+DEFINE_FLAG(int, inlining_growth_threshold, 250,
+    "Stop inlining into a function after this many inlined instructions.");
+DEFINE_FLAG(bool, trace_inlining, false, "Trace the inlined calls.");
+DEFINE_FLAG(bool, use_cha, true,
+    "Bind the instance calls on the receiver to the only implementation of "
+    "their selector, found by class hierarchy analysis.");
+
+// Instance calls which have seen more receiver classes are not inlined.
+static const intptr_t kMaxInlinedClasses = 4;
+
+
+// The function whose graph contains a call: the optimized function itself
+// or a function inlined into it.
+class FlowGraphInliner::InliningScope : public ZoneAllocated {
+ public:
+  InliningScope(const Function& function,
+                InliningScope* outer,
+                InlinedFunction* inlined_function)
+      : function_(function),
+        outer_(outer),
+        inlined_function_(inlined_function),
+        depth_((outer == NULL) ? 0 : outer->depth() + 1) { }
+
+  const Function& function() const { return function_; }
+  // The function the instructions of the graph are attributed to when the
+  // frames are rebuilt, NULL for the optimized function.
+  InlinedFunction* inlined_function() const { return inlined_function_; }
+  intptr_t depth() const { return depth_; }
+
+  // Whether the function is inlined into itself through this scope.  The
+  // bodies of recursive functions are not unrolled.
+  bool Contains(const Function& function) const {
+    for (const InliningScope* scope = this;
+         scope != NULL;
+         scope = scope->outer_) {
+      if (scope->function().raw() == function.raw()) return true;
+    }
+    return false;
+  }
+
+ private:
+  const Function& function_;
+  InliningScope* outer_;
+  InlinedFunction* inlined_function_;
+  const intptr_t depth_;
+
+  DISALLOW_COPY_AND_ASSIGN(InliningScope);
+};
+
+
+// A static call, or an instance call with the inline cache data recorded
+// for it by the unoptimized code.
+class FlowGraphInliner::CallSite : public ZoneAllocated {
+ public:
+  CallSite(Instruction* instr,
+           Computation* computation,
+           const ICData* ic_data,
+           InliningScope* scope)
+      : instr_(instr),
+        computation_(computation),
+        ic_data_(ic_data),
+        scope_(scope) { }
+
+  // The Bind or Do of the call.
+  Instruction* instr() const { return instr_; }
+  Computation* computation() const { return computation_; }
+  // NULL for static calls.
+  const ICData* ic_data() const { return ic_data_; }
+  InliningScope* scope() const { return scope_; }
+
+ private:
+  Instruction* instr_;
+  Computation* computation_;
+  const ICData* ic_data_;
+  InliningScope* scope_;
+
+  DISALLOW_COPY_AND_ASSIGN(CallSite);
+};
+
+
+// The graph of a function in SSA form built for inlining, with the return
+// instructions replaced by the splicing.
+class FlowGraphInliner::InlinedBody : public ZoneAllocated {
+ public:
+  InlinedBody(InliningScope* scope,
+              const GrowableArray<BlockEntryInstr*>& blocks,
+              intptr_t size)
+      : scope_(scope),
+        blocks_(blocks.length()),
+        size_(size),
+        return_blocks_(),
+        return_predecessors_(),
+        return_values_() {
+    for (intptr_t i = 0; i < blocks.length(); ++i) {
+      blocks_.Add(blocks[i]);
+    }
+  }
+
+  InliningScope* scope() const { return scope_; }
+  // The blocks of the graph in postorder.
+  const GrowableArray<BlockEntryInstr*>& blocks() const { return blocks_; }
+  TargetEntryInstr* entry() const {
+    return blocks_.Last()->AsTargetEntry();
+  }
+  intptr_t size() const { return size_; }
+
+  // Each return is the last instruction of its block.
+  void AddReturn(BlockEntryInstr* block, Instruction* predecessor,
+                 Value* value) {
+    return_blocks_.Add(block);
+    return_predecessors_.Add(predecessor);
+    return_values_.Add(value);
+  }
+  intptr_t ReturnCount() const { return return_blocks_.length(); }
+  BlockEntryInstr* ReturnBlockAt(intptr_t i) const {
+    return return_blocks_[i];
+  }
+  Instruction* ReturnPredecessorAt(intptr_t i) const {
+    return return_predecessors_[i];
+  }
+  Value* ReturnValueAt(intptr_t i) const { return return_values_[i]; }
+
+ private:
+  InliningScope* scope_;
+  GrowableArray<BlockEntryInstr*> blocks_;
+  const intptr_t size_;
+  GrowableArray<BlockEntryInstr*> return_blocks_;
+  GrowableArray<Instruction*> return_predecessors_;
+  GrowableArray<Value*> return_values_;
+
+  DISALLOW_COPY_AND_ASSIGN(InlinedBody);
+};
+
+
+// Uses of a definition are not shared between instructions.
+static Value* CopyValue(Value* value) {
+  UseVal* use = value->AsUse();
+  return (use == NULL) ? value : new UseVal(use->definition());
+}
+
+
+static Computation* ComputationOf(Instruction* instr) {
+  if (instr->IsBind()) return instr->AsBind()->computation();
+  if (instr->IsDo()) return instr->AsDo()->computation();
+  return NULL;
+}
+
+
+static intptr_t CallTokenIndex(Computation* computation) {
+  if (computation->IsStaticCall()) {
+    return computation->AsStaticCall()->token_index();
+  }
+  if (computation->IsInstanceCall()) {
+    return computation->AsInstanceCall()->token_index();
+  }
+  return computation->AsInstanceSetter()->token_index();
+}
+
+
+// Attribute the instructions of an inlined body to its function.
+static void SetInlinedFunction(const GrowableArray<BlockEntryInstr*>& blocks,
+                               InlinedFunction* inlined_function) {
+  for (intptr_t i = 0; i < blocks.length(); ++i) {
+    Instruction* instr = blocks[i];
+    while ((instr != NULL) &&
+           ((instr == blocks[i]) || !instr->IsBlockEntry())) {
+      instr->set_inlined_function(inlined_function);
+      instr = instr->StraightLineSuccessor();
+    }
+  }
+}
+
+
+// Computations depending on the frame or the context of the function they
+// are compiled in cannot be inlined.  The locals left after the SSA
+// construction are captured variables.
+static bool IsInlineableComputation(Computation* computation) {
+  return !computation->IsAssertAssignable() &&
+      !computation->IsCurrentContext() &&
+      !computation->IsStoreContext() &&
+      !computation->IsClosureCall() &&
+      !computation->IsCreateClosure() &&
+      !computation->IsAllocateContext() &&
+      !computation->IsChainContext() &&
+      !computation->IsNativeCall() &&
+      !computation->IsLoadLocal() &&
+      !computation->IsStoreLocal();
+}
+
+
+void FlowGraphInliner::Inline() {
+  InliningScope* scope =
+      new InliningScope(builder_->parsed_function().function(), NULL, NULL);
+  // The worklist grows while the calls in the inlined bodies are collected,
+  // so shallow calls are inlined first.  Collecting the calls attaches their
+  // type feedback, which is used even if nothing is inlined.
+  GrowableArray<CallSite*> call_sites;
+  CollectCallSites(builder_->postorder_block_entries(), scope, &call_sites);
+  if (!FLAG_use_inlining) return;
+  for (intptr_t i = 0; i < call_sites.length(); ++i) {
+    if (inlined_size_ >= FLAG_inlining_growth_threshold) break;
+    TryInlining(call_sites[i], &call_sites);
+  }
+  if (FLAG_print_flow_graph && (inlined_size_ > 0)) {
+    OS::Print("After inlining:\n");
+    builder_->PrintGraph();
+  }
+}
+
+
+void FlowGraphInliner::CollectCallSites(
+    const GrowableArray<BlockEntryInstr*>& blocks,
+    InliningScope* scope,
+    GrowableArray<CallSite*>* call_sites) {
+  // The inline caches of the unoptimized code are found by the node ids of
+  // the calls.
+  const Code& code = Code::Handle(scope->function().unoptimized_code());
+  GrowableArray<intptr_t> node_ids;
+  const GrowableObjectArray& ic_data_objs =
+      GrowableObjectArray::Handle(GrowableObjectArray::New());
+  if (!code.IsNull()) {
+    code.ExtractIcDataArraysAtCalls(&node_ids, ic_data_objs);
+  }
+  for (intptr_t i = blocks.length() - 1; i >= 0; --i) {
+    for (Instruction* instr = blocks[i]->StraightLineSuccessor();
+         (instr != NULL) && !instr->IsBlockEntry();
+         instr = instr->StraightLineSuccessor()) {
+      Computation* computation = ComputationOf(instr);
+      if (computation == NULL) continue;
+      if (computation->IsStaticCall()) {
+        call_sites->Add(new CallSite(instr, computation, NULL, scope));
+        continue;
+      }
+      intptr_t node_id = AstNode::kNoId;
+      if (computation->IsInstanceCall()) {
+        node_id = computation->AsInstanceCall()->node_id();
+      } else if (computation->IsInstanceSetter()) {
+        node_id = computation->AsInstanceSetter()->node_id();
+      } else {
+        continue;
+      }
+      for (intptr_t j = 0; j < node_ids.length(); ++j) {
+        if (node_ids[j] != node_id) continue;
+        ICData& ic_data = ICData::ZoneHandle();
+        ic_data ^= ic_data_objs.At(j);
+        // Calls which never ran have no feedback.
+        if (!ic_data.IsNull() && (ic_data.NumberOfChecks() > 0)) {
+          if (computation->IsInstanceCall()) {
+            computation->AsInstanceCall()->set_ic_data(&ic_data);
+          }
+          // Megamorphic calls see too many classes to be guarded by tests.
+          if (!ic_data.IsMegamorphic()) {
+            call_sites->Add(new CallSite(instr, computation, &ic_data, scope));
+          }
+        }
+        break;
+      }
+    }
+  }
+}
+
+
+bool FlowGraphInliner::IsInlineable(const Function& target,
+                                    InliningScope* scope) const {
+  switch (target.kind()) {
+    case RawFunction::kFunction:
+    case RawFunction::kGetterFunction:
+    case RawFunction::kSetterFunction:
+    case RawFunction::kImplicitGetter:
+    case RawFunction::kImplicitSetter:
+      break;
+    default:
+      return false;
+  }
+  // Only inline functions which already ran, and whose optimized compilation
+  // did not bail out.
+  return target.HasCode() &&
+      target.is_optimizable() &&
+      (target.num_optional_parameters() == 0) &&
+      !scope->Contains(target);
+}
+
+
+// The receiver of the optimized function is an instance of its owner or of
+// a subclass.  If the selector of a call on the receiver has a single
+// implementation in the finalized classes, inherited by the owner, the
+// receiver's class has the same implementation.  A class finalized later
+// cannot be the class of the receiver of an activation which already runs,
+// so its optimized code is only discarded for the next calls.
+const Function* FlowGraphInliner::UniqueTarget(Computation* computation) {
+  if (!FLAG_use_cha) return NULL;
+  const ParsedFunction& parsed_function = builder_->parsed_function();
+  const Function& function = parsed_function.function();
+  if (function.is_static() ||
+      function.IsClosureFunction() ||
+      (parsed_function.copied_parameter_count() != 0)) {
+    return NULL;
+  }
+  // The receiver is the first parameter, the last one above the frame
+  // pointer.
+  UseVal* use = computation->InputAt(0)->AsUse();
+  ParameterInstr* param = (use == NULL)
+      ? NULL
+      : use->definition()->AsParameter();
+  if ((param == NULL) ||
+      (param->index() != function.num_fixed_parameters() + 1)) {
+    return NULL;
+  }
+  String& selector = String::Handle();
+  if (computation->IsInstanceCall()) {
+    selector = computation->AsInstanceCall()->function_name().raw();
+  } else {
+    selector = Field::SetterSymbol(
+        computation->AsInstanceSetter()->field_name());
+  }
+  const Function& target =
+      Function::ZoneHandle(ClassFinalizer::UniqueImplementation(selector));
+  if (target.IsNull() ||
+      !target.AreValidArgumentCounts(computation->InputCount(), 0)) {
+    return NULL;
+  }
+  const Class& target_owner = Class::Handle(target.owner());
+  Class& cls = Class::Handle(function.owner());
+  while (!cls.IsNull() && (cls.raw() != target_owner.raw())) {
+    cls = cls.SuperClass();
+  }
+  return cls.IsNull() ? NULL : &target;
+}
+
+
+// Replace the instance call by a static call of its only target.
+void FlowGraphInliner::BindToTarget(CallSite* call_site,
+                                    const Function& target) {
+  InstanceCallComp* call = call_site->computation()->AsInstanceCall();
+  ZoneGrowableArray<Value*>* arguments =
+      new ZoneGrowableArray<Value*>(call->ArgumentCount());
+  for (intptr_t i = 0; i < call->ArgumentCount(); ++i) {
+    arguments->Add(call->ArgumentAt(i));
+  }
+  StaticCallComp* static_call = new StaticCallComp(call->token_index(),
+                                                   target,
+                                                   call->argument_names(),
+                                                   arguments);
+  Instruction* instr = call_site->instr();
+  if (instr->IsBind()) {
+    instr->AsBind()->set_computation(static_call);
+  } else {
+    instr->AsDo()->set_computation(static_call);
+  }
+  if (FLAG_trace_inlining) {
+    OS::Print("Bound %s to %s in %s\n",
+              call->function_name().ToCString(),
+              target.ToFullyQualifiedCString(),
+              builder_->parsed_function().function().
+                  ToFullyQualifiedCString());
+  }
+}
+
+
+void FlowGraphInliner::TryInlining(CallSite* call_site,
+                                   GrowableArray<CallSite*>* call_sites) {
+  InliningScope* scope = call_site->scope();
+  if (scope->depth() >= FLAG_inlining_depth_threshold) return;
+  Computation* computation = call_site->computation();
+  GrowableArray<Value*> arguments(computation->InputCount());
+  for (intptr_t i = 0; i < computation->InputCount(); ++i) {
+    arguments.Add(computation->InputAt(i));
+  }
+
+  // The possible targets, with the receiver class selecting each of them
+  // for instance calls.
+  GrowableArray<const Function*> targets;
+  GrowableArray<const Class*> classes;
+  const Function* unique_target = NULL;
+  if (computation->IsStaticCall()) {
+    StaticCallComp* call = computation->AsStaticCall();
+    if (!call->argument_names().IsNull()) return;
+    targets.Add(&call->function());
+  } else {
+    if (computation->IsInstanceCall() &&
+        !computation->AsInstanceCall()->argument_names().IsNull()) {
+      return;
+    }
+    unique_target = UniqueTarget(computation);
+  }
+  if (unique_target != NULL) {
+    // The call on the receiver of the optimized function has a single
+    // target, which needs no class test.
+    targets.Add(unique_target);
+  } else if (!computation->IsStaticCall()) {
+    const ICData& ic_data = *call_site->ic_data();
+    // The arithmetic operators of doubles are computed by the optimized
+    // code, on unboxed values where possible.
+    const bool is_double_operator =
+        FlowGraphOptimizer::DoubleOperatorKind(computation) !=
+            Token::kILLEGAL;
+    // The operators of Smis are computed inline as well, where the range
+    // analysis can see the comparisons.
+    const bool is_smi_operator =
+        FlowGraphAllocator::IsSmiFastPathCall(computation);
+    const Class& double_class =
+        Class::Handle(Isolate::Current()->object_store()->double_class());
+    GrowableArray<const Class*> check_classes;
+    for (intptr_t i = 0; i < ic_data.NumberOfChecks(); ++i) {
+      Function& target = Function::ZoneHandle();
+      ic_data.GetCheckAt(i, &check_classes, &target);
+      const Class& receiver_class = *check_classes[0];
+      if ((is_double_operator &&
+           (receiver_class.raw() == double_class.raw())) ||
+          (is_smi_operator && (receiver_class.raw() == Smi::Class()))) {
+        continue;
+      }
+      bool is_duplicate = false;
+      for (intptr_t j = 0; j < classes.length(); ++j) {
+        if (classes[j]->raw() == receiver_class.raw()) is_duplicate = true;
+      }
+      if (is_duplicate) continue;
+      if (classes.length() == kMaxInlinedClasses) return;
+      classes.Add(&receiver_class);
+      targets.Add(&target);
+    }
+  }
+
+  // Build the bodies of the inlineable targets.  The call is kept for the
+  // classes of the other targets.
+  GrowableArray<InlinedBody*> bodies;
+  GrowableArray<const Class*> inlined_classes;
+  for (intptr_t i = 0; i < targets.length(); ++i) {
+    const Function& target = *targets[i];
+    if (target.IsNull()) continue;
+    InlinedBody* body = BuildArrayAccessBody(target, computation, scope);
+    if ((body == NULL) && IsInlineable(target, scope)) {
+      body = BuildInlinedBody(target, arguments, scope,
+                              CallTokenIndex(computation));
+    }
+    if (body == NULL) continue;
+    bodies.Add(body);
+    if (!classes.is_empty()) inlined_classes.Add(classes[i]);
+  }
+  if (unique_target != NULL) {
+    if (bodies.is_empty()) {
+      // Setters are only bound by inlining, which keeps the assigned value.
+      if (!computation->IsInstanceCall()) return;
+      BindToTarget(call_site, *unique_target);
+    }
+    ClassFinalizer::AddDependentFunction(
+        String::Handle(unique_target->name()),
+        builder_->parsed_function().function());
+  }
+  if (bodies.is_empty()) return;
+
+  SpliceBodies(call_site, bodies, inlined_classes);
+  for (intptr_t i = 0; i < bodies.length(); ++i) {
+    SetInlinedFunction(bodies[i]->blocks(),
+                       bodies[i]->scope()->inlined_function());
+    inlined_size_ += bodies[i]->size();
+    if (FLAG_trace_inlining) {
+      OS::Print("Inlined %s in %s (depth %d)\n",
+                bodies[i]->scope()->function().ToFullyQualifiedCString(),
+                builder_->parsed_function().function().
+                    ToFullyQualifiedCString(),
+                bodies[i]->scope()->depth());
+    }
+    CollectCallSites(bodies[i]->blocks(), bodies[i]->scope(), call_sites);
+  }
+}
+
+
+FlowGraphInliner::InlinedBody* FlowGraphInliner::BuildInlinedBody(
+    const Function& target,
+    const GrowableArray<Value*>& arguments,
+    InliningScope* scope,
+    intptr_t call_token_index) {
+  if (arguments.length() != target.num_fixed_parameters()) return NULL;
+  Isolate* isolate = Isolate::Current();
+  InlinedBody* body = NULL;
+  LongJump* base = isolate->long_jump_base();
+  LongJump jump;
+  isolate->set_long_jump_base(&jump);
+  if (setjmp(*jump.Set()) == 0) {
+    ParsedFunction parsed_function(target);
+    Parser::ParseFunction(&parsed_function);
+    parsed_function.AllocateVariables();
+    // Parameters copied into the frame are not renamed to the arguments.
+    if (parsed_function.copied_parameter_count() == 0) {
+      FlowGraphBuilder callee_builder(parsed_function, -1);
+      callee_builder.BuildGraph();
+      callee_builder.ComputeInlinedSSA(builder_->current_ssa_temp_index(),
+                                       arguments);
+      const GrowableArray<BlockEntryInstr*>& blocks =
+          callee_builder.postorder_block_entries();
+
+      // Measure the graph and find its returns.
+      intptr_t size = 0;
+      bool is_inlineable = true;
+      for (intptr_t i = 0; is_inlineable && (i < blocks.length()); ++i) {
+        Instruction* previous = blocks[i];
+        for (Instruction* instr = previous->StraightLineSuccessor();
+             (instr != NULL) && !instr->IsBlockEntry();
+             instr = instr->StraightLineSuccessor()) {
+          ++size;
+          Computation* computation = ComputationOf(instr);
+          if (instr->IsThrow() || instr->IsReThrow() ||
+              ((computation != NULL) &&
+               !IsInlineableComputation(computation))) {
+            is_inlineable = false;
+            break;
+          }
+          previous = instr;
+        }
+      }
+      if (is_inlineable &&
+          !blocks.is_empty() &&
+          (size <= FLAG_inlining_size_threshold)) {
+        InlinedFunction* inlined_function =
+            new InlinedFunction(target,
+                                scope->inlined_function(),
+                                call_token_index);
+        body = new InlinedBody(
+            new InliningScope(target, scope, inlined_function), blocks, size);
+        for (intptr_t i = 0; i < blocks.length(); ++i) {
+          Instruction* previous = blocks[i];
+          Instruction* instr = previous->StraightLineSuccessor();
+          while ((instr != NULL) && !instr->IsBlockEntry()) {
+            if (instr->IsReturn()) {
+              body->AddReturn(blocks[i], previous, instr->AsReturn()->value());
+            }
+            previous = instr;
+            instr = instr->StraightLineSuccessor();
+          }
+        }
+        if (body->ReturnCount() == 0) {
+          body = NULL;
+        } else {
+          builder_->set_current_ssa_temp_index(
+              callee_builder.current_ssa_temp_index());
+        }
+      }
+    }
+  } else {
+    // The target cannot be inlined, but the caller is still optimized.
+    Error& error = Error::Handle(isolate->object_store()->sticky_error());
+    isolate->object_store()->clear_sticky_error();
+    if (FLAG_trace_inlining) {
+      OS::Print("Not inlined: %s\n", error.ToErrorCString());
+    }
+    body = NULL;
+  }
+  isolate->set_long_jump_base(base);
+  return body;
+}
+
+
+FlowGraphInliner::InlinedBody* FlowGraphInliner::BuildArrayAccessBody(
+    const Function& target,
+    Computation* computation,
+    InliningScope* scope) {
+  InstanceCallComp* call = computation->AsInstanceCall();
+  if (call == NULL) return NULL;
+  ObjectStore* object_store = Isolate::Current()->object_store();
+  const Class& owner = Class::Handle(target.owner());
+  if ((owner.raw() != object_store->array_class()) &&
+      (owner.raw() != object_store->immutable_array_class())) {
+    return NULL;
+  }
+  const String& name = String::Handle(target.name());
+  Computation* load = NULL;
+  if (name.Equals("get:length") && (call->ArgumentCount() == 1)) {
+    load = new NativeLoadFieldComp(CopyValue(call->ArgumentAt(0)),
+                                   Array::length_offset());
+  } else if (name.Equals(Token::Str(Token::kINDEX)) &&
+             (call->ArgumentCount() == 2)) {
+    load = new LoadIndexedComp(call,
+                               CopyValue(call->ArgumentAt(0)),
+                               CopyValue(call->ArgumentAt(1)));
+  } else {
+    return NULL;
+  }
+  TargetEntryInstr* entry = new TargetEntryInstr();
+  // Not a temporary of the non-optimizing compiler.
+  BindInstr* bind = new BindInstr(-1, load);
+  bind->set_ssa_temp_index(builder_->current_ssa_temp_index());
+  builder_->set_current_ssa_temp_index(bind->ssa_temp_index() + 1);
+  entry->SetSuccessor(bind);
+  GrowableArray<BlockEntryInstr*> blocks(1);
+  blocks.Add(entry);
+  // The load is compiled as code of the caller: the accessors are natives
+  // without frames of their own to rebuild, and the call kept for other
+  // receivers is at a token of the caller.
+  InlinedBody* body = new InlinedBody(
+      new InliningScope(target, scope, scope->inlined_function()), blocks, 1);
+  body->AddReturn(entry, bind, new UseVal(bind));
+  return body;
+}
+
+
+// Find the instruction before the call and the block it is in.
+static bool FindCall(const GrowableArray<BlockEntryInstr*>& blocks,
+                     Instruction* call,
+                     BlockEntryInstr** block,
+                     Instruction** previous) {
+  for (intptr_t i = 0; i < blocks.length(); ++i) {
+    Instruction* current = blocks[i];
+    Instruction* next = current->StraightLineSuccessor();
+    while ((next != NULL) && !next->IsBlockEntry()) {
+      if (next == call) {
+        *block = blocks[i];
+        *previous = current;
+        return true;
+      }
+      current = next;
+      next = next->StraightLineSuccessor();
+    }
+  }
+  return false;
+}
+
+
+// Record the predecessors of the joins with phis, whose inputs are in
+// predecessor order.  The predecessors of the block containing the call
+// become predecessors of the join after the call.
+static void RecordPhiPredecessors(
+    const GrowableArray<BlockEntryInstr*>& blocks,
+    BlockEntryInstr* call_block,
+    JoinEntryInstr* exit,
+    GrowableArray<JoinEntryInstr*>* joins,
+    GrowableArray<ZoneGrowableArray<BlockEntryInstr*>*>* predecessors) {
+  for (intptr_t i = 0; i < blocks.length(); ++i) {
+    JoinEntryInstr* join = blocks[i]->AsJoinEntry();
+    if ((join == NULL) || (join->phis() == NULL)) continue;
+    ZoneGrowableArray<BlockEntryInstr*>* preds =
+        new ZoneGrowableArray<BlockEntryInstr*>(join->PredecessorCount());
+    for (intptr_t j = 0; j < join->PredecessorCount(); ++j) {
+      BlockEntryInstr* pred = join->PredecessorAt(j);
+      preds->Add((pred == call_block) ? exit : pred);
+    }
+    joins->Add(join);
+    predecessors->Add(preds);
+  }
+}
+
+
+// Reorder the phi inputs for the predecessors found by the rediscovery.
+static void PermutePhiInputs(
+    const GrowableArray<JoinEntryInstr*>& joins,
+    const GrowableArray<ZoneGrowableArray<BlockEntryInstr*>*>& predecessors) {
+  for (intptr_t i = 0; i < joins.length(); ++i) {
+    JoinEntryInstr* join = joins[i];
+    const ZoneGrowableArray<BlockEntryInstr*>& preds = *predecessors[i];
+    ASSERT(join->PredecessorCount() == preds.length());
+    for (intptr_t j = 0; j < join->phis()->length(); ++j) {
+      PhiInstr* phi = (*join->phis())[j];
+      GrowableArray<Value*> inputs(preds.length());
+      for (intptr_t k = 0; k < preds.length(); ++k) {
+        inputs.Add(phi->InputAt(k));
+      }
+      for (intptr_t k = 0; k < preds.length(); ++k) {
+        phi->SetInputAt(join->IndexOfPredecessor(preds[k]), inputs[k]);
+      }
+    }
+  }
+}
+
+
+static void ReplaceUses(const GrowableArray<BlockEntryInstr*>& blocks,
+                        Definition* definition,
+                        Value* value) {
+  for (intptr_t i = 0; i < blocks.length(); ++i) {
+    JoinEntryInstr* join = blocks[i]->AsJoinEntry();
+    if ((join != NULL) && (join->phis() != NULL)) {
+      for (intptr_t j = 0; j < join->phis()->length(); ++j) {
+        PhiInstr* phi = (*join->phis())[j];
+        for (intptr_t k = 0; k < phi->InputCount(); ++k) {
+          UseVal* use = phi->InputAt(k)->AsUse();
+          if ((use != NULL) && (use->definition() == definition)) {
+            phi->SetInputAt(k, CopyValue(value));
+          }
+        }
+      }
+    }
+    for (Instruction* instr = blocks[i]->StraightLineSuccessor();
+         (instr != NULL) && !instr->IsBlockEntry();
+         instr = instr->StraightLineSuccessor()) {
+      for (intptr_t k = 0; k < instr->InputCount(); ++k) {
+        UseVal* use = instr->InputAt(k)->AsUse();
+        if ((use != NULL) && (use->definition() == definition)) {
+          instr->SetInputAt(k, CopyValue(value));
+        }
+      }
+    }
+  }
+}
+
+
+void FlowGraphInliner::SpliceBodies(
+    CallSite* call_site,
+    const GrowableArray<InlinedBody*>& bodies,
+    const GrowableArray<const Class*>& classes) {
+  Instruction* call = call_site->instr();
+  BlockEntryInstr* call_block = NULL;
+  Instruction* previous = NULL;
+  if (!FindCall(builder_->postorder_block_entries(),
+                call, &call_block, &previous)) {
+    UNREACHABLE();
+  }
+
+  // The code after the call moves to a new join, which the inlined bodies
+  // (and the call for other receiver classes) flow into.
+  JoinEntryInstr* exit = new JoinEntryInstr();
+  exit->set_inlined_function(call->inlined_function());
+  exit->SetSuccessor(call->StraightLineSuccessor());
+  GrowableArray<JoinEntryInstr*> joins;
+  GrowableArray<ZoneGrowableArray<BlockEntryInstr*>*> predecessors;
+  RecordPhiPredecessors(builder_->postorder_block_entries(),
+                        call_block, exit, &joins, &predecessors);
+  GrowableArray<BlockEntryInstr*> added_blocks;
+  for (intptr_t i = 0; i < bodies.length(); ++i) {
+    RecordPhiPredecessors(bodies[i]->blocks(), NULL, NULL,
+                          &joins, &predecessors);
+    for (intptr_t j = 0; j < bodies[i]->blocks().length(); ++j) {
+      added_blocks.Add(bodies[i]->blocks()[j]);
+    }
+  }
+
+  TargetEntryInstr* fallback = NULL;
+  if (classes.is_empty()) {
+    ASSERT(bodies.length() == 1);
+    previous->ReplaceSuccessor(bodies[0]->entry());
+  } else {
+    // Test the receiver class for each body in turn.  The call is the
+    // fallback when no test succeeds.
+    ASSERT(classes.length() == bodies.length());
+    Value* receiver = call_site->computation()->InputAt(0);
+    Instruction* current = previous;
+    for (intptr_t i = 0; i < classes.length(); ++i) {
+      // Not a temporary of the non-optimizing compiler.
+      BindInstr* test =
+          new BindInstr(-1, new TestClassComp(CopyValue(receiver),
+                                              *classes[i]));
+      test->set_ssa_temp_index(builder_->current_ssa_temp_index());
+      builder_->set_current_ssa_temp_index(test->ssa_temp_index() + 1);
+      BranchInstr* branch = new BranchInstr(new UseVal(test));
+      TargetEntryInstr* miss = new TargetEntryInstr();
+      test->set_inlined_function(call->inlined_function());
+      branch->set_inlined_function(call->inlined_function());
+      miss->set_inlined_function(call->inlined_function());
+      current->ReplaceSuccessor(test);
+      test->SetSuccessor(branch);
+      *branch->true_successor_address() = bodies[i]->entry();
+      *branch->false_successor_address() = miss;
+      added_blocks.Add(miss);
+      current = miss;
+    }
+    fallback = current->AsTargetEntry();
+    fallback->SetSuccessor(call);
+    call->ReplaceSuccessor(exit);
+  }
+  for (intptr_t i = 0; i < bodies.length(); ++i) {
+    for (intptr_t j = 0; j < bodies[i]->ReturnCount(); ++j) {
+      bodies[i]->ReturnPredecessorAt(j)->ReplaceSuccessor(exit);
+    }
+  }
+  added_blocks.Add(exit);
+  builder_->RediscoverBlocks(added_blocks);
+  PermutePhiInputs(joins, predecessors);
+
+  // The uses of the call's value become uses of the returned values, merged
+  // by a phi if there are several.
+  BindInstr* bind = call->AsBind();
+  if (bind == NULL) return;
+  GrowableArray<Value*> exit_values(exit->PredecessorCount());
+  for (intptr_t i = 0; i < exit->PredecessorCount(); ++i) {
+    BlockEntryInstr* pred = exit->PredecessorAt(i);
+    Value* value = NULL;
+    if (pred == fallback) {
+      value = new UseVal(bind);
+    } else if (call_site->computation()->IsInstanceSetter()) {
+      // An assignment's value is the assigned value.
+      value = call_site->computation()->AsInstanceSetter()->value();
+    } else {
+      for (intptr_t j = 0; (value == NULL) && (j < bodies.length()); ++j) {
+        for (intptr_t k = 0; k < bodies[j]->ReturnCount(); ++k) {
+          if (bodies[j]->ReturnBlockAt(k) == pred) {
+            value = bodies[j]->ReturnValueAt(k);
+            break;
+          }
+        }
+      }
+    }
+    ASSERT(value != NULL);
+    exit_values.Add(value);
+  }
+  if (exit_values.length() == 1) {
+    ReplaceUses(builder_->postorder_block_entries(), bind, exit_values[0]);
+    return;
+  }
+  PhiInstr* phi = new PhiInstr(exit, -1);
+  phi->set_ssa_temp_index(builder_->current_ssa_temp_index());
+  builder_->set_current_ssa_temp_index(phi->ssa_temp_index() + 1);
+  phi->mark_alive();
+  ReplaceUses(builder_->postorder_block_entries(), bind, new UseVal(phi));
+  for (intptr_t i = 0; i < exit_values.length(); ++i) {
+    phi->SetInputAt(i, CopyValue(exit_values[i]));
+  }
+  exit->InsertPhi(phi);
+}
+
+}  // namespace dart
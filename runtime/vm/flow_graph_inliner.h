@@ -0,0 +1,84 @@
+// Copyright (c) 2012, the Dart project authors.  Please see the AUTHORS file
+// for details. All rights reserved. Use of this source code is governed by a
+// BSD-style license that can be found in the LICENSE file.
+
+#ifndef VM_FLOW_GRAPH_INLINER_H_
+#define VM_FLOW_GRAPH_INLINER_H_
+
+#include "vm/allocation.h"
+#include "vm/growable_array.h"
+
+namespace dart {
+
+class BlockEntryInstr;
+class Class;
+class Computation;
+class FlowGraphBuilder;
+class Function;
+class Value;
+
+// Inline the bodies of small functions at the calls of a flow graph in SSA
+// form.  Static calls are inlined directly.  Instance calls are inlined for
+// the receiver classes recorded by the inline caches of the unoptimized
+// code: each inlined body is guarded by a test of the receiver's class, and
+// the call itself is kept for the other classes, so the optimized code never
+// has to deoptimize when a new receiver class shows up.  The length getter
+// and the index operator of arrays are inlined as loads.  The calls on the
+// receiver of the optimized function whose selector has a single
+// implementation are inlined without a test, or bound to the implementation;
+// the optimized code is then discarded if another implementation is
+// finalized.  The instructions of each inlined body refer to the inlined
+// function, which the compiler records in the optimized code to rebuild the
+// frames of the inlined functions in stack traces.
+class FlowGraphInliner : public ValueObject {
+ public:
+  explicit FlowGraphInliner(FlowGraphBuilder* builder)
+      : builder_(builder), inlined_size_(0) { }
+
+  void Inline();
+
+ private:
+  class CallSite;
+  class InlinedBody;
+  class InliningScope;
+
+  // Add the calls of the blocks which have type feedback (or are static
+  // calls) to the worklist.
+  void CollectCallSites(const GrowableArray<BlockEntryInstr*>& blocks,
+                        InliningScope* scope,
+                        GrowableArray<CallSite*>* call_sites);
+  void TryInlining(CallSite* call_site,
+                   GrowableArray<CallSite*>* call_sites);
+  bool IsInlineable(const Function& target, InliningScope* scope) const;
+  // The only target of an instance call or setter on the receiver of the
+  // optimized function, found by class hierarchy analysis, or NULL.
+  const Function* UniqueTarget(Computation* computation);
+  // Replace the instance call by a static call of the target.
+  void BindToTarget(CallSite* call_site, const Function& target);
+  // Build the graph of the target with the arguments as its parameters, or
+  // return NULL if the target cannot be inlined.
+  InlinedBody* BuildInlinedBody(const Function& target,
+                                const GrowableArray<Value*>& arguments,
+                                InliningScope* scope,
+                                intptr_t call_token_index);
+  // Build the body of the length getter or the index operator of arrays,
+  // which are native functions, as a load from the array.  Return NULL for
+  // other targets.
+  InlinedBody* BuildArrayAccessBody(const Function& target,
+                                    Computation* computation,
+                                    InliningScope* scope);
+  // Replace the call by the inlined bodies, guarded by class tests for
+  // instance calls.
+  void SpliceBodies(CallSite* call_site,
+                    const GrowableArray<InlinedBody*>& bodies,
+                    const GrowableArray<const Class*>& classes);
+
+  FlowGraphBuilder* builder_;
+  intptr_t inlined_size_;
+
+  DISALLOW_COPY_AND_ASSIGN(FlowGraphInliner);
+};
+
+}  // namespace dart
+
+#endif  // VM_FLOW_GRAPH_INLINER_H_
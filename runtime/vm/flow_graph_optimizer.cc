@@ -0,0 +1,798 @@
+// Copyright (c) 2012, the Dart project authors.  Please see the AUTHORS file
+// for details. All rights reserved. Use of this source code is governed by a
+// BSD-style license that can be found in the LICENSE file.
+
+#include "vm/flow_graph_optimizer.h"
+
+#include "vm/bit_vector.h"
+#include "vm/flags.h"
+#include "vm/flow_graph_allocator.h"
+#include "vm/flow_graph_builder.h"
+#include "vm/intermediate_language.h"
+#include "vm/object.h"
+#include "vm/os.h"
+
+namespace dart {
+
+DECLARE_FLAG(bool, print_flow_graph);
+
+DEFINE_FLAG(bool, unbox_doubles, true,
+    "Compute on unboxed doubles in optimized code.");
+DEFINE_FLAG(bool, use_cse, true,
+    "Eliminate common subexpressions in optimized code.");
+DEFINE_FLAG(bool, use_licm, true,
+    "Hoist loop invariant computations out of loops in optimized code.");
+DEFINE_FLAG(bool, eliminate_bounds_checks, true,
+    "Drop the bounds checks of array loads proven to be in bounds.");
+
+
+Token::Kind FlowGraphOptimizer::DoubleOperatorKind(Computation* computation) {
+  InstanceCallComp* call = computation->AsInstanceCall();
+  if ((call == NULL) ||
+      (call->ArgumentCount() != 2) ||
+      !call->argument_names().IsNull()) {
+    return Token::kILLEGAL;
+  }
+  const Token::Kind kKinds[] = {
+    Token::kADD, Token::kSUB, Token::kMUL, Token::kDIV
+  };
+  return call->OperatorKind(kKinds, ARRAY_SIZE(kKinds));
+}
+
+
+// Whether the value is known to be a double, given the definitions known to
+// compute doubles.
+static bool IsDoubleValue(Value* value, const GrowableArray<bool>& is_double) {
+  if (value->IsConstant()) return value->AsConstant()->value().IsDouble();
+  Definition* definition = value->AsUse()->definition();
+  return definition->HasSSATemp() && is_double[definition->ssa_temp_index()];
+}
+
+
+BindInstr* FlowGraphOptimizer::InsertBoxAfter(Instruction* instr,
+                                              Definition* definition) {
+  // Not a temporary of the non-optimizing compiler.
+  BindInstr* box = new BindInstr(-1, new BoxDoubleComp(new UseVal(definition)));
+  box->set_ssa_temp_index(builder_->current_ssa_temp_index());
+  builder_->set_current_ssa_temp_index(box->ssa_temp_index() + 1);
+  box->SetSuccessor(instr->StraightLineSuccessor());
+  instr->ReplaceSuccessor(box);
+  return box;
+}
+
+
+void FlowGraphOptimizer::UnboxDoubles() {
+  if (!FLAG_unbox_doubles) return;
+  const GrowableArray<BlockEntryInstr*>& blocks =
+      builder_->postorder_block_entries();
+
+  // Collect the double operators and the phis, which may compute doubles.
+  GrowableArray<BindInstr*> operators;
+  GrowableArray<PhiInstr*> phis;
+  for (intptr_t i = 0; i < blocks.length(); ++i) {
+    JoinEntryInstr* join = blocks[i]->AsJoinEntry();
+    if ((join != NULL) && (join->phis() != NULL)) {
+      for (intptr_t j = 0; j < join->phis()->length(); ++j) {
+        phis.Add((*join->phis())[j]);
+      }
+    }
+    for (Instruction* instr = blocks[i]->StraightLineSuccessor();
+         (instr != NULL) && !instr->IsBlockEntry();
+         instr = instr->StraightLineSuccessor()) {
+      BindInstr* bind = instr->AsBind();
+      if ((bind != NULL) &&
+          bind->HasSSATemp() &&
+          (DoubleOperatorKind(bind->computation()) != Token::kILLEGAL)) {
+        operators.Add(bind);
+      }
+    }
+  }
+  if (operators.is_empty()) return;
+
+  // Optimistically assume that all of them compute doubles, and drop the
+  // operators whose receiver and the phis whose inputs are not known to be
+  // doubles until nothing changes.
+  GrowableArray<bool> is_double(builder_->current_ssa_temp_index());
+  for (intptr_t i = 0; i < builder_->current_ssa_temp_index(); ++i) {
+    is_double.Add(false);
+  }
+  for (intptr_t i = 0; i < operators.length(); ++i) {
+    is_double[operators[i]->ssa_temp_index()] = true;
+  }
+  for (intptr_t i = 0; i < phis.length(); ++i) {
+    is_double[phis[i]->ssa_temp_index()] = true;
+  }
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    for (intptr_t i = 0; i < operators.length(); ++i) {
+      BindInstr* bind = operators[i];
+      if (is_double[bind->ssa_temp_index()] &&
+          !IsDoubleValue(bind->InputAt(0), is_double)) {
+        is_double[bind->ssa_temp_index()] = false;
+        changed = true;
+      }
+    }
+    for (intptr_t i = 0; i < phis.length(); ++i) {
+      PhiInstr* phi = phis[i];
+      if (!is_double[phi->ssa_temp_index()]) continue;
+      for (intptr_t j = 0; j < phi->InputCount(); ++j) {
+        if (!IsDoubleValue(phi->InputAt(j), is_double)) {
+          is_double[phi->ssa_temp_index()] = false;
+          changed = true;
+          break;
+        }
+      }
+    }
+  }
+
+  // The double operators take the unboxed left operand, and convert the
+  // right operand unless it is unboxed as well.
+  bool has_unboxed_values = false;
+  for (intptr_t i = 0; i < operators.length(); ++i) {
+    BindInstr* bind = operators[i];
+    if (!is_double[bind->ssa_temp_index()]) continue;
+    InstanceCallComp* call = bind->computation()->AsInstanceCall();
+    bind->set_computation(
+        new UnboxedDoubleBinaryOpComp(DoubleOperatorKind(call),
+                                      call,
+                                      call->ArgumentAt(0),
+                                      call->ArgumentAt(1)));
+    has_unboxed_values = true;
+  }
+  if (!has_unboxed_values) return;
+  for (intptr_t i = 0; i < phis.length(); ++i) {
+    if (is_double[phis[i]->ssa_temp_index()]) {
+      phis[i]->set_representation(kUnboxedDouble);
+    }
+  }
+
+  // Box the unboxed values flowing into the other instructions, once per
+  // block: before the first instruction using them, and at the end of the
+  // predecessors of tagged phis.
+  GrowableArray<BindInstr*> boxes(is_double.length());
+  for (intptr_t i = 0; i < is_double.length(); ++i) {
+    boxes.Add(NULL);
+  }
+  for (intptr_t i = 0; i < blocks.length(); ++i) {
+    BlockEntryInstr* block = blocks[i];
+    GrowableArray<intptr_t> boxed;
+    Instruction* previous = block;
+    Instruction* instr = block->StraightLineSuccessor();
+    while ((instr != NULL) && !instr->IsBlockEntry()) {
+      BindInstr* bind = instr->AsBind();
+      const bool takes_unboxed_values = (bind != NULL) &&
+          (bind->computation()->IsUnboxedDoubleBinaryOp() ||
+           bind->computation()->IsBoxDouble());
+      for (intptr_t j = 0;
+           !takes_unboxed_values && (j < instr->InputCount());
+           ++j) {
+        UseVal* use = instr->InputAt(j)->AsUse();
+        if ((use == NULL) ||
+            (use->definition()->representation() != kUnboxedDouble)) {
+          continue;
+        }
+        const intptr_t index = use->definition()->ssa_temp_index();
+        if (boxes[index] == NULL) {
+          boxes[index] = InsertBoxAfter(previous, use->definition());
+          boxed.Add(index);
+          previous = boxes[index];
+        }
+        instr->SetInputAt(j, new UseVal(boxes[index]));
+      }
+      previous = instr;
+      instr = instr->StraightLineSuccessor();
+    }
+    JoinEntryInstr* join = (instr == NULL) ? NULL : instr->AsJoinEntry();
+    if ((join != NULL) && (join->phis() != NULL)) {
+      const intptr_t pred_index = join->IndexOfPredecessor(block);
+      for (intptr_t j = 0; j < join->phis()->length(); ++j) {
+        PhiInstr* phi = (*join->phis())[j];
+        UseVal* use = phi->InputAt(pred_index)->AsUse();
+        if ((phi->representation() == kUnboxedDouble) ||
+            (use == NULL) ||
+            (use->definition()->representation() != kUnboxedDouble)) {
+          continue;
+        }
+        const intptr_t index = use->definition()->ssa_temp_index();
+        if (boxes[index] == NULL) {
+          boxes[index] = InsertBoxAfter(previous, use->definition());
+          boxed.Add(index);
+          previous = boxes[index];
+          block->set_last_instruction(previous);
+        }
+        phi->SetInputAt(pred_index, new UseVal(boxes[index]));
+      }
+    }
+    for (intptr_t j = 0; j < boxed.length(); ++j) {
+      boxes[boxed[j]] = NULL;
+    }
+  }
+
+  if (FLAG_print_flow_graph) {
+    OS::Print("After unboxing:\n");
+    builder_->PrintGraph();
+  }
+}
+
+
+static Computation* ComputationOf(Instruction* instr) {
+  if (instr->IsBind()) return instr->AsBind()->computation();
+  if (instr->IsDo()) return instr->AsDo()->computation();
+  return NULL;
+}
+
+
+static bool IsUseOf(Value* value, Definition* definition) {
+  UseVal* use = value->AsUse();
+  return (use != NULL) && (use->definition() == definition);
+}
+
+
+// Whether 'dominator' dominates 'block'.  NULL, the block of the
+// parameters, dominates all blocks.
+static bool Dominates(BlockEntryInstr* dominator, BlockEntryInstr* block) {
+  if (dominator == NULL) return true;
+  for (BlockEntryInstr* current = block;
+       current != NULL;
+       current = current->dominator()) {
+    if (current == dominator) return true;
+  }
+  return false;
+}
+
+
+// Unlink the instruction following 'previous' in the block.
+static void RemoveInstruction(BlockEntryInstr* block,
+                              Instruction* previous,
+                              Instruction* instr) {
+  previous->ReplaceSuccessor(instr->StraightLineSuccessor());
+  if (block->last_instruction() == instr) {
+    block->set_last_instruction((previous == block) ? NULL : previous);
+  }
+}
+
+
+// Append the instruction to a block which does not end with a branch.
+static void AppendInstruction(BlockEntryInstr* block, Instruction* instr) {
+  Instruction* last = (block->last_instruction() == NULL)
+      ? block
+      : block->last_instruction();
+  instr->ReplaceSuccessor(last->StraightLineSuccessor());
+  last->ReplaceSuccessor(instr);
+  block->set_last_instruction(instr);
+}
+
+
+void FlowGraphOptimizer::ComputeDefinitionBlocks(
+    GrowableArray<BlockEntryInstr*>* definition_blocks) const {
+  for (intptr_t i = 0; i < builder_->current_ssa_temp_index(); ++i) {
+    definition_blocks->Add(NULL);
+  }
+  const GrowableArray<BlockEntryInstr*>& blocks =
+      builder_->postorder_block_entries();
+  for (intptr_t i = 0; i < blocks.length(); ++i) {
+    JoinEntryInstr* join = blocks[i]->AsJoinEntry();
+    if ((join != NULL) && (join->phis() != NULL)) {
+      for (intptr_t j = 0; j < join->phis()->length(); ++j) {
+        (*definition_blocks)[(*join->phis())[j]->ssa_temp_index()] = join;
+      }
+    }
+    for (Instruction* instr = blocks[i]->StraightLineSuccessor();
+         (instr != NULL) && !instr->IsBlockEntry();
+         instr = instr->StraightLineSuccessor()) {
+      BindInstr* bind = instr->AsBind();
+      if ((bind != NULL) && bind->HasSSATemp()) {
+        (*definition_blocks)[bind->ssa_temp_index()] = blocks[i];
+      }
+    }
+  }
+}
+
+
+// Computations without side effects whose value only depends on their
+// inputs.  The fields loaded natively (the lengths of arrays, the type
+// arguments of instances and the parents of contexts) are not changed after
+// the object is initialized.
+static bool IsPureComputation(Computation* computation) {
+  return computation->IsTestClass() ||
+      computation->IsStrictCompare() ||
+      computation->IsBooleanNegate() ||
+      computation->IsNativeLoadField();
+}
+
+
+static bool AreEqualValues(Value* a, Value* b) {
+  if (a->IsUse() && b->IsUse()) {
+    return a->AsUse()->definition() == b->AsUse()->definition();
+  }
+  if (a->IsConstant() && b->IsConstant()) {
+    return a->AsConstant()->value().raw() == b->AsConstant()->value().raw();
+  }
+  return false;
+}
+
+
+// Whether the pure computations or loads of instance fields compute the
+// same value.
+static bool AreEqualComputations(Computation* a, Computation* b) {
+  if (a->IsTestClass()) {
+    if (!b->IsTestClass() ||
+        (a->AsTestClass()->cls().raw() != b->AsTestClass()->cls().raw())) {
+      return false;
+    }
+  } else if (a->IsStrictCompare()) {
+    if (!b->IsStrictCompare() ||
+        (a->AsStrictCompare()->kind() != b->AsStrictCompare()->kind())) {
+      return false;
+    }
+  } else if (a->IsBooleanNegate()) {
+    if (!b->IsBooleanNegate()) return false;
+  } else if (a->IsNativeLoadField()) {
+    if (!b->IsNativeLoadField() ||
+        (a->AsNativeLoadField()->offset_in_bytes() !=
+         b->AsNativeLoadField()->offset_in_bytes())) {
+      return false;
+    }
+  } else if (a->IsLoadInstanceField()) {
+    if (!b->IsLoadInstanceField() ||
+        (a->AsLoadInstanceField()->field().raw() !=
+         b->AsLoadInstanceField()->field().raw())) {
+      return false;
+    }
+  } else {
+    return false;
+  }
+  ASSERT(a->InputCount() == b->InputCount());
+  for (intptr_t i = 0; i < a->InputCount(); ++i) {
+    if (!AreEqualValues(a->InputAt(i), b->InputAt(i))) return false;
+  }
+  return true;
+}
+
+
+// Whether the instruction may change an instance field.  The calls, which
+// may run any code, do.  Stores to instance fields are handled by the
+// caller.
+static bool MayChangeFields(Instruction* instr) {
+  Computation* computation = ComputationOf(instr);
+  if (computation == NULL) return false;
+  if (computation->IsUnboxedDoubleBinaryOp()) {
+    return computation->AsUnboxedDoubleBinaryOp()->HasSlowPath();
+  }
+  // The slow path of an array load calls the index operator of the array.
+  return !(IsPureComputation(computation) ||
+           computation->IsTemp() ||
+           computation->IsConstant() ||
+           computation->IsUse() ||
+           computation->IsLoadLocal() ||
+           computation->IsStoreLocal() ||
+           computation->IsLoadInstanceField() ||
+           computation->IsLoadStaticField() ||
+           computation->IsStoreStaticField() ||
+           computation->IsCurrentContext() ||
+           computation->IsStoreContext() ||
+           computation->IsChainContext() ||
+           computation->IsBoxDouble() ||
+           computation->IsLoadIndexed());
+}
+
+
+// Number the values of the block and of the blocks it dominates.  The pure
+// computations available in the block are those of its dominators, the
+// loads of instance fields are those available at the end of its only
+// predecessor.  Uses of the eliminated computations are renamed to the
+// computations replacing them.
+static void NumberValues(BlockEntryInstr* block,
+                         GrowableArray<BindInstr*>* available,
+                         const GrowableArray<BindInstr*>& predecessor_loads,
+                         GrowableArray<Definition*>* replacements) {
+  const intptr_t available_count = available->length();
+  GrowableArray<BindInstr*> loads;
+  if (block->IsTargetEntry()) loads.AddArray(predecessor_loads);
+
+  Instruction* previous = block;
+  Instruction* instr = block->StraightLineSuccessor();
+  while ((instr != NULL) && !instr->IsBlockEntry()) {
+    Instruction* next = instr->StraightLineSuccessor();
+    for (intptr_t i = 0; i < instr->InputCount(); ++i) {
+      UseVal* use = instr->InputAt(i)->AsUse();
+      if ((use == NULL) || !use->definition()->HasSSATemp()) continue;
+      Definition* replacement =
+          (*replacements)[use->definition()->ssa_temp_index()];
+      if (replacement != NULL) instr->SetInputAt(i, new UseVal(replacement));
+    }
+    BindInstr* bind = instr->AsBind();
+    Computation* computation = ComputationOf(instr);
+    if ((bind != NULL) &&
+        bind->HasSSATemp() &&
+        (IsPureComputation(computation) ||
+         computation->IsLoadInstanceField())) {
+      GrowableArray<BindInstr*>* candidates =
+          computation->IsLoadInstanceField() ? &loads : available;
+      BindInstr* match = NULL;
+      for (intptr_t i = 0; i < candidates->length(); ++i) {
+        if (AreEqualComputations((*candidates)[i]->computation(),
+                                 computation)) {
+          match = (*candidates)[i];
+          break;
+        }
+      }
+      if (match != NULL) {
+        (*replacements)[bind->ssa_temp_index()] = match;
+        RemoveInstruction(block, previous, instr);
+        instr = next;
+        continue;
+      }
+      candidates->Add(bind);
+    } else if ((computation != NULL) &&
+               computation->IsStoreInstanceField()) {
+      // Other fields are not changed by the store.
+      const Field& field = computation->AsStoreInstanceField()->field();
+      GrowableArray<BindInstr*> kept;
+      for (intptr_t i = 0; i < loads.length(); ++i) {
+        LoadInstanceFieldComp* load =
+            loads[i]->computation()->AsLoadInstanceField();
+        if (load->field().raw() != field.raw()) kept.Add(loads[i]);
+      }
+      loads.Clear();
+      loads.AddArray(kept);
+    } else if (MayChangeFields(instr)) {
+      loads.Clear();
+    }
+    previous = instr;
+    instr = next;
+  }
+
+  for (intptr_t i = 0; i < block->dominated_blocks().length(); ++i) {
+    NumberValues(block->dominated_blocks()[i],
+                 available,
+                 loads,
+                 replacements);
+  }
+  while (available->length() > available_count) {
+    available->RemoveLast();
+  }
+}
+
+
+void FlowGraphOptimizer::EliminateCommonSubexpressions() {
+  if (!FLAG_use_cse) return;
+  const GrowableArray<BlockEntryInstr*>& blocks =
+      builder_->postorder_block_entries();
+  GrowableArray<Definition*> replacements(builder_->current_ssa_temp_index());
+  for (intptr_t i = 0; i < builder_->current_ssa_temp_index(); ++i) {
+    replacements.Add(NULL);
+  }
+  // The graph entry is the root of the dominator tree.
+  GrowableArray<BindInstr*> available;
+  GrowableArray<BindInstr*> no_loads;
+  NumberValues(blocks.Last(), &available, no_loads, &replacements);
+
+  // The phis may use values defined later in the dominator tree order.
+  bool changed = false;
+  for (intptr_t i = 0; i < replacements.length(); ++i) {
+    if (replacements[i] != NULL) changed = true;
+  }
+  if (!changed) return;
+  for (intptr_t i = 0; i < blocks.length(); ++i) {
+    JoinEntryInstr* join = blocks[i]->AsJoinEntry();
+    if ((join == NULL) || (join->phis() == NULL)) continue;
+    for (intptr_t j = 0; j < join->phis()->length(); ++j) {
+      PhiInstr* phi = (*join->phis())[j];
+      for (intptr_t k = 0; k < phi->InputCount(); ++k) {
+        UseVal* use = phi->InputAt(k)->AsUse();
+        if ((use == NULL) || !use->definition()->HasSSATemp()) continue;
+        Definition* replacement =
+            replacements[use->definition()->ssa_temp_index()];
+        if (replacement != NULL) phi->SetInputAt(k, new UseVal(replacement));
+      }
+    }
+  }
+
+  if (FLAG_print_flow_graph) {
+    OS::Print("After common subexpression elimination:\n");
+    builder_->PrintGraph();
+  }
+}
+
+
+// Whether the computation of the instruction can be moved out of a loop if
+// its inputs are defined outside.  Class tests, comparisons and negations
+// never fail, a load fails if its input is a Smi and is therefore only
+// moved from the loop header.
+static bool IsHoistable(Instruction* instr, bool is_in_header) {
+  BindInstr* bind = instr->AsBind();
+  if ((bind == NULL) || !bind->HasSSATemp()) return false;
+  Computation* computation = bind->computation();
+  if (computation->IsNativeLoadField()) return is_in_header;
+  return IsPureComputation(computation);
+}
+
+
+void FlowGraphOptimizer::HoistLoopInvariants() {
+  if (!FLAG_use_licm) return;
+  const GrowableArray<BlockEntryInstr*>& blocks =
+      builder_->postorder_block_entries();
+  GrowableArray<BlockEntryInstr*> definition_blocks;
+  ComputeDefinitionBlocks(&definition_blocks);
+  bool changed = false;
+
+  // The headers of inner loops come first in postorder, so the invariants
+  // moved out of an inner loop can be moved out of the outer loop next.
+  for (intptr_t i = 0; i < blocks.length(); ++i) {
+    JoinEntryInstr* header = blocks[i]->AsJoinEntry();
+    if (header == NULL) continue;
+    // The loop is entered from a single block and the other predecessors
+    // of the header are the ends of back edges, which it dominates.
+    BlockEntryInstr* pre_header = NULL;
+    GrowableArray<BlockEntryInstr*> back_edges;
+    bool has_single_entry = true;
+    for (intptr_t j = 0; j < header->PredecessorCount(); ++j) {
+      BlockEntryInstr* pred = header->PredecessorAt(j);
+      if (Dominates(header, pred)) {
+        back_edges.Add(pred);
+      } else if (pre_header == NULL) {
+        pre_header = pred;
+      } else {
+        has_single_entry = false;
+      }
+    }
+    if (back_edges.is_empty() || (pre_header == NULL) || !has_single_entry) {
+      continue;
+    }
+
+    // The blocks of the loop reach a back edge without passing the header.
+    // They are numbered in preorder.
+    BitVector* loop_blocks = new BitVector(blocks.length());
+    loop_blocks->Add(header->preorder_number());
+    while (!back_edges.is_empty()) {
+      BlockEntryInstr* block = back_edges.Last();
+      back_edges.RemoveLast();
+      if (loop_blocks->Contains(block->preorder_number())) continue;
+      loop_blocks->Add(block->preorder_number());
+      for (intptr_t j = 0; j < block->PredecessorCount(); ++j) {
+        back_edges.Add(block->PredecessorAt(j));
+      }
+    }
+
+    // Visit the blocks of the loop in reverse postorder, so the moved
+    // definitions stay ahead of their uses.
+    for (intptr_t j = i; j >= 0; --j) {
+      BlockEntryInstr* block = blocks[j];
+      if (!loop_blocks->Contains(block->preorder_number())) continue;
+      Instruction* previous = block;
+      Instruction* instr = block->StraightLineSuccessor();
+      while ((instr != NULL) && !instr->IsBlockEntry()) {
+        Instruction* next = instr->StraightLineSuccessor();
+        bool is_invariant = IsHoistable(instr, block == header);
+        for (intptr_t k = 0; is_invariant && (k < instr->InputCount()); ++k) {
+          UseVal* use = instr->InputAt(k)->AsUse();
+          if ((use == NULL) || !use->definition()->HasSSATemp()) continue;
+          BlockEntryInstr* definition_block =
+              definition_blocks[use->definition()->ssa_temp_index()];
+          if ((definition_block != NULL) &&
+              loop_blocks->Contains(definition_block->preorder_number())) {
+            is_invariant = false;
+          }
+        }
+        if (is_invariant) {
+          RemoveInstruction(block, previous, instr);
+          AppendInstruction(pre_header, instr);
+          definition_blocks[instr->AsBind()->ssa_temp_index()] = pre_header;
+          changed = true;
+        } else {
+          previous = instr;
+        }
+        instr = next;
+      }
+    }
+  }
+
+  if (changed && FLAG_print_flow_graph) {
+    OS::Print("After loop invariant code motion:\n");
+    builder_->PrintGraph();
+  }
+}
+
+
+// The definition tested by the branch entering the block, and whether the
+// block is the true successor of the branch, or NULL if the block is not a
+// successor of a branch.
+static Definition* BranchTestOf(BlockEntryInstr* block,
+                                bool* is_true_successor) {
+  TargetEntryInstr* target = block->AsTargetEntry();
+  if ((target == NULL) || (target->PredecessorCount() != 1)) return NULL;
+  Instruction* last = target->PredecessorAt(0)->last_instruction();
+  BranchInstr* branch = (last == NULL) ? NULL : last->AsBranch();
+  if ((branch == NULL) || !branch->value()->IsUse()) return NULL;
+  *is_true_successor = (branch->true_successor() == target);
+  return branch->value()->AsUse()->definition();
+}
+
+
+// Whether the value flowing into the join from its predecessor is never the
+// value of the join's phis at the block.  That is the case if the
+// predecessor and the block are only reached by opposite outcomes of a test
+// made before the join, since the test is not made again between the join
+// and the block the join dominates.
+static bool IsExcludedPredecessor(
+    BlockEntryInstr* predecessor,
+    JoinEntryInstr* join,
+    BlockEntryInstr* block,
+    const GrowableArray<BlockEntryInstr*>& definition_blocks) {
+  for (BlockEntryInstr* current = predecessor;
+       current != NULL;
+       current = current->dominator()) {
+    bool outcome = false;
+    Definition* test = BranchTestOf(current, &outcome);
+    if ((test == NULL) || !test->HasSSATemp()) continue;
+    BlockEntryInstr* test_block =
+        definition_blocks[test->ssa_temp_index()];
+    if ((test_block == NULL) ||
+        (test_block == join) ||
+        !Dominates(test_block, join)) {
+      continue;
+    }
+    for (BlockEntryInstr* other = block;
+         other != NULL;
+         other = other->dominator()) {
+      bool other_outcome = false;
+      if ((BranchTestOf(other, &other_outcome) == test) &&
+          (other_outcome != outcome)) {
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+
+// Whether the value is the length of the array at the block: a load of the
+// length of the array, or a phi whose other inputs do not flow to the
+// block.
+static bool IsArrayLength(
+    Value* value,
+    Definition* array,
+    BlockEntryInstr* block,
+    const GrowableArray<BlockEntryInstr*>& definition_blocks) {
+  UseVal* use = value->AsUse();
+  if ((use == NULL) || !use->definition()->HasSSATemp()) return false;
+  PhiInstr* phi = use->definition()->AsPhi();
+  const intptr_t input_count = (phi == NULL) ? 1 : phi->InputCount();
+  for (intptr_t i = 0; i < input_count; ++i) {
+    UseVal* input = (phi == NULL) ? use : phi->InputAt(i)->AsUse();
+    BindInstr* bind =
+        (input == NULL) ? NULL : input->definition()->AsBind();
+    NativeLoadFieldComp* load =
+        (bind == NULL) ? NULL : bind->computation()->AsNativeLoadField();
+    if ((load != NULL) &&
+        (load->offset_in_bytes() == Array::length_offset()) &&
+        IsUseOf(load->value(), array)) {
+      continue;
+    }
+    if (phi == NULL) return false;
+    JoinEntryInstr* join =
+        definition_blocks[phi->ssa_temp_index()]->AsJoinEntry();
+    if (!Dominates(join, block) ||
+        !IsExcludedPredecessor(join->PredecessorAt(i),
+                               join,
+                               block,
+                               definition_blocks)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+
+// Whether the phi counts up from a non-negative Smi: its inputs are a Smi
+// constant and the sum of the phi and a positive Smi constant.  Its values
+// are non-negative integers, which are Smis when they are below the length
+// of an array.
+static bool IsNonNegativeInductionVariable(PhiInstr* phi) {
+  if (phi->InputCount() != 2) return false;
+  bool has_start = false;
+  bool has_increment = false;
+  for (intptr_t i = 0; i < phi->InputCount(); ++i) {
+    Value* input = phi->InputAt(i);
+    if (input->IsConstant()) {
+      const Object& start = input->AsConstant()->value();
+      has_start = start.IsSmi() &&
+          (Smi::CheckedHandle(start.raw()).Value() >= 0);
+      continue;
+    }
+    if (!input->IsUse()) return false;
+    BindInstr* bind = input->AsUse()->definition()->AsBind();
+    InstanceCallComp* call =
+        (bind == NULL) ? NULL : bind->computation()->AsInstanceCall();
+    if ((call == NULL) ||
+        !FlowGraphAllocator::IsSmiFastPathCall(call) ||
+        !call->function_name().Equals(Token::Str(Token::kADD)) ||
+        !IsUseOf(call->ArgumentAt(0), phi) ||
+        !call->ArgumentAt(1)->IsConstant()) {
+      return false;
+    }
+    const Object& increment = call->ArgumentAt(1)->AsConstant()->value();
+    has_increment = increment.IsSmi() &&
+        (Smi::CheckedHandle(increment.raw()).Value() > 0);
+  }
+  return has_start && has_increment;
+}
+
+
+// Whether the block is only reached when the index is below the length of
+// the array: by the true outcome of 'index < length' or 'length > index'.
+static bool IsBelowLength(
+    PhiInstr* index,
+    Definition* array,
+    BlockEntryInstr* block,
+    const GrowableArray<BlockEntryInstr*>& definition_blocks) {
+  for (BlockEntryInstr* current = block;
+       current != NULL;
+       current = current->dominator()) {
+    bool is_true_successor = false;
+    Definition* test = BranchTestOf(current, &is_true_successor);
+    BindInstr* bind = (test == NULL) ? NULL : test->AsBind();
+    if ((bind == NULL) || !is_true_successor) continue;
+    InstanceCallComp* call = bind->computation()->AsInstanceCall();
+    if ((call == NULL) || !FlowGraphAllocator::IsSmiFastPathCall(call)) {
+      continue;
+    }
+    Value* length = NULL;
+    if (call->function_name().Equals(Token::Str(Token::kLT)) &&
+        IsUseOf(call->ArgumentAt(0), index)) {
+      length = call->ArgumentAt(1);
+    } else if (call->function_name().Equals(Token::Str(Token::kGT)) &&
+               IsUseOf(call->ArgumentAt(1), index)) {
+      length = call->ArgumentAt(0);
+    }
+    if ((length != NULL) &&
+        IsArrayLength(length, array, block, definition_blocks)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+
+void FlowGraphOptimizer::EliminateBoundsChecks() {
+  if (!FLAG_eliminate_bounds_checks) return;
+  const GrowableArray<BlockEntryInstr*>& blocks =
+      builder_->postorder_block_entries();
+  GrowableArray<BlockEntryInstr*> definition_blocks;
+  ComputeDefinitionBlocks(&definition_blocks);
+  bool changed = false;
+  for (intptr_t i = 0; i < blocks.length(); ++i) {
+    for (Instruction* instr = blocks[i]->StraightLineSuccessor();
+         (instr != NULL) && !instr->IsBlockEntry();
+         instr = instr->StraightLineSuccessor()) {
+      BindInstr* bind = instr->AsBind();
+      LoadIndexedComp* load =
+          (bind == NULL) ? NULL : bind->computation()->AsLoadIndexed();
+      if ((load == NULL) ||
+          !load->needs_bounds_check() ||
+          !load->array()->IsUse() ||
+          !load->index()->IsUse()) {
+        continue;
+      }
+      PhiInstr* index = load->index()->AsUse()->definition()->AsPhi();
+      if ((index != NULL) &&
+          IsNonNegativeInductionVariable(index) &&
+          IsBelowLength(index,
+                        load->array()->AsUse()->definition(),
+                        blocks[i],
+                        definition_blocks)) {
+        load->set_needs_bounds_check(false);
+        changed = true;
+      }
+    }
+  }
+
+  if (changed && FLAG_print_flow_graph) {
+    OS::Print("After bounds check elimination:\n");
+    builder_->PrintGraph();
+  }
+}
+
+}  // namespace dart
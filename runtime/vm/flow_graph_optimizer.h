@@ -0,0 +1,71 @@
+// Copyright (c) 2012, the Dart project authors.  Please see the AUTHORS file
+// for details. All rights reserved. Use of this source code is governed by a
+// BSD-style license that can be found in the LICENSE file.
+
+#ifndef VM_FLOW_GRAPH_OPTIMIZER_H_
+#define VM_FLOW_GRAPH_OPTIMIZER_H_
+
+#include "vm/allocation.h"
+#include "vm/growable_array.h"
+#include "vm/token.h"
+
+namespace dart {
+
+class BindInstr;
+class BlockEntryInstr;
+class Computation;
+class Definition;
+class FlowGraphBuilder;
+class Instruction;
+
+// Optimizations of a flow graph in SSA form, run after inlining and before
+// register allocation.
+class FlowGraphOptimizer : public ValueObject {
+ public:
+  explicit FlowGraphOptimizer(FlowGraphBuilder* builder)
+      : builder_(builder) { }
+
+  // Replace the computations which compute again the value of a computation
+  // dominating them by that value: class tests, strict comparisons,
+  // negations and loads of fields which are not changed after the object is
+  // initialized.  Loads of instance fields are reused in the block and the
+  // blocks it branches to, until a call or a store may change the field.
+  void EliminateCommonSubexpressions();
+
+  // Move the class tests, strict comparisons and negations whose inputs are
+  // defined outside of a loop to the end of the block entering the loop.
+  // Loads of unchanged fields are moved from the loop header only, which
+  // runs whenever the loop is entered.
+  void HoistLoopInvariants();
+
+  // Drop the bounds check of the loads from an array indexed by a variable
+  // counting up from a non-negative Smi, when a dominating branch compares
+  // it with the length of the same array.
+  void EliminateBoundsChecks();
+
+  // Compute the arithmetic operators of doubles on unboxed values when the
+  // left operand is known to be a double: a double constant, the result of
+  // another such operator, or a phi merging only those.  Unboxed values are
+  // boxed where they flow into any other instruction.
+  void UnboxDoubles();
+
+  // The operator of an instance call which the optimizer computes on
+  // unboxed doubles, or Token::kILLEGAL.
+  static Token::Kind DoubleOperatorKind(Computation* computation);
+
+ private:
+  // Insert a box of the unboxed definition after the instruction.
+  BindInstr* InsertBoxAfter(Instruction* instr, Definition* definition);
+
+  // Record the block of each definition, indexed by SSA temp index.  The
+  // parameters are in no block.
+  void ComputeDefinitionBlocks(GrowableArray<BlockEntryInstr*>* blocks) const;
+
+  FlowGraphBuilder* builder_;
+
+  DISALLOW_COPY_AND_ASSIGN(FlowGraphOptimizer);
+};
+
+}  // namespace dart
+
+#endif  // VM_FLOW_GRAPH_OPTIMIZER_H_
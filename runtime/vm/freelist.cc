@@ -4,7 +4,9 @@
 
 #include "vm/freelist.h"
 
+#include "platform/utils.h"
 #include "vm/object.h"
+#include "vm/os.h"
 #include "vm/raw_object.h"
 
 namespace dart {
@@ -55,7 +57,115 @@ void FreeListElement::InitOnce() {
 }
 
 
+// The large elements form a treap: a binary search tree on the size of the
+// elements, which is kept balanced by maintaining a heap order on a
+// pseudo-random priority derived from the element address. Each tree node
+// heads a list of further elements of the same size.
+static uint32_t Priority(FreeListElement* element) {
+  return Utils::WordHash(reinterpret_cast<word>(element));
+}
+
+
+static FreeListElement* RotateRight(FreeListElement* node) {
+  FreeListElement* left = node->left();
+  node->set_left(left->right());
+  left->set_right(node);
+  return left;
+}
+
+
+static FreeListElement* RotateLeft(FreeListElement* node) {
+  FreeListElement* right = node->right();
+  node->set_right(right->left());
+  right->set_left(node);
+  return right;
+}
+
+
+// Inserts the element into the subtree and returns its new root.
+static FreeListElement* InsertLargeElement(FreeListElement* node,
+                                           FreeListElement* element) {
+  if (node == NULL) {
+    element->set_left(NULL);
+    element->set_right(NULL);
+    return element;
+  }
+  intptr_t size = element->Size();
+  if (size == node->Size()) {
+    element->set_next(node->next());
+    node->set_next(element);
+  } else if (size < node->Size()) {
+    node->set_left(InsertLargeElement(node->left(), element));
+    if (Priority(node->left()) > Priority(node)) {
+      node = RotateRight(node);
+    }
+  } else {
+    node->set_right(InsertLargeElement(node->right(), element));
+    if (Priority(node->right()) > Priority(node)) {
+      node = RotateLeft(node);
+    }
+  }
+  return node;
+}
+
+
+// Joins two subtrees, all elements of left are smaller than those of right.
+static FreeListElement* MergeLargeElements(FreeListElement* left,
+                                           FreeListElement* right) {
+  if (left == NULL) {
+    return right;
+  }
+  if (right == NULL) {
+    return left;
+  }
+  if (Priority(left) > Priority(right)) {
+    left->set_right(MergeLargeElements(left->right(), right));
+    return left;
+  }
+  right->set_left(MergeLargeElements(left, right->left()));
+  return right;
+}
+
+
+// Removes the tree node holding elements of the given size and returns the new
+// root of the subtree.
+static FreeListElement* RemoveLargeElement(FreeListElement* node,
+                                           intptr_t size) {
+  ASSERT(node != NULL);
+  if (size < node->Size()) {
+    node->set_left(RemoveLargeElement(node->left(), size));
+    return node;
+  }
+  if (size > node->Size()) {
+    node->set_right(RemoveLargeElement(node->right(), size));
+    return node;
+  }
+  return MergeLargeElements(node->left(), node->right());
+}
+
+
+static void CountLargeElements(FreeListElement* node,
+                               intptr_t* count,
+                               intptr_t* sizes,
+                               intptr_t* total,
+                               intptr_t* largest) {
+  while (node != NULL) {
+    CountLargeElements(node->left(), count, sizes, total, largest);
+    (*sizes)++;
+    *largest = Utils::Maximum(*largest, node->Size());
+    for (FreeListElement* element = node;
+         element != NULL;
+         element = element->next()) {
+      (*count)++;
+      *total += element->Size();
+    }
+    node = node->right();
+  }
+}
+
+
 FreeList::FreeList() {
+  ASSERT((kNumMapWords * kBitsPerWord) == kNumLists);
   Reset();
 }
 
@@ -66,43 +176,39 @@ FreeList::~FreeList() {
 
 
 uword FreeList::TryAllocate(intptr_t size) {
-  int index = IndexForSize(size);
-  if ((index != kNumLists) && (free_lists_[index] != NULL)) {
-    return reinterpret_cast<uword>(DequeueElement(index));
-  }
-
-  if (index < kNumLists) {
-    index++;
-    while (index < kNumLists) {
-      if (free_lists_[index] != NULL) {
-        // Dequeue an element from the list, split and enqueue the remainder in
-        // the appropriate list.
-        FreeListElement* element = DequeueElement(index);
-        SplitElementAfterAndEnqueue(element, size);
-        return reinterpret_cast<uword>(element);
-      }
-      index++;
+  intptr_t index = IndexForSize(size);
+  if (index != kNumLists) {
+    intptr_t list_index = NextNonEmptyList(index);
+    if (list_index == index) {
+      return reinterpret_cast<uword>(DequeueElement(index));
+    }
+    if (list_index > 0) {
+      // Dequeue an element from the list, split and enqueue the remainder in
+      // the appropriate list.
+      FreeListElement* element = DequeueElement(list_index);
+      SplitElementAfterAndEnqueue(element, size);
+      return reinterpret_cast<uword>(element);
     }
   }
 
-  FreeListElement* previous = NULL;
-  FreeListElement* current = free_lists_[kNumLists];
-  while (current != NULL) {
-    if (current->Size() >= size) {
-      // Found an element large enough to hold the requested size. Dequeue,
-      // split and enqueue the remainder.
-      if (previous == NULL) {
-        free_lists_[kNumLists] = current->next();
-      } else {
-        previous->set_next(current->next());
-      }
-      SplitElementAfterAndEnqueue(current, size);
-      return reinterpret_cast<uword>(current);
-    }
-    previous = current;
-    current = current->next();
+  FreeListElement* element = DequeueLargeElement(size);
+  if (element == NULL) {
+    return 0;
+  }
+  // Found an element large enough to hold the requested size. Split and
+  // enqueue the remainder.
+  SplitElementAfterAndEnqueue(element, size);
+  return reinterpret_cast<uword>(element);
+}
+
+
+uword FreeList::TryAllocateChunk(intptr_t minimum_size, intptr_t* chunk_size) {
+  FreeListElement* element = DequeueLargeElement(minimum_size);
+  if (element == NULL) {
+    return 0;
   }
-  return 0;
+  *chunk_size = element->Size();
+  return reinterpret_cast<uword>(element);
 }
 
 
@@ -114,11 +220,43 @@ void FreeList::Free(uword addr, intptr_t size) {
 
 
 void FreeList::Reset() {
-  for (int i = 0; i < (kNumLists + 1); i++) {
+  for (int i = 0; i < kNumLists; i++) {
     free_lists_[i] = NULL;
   }
+  for (int i = 0; i < kNumMapWords; i++) {
+    free_map_[i] = 0;
+  }
+  large_elements_ = NULL;
+}
+
+
+void FreeList::Print() const {
+  const intptr_t KB2 = KB / 2;
+  for (intptr_t index = 1; index < kNumLists; index++) {
+    if (free_lists_[index] == NULL) {
+      continue;
+    }
+    intptr_t count = 0;
+    for (FreeListElement* element = free_lists_[index];
+         element != NULL;
+         element = element->next()) {
+      count++;
+    }
+    intptr_t size = index * kObjectAlignment;
+    OS::PrintErr("  FreeList[%d bytes]: %d elements (%dK)\n",
+                 size, count, (count * size + KB2) / KB);
+  }
+  intptr_t count = 0;
+  intptr_t sizes = 0;
+  intptr_t total = 0;
+  intptr_t largest = 0;
+  CountLargeElements(large_elements_, &count, &sizes, &total, &largest);
+  OS::PrintErr("  FreeList[large]: %d elements of %d sizes (%dK), "
+               "largest %d bytes\n",
+               count, sizes, (total + KB2) / KB, largest);
 }
 
+
 intptr_t FreeList::IndexForSize(intptr_t size) {
   ASSERT(size >= kObjectAlignment);
   ASSERT(Utils::IsAligned(size, kObjectAlignment));
@@ -131,19 +269,76 @@ intptr_t FreeList::IndexForSize(intptr_t size) {
 }
 
 
+intptr_t FreeList::NextNonEmptyList(intptr_t index) const {
+  ASSERT((index >= 0) && (index < kNumLists));
+  intptr_t word_index = index / kBitsPerWord;
+  // Ignore the lists before index in the first word.
+  uword mask = ~static_cast<uword>(0) << (index % kBitsPerWord);
+  uword bits = free_map_[word_index] & mask;
+  while (bits == 0) {
+    word_index++;
+    if (word_index == kNumMapWords) {
+      return -1;
+    }
+    bits = free_map_[word_index];
+  }
+  return (word_index * kBitsPerWord) + Utils::CountTrailingZeros(bits);
+}
+
+
 void FreeList::EnqueueElement(FreeListElement* element, intptr_t index) {
+  if (index == kNumLists) {
+    element->set_next(NULL);
+    large_elements_ = InsertLargeElement(large_elements_, element);
+    return;
+  }
   element->set_next(free_lists_[index]);
   free_lists_[index] = element;
+  SetListNonEmpty(index);
 }
 
 
 FreeListElement* FreeList::DequeueElement(intptr_t index) {
   FreeListElement* result = free_lists_[index];
   free_lists_[index] = result->next();
+  if (free_lists_[index] == NULL) {
+    SetListEmpty(index);
+  }
   return result;
 }
 
 
+FreeListElement* FreeList::DequeueLargeElement(intptr_t size) {
+  // Find the smallest node which is large enough.
+  FreeListElement* best = NULL;
+  FreeListElement* node = large_elements_;
+  while (node != NULL) {
+    if (node->Size() == size) {
+      best = node;
+      break;
+    }
+    if (node->Size() > size) {
+      best = node;
+      node = node->left();
+    } else {
+      node = node->right();
+    }
+  }
+  if (best == NULL) {
+    return NULL;
+  }
+  // Prefer taking an element from the list of the node over restructuring
+  // the tree.
+  FreeListElement* result = best->next();
+  if (result != NULL) {
+    best->set_next(result->next());
+    return result;
+  }
+  large_elements_ = RemoveLargeElement(large_elements_, best->Size());
+  return best;
+}
+
+
 void FreeList::SplitElementAfterAndEnqueue(FreeListElement* element,
                                            intptr_t size) {
   intptr_t remainder_size = element->Size() - size;
@@ -40,6 +40,13 @@ class FreeListElement {
     return *SizeAddress();
   }
 
+  // Large elements are kept in a tree ordered by size, the links to the
+  // smaller and larger elements are embedded after the size.
+  FreeListElement* left() const { return *LinkAddress(0); }
+  void set_left(FreeListElement* left) { *LinkAddress(0) = left; }
+  FreeListElement* right() const { return *LinkAddress(1); }
+  void set_right(FreeListElement* right) { *LinkAddress(1) = right; }
+
   static FreeListElement* AsElement(uword addr, intptr_t size);
 
   static bool IsSpecialClass(RawObject* raw_obj) {
@@ -60,6 +67,11 @@ class FreeListElement {
     return reinterpret_cast<intptr_t*>(addr);
   }
 
+  FreeListElement** LinkAddress(intptr_t index) const {
+    uword addr = reinterpret_cast<uword>(SizeAddress()) + kWordSize;
+    return reinterpret_cast<FreeListElement**>(addr) + index;
+  }
+
   // The two fake classe being used by the FreeList to identify free objects in
   // the heap. These can be static and shared between isolates since they
   // contain no per-isolate information. Actually, they need to be static so
@@ -77,6 +89,10 @@ class FreeListElement {
 };
 
 
+// Free memory is kept in segregated lists of exactly sized elements for small
+// sizes. A bitmap of the non-empty lists finds the smallest fitting list with
+// a single bit scan. Elements too large for the lists are kept in a tree,
+// which is searched for the best fitting element.
 class FreeList {
  public:
   FreeList();
@@ -85,19 +101,46 @@ class FreeList {
   uword TryAllocate(intptr_t size);
   void Free(uword addr, intptr_t size);
 
+  // Allocates a whole element of at least minimum_size bytes without splitting
+  // it. Only elements from the tree of large elements are considered. Returns
+  // the size of the element in chunk_size.
+  uword TryAllocateChunk(intptr_t minimum_size, intptr_t* chunk_size);
+
   void Reset();
 
+  // Prints the number and total size of the free elements per list.
+  void Print() const;
+
  private:
   static const int kNumLists = 128;
+  static const int kNumMapWords = kNumLists / kBitsPerWord;
 
   static intptr_t IndexForSize(intptr_t size);
 
+  void SetListNonEmpty(intptr_t index) {
+    free_map_[index / kBitsPerWord] |=
+        static_cast<uword>(1) << (index % kBitsPerWord);
+  }
+  void SetListEmpty(intptr_t index) {
+    free_map_[index / kBitsPerWord] &=
+        ~(static_cast<uword>(1) << (index % kBitsPerWord));
+  }
+  // Returns the index of the first non-empty list at or after index, or -1.
+  intptr_t NextNonEmptyList(intptr_t index) const;
+
   void EnqueueElement(FreeListElement* element, intptr_t index);
   FreeListElement* DequeueElement(intptr_t index);
 
   void SplitElementAfterAndEnqueue(FreeListElement* element, intptr_t size);
 
-  FreeListElement* free_lists_[kNumLists + 1];
+  // Removes the smallest large element of at least size bytes.
+  FreeListElement* DequeueLargeElement(intptr_t size);
+
+  FreeListElement* free_lists_[kNumLists];
+  uword free_map_[kNumMapWords];
+
+  // Root of the tree of large elements.
+  FreeListElement* large_elements_;
 
   DISALLOW_COPY_AND_ASSIGN(FreeList);
 };
@@ -50,4 +50,81 @@ TEST_CASE(FreeList) {
   delete free_list;
 }
 
+
+TEST_CASE(FreeListChunk) {
+  FreeList* free_list = new FreeList();
+  intptr_t kBlobSize = 64 * KB;
+  intptr_t kSmallObjectSize = 4 * kWordSize;
+  intptr_t kChunkSize = 8 * KB;
+  uword blob = reinterpret_cast<uword>(malloc(kBlobSize));
+  // Small free blocks are never handed out as chunks.
+  free_list->Free(blob, kSmallObjectSize);
+  intptr_t chunk_size = 0;
+  EXPECT(free_list->TryAllocateChunk(kSmallObjectSize, &chunk_size) == 0);
+  // A large free block is handed out whole instead of being split.
+  free_list->Free(blob + kChunkSize, kChunkSize);
+  uword chunk = free_list->TryAllocateChunk(kSmallObjectSize, &chunk_size);
+  EXPECT_EQ(blob + kChunkSize, chunk);
+  EXPECT_EQ(kChunkSize, chunk_size);
+  EXPECT(free_list->TryAllocateChunk(kSmallObjectSize, &chunk_size) == 0);
+  // The block has to be at least as large as the requested minimum.
+  free_list->Free(blob + kChunkSize, kChunkSize);
+  EXPECT(free_list->TryAllocateChunk(2 * kChunkSize, &chunk_size) == 0);
+  free_list->Free(blob + 2 * kChunkSize, 4 * kChunkSize);
+  chunk = free_list->TryAllocateChunk(2 * kChunkSize, &chunk_size);
+  EXPECT_EQ(blob + 2 * kChunkSize, chunk);
+  EXPECT_EQ(4 * kChunkSize, chunk_size);
+  // The small block is still available for regular allocation.
+  EXPECT_EQ(blob, free_list->TryAllocate(kSmallObjectSize));
+  // Delete the memory associated with the test.
+  free(reinterpret_cast<void*>(blob));
+  delete free_list;
+}
+
+
+TEST_CASE(FreeListBestFit) {
+  FreeList* free_list = new FreeList();
+  intptr_t kBlobSize = 1 * MB;
+  intptr_t kSmallObjectSize = 4 * kWordSize;
+  intptr_t kLargeObjectSize = 8 * KB;
+  uword blob = reinterpret_cast<uword>(malloc(kBlobSize));
+  // Free large blocks of different sizes, separated by allocated memory.
+  uword large_block = blob;
+  uword larger_block = blob + 2 * kLargeObjectSize;
+  uword largest_block = blob + 5 * kLargeObjectSize;
+  free_list->Free(largest_block, 4 * kLargeObjectSize);
+  free_list->Free(large_block, kLargeObjectSize);
+  free_list->Free(larger_block, 2 * kLargeObjectSize);
+  // Large objects are allocated from the smallest block they fit into.
+  EXPECT_EQ(larger_block,
+            free_list->TryAllocate(kLargeObjectSize + kSmallObjectSize));
+  EXPECT_EQ(largest_block, free_list->TryAllocate(2 * kLargeObjectSize));
+  EXPECT_EQ(large_block, free_list->TryAllocate(kLargeObjectSize));
+  // The small remainder of the larger block is found through its list.
+  EXPECT_EQ(larger_block + kLargeObjectSize + kSmallObjectSize,
+            free_list->TryAllocate(kSmallObjectSize));
+  // Small objects are split from the smallest non-empty list.
+  free_list->Free(blob, 2 * kSmallObjectSize);
+  free_list->Free(blob + 4 * kSmallObjectSize, 3 * kSmallObjectSize);
+  EXPECT_EQ(blob, free_list->TryAllocate(kSmallObjectSize));
+  EXPECT_EQ(blob + kSmallObjectSize, free_list->TryAllocate(kSmallObjectSize));
+  EXPECT_EQ(blob + 4 * kSmallObjectSize,
+            free_list->TryAllocate(kSmallObjectSize));
+  // Many large blocks of the same size share a single tree node.
+  const intptr_t kNumBlocks = 32;
+  for (intptr_t i = 0; i < kNumBlocks; i++) {
+    free_list->Free(blob + (2 * i + 10) * kLargeObjectSize, kLargeObjectSize);
+  }
+  for (intptr_t i = 0; i < kNumBlocks; i++) {
+    EXPECT(free_list->TryAllocate(kLargeObjectSize) != 0);
+  }
+  // Only the remainder of the largest block is left.
+  EXPECT_EQ(largest_block + 2 * kLargeObjectSize,
+            free_list->TryAllocate(2 * kLargeObjectSize));
+  EXPECT(free_list->TryAllocate(kLargeObjectSize) == 0);
+  // Delete the memory associated with the test.
+  free(reinterpret_cast<void*>(blob));
+  delete free_list;
+}
+
 }  // namespace dart
@@ -0,0 +1,453 @@
+// Copyright (c) 2012, the Dart project authors.  Please see the AUTHORS file
+// for details. All rights reserved. Use of this source code is governed by a
+// BSD-style license that can be found in the LICENSE file.
+
+#include "vm/gc_compactor.h"
+
+#include "platform/assert.h"
+#include "platform/utils.h"
+#include "vm/dart_api_state.h"
+#include "vm/freelist.h"
+#include "vm/heap.h"
+#include "vm/isolate.h"
+#include "vm/pages.h"
+#include "vm/raw_object.h"
+#include "vm/stack_frame.h"
+#include "vm/store_buffer.h"
+#include "vm/visitor.h"
+
+namespace dart {
+
+// The forwarding information of a block of kUnitsPerBlock allocation units.
+// Each live unit of the block has its bit set. The forwarding address of an
+// object is the new address of its block plus the size of the live units
+// preceding the object in the block.
+class ForwardingBlock {
+ public:
+  static const intptr_t kUnitsPerBlock = 32;
+
+  ForwardingBlock() : new_address_(0), live_bitvector_(0) { }
+
+  uword Lookup(intptr_t unit) const {
+    return new_address_ +
+        (NumLiveUnitsBefore(unit) << kObjectAlignmentLog2);
+  }
+
+  intptr_t NumLiveUnitsBefore(intptr_t unit) const {
+    ASSERT((unit >= 0) && (unit < kUnitsPerBlock));
+    uint32_t mask = (static_cast<uint32_t>(1) << unit) - 1;
+    return Utils::CountOneBits(live_bitvector_ & mask);
+  }
+
+  bool IsLive(intptr_t unit) const {
+    return (live_bitvector_ & (static_cast<uint32_t>(1) << unit)) != 0;
+  }
+  bool IsEmpty() const { return live_bitvector_ == 0; }
+
+  // Marks the units [first_unit, first_unit + num_units) as live.
+  void RecordLive(intptr_t first_unit, intptr_t num_units) {
+    ASSERT((first_unit + num_units) <= kUnitsPerBlock);
+    uint32_t mask = (num_units == kUnitsPerBlock) ?
+        ~static_cast<uint32_t>(0) :
+        ((static_cast<uint32_t>(1) << num_units) - 1);
+    live_bitvector_ |= mask << first_unit;
+  }
+
+  void set_new_address(uword value) { new_address_ = value; }
+
+ private:
+  uword new_address_;
+  uint32_t live_bitvector_;
+
+  DISALLOW_COPY_AND_ASSIGN(ForwardingBlock);
+};
+
+
+// The forwarding information of a regular sized page. Besides the blocks it
+// keeps the sizes of the live objects which are too large to be encoded in
+// their header, since their class may already have been moved when the object
+// itself is moved.
+class ForwardingPage {
+ public:
+  static const intptr_t kBlockSize =
+      ForwardingBlock::kUnitsPerBlock * kObjectAlignment;
+  static const intptr_t kBlocksPerPage = PageSpace::kPageSize / kBlockSize;
+  static const intptr_t kMaxLargeObjects =
+      PageSpace::kPageSize / RawObject::SizeTag::kMaxSizeTag;
+
+  explicit ForwardingPage(uword compacted_top)
+      : compacted_top_(compacted_top),
+        num_large_objects_(0),
+        next_large_object_(0) { }
+
+  ForwardingBlock* BlockFor(uword addr) {
+    return &blocks_[PageOffset(addr) / kBlockSize];
+  }
+  static intptr_t UnitFor(uword addr) {
+    return (PageOffset(addr) >> kObjectAlignmentLog2) %
+        ForwardingBlock::kUnitsPerBlock;
+  }
+
+  uword Lookup(uword addr) {
+    return BlockFor(addr)->Lookup(UnitFor(addr));
+  }
+  bool IsLive(uword addr) {
+    return BlockFor(addr)->IsLive(UnitFor(addr));
+  }
+
+  void RecordLive(uword addr, intptr_t size) {
+    uword end = addr + size;
+    while (addr < end) {
+      uword block_end = Utils::RoundDown(addr, kBlockSize) + kBlockSize;
+      if (block_end > end) {
+        block_end = end;
+      }
+      BlockFor(addr)->RecordLive(UnitFor(addr),
+                                 (block_end - addr) >> kObjectAlignmentLog2);
+      addr = block_end;
+    }
+  }
+
+  void AddLargeObjectSize(intptr_t size) {
+    ASSERT(num_large_objects_ < kMaxLargeObjects);
+    large_object_sizes_[num_large_objects_++] = size;
+  }
+  // The large object sizes are consumed in the order they were added.
+  intptr_t NextLargeObjectSize() {
+    ASSERT(next_large_object_ < num_large_objects_);
+    return large_object_sizes_[next_large_object_++];
+  }
+
+  uword compacted_top() const { return compacted_top_; }
+  void set_compacted_top(uword value) { compacted_top_ = value; }
+
+ private:
+  static uword PageOffset(uword addr) {
+    return addr & (PageSpace::kPageSize - 1);
+  }
+
+  ForwardingBlock blocks_[kBlocksPerPage];
+  intptr_t large_object_sizes_[kMaxLargeObjects];
+  uword compacted_top_;
+  intptr_t num_large_objects_;
+  intptr_t next_large_object_;
+
+  DISALLOW_COPY_AND_ASSIGN(ForwardingPage);
+};
+
+
+static RawObject* Forward(RawObject* raw_obj) {
+  if (!raw_obj->IsHeapObject() || raw_obj->IsNewObject()) {
+    return raw_obj;
+  }
+  // Only the pages being compacted have forwarding information.
+  ForwardingPage* forwarding_page =
+      PageSpace::PageFor(raw_obj)->forwarding_page();
+  if (forwarding_page == NULL) {
+    return raw_obj;
+  }
+  uword addr = RawObject::ToAddr(raw_obj);
+  ASSERT(forwarding_page->IsLive(addr));
+  return RawObject::FromAddr(forwarding_page->Lookup(addr));
+}
+
+
+// Updates the visited pointers to their forwarding addresses. Every pointer
+// has to be visited exactly once. The class of an object is still needed to
+// visit the object, so its class pointer is skipped and updated separately.
+class ForwardPointersVisitor : public ObjectPointerVisitor {
+ public:
+  ForwardPointersVisitor() : skipped_(NULL) { }
+
+  void VisitPointers(RawObject** first, RawObject** last) {
+    for (RawObject** current = first; current <= last; current++) {
+      if (current != skipped_) {
+        *current = Forward(*current);
+      }
+    }
+  }
+
+  // Returns the size of the object.
+  intptr_t VisitObjectPointers(RawObject* raw_obj) {
+    skipped_ = reinterpret_cast<RawObject**>(&raw_obj->ptr()->class_);
+    intptr_t size = raw_obj->VisitPointers(this);
+    skipped_ = NULL;
+    return size;
+  }
+
+  static void ForwardClass(RawObject* raw_obj) {
+    if (raw_obj->IsFreeListElement()) {
+      // The classes of free list elements are not in the heap.
+      return;
+    }
+    raw_obj->ptr()->class_ =
+        reinterpret_cast<RawClass*>(Forward(raw_obj->ptr()->class_));
+  }
+
+ private:
+  RawObject** skipped_;
+
+  DISALLOW_COPY_AND_ASSIGN(ForwardPointersVisitor);
+};
+
+
+class ForwardObjectPointersVisitor : public ObjectVisitor {
+ public:
+  explicit ForwardObjectPointersVisitor(ForwardPointersVisitor* visitor)
+      : visitor_(visitor) { }
+
+  void VisitObject(RawObject* raw_obj) {
+    visitor_->VisitObjectPointers(raw_obj);
+  }
+
+ private:
+  ForwardPointersVisitor* visitor_;
+
+  DISALLOW_COPY_AND_ASSIGN(ForwardObjectPointersVisitor);
+};
+
+
+class ForwardClassVisitor : public ObjectVisitor {
+ public:
+  ForwardClassVisitor() { }
+
+  void VisitObject(RawObject* raw_obj) {
+    ForwardPointersVisitor::ForwardClass(raw_obj);
+  }
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(ForwardClassVisitor);
+};
+
+
+void GCCompactor::PlanBlock(HeapPage* page,
+                            uword first_object,
+                            intptr_t size) {
+  // The objects starting in a block are kept together. Objects only move
+  // towards the start of the page list, so there is always a page left to
+  // move them to.
+  if ((destination_top_ + size) > destination_page_->end()) {
+    destination_page_ = destination_page_->next();
+    ASSERT(destination_page_ != NULL);
+    destination_top_ = destination_page_->first_object_start();
+  }
+  ASSERT((destination_page_ != page) || (destination_top_ <= first_object));
+  ForwardingPage* forwarding_page = page->forwarding_page();
+  ForwardingBlock* block = forwarding_page->BlockFor(first_object);
+  // The live units before the first object of the block belong to an object
+  // starting in a previous block.
+  intptr_t preceding_units =
+      block->NumLiveUnitsBefore(ForwardingPage::UnitFor(first_object));
+  block->set_new_address(
+      destination_top_ - (preceding_units << kObjectAlignmentLog2));
+  destination_top_ += size;
+  destination_page_->forwarding_page()->set_compacted_top(destination_top_);
+}
+
+
+void GCCompactor::PlanPage(HeapPage* page) {
+  ForwardingPage* forwarding_page = page->forwarding_page();
+  ForwardingBlock* block = NULL;
+  uword block_first_object = 0;
+  intptr_t block_size = 0;
+
+  uword current = page->first_object_start();
+  uword top = page->top();
+  while (current < top) {
+    RawObject* raw_obj = RawObject::FromAddr(current);
+    intptr_t obj_size = raw_obj->Size();
+    if (raw_obj->IsMarked()) {
+      forwarding_page->RecordLive(current, obj_size);
+      if (RawObject::SizeTag::decode(raw_obj->ptr()->tags_) == 0) {
+        forwarding_page->AddLargeObjectSize(obj_size);
+      }
+      ForwardingBlock* obj_block = forwarding_page->BlockFor(current);
+      if (obj_block != block) {
+        if (block != NULL) {
+          PlanBlock(page, block_first_object, block_size);
+        }
+        block = obj_block;
+        block_first_object = current;
+        block_size = 0;
+      }
+      block_size += obj_size;
+    }
+    current += obj_size;
+  }
+  ASSERT(current == top);
+  if (block != NULL) {
+    PlanBlock(page, block_first_object, block_size);
+  }
+}
+
+
+void GCCompactor::ForwardPagePointers(HeapPage* page,
+                                      ForwardPointersVisitor* visitor) {
+  uword current = page->first_object_start();
+  uword top = page->top();
+  while (current < top) {
+    RawObject* raw_obj = RawObject::FromAddr(current);
+    if (raw_obj->IsMarked()) {
+      current += visitor->VisitObjectPointers(raw_obj);
+    } else {
+      current += raw_obj->Size();
+    }
+  }
+  ASSERT(current == top);
+}
+
+
+void GCCompactor::ForwardStoreBuffer(Isolate* isolate) {
+  StoreBuffer* buffer = isolate->store_buffer();
+  StoreBufferBlock* blocks = buffer->TakeBlocks();
+  for (StoreBufferBlock* block = blocks;
+       block != NULL;
+       block = block->next()) {
+    intptr_t count = block->Count();
+    for (intptr_t i = 0; i < count; i++) {
+      buffer->AddObject(Forward(block->At(i)));
+    }
+  }
+  buffer->ReleaseBlocks(blocks);
+}
+
+
+void GCCompactor::ForwardPointers(Isolate* isolate, PageSpace* page_space) {
+  ForwardPointersVisitor visitor;
+  // The roots visited by the marker, including all weak persistent handles.
+  isolate->VisitObjectPointers(&visitor,
+                               true,
+                               StackFrameIterator::kDontValidateFrames);
+  ApiState* state = isolate->api_state();
+  if (state != NULL) {
+    state->weak_persistent_handles().VisitObjectPointers(&visitor);
+  }
+
+  ForwardObjectPointersVisitor object_visitor(&visitor);
+  heap_->IterateNewObjects(&object_visitor);
+  heap_->IterateCodeObjects(&object_visitor);
+  for (HeapPage* page = page_space->large_pages_;
+       page != NULL;
+       page = page->next()) {
+    page->VisitObjects(&object_visitor);
+  }
+  for (HeapPage* page = page_space->pages_;
+       page != NULL;
+       page = page->next()) {
+    ForwardPagePointers(page, &visitor);
+  }
+
+  ForwardStoreBuffer(isolate);
+}
+
+
+void GCCompactor::SlidePage(HeapPage* page) {
+  ForwardingPage* forwarding_page = page->forwarding_page();
+  uword current = page->first_object_start();
+  uword top = page->top();
+  while (current < top) {
+    if (!forwarding_page->IsLive(current)) {
+      // Skip over blocks without live objects.
+      if (forwarding_page->BlockFor(current)->IsEmpty()) {
+        current = Utils::RoundDown(current, ForwardingPage::kBlockSize) +
+            ForwardingPage::kBlockSize;
+      } else {
+        current += kObjectAlignment;
+      }
+      continue;
+    }
+    // The objects preceding this one in the page list did not move past it,
+    // so its header is still intact. Its class may have been moved already
+    // though.
+    RawObject* raw_obj = RawObject::FromAddr(current);
+    intptr_t obj_size = RawObject::SizeTag::decode(raw_obj->ptr()->tags_);
+    if (obj_size == 0) {
+      obj_size = forwarding_page->NextLargeObjectSize();
+    }
+    uword new_addr = forwarding_page->Lookup(current);
+    ASSERT(!page->Contains(new_addr) || (new_addr <= current));
+    if (new_addr != current) {
+      memmove(reinterpret_cast<void*>(new_addr),
+              reinterpret_cast<void*>(current),
+              obj_size);
+    }
+    RawObject* new_obj = RawObject::FromAddr(new_addr);
+    new_obj->ClearMarkBit();
+    ForwardPointersVisitor::ForwardClass(new_obj);
+    current += obj_size;
+  }
+}
+
+
+void GCCompactor::ForwardClasses(PageSpace* page_space) {
+  // The objects which were not moved still refer to the old location of their
+  // class.
+  ForwardClassVisitor visitor;
+  heap_->IterateNewObjects(&visitor);
+  heap_->IterateCodeObjects(&visitor);
+  for (HeapPage* page = page_space->large_pages_;
+       page != NULL;
+       page = page->next()) {
+    page->VisitObjects(&visitor);
+  }
+}
+
+
+intptr_t GCCompactor::CompactPages(Isolate* isolate, PageSpace* page_space) {
+  HeapPage* pages = page_space->pages_;
+  if (pages == NULL) {
+    return 0;
+  }
+  for (HeapPage* page = pages; page != NULL; page = page->next()) {
+    page->set_forwarding_page(
+        new ForwardingPage(page->first_object_start()));
+  }
+
+  destination_page_ = pages;
+  destination_top_ = pages->first_object_start();
+  for (HeapPage* page = pages; page != NULL; page = page->next()) {
+    PlanPage(page);
+  }
+  ForwardPointers(isolate, page_space);
+  for (HeapPage* page = pages; page != NULL; page = page->next()) {
+    SlidePage(page);
+  }
+  ForwardClasses(page_space);
+
+  // All pages up to the last destination page are filled with the moved
+  // objects. The remainder of a filled page is added to the freelist, only the
+  // last destination page keeps bump allocating.
+  intptr_t in_use = 0;
+  HeapPage* page = pages;
+  while (true) {
+    ForwardingPage* forwarding_page = page->forwarding_page();
+    uword top = forwarding_page->compacted_top();
+    delete forwarding_page;
+    page->set_forwarding_page(NULL);
+    page->set_used(0);
+    in_use += top - page->first_object_start();
+    if (page == destination_page_) {
+      page->set_top(top);
+      break;
+    }
+    if (top < page->end()) {
+      page_space->freelist_.Free(top, page->end() - top);
+    }
+    page->set_top(page->end());
+    page = page->next();
+  }
+
+  // Release the pages which are left empty.
+  HeapPage* empty_pages = destination_page_->next();
+  destination_page_->set_next(NULL);
+  page_space->pages_tail_ = destination_page_;
+  for (page = empty_pages; page != NULL; page = page->next()) {
+    delete page->forwarding_page();
+    page->set_forwarding_page(NULL);
+    page_space->capacity_ -= PageSpace::kPageSize;
+  }
+  page_space->FreePages(empty_pages);
+  return in_use;
+}
+
+}  // namespace dart
@@ -0,0 +1,58 @@
+// Copyright (c) 2012, the Dart project authors.  Please see the AUTHORS file
+// for details. All rights reserved. Use of this source code is governed by a
+// BSD-style license that can be found in the LICENSE file.
+
+#ifndef VM_GC_COMPACTOR_H_
+#define VM_GC_COMPACTOR_H_
+
+#include "vm/allocation.h"
+
+namespace dart {
+
+// Forward declarations.
+class ForwardPointersVisitor;
+class Heap;
+class HeapPage;
+class Isolate;
+class PageSpace;
+
+// The class GCCompactor is used as an alternative to sweeping after marking.
+// It slides the marked objects of the regular sized pages of a page space
+// towards the start of the page list, updates all pointers to the moved
+// objects and releases the pages which are left empty. Objects on large pages
+// are not moved, those pages have to be swept before compacting.
+class GCCompactor : public ValueObject {
+ public:
+  explicit GCCompactor(Heap* heap)
+      : heap_(heap), destination_page_(NULL), destination_top_(0) { }
+  ~GCCompactor() { }
+
+  // Compacts the pages while clearing the mark bits.
+  // Returns the size of memory used by the marked objects.
+  intptr_t CompactPages(Isolate* isolate, PageSpace* page_space);
+
+ private:
+  // Computes the forwarding addresses of the marked objects on a page.
+  void PlanPage(HeapPage* page);
+  void PlanBlock(HeapPage* page, uword first_object, intptr_t size);
+
+  void ForwardPointers(Isolate* isolate, PageSpace* page_space);
+  void ForwardPagePointers(HeapPage* page, ForwardPointersVisitor* visitor);
+  void ForwardStoreBuffer(Isolate* isolate);
+  void ForwardClasses(PageSpace* page_space);
+
+  // Moves the marked objects of a page to their forwarding addresses.
+  void SlidePage(HeapPage* page);
+
+  Heap* heap_;
+
+  // The page and address the next planned object is moved to.
+  HeapPage* destination_page_;
+  uword destination_top_;
+
+  DISALLOW_IMPLICIT_CONSTRUCTORS(GCCompactor);
+};
+
+}  // namespace dart
+
+#endif  // VM_GC_COMPACTOR_H_
@@ -5,110 +5,194 @@
 #include "vm/gc_marker.h"
 
 #include "vm/allocation.h"
+#include "vm/dart.h"
 #include "vm/dart_api_state.h"
+#include "vm/flags.h"
+#include "vm/gc_tracer.h"
+#include "vm/heap.h"
 #include "vm/isolate.h"
 #include "vm/pages.h"
 #include "vm/raw_object.h"
 #include "vm/stack_frame.h"
+#include "vm/store_buffer.h"
+#include "vm/thread.h"
+#include "vm/thread_pool.h"
 #include "vm/visitor.h"
 
 namespace dart {
 
-// A simple chunked marking stack.
-class MarkingStack : public ValueObject {
+DEFINE_FLAG(int, marker_tasks, 1,
+            "The number of tasks used to mark old space objects, including "
+            "the thread requesting the collection.");
+
+// A chunk of a marking stack. Full chunks are shared between the marking tasks
+// through the MarkingStackPool.
+class MarkingStackChunk {
+ public:
+  MarkingStackChunk() : top_(0), next_(NULL) {}
+  ~MarkingStackChunk() {}
+
+  bool IsEmpty() const { return top_ == 0; }
+  bool IsFull() const { return top_ == kMarkingStackChunkSize; }
+
+  void Push(RawObject* value) {
+    ASSERT(!IsFull());
+    memory_[top_] = value;
+    top_++;
+  }
+
+  RawObject* Pop() {
+    ASSERT(!IsEmpty());
+    top_--;
+    return memory_[top_];
+  }
+
+  MarkingStackChunk* next() const { return next_; }
+  void set_next(MarkingStackChunk* value) { next_ = value; }
+
+  static const intptr_t kMarkingStackChunkSize = 1024;
+
+ private:
+  RawObject* memory_[kMarkingStackChunkSize];
+  intptr_t top_;
+  MarkingStackChunk* next_;
+
+  DISALLOW_COPY_AND_ASSIGN(MarkingStackChunk);
+};
+
+
+// The pool of marking stack chunks shared by all marking tasks. A task
+// publishes each chunk it fills and an idle task steals published chunks.
+// Draining is complete once all tasks are idle and no full chunks are left.
+class MarkingStackPool {
  public:
-  MarkingStack()
-      : head_(new MarkingStackChunk()),
+  MarkingStackPool()
+      : full_chunks_(NULL),
         empty_chunks_(NULL),
-        marking_stack_(NULL),
-        top_(0) {
-    marking_stack_ = head_->MarkingStackChunkMemory();
+        num_tasks_(1),
+        num_idle_tasks_(0) {
   }
 
-  ~MarkingStack() {
-    // TODO(iposva): Consider caching a couple emtpy marking stack chunks.
-    ASSERT(IsEmpty());
-    delete head_;
-    MarkingStackChunk* next;
+  ~MarkingStackPool() {
+    ASSERT(full_chunks_ == NULL);
     while (empty_chunks_ != NULL) {
-      next = empty_chunks_->next();
+      MarkingStackChunk* next = empty_chunks_->next();
       delete empty_chunks_;
       empty_chunks_ = next;
     }
   }
 
-  bool IsEmpty() const {
-    return IsMarkingStackChunkEmpty() && (head_->next() == NULL);
+  // Prepares the pool for draining by the given number of marking tasks.
+  void StartDrain(intptr_t num_tasks) {
+    MonitorLocker ml(&monitor_);
+    ASSERT(num_tasks > 0);
+    num_tasks_ = num_tasks;
+    num_idle_tasks_ = 0;
   }
 
-  void Push(RawObject* value) {
-    ASSERT(!IsMarkingStackChunkFull());
-    marking_stack_[top_] = value;
-    top_++;
-    if (IsMarkingStackChunkFull()) {
-      MarkingStackChunk* new_chunk;
-      if (empty_chunks_ == NULL) {
-        new_chunk = new MarkingStackChunk();
-      } else {
-        new_chunk = empty_chunks_;
-        empty_chunks_ = new_chunk->next();
-      }
-      new_chunk->set_next(head_);
-      head_ = new_chunk;
-      marking_stack_ = head_->MarkingStackChunkMemory();
-      top_ = 0;
+  bool HasFullChunks() {
+    MonitorLocker ml(&monitor_);
+    return full_chunks_ != NULL;
+  }
+
+  MarkingStackChunk* AllocateChunk() {
+    MonitorLocker ml(&monitor_);
+    if (empty_chunks_ == NULL) {
+      return new MarkingStackChunk();
     }
+    MarkingStackChunk* chunk = empty_chunks_;
+    empty_chunks_ = chunk->next();
+    chunk->set_next(NULL);
+    return chunk;
   }
 
-  RawObject* Pop() {
-    ASSERT(head_ != NULL);
-    ASSERT(!IsEmpty());
-    if (IsMarkingStackChunkEmpty()) {
-      MarkingStackChunk* empty_chunk = head_;
-      head_ = head_->next();
-      empty_chunk->set_next(empty_chunks_);
-      empty_chunks_ = empty_chunk;
-      marking_stack_ = head_->MarkingStackChunkMemory();
-      top_ = MarkingStackChunk::kMarkingStackChunkSize;
+  void FreeChunk(MarkingStackChunk* chunk) {
+    ASSERT(chunk->IsEmpty());
+    MonitorLocker ml(&monitor_);
+    chunk->set_next(empty_chunks_);
+    empty_chunks_ = chunk;
+  }
+
+  void PushFullChunk(MarkingStackChunk* chunk) {
+    MonitorLocker ml(&monitor_);
+    chunk->set_next(full_chunks_);
+    full_chunks_ = chunk;
+    ml.Notify();
+  }
+
+  // Called by a task that ran out of work. Blocks until a full chunk can be
+  // stolen, returns NULL once all tasks ran out of work.
+  MarkingStackChunk* StealFullChunk() {
+    MonitorLocker ml(&monitor_);
+    num_idle_tasks_++;
+    while (full_chunks_ == NULL) {
+      if (num_idle_tasks_ == num_tasks_) {
+        ml.NotifyAll();
+        return NULL;
+      }
+      ml.Wait();
     }
-    top_--;
-    return marking_stack_[top_];
+    num_idle_tasks_--;
+    MarkingStackChunk* chunk = full_chunks_;
+    full_chunks_ = chunk->next();
+    chunk->set_next(NULL);
+    return chunk;
   }
 
  private:
-  class MarkingStackChunk {
-   public:
-    MarkingStackChunk() : next_(NULL) {}
-    ~MarkingStackChunk() {}
+  Monitor monitor_;
+  MarkingStackChunk* full_chunks_;
+  MarkingStackChunk* empty_chunks_;
+  intptr_t num_tasks_;
+  intptr_t num_idle_tasks_;
 
-    RawObject** MarkingStackChunkMemory() {
-      return &memory_[0];
-    }
+  DISALLOW_COPY_AND_ASSIGN(MarkingStackPool);
+};
 
-    MarkingStackChunk* next() const { return next_; }
-    void set_next(MarkingStackChunk* value) { next_ = value; }
 
-    static const uint32_t kMarkingStackChunkSize = 1024;
+// The marking stack of a single marking task. Only the current chunk is
+// private to the task, all full chunks are available for stealing.
+class MarkingStack {
+ public:
+  explicit MarkingStack(MarkingStackPool* pool)
+      : pool_(pool), chunk_(pool->AllocateChunk()) {
+  }
 
-   private:
-    RawObject* memory_[kMarkingStackChunkSize];
-    MarkingStackChunk* next_;
+  ~MarkingStack() {
+    pool_->FreeChunk(chunk_);
+  }
 
-    DISALLOW_COPY_AND_ASSIGN(MarkingStackChunk);
-  };
+  MarkingStackPool* pool() const { return pool_; }
 
-  bool IsMarkingStackChunkFull() const {
-    return top_ == MarkingStackChunk::kMarkingStackChunkSize;
+  // Only valid while no other task is draining the pool.
+  bool IsEmpty() const {
+    return chunk_->IsEmpty() && !pool_->HasFullChunks();
   }
 
-  bool IsMarkingStackChunkEmpty() const {
-    return top_ == 0;
+  void Push(RawObject* value) {
+    chunk_->Push(value);
+    if (chunk_->IsFull()) {
+      pool_->PushFullChunk(chunk_);
+      chunk_ = pool_->AllocateChunk();
+    }
   }
 
-  MarkingStackChunk* head_;
-  MarkingStackChunk* empty_chunks_;
-  RawObject** marking_stack_;
-  uint32_t top_;
+  // Returns NULL once there is no marking work left in any of the tasks.
+  RawObject* Pop() {
+    if (chunk_->IsEmpty()) {
+      MarkingStackChunk* full_chunk = pool_->StealFullChunk();
+      if (full_chunk == NULL) {
+        return NULL;
+      }
+      pool_->FreeChunk(chunk_);
+      chunk_ = full_chunk;
+    }
+    return chunk_->Pop();
+  }
+
+ private:
+  MarkingStackPool* pool_;
+  MarkingStackChunk* chunk_;
 
   DISALLOW_COPY_AND_ASSIGN(MarkingStack);
 };
@@ -126,6 +210,28 @@ class MarkingVisitor : public ObjectPointerVisitor {
 
   MarkingStack* marking_stack() const { return marking_stack_; }
 
+  void DrainMarkingStack() {
+    RawObject* raw_obj = marking_stack_->Pop();
+    while (raw_obj != NULL) {
+      raw_obj->VisitPointers(this);
+      raw_obj = marking_stack_->Pop();
+    }
+  }
+
+  // Drains the marking stack until at least work bytes of objects were
+  // visited. Returns the number of bytes visited.
+  intptr_t DrainMarkingStack(intptr_t work) {
+    intptr_t visited = 0;
+    while (visited < work) {
+      RawObject* raw_obj = marking_stack_->Pop();
+      if (raw_obj == NULL) {
+        break;
+      }
+      visited += raw_obj->VisitPointers(this);
+    }
+    return visited;
+  }
+
   void VisitPointers(RawObject** first, RawObject** last) {
     for (RawObject** current = first; current <= last; current++) {
       MarkObject(*current);
@@ -137,10 +243,12 @@ class MarkingVisitor : public ObjectPointerVisitor {
     ASSERT(raw_obj->IsHeapObject());
     ASSERT(page_space_->Contains(RawObject::ToAddr(raw_obj)));
 
-    // Mark the object and push it on the marking stack.
-    ASSERT(!raw_obj->IsMarked());
+    // Mark the object and push it on the marking stack. A different marking
+    // task may have marked the object in the meantime.
+    if (!raw_obj->TryAcquireMarkBit()) {
+      return;
+    }
     RawClass* raw_class = raw_obj->ptr()->class_;
-    raw_obj->SetMarkBit();
     marking_stack_->Push(raw_obj);
 
     // Update the number of used bytes on this page for fast accounting.
@@ -188,6 +296,44 @@ class MarkingVisitor : public ObjectPointerVisitor {
 };
 
 
+// A helper task draining the shared marking stack pool in parallel with the
+// thread requesting the collection.
+class MarkingTask : public ThreadPool::Task {
+ public:
+  MarkingTask(Heap* heap,
+              PageSpace* page_space,
+              MarkingStackPool* pool,
+              Monitor* monitor,
+              intptr_t* num_running_tasks)
+      : heap_(heap),
+        page_space_(page_space),
+        pool_(pool),
+        monitor_(monitor),
+        num_running_tasks_(num_running_tasks) {
+  }
+
+  virtual void Run() {
+    {
+      MarkingStack marking_stack(pool_);
+      MarkingVisitor visitor(heap_, page_space_, &marking_stack);
+      visitor.DrainMarkingStack();
+    }
+    MonitorLocker ml(monitor_);
+    (*num_running_tasks_)--;
+    ml.Notify();
+  }
+
+ private:
+  Heap* heap_;
+  PageSpace* page_space_;
+  MarkingStackPool* pool_;
+  Monitor* monitor_;
+  intptr_t* num_running_tasks_;
+
+  DISALLOW_COPY_AND_ASSIGN(MarkingTask);
+};
+
+
 bool IsUnreachable(const RawObject* raw_obj) {
   if (!raw_obj->IsHeapObject()) {
     return false;
@@ -254,6 +400,7 @@ void GCMarker::IterateWeakRoots(Isolate* isolate,
 
 
 void GCMarker::IterateWeakReferences(Isolate* isolate,
+                                     PageSpace* page_space,
                                      MarkingVisitor* visitor) {
   ApiState* state = isolate->api_state();
   ASSERT(state != NULL);
@@ -288,7 +435,7 @@ void GCMarker::IterateWeakReferences(Isolate* isolate,
       }
     }
     if (!visitor->marking_stack()->IsEmpty()) {
-      DrainMarkingStack(isolate, visitor);
+      DrainMarkingStack(isolate, page_space, visitor);
     } else {
       // Break out of the loop if there has been no forward process.
       break;
@@ -306,26 +453,136 @@ void GCMarker::IterateWeakReferences(Isolate* isolate,
 
 
 void GCMarker::DrainMarkingStack(Isolate* isolate,
+                                 PageSpace* page_space,
                                  MarkingVisitor* visitor) {
-  while (!visitor->marking_stack()->IsEmpty()) {
-    RawObject* raw_obj = visitor->marking_stack()->Pop();
-    raw_obj->VisitPointers(visitor);
+  MarkingStackPool* pool = visitor->marking_stack()->pool();
+  const intptr_t num_helper_tasks =
+      (FLAG_marker_tasks > 1) ? (FLAG_marker_tasks - 1) : 0;
+  pool->StartDrain(num_helper_tasks + 1);
+  Monitor monitor;
+  intptr_t num_running_tasks = num_helper_tasks;
+  for (intptr_t i = 0; i < num_helper_tasks; i++) {
+    Dart::thread_pool()->Run(
+        new MarkingTask(heap_, page_space, pool, &monitor, &num_running_tasks));
+  }
+  visitor->DrainMarkingStack();
+  MonitorLocker ml(&monitor);
+  while (num_running_tasks > 0) {
+    ml.Wait();
+  }
+}
+
+
+void GCMarker::ProcessStoreBuffer(Isolate* isolate, PageSpace* page_space) {
+  // Drop the unreachable objects from the remembered set before they are
+  // swept. All remembered objects live in the data page space.
+  StoreBuffer* buffer = isolate->store_buffer();
+  StoreBufferBlock* blocks = buffer->TakeBlocks();
+  for (StoreBufferBlock* block = blocks;
+       block != NULL;
+       block = block->next()) {
+    intptr_t count = block->Count();
+    for (intptr_t i = 0; i < count; i++) {
+      RawObject* raw_obj = block->At(i);
+      ASSERT(raw_obj->IsRemembered());
+      ASSERT(page_space->Contains(RawObject::ToAddr(raw_obj)));
+      if (raw_obj->IsMarked()) {
+        buffer->AddObject(raw_obj);
+      }
+    }
+  }
+  buffer->ReleaseBlocks(blocks);
+}
+
+
+void GCMarker::FinishMarking(Isolate* isolate,
+                             PageSpace* page_space,
+                             IncrementalMarker* incremental_marker,
+                             bool invoke_api_callbacks) {
+  GCTracer* tracer = heap_->tracer();
+  MarkingVisitor* mark = incremental_marker->visitor_;
+  Prologue(isolate, invoke_api_callbacks);
+  {
+    // The roots are not covered by the write barrier and are visited again.
+    GCPhaseScope phase(tracer, kGcRootsPhase);
+    IterateRoots(isolate, mark, !invoke_api_callbacks);
+  }
+  {
+    GCPhaseScope phase(tracer, kGcMarkPhase);
+    DrainMarkingStack(isolate, page_space, mark);
+    IterateWeakReferences(isolate, page_space, mark);
   }
+  {
+    GCPhaseScope phase(tracer, kGcWeakHandlesPhase);
+    MarkingWeakVisitor mark_weak;
+    IterateWeakRoots(isolate, &mark_weak, invoke_api_callbacks);
+  }
+  ProcessStoreBuffer(isolate, page_space);
+  Epilogue(isolate, invoke_api_callbacks);
 }
 
 
 void GCMarker::MarkObjects(Isolate* isolate,
                            PageSpace* page_space,
                            bool invoke_api_callbacks) {
-  MarkingStack marking_stack;
+  MarkingStackPool pool;
+  MarkingStack marking_stack(&pool);
   Prologue(isolate, invoke_api_callbacks);
   MarkingVisitor mark(heap_, page_space, &marking_stack);
-  IterateRoots(isolate, &mark, !invoke_api_callbacks);
-  DrainMarkingStack(isolate, &mark);
-  IterateWeakReferences(isolate, &mark);
-  MarkingWeakVisitor mark_weak;
-  IterateWeakRoots(isolate, &mark_weak, invoke_api_callbacks);
+  GCTracer* tracer = heap_->tracer();
+  {
+    GCPhaseScope phase(tracer, kGcRootsPhase);
+    IterateRoots(isolate, &mark, !invoke_api_callbacks);
+  }
+  {
+    GCPhaseScope phase(tracer, kGcMarkPhase);
+    DrainMarkingStack(isolate, page_space, &mark);
+    IterateWeakReferences(isolate, page_space, &mark);
+  }
+  {
+    GCPhaseScope phase(tracer, kGcWeakHandlesPhase);
+    MarkingWeakVisitor mark_weak;
+    IterateWeakRoots(isolate, &mark_weak, invoke_api_callbacks);
+  }
+  ProcessStoreBuffer(isolate, page_space);
   Epilogue(isolate, invoke_api_callbacks);
 }
 
+IncrementalMarker::IncrementalMarker(Heap* heap, PageSpace* page_space)
+    : pool_(new MarkingStackPool()),
+      marking_stack_(new MarkingStack(pool_)),
+      visitor_(new MarkingVisitor(heap, page_space, marking_stack_)) {
+}
+
+
+IncrementalMarker::~IncrementalMarker() {
+  // Drop the remaining gray objects if marking was abandoned.
+  pool_->StartDrain(1);
+  while (marking_stack_->Pop() != NULL) {
+  }
+  delete visitor_;
+  delete marking_stack_;
+  delete pool_;
+}
+
+
+void IncrementalMarker::Start(Isolate* isolate) {
+  // Weak persistent handles are only processed when marking finishes.
+  GCMarker marker(isolate->heap());
+  marker.IterateRoots(isolate, visitor_, false);
+}
+
+
+bool IncrementalMarker::Step(intptr_t work) {
+  // Steps are taken by the mutator thread alone.
+  pool_->StartDrain(1);
+  visitor_->DrainMarkingStack(work);
+  return marking_stack_->IsEmpty();
+}
+
+
+void IncrementalMarker::Shade(RawObject* raw_obj) {
+  visitor_->VisitPointer(&raw_obj);
+}
+
 }  // namespace dart
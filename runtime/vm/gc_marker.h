@@ -12,10 +12,14 @@ namespace dart {
 // Forward declarations.
 class HandleVisitor;
 class Heap;
+class IncrementalMarker;
 class Isolate;
+class MarkingStack;
+class MarkingStackPool;
 class MarkingVisitor;
 class ObjectPointerVisitor;
 class PageSpace;
+class RawObject;
 
 // The class GCMarker is used to mark reachable old generation objects as part
 // of the mark-sweep collection. The marking bit used is defined in RawObject.
@@ -28,6 +32,13 @@ class GCMarker : public ValueObject {
                    PageSpace* page_space,
                    bool invoke_api_callbacks);
 
+  // Completes the marking started by the incremental marker in a final pause,
+  // which revisits the roots before processing the weak references.
+  void FinishMarking(Isolate* isolate,
+                     PageSpace* page_space,
+                     IncrementalMarker* incremental_marker,
+                     bool invoke_api_callbacks);
+
  private:
   void Prologue(Isolate* isolate, bool invoke_api_callbacks);
   void Epilogue(Isolate* isolate, bool invoke_api_callbacks);
@@ -37,14 +48,50 @@ class GCMarker : public ValueObject {
   void IterateWeakRoots(Isolate* isolate,
                         HandleVisitor* visitor,
                         bool visit_prologue_weak_persistent_handles);
-  void IterateWeakReferences(Isolate* isolate, MarkingVisitor* visitor);
-  void DrainMarkingStack(Isolate* isolate, MarkingVisitor* visitor);
+  void IterateWeakReferences(Isolate* isolate,
+                             PageSpace* page_space,
+                             MarkingVisitor* visitor);
+  // Drains the marking stack using --marker_tasks parallel tasks.
+  void DrainMarkingStack(Isolate* isolate,
+                         PageSpace* page_space,
+                         MarkingVisitor* visitor);
+  void ProcessStoreBuffer(Isolate* isolate, PageSpace* page_space);
 
   Heap* heap_;
 
+  friend class IncrementalMarker;
   DISALLOW_IMPLICIT_CONSTRUCTORS(GCMarker);
 };
 
+
+// The class IncrementalMarker keeps the marking state of old space between
+// the marking steps interleaved with the mutator. Marking follows a snapshot
+// of the heap at its start: the write barrier shades the old values of the
+// overwritten fields and objects allocated in old space are allocated black.
+class IncrementalMarker {
+ public:
+  IncrementalMarker(Heap* heap, PageSpace* page_space);
+  ~IncrementalMarker();
+
+  // Shades the objects directly reachable from the roots.
+  void Start(Isolate* isolate);
+
+  // Scans gray objects until at least work bytes were scanned or no gray
+  // objects are left. Returns true if there are no gray objects left.
+  bool Step(intptr_t work);
+
+  // Shades the value of an overwritten field.
+  void Shade(RawObject* raw_obj);
+
+ private:
+  MarkingStackPool* pool_;
+  MarkingStack* marking_stack_;
+  MarkingVisitor* visitor_;
+
+  friend class GCMarker;
+  DISALLOW_COPY_AND_ASSIGN(IncrementalMarker);
+};
+
 }  // namespace dart
 
 #endif  // VM_GC_MARKER_H_
@@ -0,0 +1,156 @@
+// Copyright (c) 2012, the Dart project authors.  Please see the AUTHORS file
+// for details. All rights reserved. Use of this source code is governed by a
+// BSD-style license that can be found in the LICENSE file.
+
+#include "vm/gc_tracer.h"
+
+#include <stdarg.h>
+
+#include "platform/assert.h"
+#include "platform/utils.h"
+#include "vm/os.h"
+
+namespace dart {
+
+static const char* kKindNames[] = {
+  "scavenge",
+  "mark-sweep",
+  "mark-compact",
+};
+
+
+static const char* kReasonNames[] = {
+  "new space full",
+  "old space full",
+  "incremental marking done",
+  "explicit",
+};
+
+
+static const char* kPhaseNames[kGcNumPhases] = {
+  "roots",
+  "process_to_space",
+  "mark",
+  "weak_handles",
+  "sweep",
+  "compact",
+};
+
+
+void GCTracer::StartEvent(Dart_GcReason reason) {
+  ASSERT(!in_event_);
+  in_event_ = true;
+  memset(&current_, 0, sizeof(current_));
+  current_.reason = reason;
+  current_.start_time = OS::GetCurrentTimeMicros();
+}
+
+
+void GCTracer::EndEvent(Dart_GcKind kind,
+                        intptr_t used_before,
+                        intptr_t used_after,
+                        intptr_t capacity,
+                        intptr_t promoted) {
+  ASSERT(in_event_);
+  in_event_ = false;
+  current_.kind = kind;
+  current_.duration = OS::GetCurrentTimeMicros() - current_.start_time;
+  current_.used_before = used_before;
+  current_.used_after = used_after;
+  current_.capacity = capacity;
+  current_.promoted = promoted;
+  // The objects promoted by a scavenge are not freed but moved to old space.
+  current_.freed = used_before - used_after - promoted;
+  current_.fragmentation =
+      (capacity == 0) ? 0 : (((capacity - used_after) * 100) / capacity);
+  events_[num_events_ % kNumEvents] = current_;
+  num_events_++;
+  if (callback_ != NULL) {
+    (*callback_)(&current_);
+  }
+}
+
+
+const Dart_GcEvent& GCTracer::EventAt(intptr_t i) const {
+  ASSERT((i >= 0) && (i < num_events_) && (i < kNumEvents));
+  return events_[(num_events_ - 1 - i) % kNumEvents];
+}
+
+
+// Prints into the rest of the buffer, if any, and advances the position by
+// the full length of the output.
+static void Append(char* buffer,
+                   intptr_t size,
+                   intptr_t* position,
+                   const char* format, ...) {
+  char* rest = NULL;
+  intptr_t rest_size = 0;
+  if (*position < size) {
+    rest = buffer + *position;
+    rest_size = size - *position;
+  }
+  va_list args;
+  va_start(args, format);
+  *position += OS::VSNPrint(rest, rest_size, format, args);
+  va_end(args);
+}
+
+
+intptr_t GCTracer::PrintJSONTo(char* buffer, intptr_t size) const {
+  intptr_t position = 0;
+  Append(buffer, size, &position, "{\"events\":[");
+  intptr_t num_buffered = Utils::Minimum(num_events_, kNumEvents);
+  for (intptr_t i = num_buffered - 1; i >= 0; i--) {
+    const Dart_GcEvent& event = EventAt(i);
+    Append(buffer, size, &position,
+           "{\"kind\":\"%s\",\"reason\":\"%s\","
+           "\"start_time\":%lld,\"duration\":%lld,\"phases\":{",
+           kKindNames[event.kind],
+           kReasonNames[event.reason],
+           event.start_time,
+           event.duration);
+    bool first_phase = true;
+    for (intptr_t phase = 0; phase < kGcNumPhases; phase++) {
+      if (event.phase_durations[phase] == 0) {
+        continue;
+      }
+      Append(buffer, size, &position, "%s\"%s\":%lld",
+             first_phase ? "" : ",",
+             kPhaseNames[phase],
+             event.phase_durations[phase]);
+      first_phase = false;
+    }
+    Append(buffer, size, &position,
+           "},\"used_before\":%lld,\"used_after\":%lld,\"capacity\":%lld,"
+           "\"promoted\":%lld,\"freed\":%lld,\"fragmentation\":%lld}%s",
+           static_cast<int64_t>(event.used_before),
+           static_cast<int64_t>(event.used_after),
+           static_cast<int64_t>(event.capacity),
+           static_cast<int64_t>(event.promoted),
+           static_cast<int64_t>(event.freed),
+           static_cast<int64_t>(event.fragmentation),
+           (i == 0) ? "" : ",");
+  }
+  Append(buffer, size, &position, "]}");
+  return position;
+}
+
+
+const char* GCTracer::PrintJSON(uword (*allocator)(intptr_t size)) const {
+  intptr_t length = PrintJSONTo(NULL, 0);
+  char* buffer = reinterpret_cast<char*>(allocator(length + 1));
+  PrintJSONTo(buffer, length + 1);
+  return buffer;
+}
+
+
+GCPhaseScope::GCPhaseScope(GCTracer* tracer, Dart_GcPhase phase)
+    : tracer_(tracer), phase_(phase), start_(OS::GetCurrentTimeMicros()) {
+}
+
+
+GCPhaseScope::~GCPhaseScope() {
+  tracer_->AddPhaseTime(phase_, OS::GetCurrentTimeMicros() - start_);
+}
+
+}  // namespace dart
@@ -0,0 +1,87 @@
+// Copyright (c) 2012, the Dart project authors.  Please see the AUTHORS file
+// for details. All rights reserved. Use of this source code is governed by a
+// BSD-style license that can be found in the LICENSE file.
+
+#ifndef VM_GC_TRACER_H_
+#define VM_GC_TRACER_H_
+
+#include "include/dart_api.h"
+#include "vm/allocation.h"
+#include "vm/globals.h"
+
+namespace dart {
+
+// The class GCTracer records the garbage collections of a heap. The records
+// of the most recent collections are kept in a ring buffer, which can be
+// printed as JSON, and each record is passed to the event callback of the
+// embedder once its collection has finished.
+class GCTracer {
+ public:
+  static const intptr_t kNumEvents = 64;
+
+  GCTracer() : num_events_(0), callback_(NULL), in_event_(false) { }
+  ~GCTracer() { }
+
+  // Brackets a garbage collection. The phases timed in between are recorded
+  // as part of the event.
+  void StartEvent(Dart_GcReason reason);
+  void EndEvent(Dart_GcKind kind,
+                intptr_t used_before,
+                intptr_t used_after,
+                intptr_t capacity,
+                intptr_t promoted);
+
+  void AddPhaseTime(Dart_GcPhase phase, int64_t micros) {
+    ASSERT((phase >= 0) && (phase < kGcNumPhases));
+    if (in_event_) {
+      current_.phase_durations[phase] += micros;
+    }
+  }
+
+  // The number of collections recorded so far, including the ones which
+  // were dropped from the ring buffer.
+  intptr_t NumEvents() const { return num_events_; }
+  // Returns the recorded event i, counting back from the most recent one.
+  const Dart_GcEvent& EventAt(intptr_t i) const;
+
+  Dart_GcEventCallback callback() const { return callback_; }
+  void set_callback(Dart_GcEventCallback callback) { callback_ = callback; }
+
+  // Prints the buffered events, oldest first, into a string allocated with
+  // the given allocator.
+  const char* PrintJSON(uword (*allocator)(intptr_t size)) const;
+
+ private:
+  // Prints at most size characters of the JSON document into buffer and
+  // returns its full length.
+  intptr_t PrintJSONTo(char* buffer, intptr_t size) const;
+
+  Dart_GcEvent events_[kNumEvents];
+  intptr_t num_events_;
+  Dart_GcEventCallback callback_;
+
+  // The event of the collection in progress.
+  bool in_event_;
+  Dart_GcEvent current_;
+
+  DISALLOW_COPY_AND_ASSIGN(GCTracer);
+};
+
+
+// Adds the time spent in its scope to a phase of the current collection.
+class GCPhaseScope : public ValueObject {
+ public:
+  GCPhaseScope(GCTracer* tracer, Dart_GcPhase phase);
+  ~GCPhaseScope();
+
+ private:
+  GCTracer* tracer_;
+  Dart_GcPhase phase_;
+  int64_t start_;
+
+  DISALLOW_IMPLICIT_CONSTRUCTORS(GCPhaseScope);
+};
+
+}  // namespace dart
+
+#endif  // VM_GC_TRACER_H_
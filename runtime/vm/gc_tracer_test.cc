@@ -0,0 +1,93 @@
+// Copyright (c) 2012, the Dart project authors.  Please see the AUTHORS file
+// for details. All rights reserved. Use of this source code is governed by a
+// BSD-style license that can be found in the LICENSE file.
+
+#include "platform/assert.h"
+#include "vm/gc_tracer.h"
+#include "vm/heap.h"
+#include "vm/object.h"
+#include "vm/unit_test.h"
+
+namespace dart {
+
+static uword MallocAllocator(intptr_t size) {
+  return reinterpret_cast<uword>(malloc(size));
+}
+
+
+static intptr_t CountOccurrences(const char* str, const char* pattern) {
+  intptr_t count = 0;
+  const char* p = strstr(str, pattern);
+  while (p != NULL) {
+    count++;
+    p = strstr(p + 1, pattern);
+  }
+  return count;
+}
+
+
+UNIT_TEST_CASE(GCTracer_RingBuffer) {
+  GCTracer tracer;
+  const intptr_t kNumEvents = GCTracer::kNumEvents;
+  const char* json = tracer.PrintJSON(MallocAllocator);
+  EXPECT_STREQ("{\"events\":[]}", json);
+  free(const_cast<char*>(json));
+
+  const intptr_t kCount = kNumEvents + 3;
+  for (intptr_t i = 0; i < kCount; i++) {
+    tracer.StartEvent(kGcExplicit);
+    tracer.AddPhaseTime(kGcRootsPhase, 1);
+    tracer.AddPhaseTime(kGcProcessToSpacePhase, 2);
+    tracer.EndEvent(kGcScavenge, 3 * i, i, 4 * i, i);
+  }
+  EXPECT_EQ(kCount, tracer.NumEvents());
+  // The most recent events are kept.
+  const Dart_GcEvent& last = tracer.EventAt(0);
+  EXPECT_EQ(3 * (kCount - 1), last.used_before);
+  EXPECT_EQ(kCount - 1, last.used_after);
+  EXPECT_EQ(kCount - 1, last.promoted);
+  EXPECT_EQ(kCount - 1, last.freed);
+  EXPECT_EQ(75, last.fragmentation);
+  EXPECT_EQ(1, last.phase_durations[kGcRootsPhase]);
+  EXPECT_EQ(2, last.phase_durations[kGcProcessToSpacePhase]);
+  EXPECT_EQ(0, last.phase_durations[kGcMarkPhase]);
+  const Dart_GcEvent& oldest = tracer.EventAt(kNumEvents - 1);
+  EXPECT_EQ(3 * (kCount - kNumEvents), oldest.used_before);
+
+  json = tracer.PrintJSON(MallocAllocator);
+  EXPECT_EQ(kNumEvents, CountOccurrences(json, "\"kind\""));
+  EXPECT_EQ(kNumEvents,
+            CountOccurrences(json, "\"phases\":{\"roots\":1,"
+                                   "\"process_to_space\":2}"));
+  free(const_cast<char*>(json));
+}
+
+
+TEST_CASE(GCTracer_Phases) {
+  Heap* heap = Isolate::Current()->heap();
+  GCTracer* tracer = heap->tracer();
+  intptr_t num_events = tracer->NumEvents();
+  heap->CollectGarbage(Heap::kNew);
+  EXPECT_EQ(num_events + 1, tracer->NumEvents());
+  const Dart_GcEvent& scavenge = tracer->EventAt(0);
+  EXPECT_EQ(kGcScavenge, scavenge.kind);
+  EXPECT_EQ(kGcExplicit, scavenge.reason);
+  EXPECT_EQ(0, scavenge.phase_durations[kGcMarkPhase]);
+  EXPECT_EQ(heap->Used(Heap::kNew), scavenge.used_after);
+  EXPECT_EQ(scavenge.used_before - scavenge.used_after - scavenge.promoted,
+            scavenge.freed);
+
+  const Array& array = Array::Handle(Array::New(1 * KB, Heap::kOld));
+  EXPECT(!array.IsNull());
+  heap->CollectGarbage(Heap::kOld);
+  EXPECT_EQ(num_events + 2, tracer->NumEvents());
+  const Dart_GcEvent& mark_sweep = tracer->EventAt(0);
+  EXPECT(mark_sweep.kind != kGcScavenge);
+  EXPECT_EQ(0, mark_sweep.phase_durations[kGcProcessToSpacePhase]);
+  EXPECT_EQ(0, mark_sweep.promoted);
+  EXPECT_EQ(heap->Used(Heap::kOld), mark_sweep.used_after);
+  EXPECT_EQ(heap->Capacity(Heap::kOld), mark_sweep.capacity);
+  EXPECT(mark_sweep.duration >= mark_sweep.phase_durations[kGcMarkPhase]);
+}
+
+}  // namespace dart
@@ -23,10 +23,14 @@ void Handles<kHandleSizeInWords,
     block = block->next_block();
   }
 
-  // Visit all scoped handles.
+  // Visit all scoped handles. The blocks following the current scoped block
+  // are only kept for reuse and contain stale handles.
   block = &first_scoped_block_;
   do {
     block->VisitObjectPointers(visitor);
+    if (block == scoped_blocks_) {
+      break;
+    }
     block = block->next_block();
   } while (block != NULL);
 }
@@ -43,10 +47,14 @@ void Handles<kHandleSizeInWords,
     block = block->next_block();
   }
 
-  // Visit all scoped handles.
+  // Visit all scoped handles. The blocks following the current scoped block
+  // are only kept for reuse and contain stale handles.
   block = &first_scoped_block_;
   do {
     block->Visit(visitor);
+    if (block == scoped_blocks_) {
+      break;
+    }
     block = block->next_block();
   } while (block != NULL);
 }
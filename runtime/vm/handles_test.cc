@@ -8,6 +8,7 @@
 #include "vm/heap.h"
 #include "vm/object.h"
 #include "vm/unit_test.h"
+#include "vm/visitor.h"
 #include "vm/zone.h"
 
 namespace dart {
@@ -80,4 +81,45 @@ TEST_CASE(AllocateScopeHandle) {
   EXPECT_EQ(handle_count, VMHandles::ScopedHandleCount());
 }
 
+
+class CountingPointerVisitor : public ObjectPointerVisitor {
+ public:
+  CountingPointerVisitor() : count_(0) { }
+
+  void VisitPointers(RawObject** first, RawObject** last) {
+    count_ += (last - first) + 1;
+  }
+
+  int count() const { return count_; }
+
+ private:
+  int count_;
+
+  DISALLOW_COPY_AND_ASSIGN(CountingPointerVisitor);
+};
+
+
+// Unit test for visiting handles, the handles of closed scopes must not be
+// visited even though their blocks are kept around for reuse.
+TEST_CASE(VisitScopedHandles) {
+  Isolate* isolate = Isolate::Current();
+  VMHandles* handles = isolate->current_zone()->handles();
+  CountingPointerVisitor initial;
+  handles->VisitObjectPointers(&initial);
+  static const int kNumHandles = 2 * kVMHandlesPerChunk + 1;
+  {
+    HANDLESCOPE(isolate);
+    for (int i = 0; i < kNumHandles; i++) {
+      const Smi& handle = Smi::Handle(Smi::New(i));
+      EXPECT_EQ(i, handle.Value());
+    }
+    CountingPointerVisitor inside;
+    handles->VisitObjectPointers(&inside);
+    EXPECT_EQ(initial.count() + kNumHandles, inside.count());
+  }
+  CountingPointerVisitor after;
+  handles->VisitObjectPointers(&after);
+  EXPECT_EQ(initial.count(), after.count());
+}
+
 }  // namespace dart
@@ -54,7 +54,10 @@ uword Heap::AllocateNew(intptr_t size) {
   if (addr != 0) {
     return addr;
   }
-  CollectGarbage(kNew);
+  CollectGarbage(kNew, kIgnoreApiCallbacks, kGcNewSpaceFull);
+  if (old_space_->NeedsIncrementalMarkingStep()) {
+    old_space_->TakeIncrementalMarkingStep();
+  }
   if (FLAG_verbose_gc) {
     OS::PrintErr("New space (%dk) Old space (%dk) Code space (%dk)\n",
                  (new_space_->in_use() / KB),
@@ -71,9 +74,12 @@ uword Heap::AllocateNew(intptr_t size) {
 
 uword Heap::AllocateOld(intptr_t size) {
   ASSERT(Isolate::Current()->no_gc_scope_depth() == 0);
+  if (old_space_->NeedsIncrementalMarkingStep()) {
+    old_space_->TakeIncrementalMarkingStep();
+  }
   uword addr = old_space_->TryAllocate(size);
   if (addr == 0) {
-    CollectAllGarbage();
+    CollectAllGarbage(kGcOldSpaceFull);
     if (FLAG_verbose_gc) {
       OS::PrintErr("New space (%dk) Old space (%dk) Code space (%dk)\n",
                    (new_space_->in_use() / KB),
@@ -129,18 +135,70 @@ void Heap::IterateCodePointers(ObjectPointerVisitor* visitor) {
 }
 
 
+void Heap::IterateNewObjects(ObjectVisitor* visitor) {
+  new_space_->VisitObjects(visitor);
+}
+
+
+void Heap::IterateOldObjects(ObjectVisitor* visitor) {
+  old_space_->VisitObjects(visitor);
+}
+
+
+void Heap::IterateCodeObjects(ObjectVisitor* visitor) {
+  code_space_->VisitObjects(visitor);
+}
+
+
+intptr_t Heap::Used(Space space) const {
+  switch (space) {
+    case kNew:
+      return new_space_->in_use();
+    case kOld:
+      return old_space_->in_use();
+    case kExecutable:
+      return code_space_->in_use();
+    default:
+      UNREACHABLE();
+  }
+  return 0;
+}
+
+
+intptr_t Heap::Capacity(Space space) const {
+  switch (space) {
+    case kNew:
+      return new_space_->capacity();
+    case kOld:
+      return old_space_->capacity();
+    case kExecutable:
+      return code_space_->capacity();
+    default:
+      UNREACHABLE();
+  }
+  return 0;
+}
+
+
 void Heap::CollectGarbage(Space space, ApiCallbacks api_callbacks) {
+  CollectGarbage(space, api_callbacks, kGcExplicit);
+}
+
+
+void Heap::CollectGarbage(Space space,
+                          ApiCallbacks api_callbacks,
+                          Dart_GcReason reason) {
   bool invoke_api_callbacks = (api_callbacks == kInvokeApiCallbacks);
   switch (space) {
     case kNew:
-      new_space_->Scavenge(invoke_api_callbacks);
+      new_space_->Scavenge(invoke_api_callbacks, reason);
       break;
     case kOld:
-      old_space_->MarkSweep(invoke_api_callbacks);
+      old_space_->MarkSweep(invoke_api_callbacks, reason);
       break;
     case kExecutable:
       UNIMPLEMENTED();
-      code_space_->MarkSweep(invoke_api_callbacks);
+      code_space_->MarkSweep(invoke_api_callbacks, reason);
       break;
     default:
       UNREACHABLE();
@@ -160,8 +218,13 @@ void Heap::CollectGarbage(Space space) {
 
 
 void Heap::CollectAllGarbage() {
-  new_space_->Scavenge(kInvokeApiCallbacks);
-  old_space_->MarkSweep(kInvokeApiCallbacks);
+  CollectAllGarbage(kGcExplicit);
+}
+
+
+void Heap::CollectAllGarbage(Dart_GcReason reason) {
+  new_space_->Scavenge(kInvokeApiCallbacks, reason);
+  old_space_->MarkSweep(kInvokeApiCallbacks, reason);
   // TODO(iposva): Merge old and code space.
   // code_space_->MarkSweep(kInvokeApiCallbacks);
 }
@@ -189,6 +252,8 @@ bool Heap::Verify() const {
   new_space_->VisitObjectPointers(&visitor);
   old_space_->VisitObjectPointers(&visitor);
   code_space_->VisitObjectPointers(&visitor);
+  VerifyRememberedSetVisitor remembered_set_visitor;
+  old_space_->VisitObjects(&remembered_set_visitor);
   // Only returning a value so that Heap::Validate can be called from an ASSERT.
   return true;
 }
@@ -5,9 +5,11 @@
 #ifndef VM_HEAP_H_
 #define VM_HEAP_H_
 
+#include "include/dart_api.h"
 #include "platform/assert.h"
 #include "vm/allocation.h"
 #include "vm/flags.h"
+#include "vm/gc_tracer.h"
 #include "vm/globals.h"
 #include "vm/pages.h"
 #include "vm/scavenger.h"
@@ -75,6 +77,22 @@ class Heap {
     return 0;
   }
 
+  // Incremental marking of old space.
+  void StartIncrementalMarking() { old_space_->StartIncrementalMarking(); }
+  bool IncrementalMarkingStep(intptr_t work) {
+    return old_space_->IncrementalMarkingStep(work);
+  }
+  bool IsIncrementalMarking() const { return old_space_->IsMarking(); }
+  // Objects allocated in old space while it is marked incrementally are live.
+  void AllocateBlack(RawObject* raw_obj, intptr_t size) {
+    if (old_space_->IsMarking()) {
+      old_space_->AllocateBlack(raw_obj, size);
+    }
+  }
+  void ShadeOverwrittenValue(RawObject* raw_obj) {
+    old_space_->ShadeOverwrittenValue(raw_obj);
+  }
+
   // Heap contains the specified address.
   bool Contains(uword addr) const;
   bool CodeContains(uword addr) const;
@@ -84,10 +102,21 @@ class Heap {
   void IterateOldPointers(ObjectPointerVisitor* visitor);
   void IterateCodePointers(ObjectPointerVisitor* visitor);
 
+  void IterateNewObjects(ObjectVisitor* visitor);
+  void IterateOldObjects(ObjectVisitor* visitor);
+  void IterateCodeObjects(ObjectVisitor* visitor);
+
+  // Number of bytes used by objects and reserved for the space.
+  intptr_t Used(Space space) const;
+  intptr_t Capacity(Space space) const;
+
   void CollectGarbage(Space space);
   void CollectGarbage(Space space, ApiCallbacks api_callbacks);
   void CollectAllGarbage();
 
+  // The records of the recent garbage collections.
+  GCTracer* tracer() { return &tracer_; }
+
   // Accessors for inlined allocation in generated code.
   uword TopAddress();
   uword EndAddress();
@@ -106,11 +135,18 @@ class Heap {
   uword AllocateOld(intptr_t size);
   uword AllocateCode(intptr_t size);
 
+  void CollectGarbage(Space space,
+                      ApiCallbacks api_callbacks,
+                      Dart_GcReason reason);
+  void CollectAllGarbage(Dart_GcReason reason);
+
   // The different spaces used for allocation.
   Scavenger* new_space_;
   PageSpace* old_space_;
   PageSpace* code_space_;
 
+  GCTracer tracer_;
+
   DISALLOW_COPY_AND_ASSIGN(Heap);
 };
 
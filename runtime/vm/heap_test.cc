@@ -3,12 +3,21 @@
 // BSD-style license that can be found in the LICENSE file.
 
 #include "platform/assert.h"
+#include "vm/flags.h"
 #include "vm/globals.h"
 #include "vm/heap.h"
+#include "vm/object.h"
 #include "vm/unit_test.h"
 
 namespace dart {
 
+DECLARE_FLAG(int, compaction_threshold);
+DECLARE_FLAG(bool, lazy_sweep);
+DECLARE_FLAG(int, marker_tasks);
+DECLARE_FLAG(int, new_gen_grow_survival);
+DECLARE_FLAG(int, new_gen_shrink_survival);
+DECLARE_FLAG(int, tenuring_age);
+
 // Only ia32 and x64 can run execution tests.
 #if defined(TARGET_ARCH_IA32) || defined(TARGET_ARCH_X64)
 TEST_CASE(OldGC) {
@@ -59,5 +68,292 @@ TEST_CASE(LargeSweep) {
   heap->CollectGarbage(Heap::kOld);
 }
 
+
+TEST_CASE(CardMarkingStoreIndexed) {
+  const char* kScriptChars =
+  "class Value {\n"
+  "  Value(this.x);\n"
+  "  final int x;\n"
+  "}\n"
+  "class CardTester {\n"
+  "  static List list;\n"
+  "  static void allocate() {\n"
+  "    list = new List(4 * 1024 * 1024);\n"
+  "  }\n"
+  "  static void store(int i) {\n"
+  "    list[i] = new Value(i);\n"
+  "  }\n"
+  "  static bool check(int i) {\n"
+  "    return list[i].x == i;\n"
+  "  }\n"
+  "}\n";
+  Dart_Handle lib = TestCase::LoadTestScript(kScriptChars, NULL);
+  Dart_Handle result = Dart_InvokeStatic(lib,
+                                         Dart_NewString("CardTester"),
+                                         Dart_NewString("allocate"),
+                                         0, NULL);
+  EXPECT_VALID(result);
+  Heap* heap = Isolate::Current()->heap();
+  heap->CollectGarbage(Heap::kNew);
+
+  // Store a new object into the last element of the large array from
+  // generated code and make sure it survives scavenges.
+  Dart_Handle args[1];
+  args[0] = Dart_NewInteger(4 * 1024 * 1024 - 1);
+  result = Dart_InvokeStatic(lib,
+                             Dart_NewString("CardTester"),
+                             Dart_NewString("store"),
+                             1, args);
+  EXPECT_VALID(result);
+  for (intptr_t i = 0; i < 3; i++) {
+    heap->CollectGarbage(Heap::kNew);
+    result = Dart_InvokeStatic(lib,
+                               Dart_NewString("CardTester"),
+                               Dart_NewString("check"),
+                               1, args);
+    EXPECT_VALID(result);
+    bool value = false;
+    EXPECT_VALID(Dart_BooleanValue(result, &value));
+    EXPECT(value);
+  }
+}
+
 #endif  // defined(TARGET_ARCH_IA32) || defined(TARGET_ARCH_X64).
+
+
+TEST_CASE(LazySweep) {
+  const intptr_t kNumArrays = 256;
+  const intptr_t kArrayLength = 2 * KB;  // Spread over several pages.
+  Isolate* isolate = Isolate::Current();
+  Heap* heap = isolate->heap();
+  const bool saved_lazy_sweep = FLAG_lazy_sweep;
+  FLAG_lazy_sweep = true;
+  const intptr_t saved_compaction_threshold = FLAG_compaction_threshold;
+  FLAG_compaction_threshold = 100;
+  const Array& live = Array::Handle(Array::New(kNumArrays, Heap::kOld));
+  {
+    HandleScope scope(isolate);
+    Array& array = Array::Handle();
+    for (intptr_t i = 0; i < kNumArrays; i++) {
+      array = Array::New(kArrayLength, Heap::kOld);
+      array.SetAt(0, Smi::Handle(Smi::New(i)));
+      if ((i % 2) == 0) {
+        live.SetAt(i, array);
+      }
+    }
+  }
+  const intptr_t used = heap->Used(Heap::kOld);
+  heap->CollectGarbage(Heap::kOld);
+  EXPECT(heap->Used(Heap::kOld) < used);
+  // The unswept pages only expose their live objects.
+  EXPECT(heap->Verify());
+
+  // The garbage arrays are reclaimed by sweeping on demand. Half of their
+  // space suffices for the new arrays, as the sweeper drops the free space at
+  // the end of a page.
+  const intptr_t capacity = heap->Capacity(Heap::kOld);
+  {
+    HandleScope scope(isolate);
+    Array& array = Array::Handle();
+    for (intptr_t i = 1; i < kNumArrays; i += 4) {
+      array = Array::New(kArrayLength, Heap::kOld);
+      array.SetAt(0, Smi::Handle(Smi::New(i)));
+      live.SetAt(i, array);
+    }
+  }
+  EXPECT_EQ(capacity, heap->Capacity(Heap::kOld));
+  EXPECT(heap->Verify());
+  Array& array = Array::Handle();
+  for (intptr_t i = 0; i < kNumArrays; i++) {
+    array ^= live.At(i);
+    if (((i % 2) == 0) || ((i % 4) == 1)) {
+      EXPECT_EQ(Smi::New(i), array.At(0));
+    } else {
+      EXPECT(array.IsNull());
+    }
+  }
+  FLAG_lazy_sweep = saved_lazy_sweep;
+  FLAG_compaction_threshold = saved_compaction_threshold;
+}
+
+
+TEST_CASE(ParallelMarking) {
+  const intptr_t kNumArrays = 64 * KB;
+  Heap* heap = Isolate::Current()->heap();
+  const Array& live = Array::Handle(Array::New(kNumArrays, Heap::kOld));
+  {
+    HandleScope scope(Isolate::Current());
+    Array& array = Array::Handle();
+    String& str = String::Handle();
+    for (intptr_t i = 0; i < kNumArrays; i++) {
+      // Every other array is garbage, the live ones share the string with
+      // their predecessor so that marking tasks race for the same objects.
+      array = Array::New(2, Heap::kOld);
+      array.SetAt(0, str);
+      str = String::New("marked", Heap::kOld);
+      array.SetAt(1, str);
+      if ((i % 2) == 0) {
+        live.SetAt(i, array);
+      }
+    }
+  }
+  const intptr_t saved_marker_tasks = FLAG_marker_tasks;
+  FLAG_marker_tasks = 4;
+  heap->CollectGarbage(Heap::kOld);
+  FLAG_marker_tasks = saved_marker_tasks;
+  EXPECT(heap->Verify());
+  Array& array = Array::Handle();
+  String& str = String::Handle();
+  for (intptr_t i = 0; i < kNumArrays; i += 2) {
+    array ^= live.At(i);
+    str ^= array.At(1);
+    EXPECT(str.Equals("marked"));
+  }
+}
+
+
+TEST_CASE(Compaction) {
+  const intptr_t kNumArrays = 8 * KB;
+  const intptr_t kArrayLength = 64;
+  Isolate* isolate = Isolate::Current();
+  Heap* heap = isolate->heap();
+  const Array& live = Array::Handle(Array::New(kNumArrays, Heap::kOld));
+  // The surviving arrays are also referred to from new space.
+  const Array& new_live = Array::Handle(Array::New(kNumArrays / 8));
+  {
+    HandleScope scope(isolate);
+    Array& array = Array::Handle();
+    String& str = String::Handle();
+    for (intptr_t i = 0; i < kNumArrays; i++) {
+      array = Array::New(kArrayLength, Heap::kOld);
+      array.SetAt(0, Smi::Handle(Smi::New(i)));
+      if ((i % 8) == 0) {
+        str = String::New("old", Heap::kOld);
+        array.SetAt(1, str);
+        // Remembered by the store buffer.
+        str = String::New("new");
+        array.SetAt(2, str);
+        live.SetAt(i, array);
+        new_live.SetAt(i / 8, array);
+      }
+    }
+  }
+  const intptr_t capacity = heap->Capacity(Heap::kOld);
+  const intptr_t saved_compaction_threshold = FLAG_compaction_threshold;
+  FLAG_compaction_threshold = 0;
+  heap->CollectGarbage(Heap::kOld);
+  FLAG_compaction_threshold = saved_compaction_threshold;
+  // The empty pages were released.
+  EXPECT(heap->Capacity(Heap::kOld) < capacity);
+  EXPECT(heap->Verify());
+
+  heap->CollectGarbage(Heap::kNew);
+  Array& array = Array::Handle();
+  String& str = String::Handle();
+  for (intptr_t i = 0; i < kNumArrays; i += 8) {
+    array ^= live.At(i);
+    EXPECT_EQ(Smi::New(i), array.At(0));
+    EXPECT_EQ(array.raw(), new_live.At(i / 8));
+    str ^= array.At(1);
+    EXPECT(str.Equals("old"));
+    str ^= array.At(2);
+    EXPECT(str.Equals("new"));
+  }
+}
+
+
+TEST_CASE(TenuringAge) {
+  Heap* heap = Isolate::Current()->heap();
+  const intptr_t saved_tenuring_age = FLAG_tenuring_age;
+  for (intptr_t age = 0; age <= RawObject::kMaxAge; age++) {
+    FLAG_tenuring_age = age;
+    const String& str = String::Handle(String::New("aging"));
+    for (intptr_t i = 0; i < age; i++) {
+      heap->CollectGarbage(Heap::kNew);
+      EXPECT(str.raw()->IsNewObject());
+      EXPECT_EQ(i + 1, str.raw()->Age());
+    }
+    heap->CollectGarbage(Heap::kNew);
+    EXPECT(str.raw()->IsOldObject());
+    EXPECT_EQ(0, str.raw()->Age());
+    EXPECT(str.Equals("aging"));
+  }
+  FLAG_tenuring_age = saved_tenuring_age;
+}
+
+
+TEST_CASE(AdaptiveNewSpace) {
+  Isolate* isolate = Isolate::Current();
+  Heap* heap = isolate->heap();
+  const intptr_t saved_grow_survival = FLAG_new_gen_grow_survival;
+  const intptr_t saved_shrink_survival = FLAG_new_gen_shrink_survival;
+  const intptr_t saved_tenuring_age = FLAG_tenuring_age;
+  FLAG_tenuring_age = RawObject::kMaxAge;
+
+  // New space shrinks while nothing survives.
+  intptr_t capacity = heap->Capacity(Heap::kNew);
+  FLAG_new_gen_shrink_survival = 100;
+  heap->CollectGarbage(Heap::kNew);
+  EXPECT(heap->Capacity(Heap::kNew) < capacity);
+
+  // New space grows while everything survives.
+  capacity = heap->Capacity(Heap::kNew);
+  FLAG_new_gen_shrink_survival = 0;
+  FLAG_new_gen_grow_survival = 0;
+  const Array& survivors = Array::Handle(Array::New(1 * KB));
+  String& str = String::Handle();
+  for (intptr_t i = 0; i < survivors.Length(); i++) {
+    str = String::New("survivor");
+    survivors.SetAt(i, str);
+  }
+  heap->CollectGarbage(Heap::kNew);
+  EXPECT(heap->Capacity(Heap::kNew) > capacity);
+  EXPECT(survivors.raw()->IsNewObject());
+  str ^= survivors.At(survivors.Length() - 1);
+  EXPECT(str.Equals("survivor"));
+
+  FLAG_new_gen_grow_survival = saved_grow_survival;
+  FLAG_new_gen_shrink_survival = saved_shrink_survival;
+  FLAG_tenuring_age = saved_tenuring_age;
+}
+
+
+
+TEST_CASE(IncrementalMarking) {
+  Heap* heap = Isolate::Current()->heap();
+  const Array& holder = Array::Handle(Array::New(1, Heap::kOld));
+  const Array& black = Array::Handle(Array::New(2, Heap::kOld));
+  holder.SetAt(0, String::Handle(String::New("moved", Heap::kOld)));
+  // Finish the marking started by the allocations so far, if any.
+  if (heap->IsIncrementalMarking()) {
+    heap->CollectGarbage(Heap::kOld);
+  }
+  heap->StartIncrementalMarking();
+  EXPECT(heap->IsIncrementalMarking());
+  // Scan all gray objects, the arrays are marked from the handles.
+  EXPECT(heap->IncrementalMarkingStep(kIntptrMax));
+  EXPECT(black.raw()->IsMarked());
+
+  // The string is moved into the scanned array and is only reachable from
+  // the marking snapshot through the overwritten slot of the holder.
+  String& str = String::Handle();
+  str ^= holder.At(0);
+  black.SetAt(0, str);
+  holder.SetAt(0, Object::Handle());
+  // Objects allocated during marking are allocated black.
+  const String& allocated = String::Handle(String::New("new", Heap::kOld));
+  EXPECT(allocated.raw()->IsMarked());
+  black.SetAt(1, allocated);
+
+  heap->CollectGarbage(Heap::kOld);
+  EXPECT(!heap->IsIncrementalMarking());
+  EXPECT(heap->Verify());
+  str ^= black.At(0);
+  EXPECT(!str.raw()->IsFreeListElement());
+  EXPECT(str.Equals("moved"));
+  str ^= black.At(1);
+  EXPECT(!str.raw()->IsFreeListElement());
+  EXPECT(str.Equals("new"));
+}
+
 }
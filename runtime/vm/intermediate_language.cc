@@ -81,6 +81,18 @@ Instruction* BranchInstr::Accept(FlowGraphVisitor* visitor) {
 }
 
 
+Instruction* PhiInstr::Accept(FlowGraphVisitor* visitor) {
+  visitor->VisitPhi(this);
+  return NULL;
+}
+
+
+Instruction* ParameterInstr::Accept(FlowGraphVisitor* visitor) {
+  visitor->VisitParameter(this);
+  return NULL;
+}
+
+
 // Default implementation of visiting basic blocks.  Can be overridden.
 void FlowGraphVisitor::VisitBlocks() {
   for (intptr_t i = 0; i < block_order_.length(); ++i) {
@@ -92,6 +104,120 @@ void FlowGraphVisitor::VisitBlocks() {
 }
 
 
+bool InstanceCallComp::HasReceiverClass(const Class& cls) const {
+  if (ic_data_ == NULL) return false;
+  GrowableArray<const Class*> classes;
+  Function& target = Function::Handle();
+  for (intptr_t i = 0; i < ic_data_->NumberOfChecks(); ++i) {
+    ic_data_->GetCheckAt(i, &classes, &target);
+    if (classes[0]->raw() == cls.raw()) return true;
+  }
+  return false;
+}
+
+
+Token::Kind InstanceCallComp::OperatorKind(const Token::Kind* kinds,
+                                           intptr_t count) const {
+  for (intptr_t i = 0; i < count; ++i) {
+    if (function_name().Equals(Token::Str(kinds[i]))) return kinds[i];
+  }
+  return Token::kILLEGAL;
+}
+
+
+bool UnboxedDoubleBinaryOpComp::HasSlowPath() const {
+  if (right_->IsConstant()) {
+    const Object& value = right_->AsConstant()->value();
+    return !value.IsSmi() && !value.IsDouble();
+  }
+  return right_->AsUse()->definition()->representation() != kUnboxedDouble;
+}
+
+
+intptr_t BlockEntryInstr::SuccessorCount() const {
+  // A block without instructions falls through to the successor of its
+  // entry.
+  Instruction* last =
+      (last_instruction() == NULL) ? const_cast<BlockEntryInstr*>(this)
+                                   : last_instruction();
+  if (last->IsBranch()) return 2;
+  return (last->StraightLineSuccessor() == NULL) ? 0 : 1;
+}
+
+
+BlockEntryInstr* BlockEntryInstr::SuccessorAt(intptr_t index) const {
+  Instruction* last =
+      (last_instruction() == NULL) ? const_cast<BlockEntryInstr*>(this)
+                                   : last_instruction();
+  BranchInstr* branch = last->AsBranch();
+  if (branch != NULL) {
+    ASSERT((index == 0) || (index == 1));
+    return (index == 0) ? branch->true_successor() : branch->false_successor();
+  }
+  ASSERT(index == 0);
+  BlockEntryInstr* successor = last->StraightLineSuccessor()->AsBlockEntry();
+  ASSERT(successor != NULL);
+  return successor;
+}
+
+
+void BlockEntryInstr::ClearDiscovery() {
+  preorder_number_ = -1;
+  postorder_number_ = -1;
+  dominator_ = NULL;
+  dominated_blocks_.Clear();
+  last_instruction_ = NULL;
+}
+
+
+void JoinEntryInstr::ClearDiscovery() {
+  BlockEntryInstr::ClearDiscovery();
+  predecessors_.Clear();
+}
+
+
+void TargetEntryInstr::ClearDiscovery() {
+  BlockEntryInstr::ClearDiscovery();
+  predecessor_ = NULL;
+}
+
+
+intptr_t JoinEntryInstr::IndexOfPredecessor(BlockEntryInstr* pred) const {
+  for (intptr_t i = 0; i < predecessors_.length(); ++i) {
+    if (predecessors_[i] == pred) return i;
+  }
+  UNREACHABLE();
+  return -1;
+}
+
+
+void JoinEntryInstr::InsertPhi(PhiInstr* phi) {
+  if (phis_ == NULL) {
+    phis_ = new ZoneGrowableArray<PhiInstr*>(2);
+  }
+  phis_->Add(phi);
+}
+
+
+void JoinEntryInstr::RemoveDeadPhis() {
+  if (phis_ == NULL) return;
+  intptr_t live_count = 0;
+  for (intptr_t i = 0; i < phis_->length(); ++i) {
+    PhiInstr* phi = (*phis_)[i];
+    if (phi->is_alive()) {
+      (*phis_)[live_count++] = phi;
+    }
+  }
+  if (live_count == 0) {
+    phis_ = NULL;
+    return;
+  }
+  while (phis_->length() > live_count) {
+    phis_->RemoveLast();
+  }
+}
+
+
 // ==== Postorder graph traversal.
 void JoinEntryInstr::DiscoverBlocks(
     BlockEntryInstr* current_block,
@@ -109,12 +235,11 @@ void JoinEntryInstr::DiscoverBlocks(
   // 2. If the block has already been reached by the traversal, we are done.
   if (preorder_number() >= 0) return;
 
-  // 3. The last entry in the preorder array is the spanning-tree parent.
-  intptr_t parent_number = preorder->length() - 1;
-  parent->Add(parent_number);
+  // 3. The block the traversal came from is the spanning-tree parent.
+  parent->Add(current_block->preorder_number());
 
   // 4. Assign preorder number and add the block entry to the list.
-  set_preorder_number(parent_number + 1);
+  set_preorder_number(preorder->length());
   preorder->Add(this);
   // The preorder and parent arrays are both indexed by preorder block
   // number, so they should stay in lockstep.
@@ -150,13 +275,12 @@ void TargetEntryInstr::DiscoverBlocks(
   // 2. There is a single predecessor, so we should only reach this block once.
   ASSERT(preorder_number() == -1);
 
-  // 3. The last entry in the preorder array is the spanning-tree parent.
+  // 3. The block the traversal came from is the spanning-tree parent.
   // The global graph entry has no parent, indicated by -1.
-  intptr_t parent_number = preorder->length() - 1;
-  parent->Add(parent_number);
+  parent->Add((current_block == NULL) ? -1 : current_block->preorder_number());
 
   // 4. Assign preorder number and add the block entry to the list.
-  set_preorder_number(parent_number + 1);
+  set_preorder_number(preorder->length());
   preorder->Add(this);
   // The preorder and parent arrays are indexed by preorder block number, so
   // they should stay in lockstep.
@@ -9,10 +9,12 @@
 #include "vm/ast.h"
 #include "vm/growable_array.h"
 #include "vm/handles_impl.h"
+#include "vm/locations.h"
 #include "vm/object.h"
 
 namespace dart {
 
+class Definition;
 class FlowGraphVisitor;
 class LocalVariable;
 
@@ -21,6 +23,7 @@ class LocalVariable;
 #define FOR_EACH_VALUE(M)                                                      \
   M(Temp, TempVal)                                                             \
   M(Constant, ConstantVal)                                                     \
+  M(Use, UseVal)                                                               \
 
 
 // M is a two argument macro.  It is applied to each concrete instruction's
@@ -55,12 +58,24 @@ class LocalVariable;
   M(ExtractConstructorInstantiator, ExtractConstructorInstantiatorComp)        \
   M(AllocateContext, AllocateContextComp)                                      \
   M(ChainContext, ChainContextComp)                                            \
+  M(TestClass, TestClassComp)                                                  \
+  M(UnboxedDoubleBinaryOp, UnboxedDoubleBinaryOpComp)                          \
+  M(BoxDouble, BoxDoubleComp)                                                  \
+  M(LoadIndexed, LoadIndexedComp)                                              \
 
 
 #define FORWARD_DECLARATION(ShortName, ClassName) class ClassName;
 FOR_EACH_COMPUTATION(FORWARD_DECLARATION)
 #undef FORWARD_DECLARATION
 
+class Value;
+
+// The representation of the value of a definition in optimized code.
+enum Representation {
+  kTagged,         // A Smi or a pointer to an object.
+  kUnboxedDouble   // The value of a Double, which the GC does not see.
+};
+
 class Computation : public ZoneAllocated {
  public:
   Computation() { }
@@ -68,6 +83,21 @@ class Computation : public ZoneAllocated {
   // Visiting support.
   virtual void Accept(FlowGraphVisitor* visitor) = 0;
 
+  virtual Representation representation() const { return kTagged; }
+
+  // The operands of the computation.  The SSA construction renames them in
+  // place.
+  virtual intptr_t InputCount() const = 0;
+  virtual Value* InputAt(intptr_t index) const = 0;
+  virtual void SetInputAt(intptr_t index, Value* value) = 0;
+
+#define DEFINE_TESTERS(ShortName, ClassName)                                   \
+  virtual ClassName* As##ShortName() { return NULL; }                          \
+  bool Is##ShortName() { return As##ShortName() != NULL; }
+
+  FOR_EACH_COMPUTATION(DEFINE_TESTERS)
+#undef DEFINE_TESTERS
+
  private:
   DISALLOW_COPY_AND_ASSIGN(Computation);
 };
@@ -77,12 +107,12 @@ class Value : public Computation {
  public:
   Value() { }
 
-#define DEFINE_TESTERS(ShortName, ClassName)                                   \
-  virtual ClassName* As##ShortName() { return NULL; }                          \
-  bool Is##ShortName() { return As##ShortName() != NULL; }
-
-  FOR_EACH_VALUE(DEFINE_TESTERS)
-#undef DEFINE_TESTERS
+  virtual intptr_t InputCount() const { return 0; }
+  virtual Value* InputAt(intptr_t index) const {
+    UNREACHABLE();
+    return NULL;
+  }
+  virtual void SetInputAt(intptr_t index, Value* value) { UNREACHABLE(); }
 
  private:
   DISALLOW_COPY_AND_ASSIGN(Value);
@@ -91,11 +121,12 @@ class Value : public Computation {
 
 // Functions defined in all concrete computation classes.
 #define DECLARE_COMPUTATION(ShortName)                                         \
-  virtual void Accept(FlowGraphVisitor* visitor);
+  virtual void Accept(FlowGraphVisitor* visitor);                              \
+  virtual ShortName##Comp* As##ShortName() { return this; }
 
 // Functions defined in all concrete value classes.
 #define DECLARE_VALUE(ShortName)                                               \
-  DECLARE_COMPUTATION(ShortName)                                               \
+  virtual void Accept(FlowGraphVisitor* visitor);                              \
   virtual ShortName##Val* As##ShortName() { return this; }
 
 
@@ -130,6 +161,26 @@ class ConstantVal: public Value {
   DISALLOW_COPY_AND_ASSIGN(ConstantVal);
 };
 
+
+// A use of the value of a definition in SSA form.  Uses replace the
+// temporaries and the stack-allocated local variables of the graph built
+// for the non-optimizing compiler.
+class UseVal : public Value {
+ public:
+  explicit UseVal(Definition* definition) : definition_(definition) {
+    ASSERT(definition != NULL);
+  }
+
+  DECLARE_VALUE(Use)
+
+  Definition* definition() const { return definition_; }
+
+ private:
+  Definition* const definition_;
+
+  DISALLOW_COPY_AND_ASSIGN(UseVal);
+};
+
 #undef DECLARE_VALUE
 
 
@@ -140,6 +191,16 @@ class AssertAssignableComp : public Computation {
 
   DECLARE_COMPUTATION(AssertAssignable)
 
+  virtual intptr_t InputCount() const { return 1; }
+  virtual Value* InputAt(intptr_t index) const {
+    ASSERT(index == 0);
+    return value_;
+  }
+  virtual void SetInputAt(intptr_t index, Value* value) {
+    ASSERT(index == 0);
+    value_ = value;
+  }
+
   Value* value() const { return value_; }
   const AbstractType& type() const { return type_; }
 
@@ -159,6 +220,13 @@ class CurrentContextComp : public Computation {
 
   DECLARE_COMPUTATION(CurrentContext)
 
+  virtual intptr_t InputCount() const { return 0; }
+  virtual Value* InputAt(intptr_t index) const {
+    UNREACHABLE();
+    return NULL;
+  }
+  virtual void SetInputAt(intptr_t index, Value* value) { UNREACHABLE(); }
+
  private:
   DISALLOW_COPY_AND_ASSIGN(CurrentContextComp);
 };
@@ -172,6 +240,16 @@ class StoreContextComp : public Computation {
 
   DECLARE_COMPUTATION(StoreContext);
 
+  virtual intptr_t InputCount() const { return 1; }
+  virtual Value* InputAt(intptr_t index) const {
+    ASSERT(index == 0);
+    return value_;
+  }
+  virtual void SetInputAt(intptr_t index, Value* value) {
+    ASSERT(index == 0);
+    value_ = value;
+  }
+
   Value* value() const { return value_; }
 
  private:
@@ -194,6 +272,19 @@ class ClosureCallComp : public Computation {
 
   DECLARE_COMPUTATION(ClosureCall)
 
+  // The saved context is the first operand, followed by the arguments.
+  virtual intptr_t InputCount() const { return 1 + arguments_->length(); }
+  virtual Value* InputAt(intptr_t index) const {
+    return (index == 0) ? context_ : (*arguments_)[index - 1];
+  }
+  virtual void SetInputAt(intptr_t index, Value* value) {
+    if (index == 0) {
+      context_ = value;
+    } else {
+      (*arguments_)[index - 1] = value;
+    }
+  }
+
   const Array& argument_names() const { return ast_node_.arguments()->names(); }
   intptr_t token_index() const { return ast_node_.token_index(); }
 
@@ -223,7 +314,8 @@ class InstanceCallComp : public Computation {
         function_name_(function_name),
         arguments_(arguments),
         argument_names_(argument_names),
-        checked_argument_count_(checked_argument_count) {
+        checked_argument_count_(checked_argument_count),
+        ic_data_(NULL) {
     ASSERT(function_name.IsZoneHandle());
     ASSERT(!arguments->is_empty());
     ASSERT(argument_names.IsZoneHandle());
@@ -231,6 +323,12 @@ class InstanceCallComp : public Computation {
 
   DECLARE_COMPUTATION(InstanceCall)
 
+  virtual intptr_t InputCount() const { return arguments_->length(); }
+  virtual Value* InputAt(intptr_t index) const { return (*arguments_)[index]; }
+  virtual void SetInputAt(intptr_t index, Value* value) {
+    (*arguments_)[index] = value;
+  }
+
   intptr_t node_id() const { return node_id_; }
   intptr_t token_index() const { return token_index_; }
   const String& function_name() const { return function_name_; }
@@ -239,6 +337,17 @@ class InstanceCallComp : public Computation {
   const Array& argument_names() const { return argument_names_; }
   intptr_t checked_argument_count() const { return checked_argument_count_; }
 
+  // The inline cache data recorded for the call by the unoptimized code, or
+  // NULL if the call never ran.
+  const ICData* ic_data() const { return ic_data_; }
+  void set_ic_data(const ICData* value) { ic_data_ = value; }
+
+  // Whether the inline cache recorded receivers of the given class.
+  bool HasReceiverClass(const Class& cls) const;
+
+  // The operator among 'kinds' which the call invokes, or Token::kILLEGAL.
+  Token::Kind OperatorKind(const Token::Kind* kinds, intptr_t count) const;
+
  private:
   const intptr_t node_id_;
   const intptr_t token_index_;
@@ -246,6 +355,7 @@ class InstanceCallComp : public Computation {
   ZoneGrowableArray<Value*>* const arguments_;
   const Array& argument_names_;
   const intptr_t checked_argument_count_;
+  const ICData* ic_data_;
 
   DISALLOW_COPY_AND_ASSIGN(InstanceCallComp);
 };
@@ -260,6 +370,20 @@ class StrictCompareComp : public Computation {
 
   DECLARE_COMPUTATION(StrictCompare)
 
+  virtual intptr_t InputCount() const { return 2; }
+  virtual Value* InputAt(intptr_t index) const {
+    ASSERT((index == 0) || (index == 1));
+    return (index == 0) ? left_ : right_;
+  }
+  virtual void SetInputAt(intptr_t index, Value* value) {
+    ASSERT((index == 0) || (index == 1));
+    if (index == 0) {
+      left_ = value;
+    } else {
+      right_ = value;
+    }
+  }
+
   Token::Kind kind() const { return kind_; }
   Value* left() const { return left_; }
   Value* right() const { return right_; }
@@ -289,6 +413,12 @@ class StaticCallComp : public Computation {
 
   DECLARE_COMPUTATION(StaticCall)
 
+  virtual intptr_t InputCount() const { return arguments_->length(); }
+  virtual Value* InputAt(intptr_t index) const { return (*arguments_)[index]; }
+  virtual void SetInputAt(intptr_t index, Value* value) {
+    (*arguments_)[index] = value;
+  }
+
   // Accessors forwarded to the AST node.
   const Function& function() const { return function_; }
   const Array& argument_names() const { return argument_names_; }
@@ -314,6 +444,13 @@ class LoadLocalComp : public Computation {
 
   DECLARE_COMPUTATION(LoadLocal)
 
+  virtual intptr_t InputCount() const { return 0; }
+  virtual Value* InputAt(intptr_t index) const {
+    UNREACHABLE();
+    return NULL;
+  }
+  virtual void SetInputAt(intptr_t index, Value* value) { UNREACHABLE(); }
+
   const LocalVariable& local() const { return local_; }
   intptr_t context_level() const { return context_level_; }
 
@@ -334,6 +471,16 @@ class StoreLocalComp : public Computation {
 
   DECLARE_COMPUTATION(StoreLocal)
 
+  virtual intptr_t InputCount() const { return 1; }
+  virtual Value* InputAt(intptr_t index) const {
+    ASSERT(index == 0);
+    return value_;
+  }
+  virtual void SetInputAt(intptr_t index, Value* value) {
+    ASSERT(index == 0);
+    value_ = value;
+  }
+
   const LocalVariable& local() const { return local_; }
   Value* value() const { return value_; }
   intptr_t context_level() const { return context_level_; }
@@ -353,6 +500,13 @@ class NativeCallComp : public Computation {
 
   DECLARE_COMPUTATION(NativeCall)
 
+  virtual intptr_t InputCount() const { return 0; }
+  virtual Value* InputAt(intptr_t index) const {
+    UNREACHABLE();
+    return NULL;
+  }
+  virtual void SetInputAt(intptr_t index, Value* value) { UNREACHABLE(); }
+
   intptr_t token_index() const { return ast_node_.token_index(); }
 
   const String& native_name() const {
@@ -385,6 +539,16 @@ class LoadInstanceFieldComp : public Computation {
 
   DECLARE_COMPUTATION(LoadInstanceField)
 
+  virtual intptr_t InputCount() const { return 1; }
+  virtual Value* InputAt(intptr_t index) const {
+    ASSERT(index == 0);
+    return instance_;
+  }
+  virtual void SetInputAt(intptr_t index, Value* value) {
+    ASSERT(index == 0);
+    instance_ = value;
+  }
+
   const Field& field() const { return ast_node_.field(); }
 
   Value* instance() const { return instance_; }
@@ -409,6 +573,20 @@ class StoreInstanceFieldComp : public Computation {
 
   DECLARE_COMPUTATION(StoreInstanceField)
 
+  virtual intptr_t InputCount() const { return 2; }
+  virtual Value* InputAt(intptr_t index) const {
+    ASSERT((index == 0) || (index == 1));
+    return (index == 0) ? instance_ : value_;
+  }
+  virtual void SetInputAt(intptr_t index, Value* value) {
+    ASSERT((index == 0) || (index == 1));
+    if (index == 0) {
+      instance_ = value;
+    } else {
+      value_ = value;
+    }
+  }
+
   intptr_t node_id() const { return ast_node_.id(); }
   intptr_t token_index() const { return ast_node_.token_index(); }
   const Field& field() const { return ast_node_.field(); }
@@ -431,6 +609,13 @@ class LoadStaticFieldComp : public Computation {
 
   DECLARE_COMPUTATION(LoadStaticField);
 
+  virtual intptr_t InputCount() const { return 0; }
+  virtual Value* InputAt(intptr_t index) const {
+    UNREACHABLE();
+    return NULL;
+  }
+  virtual void SetInputAt(intptr_t index, Value* value) { UNREACHABLE(); }
+
   const Field& field() const { return field_; }
 
  private:
@@ -451,12 +636,22 @@ class StoreStaticFieldComp : public Computation {
 
   DECLARE_COMPUTATION(StoreStaticField);
 
+  virtual intptr_t InputCount() const { return 1; }
+  virtual Value* InputAt(intptr_t index) const {
+    ASSERT(index == 0);
+    return value_;
+  }
+  virtual void SetInputAt(intptr_t index, Value* value) {
+    ASSERT(index == 0);
+    value_ = value;
+  }
+
   const Field& field() const { return field_; }
   Value* value() const { return value_; }
 
  private:
   const Field& field_;
-  Value* const value_;
+  Value* value_;
 
   DISALLOW_COPY_AND_ASSIGN(StoreStaticFieldComp);
 };
@@ -479,6 +674,25 @@ class StoreIndexedComp : public Computation {
 
   DECLARE_COMPUTATION(StoreIndexed)
 
+  virtual intptr_t InputCount() const { return 3; }
+  virtual Value* InputAt(intptr_t index) const {
+    switch (index) {
+      case 0: return array_;
+      case 1: return index_;
+      case 2: return value_;
+      default: UNREACHABLE();
+    }
+    return NULL;
+  }
+  virtual void SetInputAt(intptr_t index, Value* value) {
+    switch (index) {
+      case 0: array_ = value; break;
+      case 1: index_ = value; break;
+      case 2: value_ = value; break;
+      default: UNREACHABLE();
+    }
+  }
+
   intptr_t node_id() const { return node_id_; }
   intptr_t token_index() const { return token_index_; }
   Value* array() const { return array_; }
@@ -513,6 +727,20 @@ class InstanceSetterComp : public Computation {
 
   DECLARE_COMPUTATION(InstanceSetter)
 
+  virtual intptr_t InputCount() const { return 2; }
+  virtual Value* InputAt(intptr_t index) const {
+    ASSERT((index == 0) || (index == 1));
+    return (index == 0) ? receiver_ : value_;
+  }
+  virtual void SetInputAt(intptr_t index, Value* value) {
+    ASSERT((index == 0) || (index == 1));
+    if (index == 0) {
+      receiver_ = value;
+    } else {
+      value_ = value;
+    }
+  }
+
   intptr_t node_id() const { return node_id_; }
   intptr_t token_index() const { return token_index_; }
   const String& field_name() const { return field_name_; }
@@ -523,8 +751,8 @@ class InstanceSetterComp : public Computation {
   const intptr_t node_id_;
   const intptr_t token_index_;
   const String& field_name_;
-  Value* const receiver_;
-  Value* const value_;
+  Value* receiver_;
+  Value* value_;
 
   DISALLOW_COPY_AND_ASSIGN(InstanceSetterComp);
 };
@@ -543,6 +771,16 @@ class StaticSetterComp : public Computation {
 
   DECLARE_COMPUTATION(StaticSetter)
 
+  virtual intptr_t InputCount() const { return 1; }
+  virtual Value* InputAt(intptr_t index) const {
+    ASSERT(index == 0);
+    return value_;
+  }
+  virtual void SetInputAt(intptr_t index, Value* value) {
+    ASSERT(index == 0);
+    value_ = value;
+  }
+
   intptr_t token_index() const { return token_index_; }
   const Function& setter_function() const { return setter_function_; }
   Value* value() const { return value_; }
@@ -550,7 +788,7 @@ class StaticSetterComp : public Computation {
  private:
   const intptr_t token_index_;
   const Function& setter_function_;
-  Value* const value_;
+  Value* value_;
 
   DISALLOW_COPY_AND_ASSIGN(StaticSetterComp);
 };
@@ -563,6 +801,16 @@ class BooleanNegateComp : public Computation {
 
   DECLARE_COMPUTATION(BooleanNegate)
 
+  virtual intptr_t InputCount() const { return 1; }
+  virtual Value* InputAt(intptr_t index) const {
+    ASSERT(index == 0);
+    return value_;
+  }
+  virtual void SetInputAt(intptr_t index, Value* value) {
+    ASSERT(index == 0);
+    value_ = value;
+  }
+
   Value* value() const { return value_; }
 
  private:
@@ -587,6 +835,16 @@ class InstanceOfComp : public Computation {
 
   DECLARE_COMPUTATION(InstanceOf)
 
+  virtual intptr_t InputCount() const { return 1; }
+  virtual Value* InputAt(intptr_t index) const {
+    ASSERT(index == 0);
+    return value_;
+  }
+  virtual void SetInputAt(intptr_t index, Value* value) {
+    ASSERT(index == 0);
+    value_ = value;
+  }
+
   Value* value() const { return value_; }
   bool negate_result() const { return negate_result_; }
   const AbstractType& type() const { return type_; }
@@ -615,6 +873,12 @@ class AllocateObjectComp : public Computation {
 
   DECLARE_COMPUTATION(AllocateObject)
 
+  virtual intptr_t InputCount() const { return arguments_->length(); }
+  virtual Value* InputAt(intptr_t index) const { return (*arguments_)[index]; }
+  virtual void SetInputAt(intptr_t index, Value* value) {
+    (*arguments_)[index] = value;
+  }
+
   const Function& constructor() const { return ast_node_.constructor(); }
   intptr_t token_index() const { return ast_node_.token_index(); }
   const ZoneGrowableArray<Value*>& arguments() const { return *arguments_; }
@@ -633,6 +897,12 @@ class CreateArrayComp : public Computation {
 
   DECLARE_COMPUTATION(CreateArray)
 
+  virtual intptr_t InputCount() const { return elements_->length(); }
+  virtual Value* InputAt(intptr_t index) const { return (*elements_)[index]; }
+  virtual void SetInputAt(intptr_t index, Value* value) {
+    (*elements_)[index] = value;
+  }
+
   intptr_t token_index() const { return ast_node_.token_index(); }
   const AbstractTypeArguments& type_arguments() const {
     return ast_node_.type_arguments();
@@ -654,6 +924,13 @@ class CreateClosureComp : public Computation {
 
   DECLARE_COMPUTATION(CreateClosure)
 
+  virtual intptr_t InputCount() const { return 0; }
+  virtual Value* InputAt(intptr_t index) const {
+    UNREACHABLE();
+    return NULL;
+  }
+  virtual void SetInputAt(intptr_t index, Value* value) { UNREACHABLE(); }
+
   intptr_t token_index() const { return ast_node_.token_index(); }
   const Function& function() const { return ast_node_.function(); }
 
@@ -673,6 +950,16 @@ class NativeLoadFieldComp : public Computation {
 
   DECLARE_COMPUTATION(NativeLoadField)
 
+  virtual intptr_t InputCount() const { return 1; }
+  virtual Value* InputAt(intptr_t index) const {
+    ASSERT(index == 0);
+    return value_;
+  }
+  virtual void SetInputAt(intptr_t index, Value* value) {
+    ASSERT(index == 0);
+    value_ = value;
+  }
+
   Value* value() const { return value_; }
   intptr_t offset_in_bytes() const { return offset_in_bytes_; }
 
@@ -694,6 +981,16 @@ class ExtractFactoryTypeArgumentsComp : public Computation {
 
   DECLARE_COMPUTATION(ExtractFactoryTypeArguments)
 
+  virtual intptr_t InputCount() const { return 1; }
+  virtual Value* InputAt(intptr_t index) const {
+    ASSERT(index == 0);
+    return instantiator_;
+  }
+  virtual void SetInputAt(intptr_t index, Value* value) {
+    ASSERT(index == 0);
+    instantiator_ = value;
+  }
+
   Value* instantiator() const { return instantiator_; }
   const AbstractTypeArguments& type_arguments() const {
     return ast_node_.type_arguments();
@@ -720,6 +1017,16 @@ class ExtractConstructorTypeArgumentsComp : public Computation {
 
   DECLARE_COMPUTATION(ExtractConstructorTypeArguments)
 
+  virtual intptr_t InputCount() const { return 1; }
+  virtual Value* InputAt(intptr_t index) const {
+    ASSERT(index == 0);
+    return instantiator_;
+  }
+  virtual void SetInputAt(intptr_t index, Value* value) {
+    ASSERT(index == 0);
+    instantiator_ = value;
+  }
+
   Value* instantiator() const { return instantiator_; }
   const AbstractTypeArguments& type_arguments() const {
     return ast_node_.type_arguments();
@@ -749,6 +1056,20 @@ class ExtractConstructorInstantiatorComp : public Computation {
 
   DECLARE_COMPUTATION(ExtractConstructorInstantiator)
 
+  virtual intptr_t InputCount() const { return 2; }
+  virtual Value* InputAt(intptr_t index) const {
+    ASSERT((index == 0) || (index == 1));
+    return (index == 0) ? instantiator_ : discard_value_;
+  }
+  virtual void SetInputAt(intptr_t index, Value* value) {
+    ASSERT((index == 0) || (index == 1));
+    if (index == 0) {
+      instantiator_ = value;
+    } else {
+      discard_value_ = value;
+    }
+  }
+
   Value* instantiator() const { return instantiator_; }
   Value* discard_value() const { return discard_value_; }
   const AbstractTypeArguments& type_arguments() const {
@@ -775,6 +1096,13 @@ class AllocateContextComp : public Computation {
 
   DECLARE_COMPUTATION(AllocateContext);
 
+  virtual intptr_t InputCount() const { return 0; }
+  virtual Value* InputAt(intptr_t index) const {
+    UNREACHABLE();
+    return NULL;
+  }
+  virtual void SetInputAt(intptr_t index, Value* value) { UNREACHABLE(); }
+
   intptr_t token_index() const { return token_index_; }
   intptr_t num_context_variables() const { return num_context_variables_; }
 
@@ -795,6 +1123,16 @@ class ChainContextComp : public Computation {
 
   DECLARE_COMPUTATION(ChainContext)
 
+  virtual intptr_t InputCount() const { return 1; }
+  virtual Value* InputAt(intptr_t index) const {
+    ASSERT(index == 0);
+    return context_value_;
+  }
+  virtual void SetInputAt(intptr_t index, Value* value) {
+    ASSERT(index == 0);
+    context_value_ = value;
+  }
+
   Value* context_value() const { return context_value_; }
 
  private:
@@ -804,6 +1142,174 @@ class ChainContextComp : public Computation {
 };
 
 
+// Tests whether the class of the value is the given class.  Guards the
+// bodies of instance methods inlined by the optimizing compiler, which
+// falls back to the instance call for other classes.
+class TestClassComp : public Computation {
+ public:
+  TestClassComp(Value* value, const Class& cls) : value_(value), cls_(cls) {
+    ASSERT(value_ != NULL);
+    ASSERT(cls.IsZoneHandle());
+  }
+
+  DECLARE_COMPUTATION(TestClass)
+
+  virtual intptr_t InputCount() const { return 1; }
+  virtual Value* InputAt(intptr_t index) const {
+    ASSERT(index == 0);
+    return value_;
+  }
+  virtual void SetInputAt(intptr_t index, Value* value) {
+    ASSERT(index == 0);
+    value_ = value;
+  }
+
+  Value* value() const { return value_; }
+  const Class& cls() const { return cls_; }
+
+ private:
+  Value* value_;
+  const Class& cls_;
+
+  DISALLOW_COPY_AND_ASSIGN(TestClassComp);
+};
+
+
+// An arithmetic operator of the Double class applied to an unboxed double.
+// The left operand is known to be a double and the result is unboxed.  The
+// right operand may be an unboxed double or any value: doubles and Smis are
+// converted inline, other numbers are passed to the operator by the
+// original instance call.
+class UnboxedDoubleBinaryOpComp : public Computation {
+ public:
+  UnboxedDoubleBinaryOpComp(Token::Kind op_kind,
+                            InstanceCallComp* instance_call,
+                            Value* left,
+                            Value* right)
+      : op_kind_(op_kind),
+        instance_call_(instance_call),
+        left_(left),
+        right_(right) {
+    ASSERT((op_kind == Token::kADD) ||
+           (op_kind == Token::kSUB) ||
+           (op_kind == Token::kMUL) ||
+           (op_kind == Token::kDIV));
+  }
+
+  DECLARE_COMPUTATION(UnboxedDoubleBinaryOp)
+
+  virtual Representation representation() const { return kUnboxedDouble; }
+
+  virtual intptr_t InputCount() const { return 2; }
+  virtual Value* InputAt(intptr_t index) const {
+    ASSERT((index == 0) || (index == 1));
+    return (index == 0) ? left_ : right_;
+  }
+  virtual void SetInputAt(intptr_t index, Value* value) {
+    ASSERT((index == 0) || (index == 1));
+    if (index == 0) {
+      left_ = value;
+    } else {
+      right_ = value;
+    }
+  }
+
+  Token::Kind op_kind() const { return op_kind_; }
+  InstanceCallComp* instance_call() const { return instance_call_; }
+  Value* left() const { return left_; }
+  Value* right() const { return right_; }
+
+  // True if the right operand may be neither a double nor a Smi, in which
+  // case the instance call is made on a slow path.
+  bool HasSlowPath() const;
+
+ private:
+  const Token::Kind op_kind_;
+  InstanceCallComp* const instance_call_;
+  Value* left_;
+  Value* right_;
+
+  DISALLOW_COPY_AND_ASSIGN(UnboxedDoubleBinaryOpComp);
+};
+
+
+// Allocate a Double for an unboxed double flowing into an instruction which
+// expects a tagged value.
+class BoxDoubleComp : public Computation {
+ public:
+  explicit BoxDoubleComp(Value* value) : value_(value) {
+    ASSERT(value_ != NULL);
+  }
+
+  DECLARE_COMPUTATION(BoxDouble)
+
+  virtual intptr_t InputCount() const { return 1; }
+  virtual Value* InputAt(intptr_t index) const {
+    ASSERT(index == 0);
+    return value_;
+  }
+  virtual void SetInputAt(intptr_t index, Value* value) {
+    ASSERT(index == 0);
+    value_ = value;
+  }
+
+  Value* value() const { return value_; }
+
+ private:
+  Value* value_;
+
+  DISALLOW_COPY_AND_ASSIGN(BoxDoubleComp);
+};
+
+
+// Load an element of an ObjectArray or an ImmutableArray.  Replaces the
+// index operator of arrays in optimized code.  Unless the index is known to
+// be in bounds, an index which is not a Smi or is out of bounds is passed to
+// the original instance call, which throws.
+class LoadIndexedComp : public Computation {
+ public:
+  LoadIndexedComp(InstanceCallComp* instance_call, Value* array, Value* index)
+      : instance_call_(instance_call),
+        array_(array),
+        index_(index),
+        needs_bounds_check_(true) {
+    ASSERT(array_ != NULL);
+    ASSERT(index_ != NULL);
+  }
+
+  DECLARE_COMPUTATION(LoadIndexed)
+
+  virtual intptr_t InputCount() const { return 2; }
+  virtual Value* InputAt(intptr_t index) const {
+    ASSERT((index == 0) || (index == 1));
+    return (index == 0) ? array_ : index_;
+  }
+  virtual void SetInputAt(intptr_t index, Value* value) {
+    ASSERT((index == 0) || (index == 1));
+    if (index == 0) {
+      array_ = value;
+    } else {
+      index_ = value;
+    }
+  }
+
+  InstanceCallComp* instance_call() const { return instance_call_; }
+  Value* array() const { return array_; }
+  Value* index() const { return index_; }
+
+  bool needs_bounds_check() const { return needs_bounds_check_; }
+  void set_needs_bounds_check(bool value) { needs_bounds_check_ = value; }
+
+ private:
+  InstanceCallComp* const instance_call_;
+  Value* array_;
+  Value* index_;
+  bool needs_bounds_check_;
+
+  DISALLOW_COPY_AND_ASSIGN(LoadIndexedComp);
+};
+
+
 #undef DECLARE_COMPUTATION
 
 
@@ -817,6 +1323,13 @@ class ChainContextComp : public Computation {
 //                 | Bind <int> <Computation> <Instruction>
 //                 | Return <Value>
 //                 | Branch <Value> <Instruction> <Instruction>
+//
+// The SSA form of the graph additionally has phis, which are attached to
+// join entries, and parameters, which define the incoming values of the
+// stack-allocated variables.  Neither is part of the straight-line code.
+//
+// <Definition> ::= Phi <Value>*
+//                | Parameter <int>
 
 // M is a single argument macro.  It is applied to each concrete instruction
 // type name.  The concrete instruction classes are the name with Instr
@@ -832,6 +1345,8 @@ class ChainContextComp : public Computation {
   M(Throw)                                                                     \
   M(ReThrow)                                                                   \
   M(Branch)                                                                    \
+  M(Phi)                                                                       \
+  M(Parameter)                                                                 \
 
 
 // Forward declarations for Instruction classes.
@@ -848,21 +1363,66 @@ FOR_EACH_INSTRUCTION(FORWARD_DECLARATION)
   virtual type##Instr* As##type() { return this; }                             \
 
 
+// A function inlined into optimized code at a call in its caller, the
+// optimized function or another inlined function.  The instructions of the
+// inlined body refer to it, so that the frames of the inlined functions can
+// be rebuilt from the optimized code.
+class InlinedFunction : public ZoneAllocated {
+ public:
+  InlinedFunction(const Function& function,
+                  InlinedFunction* caller,
+                  intptr_t call_token_index)
+      : function_(function),
+        caller_(caller),
+        call_token_index_(call_token_index) { }
+
+  const Function& function() const { return function_; }
+  // NULL for a call in the optimized function itself.
+  InlinedFunction* caller() const { return caller_; }
+  intptr_t call_token_index() const { return call_token_index_; }
+
+ private:
+  const Function& function_;
+  InlinedFunction* caller_;
+  const intptr_t call_token_index_;
+
+  DISALLOW_COPY_AND_ASSIGN(InlinedFunction);
+};
+
+
 class Instruction : public ZoneAllocated {
  public:
-  Instruction() { }
+  Instruction() : inlined_function_(NULL) { }
 
   virtual bool IsBlockEntry() const { return false; }
   BlockEntryInstr* AsBlockEntry() {
     return IsBlockEntry() ? reinterpret_cast<BlockEntryInstr*>(this) : NULL;
   }
 
+  virtual bool IsDefinition() const { return false; }
+  Definition* AsDefinition() {
+    return IsDefinition() ? reinterpret_cast<Definition*>(this) : NULL;
+  }
+
   // Visiting support.
   virtual Instruction* Accept(FlowGraphVisitor* visitor) = 0;
 
   virtual Instruction* StraightLineSuccessor() const = 0;
   virtual void SetSuccessor(Instruction* instr) = 0;
 
+  // Redirect the straight-line successor of an instruction which is already
+  // linked into the graph, e.g., to splice in the body of an inlined call.
+  virtual void ReplaceSuccessor(Instruction* instr) { UNREACHABLE(); }
+
+  // The values used by the instruction, including the operands of its
+  // computation, if any.
+  virtual intptr_t InputCount() const { return 0; }
+  virtual Value* InputAt(intptr_t index) const {
+    UNREACHABLE();
+    return NULL;
+  }
+  virtual void SetInputAt(intptr_t index, Value* value) { UNREACHABLE(); }
+
   // Discover basic-block structure by performing a recursive depth first
   // traversal of the instruction graph reachable from this instruction.  As
   // a side effect, the block entry instructions in the graph are assigned
@@ -889,7 +1449,16 @@ class Instruction : public ZoneAllocated {
 FOR_EACH_INSTRUCTION(INSTRUCTION_TYPE_CHECK)
 #undef INSTRUCTION_TYPE_CHECK
 
+  // The inlined function the instruction was compiled from, or NULL for
+  // the instructions of the function being compiled.
+  InlinedFunction* inlined_function() const { return inlined_function_; }
+  void set_inlined_function(InlinedFunction* function) {
+    inlined_function_ = function;
+  }
+
  private:
+  InlinedFunction* inlined_function_;
+
   DISALLOW_COPY_AND_ASSIGN(Instruction);
 };
 
@@ -914,20 +1483,40 @@ class BlockEntryInstr : public Instruction {
   BlockEntryInstr* dominator() const { return dominator_; }
   void set_dominator(BlockEntryInstr* instr) { dominator_ = instr; }
 
+  // The blocks immediately dominated by this block, i.e., its children in
+  // the dominator tree.
+  const ZoneGrowableArray<BlockEntryInstr*>& dominated_blocks() const {
+    return dominated_blocks_;
+  }
+  void AddDominatedBlock(BlockEntryInstr* block) {
+    dominated_blocks_.Add(block);
+  }
+
   Instruction* last_instruction() const { return last_instruction_; }
   void set_last_instruction(Instruction* instr) { last_instruction_ = instr; }
 
+  // The control-flow successors of the block: the true and false successors
+  // of a branch, or the block the last instruction falls through to.
+  intptr_t SuccessorCount() const;
+  BlockEntryInstr* SuccessorAt(intptr_t index) const;
+
+  // Forget the block structure recorded by DiscoverBlocks, so that the
+  // blocks of a transformed graph can be discovered again.
+  virtual void ClearDiscovery();
+
  protected:
   BlockEntryInstr()
       : preorder_number_(-1),
         postorder_number_(-1),
         dominator_(NULL),
+        dominated_blocks_(1),
         last_instruction_(NULL) { }
 
  private:
   intptr_t preorder_number_;
   intptr_t postorder_number_;
   BlockEntryInstr* dominator_;  // Immediate dominator, NULL for graph entry.
+  ZoneGrowableArray<BlockEntryInstr*> dominated_blocks_;
   Instruction* last_instruction_;
 
   DISALLOW_COPY_AND_ASSIGN(BlockEntryInstr);
@@ -939,7 +1528,9 @@ class JoinEntryInstr : public BlockEntryInstr {
   JoinEntryInstr()
       : BlockEntryInstr(),
         predecessors_(2),  // Two is the assumed to be the common case.
-        successor_(NULL) { }
+        successor_(NULL),
+        phis_(NULL),
+        loop_index_(-1) { }
 
   DECLARE_INSTRUCTION(JoinEntry)
 
@@ -947,6 +1538,21 @@ class JoinEntryInstr : public BlockEntryInstr {
   virtual BlockEntryInstr* PredecessorAt(intptr_t index) const {
     return predecessors_[index];
   }
+  intptr_t IndexOfPredecessor(BlockEntryInstr* pred) const;
+
+  // The phis of the join, NULL if it has none.
+  ZoneGrowableArray<PhiInstr*>* phis() const { return phis_; }
+  void InsertPhi(PhiInstr* phi);
+  // Remove the phis which were not marked alive.
+  void RemoveDeadPhis();
+
+  // The number of the loop headed by this join, in the order the loops
+  // were built, or -1 if the join is not a loop header.  It identifies the
+  // loop for on-stack replacement.
+  intptr_t loop_index() const { return loop_index_; }
+  void set_loop_index(intptr_t index) { loop_index_ = index; }
+
+  virtual void ClearDiscovery();
 
   virtual Instruction* StraightLineSuccessor() const {
     return successor_;
@@ -955,6 +1561,7 @@ class JoinEntryInstr : public BlockEntryInstr {
     ASSERT(successor_ == NULL);
     successor_ = instr;
   }
+  virtual void ReplaceSuccessor(Instruction* instr) { successor_ = instr; }
 
   virtual void DiscoverBlocks(
       BlockEntryInstr* current_block,
@@ -965,6 +1572,8 @@ class JoinEntryInstr : public BlockEntryInstr {
  private:
   ZoneGrowableArray<BlockEntryInstr*> predecessors_;
   Instruction* successor_;
+  ZoneGrowableArray<PhiInstr*>* phis_;
+  intptr_t loop_index_;
 
   DISALLOW_COPY_AND_ASSIGN(JoinEntryInstr);
 };
@@ -985,6 +1594,8 @@ class TargetEntryInstr : public BlockEntryInstr {
     return predecessor_;
   }
 
+  virtual void ClearDiscovery();
+
   virtual Instruction* StraightLineSuccessor() const {
     return successor_;
   }
@@ -992,6 +1603,7 @@ class TargetEntryInstr : public BlockEntryInstr {
     ASSERT(successor_ == NULL);
     successor_ = instr;
   }
+  virtual void ReplaceSuccessor(Instruction* instr) { successor_ = instr; }
 
   virtual void DiscoverBlocks(
       BlockEntryInstr* current_block,
@@ -1031,6 +1643,7 @@ class PickTempInstr : public Instruction {
     ASSERT(successor_ == NULL && instr != NULL);
     successor_ = instr;
   }
+  virtual void ReplaceSuccessor(Instruction* instr) { successor_ = instr; }
 
  private:
   const intptr_t destination_;
@@ -1067,6 +1680,7 @@ class TuckTempInstr : public Instruction {
     ASSERT(successor_ == NULL && instr != NULL);
     successor_ = instr;
   }
+  virtual void ReplaceSuccessor(Instruction* instr) { successor_ = instr; }
 
  private:
   const intptr_t destination_;
@@ -1085,6 +1699,15 @@ class DoInstr : public Instruction {
   DECLARE_INSTRUCTION(Do)
 
   Computation* computation() const { return computation_; }
+  void set_computation(Computation* value) { computation_ = value; }
+
+  virtual intptr_t InputCount() const { return computation_->InputCount(); }
+  virtual Value* InputAt(intptr_t index) const {
+    return computation_->InputAt(index);
+  }
+  virtual void SetInputAt(intptr_t index, Value* value) {
+    computation_->SetInputAt(index, value);
+  }
 
   virtual Instruction* StraightLineSuccessor() const {
     return successor_;
@@ -1093,6 +1716,7 @@ class DoInstr : public Instruction {
     ASSERT(successor_ == NULL);
     successor_ = instr;
   }
+  virtual void ReplaceSuccessor(Instruction* instr) { successor_ = instr; }
 
  private:
   Computation* computation_;
@@ -1102,7 +1726,33 @@ class DoInstr : public Instruction {
 };
 
 
-class BindInstr : public Instruction {
+// Definitions are the instructions which produce a value in SSA form.  Each
+// definition is named by a distinct SSA temporary index and assigned a
+// location by the register allocator.
+class Definition : public Instruction {
+ public:
+  Definition() : ssa_temp_index_(-1), location_() { }
+
+  virtual bool IsDefinition() const { return true; }
+
+  intptr_t ssa_temp_index() const { return ssa_temp_index_; }
+  void set_ssa_temp_index(intptr_t index) { ssa_temp_index_ = index; }
+  bool HasSSATemp() const { return ssa_temp_index_ >= 0; }
+
+  const Location& location() const { return location_; }
+  void set_location(const Location& location) { location_ = location; }
+
+  virtual Representation representation() const { return kTagged; }
+
+ private:
+  intptr_t ssa_temp_index_;
+  Location location_;
+
+  DISALLOW_COPY_AND_ASSIGN(Definition);
+};
+
+
+class BindInstr : public Definition {
  public:
   BindInstr(intptr_t temp_index, Computation* computation)
       : temp_index_(temp_index), computation_(computation), successor_(NULL) { }
@@ -1111,6 +1761,19 @@ class BindInstr : public Instruction {
 
   intptr_t temp_index() const { return temp_index_; }
   Computation* computation() const { return computation_; }
+  void set_computation(Computation* value) { computation_ = value; }
+
+  virtual intptr_t InputCount() const { return computation_->InputCount(); }
+  virtual Value* InputAt(intptr_t index) const {
+    return computation_->InputAt(index);
+  }
+  virtual void SetInputAt(intptr_t index, Value* value) {
+    computation_->SetInputAt(index, value);
+  }
+
+  virtual Representation representation() const {
+    return computation_->representation();
+  }
 
   virtual Instruction* StraightLineSuccessor() const {
     return successor_;
@@ -1119,6 +1782,7 @@ class BindInstr : public Instruction {
     ASSERT(successor_ == NULL);
     successor_ = instr;
   }
+  virtual void ReplaceSuccessor(Instruction* instr) { successor_ = instr; }
 
  private:
   const intptr_t temp_index_;
@@ -1138,6 +1802,16 @@ class ReturnInstr : public Instruction {
 
   DECLARE_INSTRUCTION(Return)
 
+  virtual intptr_t InputCount() const { return 1; }
+  virtual Value* InputAt(intptr_t index) const {
+    ASSERT(index == 0);
+    return value_;
+  }
+  virtual void SetInputAt(intptr_t index, Value* value) {
+    ASSERT(index == 0);
+    value_ = value;
+  }
+
   Value* value() const { return value_; }
   intptr_t token_index() const { return token_index_; }
 
@@ -1161,6 +1835,16 @@ class ThrowInstr : public Instruction {
 
   DECLARE_INSTRUCTION(Throw)
 
+  virtual intptr_t InputCount() const { return 1; }
+  virtual Value* InputAt(intptr_t index) const {
+    ASSERT(index == 0);
+    return exception_;
+  }
+  virtual void SetInputAt(intptr_t index, Value* value) {
+    ASSERT(index == 0);
+    exception_ = value;
+  }
+
   intptr_t node_id() const { return node_id_; }
   intptr_t token_index() const { return token_index_; }
   Value* exception() const { return exception_; }
@@ -1193,6 +1877,20 @@ class ReThrowInstr : public Instruction {
 
   DECLARE_INSTRUCTION(ReThrow)
 
+  virtual intptr_t InputCount() const { return 2; }
+  virtual Value* InputAt(intptr_t index) const {
+    ASSERT((index == 0) || (index == 1));
+    return (index == 0) ? exception_ : stack_trace_;
+  }
+  virtual void SetInputAt(intptr_t index, Value* value) {
+    ASSERT((index == 0) || (index == 1));
+    if (index == 0) {
+      exception_ = value;
+    } else {
+      stack_trace_ = value;
+    }
+  }
+
   intptr_t node_id() const { return node_id_; }
   intptr_t token_index() const { return token_index_; }
   Value* exception() const { return exception_; }
@@ -1220,6 +1918,16 @@ class BranchInstr : public Instruction {
 
   DECLARE_INSTRUCTION(Branch)
 
+  virtual intptr_t InputCount() const { return 1; }
+  virtual Value* InputAt(intptr_t index) const {
+    ASSERT(index == 0);
+    return value_;
+  }
+  virtual void SetInputAt(intptr_t index, Value* value) {
+    ASSERT(index == 0);
+    value_ = value;
+  }
+
   Value* value() const { return value_; }
   TargetEntryInstr* true_successor() const { return true_successor_; }
   TargetEntryInstr* false_successor() const { return false_successor_; }
@@ -1244,6 +1952,77 @@ class BranchInstr : public Instruction {
   DISALLOW_COPY_AND_ASSIGN(BranchInstr);
 };
 
+
+// A phi merges the values of a variable flowing into a join.  Input i is
+// the value coming from the join's predecessor i.
+class PhiInstr : public Definition {
+ public:
+  PhiInstr(JoinEntryInstr* block, intptr_t variable_index)
+      : block_(block),
+        inputs_(block->PredecessorCount()),
+        variable_index_(variable_index),
+        is_alive_(false),
+        representation_(kTagged) {
+    for (intptr_t i = 0; i < block->PredecessorCount(); ++i) {
+      inputs_.Add(NULL);
+    }
+  }
+
+  DECLARE_INSTRUCTION(Phi)
+
+  JoinEntryInstr* block() const { return block_; }
+  intptr_t variable_index() const { return variable_index_; }
+
+  virtual intptr_t InputCount() const { return inputs_.length(); }
+  virtual Value* InputAt(intptr_t index) const { return inputs_[index]; }
+  virtual void SetInputAt(intptr_t index, Value* value) {
+    inputs_[index] = value;
+  }
+
+  bool is_alive() const { return is_alive_; }
+  void mark_alive() { is_alive_ = true; }
+
+  // Phis merging only doubles are unboxed by the optimizer.
+  virtual Representation representation() const { return representation_; }
+  void set_representation(Representation value) { representation_ = value; }
+
+  virtual Instruction* StraightLineSuccessor() const { return NULL; }
+  virtual void SetSuccessor(Instruction* instr) { UNREACHABLE(); }
+
+ private:
+  JoinEntryInstr* block_;
+  ZoneGrowableArray<Value*> inputs_;
+  const intptr_t variable_index_;
+  bool is_alive_;
+  Representation representation_;
+
+  DISALLOW_COPY_AND_ASSIGN(PhiInstr);
+};
+
+
+// The incoming value of a parameter.  It stays in the parameter's stack
+// slot, given by its index relative to the frame pointer.  On entry to
+// code compiled for on-stack replacement, the stack-allocated locals are
+// incoming values in their slots as well.
+class ParameterInstr : public Definition {
+ public:
+  explicit ParameterInstr(intptr_t index) : index_(index) {
+    set_location(Location::StackSlot(index));
+  }
+
+  DECLARE_INSTRUCTION(Parameter)
+
+  intptr_t index() const { return index_; }
+
+  virtual Instruction* StraightLineSuccessor() const { return NULL; }
+  virtual void SetSuccessor(Instruction* instr) { UNREACHABLE(); }
+
+ private:
+  const intptr_t index_;
+
+  DISALLOW_COPY_AND_ASSIGN(ParameterInstr);
+};
+
 #undef DECLARE_INSTRUCTION
 
 
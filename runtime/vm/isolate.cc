@@ -12,6 +12,7 @@
 #include "vm/dart_entry.h"
 #include "vm/debugger.h"
 #include "vm/debuginfo.h"
+#include "vm/deferred_optimizer.h"
 #include "vm/heap.h"
 #include "vm/message.h"
 #include "vm/object_store.h"
@@ -40,6 +41,7 @@ class IsolateMessageHandler : public MessageHandler {
 
   const char* name() const;
   void MessageNotify(Message::Priority priority);
+  bool HandleMessage(Message* message);
 
 #if defined(DEBUG)
   // Check that it is safe to access this handler.
@@ -106,6 +108,7 @@ Isolate::Isolate()
       stub_code_(NULL),
       code_index_table_(NULL),
       debugger_(NULL),
+      deferred_optimizer_(NULL),
       long_jump_base_(NULL),
       timer_list_(),
       ast_node_id_(AstNode::kNoId),
@@ -124,6 +127,7 @@ Isolate::~Isolate() {
   delete stub_code_;
   delete code_index_table_;
   delete debugger_;
+  delete deferred_optimizer_;
   delete mutex_;
   mutex_ = NULL;  // Fail fast if interrupts are scheduled on a dead isolate.
   delete message_handler_;
@@ -178,6 +182,7 @@ Isolate* Isolate::Init(const char* name_prefix) {
 
   result->debugger_ = new Debugger();
   result->debugger_->Initialize(result);
+  result->deferred_optimizer_ = new DeferredOptimizer(result);
   if (FLAG_trace_isolates) {
     if (name_prefix == NULL || strcmp(name_prefix, "vm-isolate") != 0) {
       OS::Print("[+] Starting isolate:\n"
@@ -320,6 +325,9 @@ void Isolate::Shutdown() {
     debugger_->Shutdown();
   }
 
+  // Stop interrupting the isolate to optimize the queued functions.
+  deferred_optimizer_->Shutdown();
+
   // Close all the ports owned by this isolate.
   PortMap::ClosePorts(message_handler());
 
@@ -370,13 +378,14 @@ Dart_IsolateInterruptCallback Isolate::InterruptCallback() {
 }
 
 
-static RawInstance* DeserializeMessage(void* data) {
+static RawInstance* DeserializeMessage(Message* message) {
   // Create a snapshot object using the buffer.
-  const Snapshot* snapshot = Snapshot::SetupFromBuffer(data);
+  const Snapshot* snapshot = Snapshot::SetupFromBuffer(message->data());
   ASSERT(snapshot->IsMessageSnapshot());
 
   // Read object back from the snapshot.
   SnapshotReader reader(snapshot, Isolate::Current());
+  reader.set_message(message);
   Instance& instance = Instance::Handle();
   instance ^= reader.ReadObject();
   return instance.raw();
@@ -384,6 +393,59 @@ static RawInstance* DeserializeMessage(void* data) {
 
 
 
+// Deliver the message to its port and delete it.  The normal messages are
+// delivered with 'handle_message', or the function looked up by
+// DartLibraryCalls::HandleMessage if it is null.
+static RawError* HandleIsolateMessage(Message* message,
+                                      const Function& handle_message) {
+  const Instance& msg =
+      Instance::Handle(DeserializeMessage(message));
+  Object& result = Object::Handle();
+  if (message->priority() >= Message::kOOBPriority) {
+    // For now the only OOB messages are Mirrors messages.
+    result = DartLibraryCalls::HandleMirrorsMessage(
+        message->dest_port(), message->reply_port(), msg);
+  } else if (handle_message.IsNull()) {
+    result = DartLibraryCalls::HandleMessage(
+        message->dest_port(), message->reply_port(), msg);
+  } else {
+    result = DartLibraryCalls::HandleMessage(
+        handle_message, message->dest_port(), message->reply_port(), msg);
+  }
+  delete message;
+  if (result.IsError()) {
+    // TODO(turnidge): Propagating the error of an OOB message is probably
+    // wrong here.
+    Error& error = Error::Handle();
+    error ^= result.raw();
+    return error.raw();
+  }
+  ASSERT(result.IsNull());
+  return Error::null();
+}
+
+
+bool IsolateMessageHandler::HandleMessage(Message* message) {
+  // The isolate runs on whichever worker of the pool handles its messages.
+  Isolate::SetCurrent(isolate_);
+  isolate_->SetStackLimitFromCurrentTOS(reinterpret_cast<uword>(&message));
+  bool success = true;
+  {
+    Zone zone(isolate_);
+    HandleScope handle_scope(isolate_);
+    const Error& error = Error::Handle(
+        HandleIsolateMessage(message, Function::Handle()));
+    if (!error.IsNull()) {
+      // Leave the error to the callback stopping the isolate.
+      isolate_->object_store()->set_sticky_error(error);
+      success = false;
+    }
+  }
+  Isolate::SetCurrent(NULL);
+  return success;
+}
+
+
 RawError* Isolate::StandardRunLoop() {
   ASSERT(message_notify_callback() == NULL);
   ASSERT(message_handler() != NULL);
@@ -394,34 +456,21 @@ RawError* Isolate::StandardRunLoop() {
     HandleScope handle_scope(this);
 
     // TODO(turnidge): This code is duplicated elsewhere.  Consolidate.
-    Message* message = message_handler()->queue()->Dequeue(0);
+    Message* message = message_handler()->queue()->DequeueNoWait();
+    if (message == NULL) {
+      // The isolate is idle, optimize the functions which became hot.
+      const Error& error =
+          Error::Handle(deferred_optimizer()->OptimizeQueuedFunctions());
+      if (!error.IsNull()) {
+        return error.raw();
+      }
+      message = message_handler()->queue()->Dequeue(0);
+    }
     if (message != NULL) {
-      const Instance& msg =
-          Instance::Handle(DeserializeMessage(message->data()));
-      if (message->priority() >= Message::kOOBPriority) {
-        // For now the only OOB messages are Mirrors messages.
-        const Object& result = Object::Handle(
-            DartLibraryCalls::HandleMirrorsMessage(
-                message->dest_port(), message->reply_port(), msg));
-        delete message;
-        if (result.IsError()) {
-          // TODO(turnidge): Propagating the error is probably wrong here.
-          Error& error = Error::Handle();
-          error ^= result.raw();
-          return error.raw();
-        }
-        ASSERT(result.IsNull());
-      } else {
-        const Object& result = Object::Handle(
-            DartLibraryCalls::HandleMessage(
-                message->dest_port(), message->reply_port(), msg));
-        delete message;
-        if (result.IsError()) {
-          Error& error = Error::Handle();
-          error ^= result.raw();
-          return error.raw();
-        }
-        ASSERT(result.IsNull());
+      const Error& error = Error::Handle(
+          HandleIsolateMessage(message, Function::Handle()));
+      if (!error.IsNull()) {
+        return error.raw();
       }
     }
   }
@@ -431,6 +480,45 @@ RawError* Isolate::StandardRunLoop() {
 }
 
 
+RawError* Isolate::HandleMessages(intptr_t max_messages, int64_t max_micros) {
+  ASSERT(this == Isolate::Current());
+  ASSERT(message_handler() != NULL);
+  ASSERT((max_messages > 0) || (max_micros > 0));
+  const int64_t start = (max_micros > 0) ? OS::GetCurrentTimeMicros() : 0;
+  intptr_t handled = 0;
+  // Looked up once for all the messages of the batch.
+  Function& handle_message = Function::Handle();
+  while (true) {
+    HandleScope handle_scope(this);
+    Message* message = message_handler()->queue()->DequeueNoWait();
+    if (message == NULL) {
+      // The isolate is idle, optimize the functions which became hot.
+      return deferred_optimizer()->OptimizeQueuedFunctions();
+    }
+    const bool is_oob = (message->priority() >= Message::kOOBPriority);
+    if (!is_oob && handle_message.IsNull()) {
+      handle_message = DartLibraryCalls::HandleMessageFunction();
+    }
+    const Error& error = Error::Handle(
+        HandleIsolateMessage(message, handle_message));
+    if (!error.IsNull()) {
+      return error.raw();
+    }
+    if (!is_oob) {
+      handled++;
+      if ((max_messages > 0) && (handled >= max_messages)) {
+        break;
+      }
+      if ((max_micros > 0) &&
+          ((OS::GetCurrentTimeMicros() - start) >= max_micros)) {
+        break;
+      }
+    }
+  }
+  return Error::null();
+}
+
+
 void Isolate::VisitObjectPointers(ObjectPointerVisitor* visitor,
                                   bool visit_prologue_weak_handles,
                                   bool validate_frames) {
@@ -468,6 +556,9 @@ void Isolate::VisitObjectPointers(ObjectPointerVisitor* visitor,
 
   // Visit objects in the debugger.
   debugger()->VisitObjectPointers(visitor);
+
+  // Visit the functions queued for optimization.
+  deferred_optimizer()->VisitObjectPointers(visitor);
 }
 
 
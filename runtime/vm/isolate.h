@@ -16,6 +16,7 @@ namespace dart {
 
 // Forward declarations.
 class ApiState;
+class DeferredOptimizer;
 class CodeIndexTable;
 class Debugger;
 class HandleScope;
@@ -56,7 +57,10 @@ class Isolate {
   void VisitWeakPersistentHandles(HandleVisitor* visit,
                                   bool visit_prologue_weak_persistent_handles);
 
-  StoreBufferBlock* store_buffer() { return &store_buffer_; }
+  StoreBuffer* store_buffer() { return &store_buffer_; }
+  static intptr_t store_buffer_offset() {
+    return OFFSET_OF(Isolate, store_buffer_);
+  }
 
   Dart_MessageNotifyCallback message_notify_callback() const {
     return message_notify_callback_;
@@ -213,8 +217,9 @@ class Isolate {
   enum {
     kApiInterrupt = 0x1,      // An interrupt from Dart_InterruptIsolate.
     kMessageInterrupt = 0x2,  // An interrupt to process an out of band message.
+    kOptimizeInterrupt = 0x4,  // An interrupt to optimize queued functions.
 
-    kInterruptsMask = kApiInterrupt | kMessageInterrupt,
+    kInterruptsMask = kApiInterrupt | kMessageInterrupt | kOptimizeInterrupt,
   };
 
   void ScheduleInterrupts(uword interrupt_bits);
@@ -226,11 +231,24 @@ class Isolate {
   // Returns null on success, a RawError on failure.
   RawError* StandardRunLoop();
 
+  // Handles the pending messages of the isolate without blocking: all OOB
+  // messages, and normal messages until 'max_messages' of them have been
+  // handled or 'max_micros' microseconds have passed (0 means no limit, at
+  // least one of the limits must be set).
+  // Once no message is left, the functions which became hot are optimized.
+  // The messages are deserialized into the current zone.
+  // Returns null on success, a RawError on failure.
+  RawError* HandleMessages(intptr_t max_messages, int64_t max_micros);
+
   intptr_t ast_node_id() const { return ast_node_id_; }
   void set_ast_node_id(int value) { ast_node_id_ = value; }
 
   Debugger* debugger() const { return debugger_; }
 
+  DeferredOptimizer* deferred_optimizer() const {
+    return deferred_optimizer_;
+  }
+
   static void SetCreateCallback(Dart_IsolateCreateCallback cback);
   static Dart_IsolateCreateCallback CreateCallback();
 
@@ -257,7 +275,7 @@ class Isolate {
   static const uword kDefaultStackSize = (1 * MB);
 
   static ThreadLocalKey isolate_key;
-  StoreBufferBlock store_buffer_;
+  StoreBuffer store_buffer_;
   Dart_MessageNotifyCallback message_notify_callback_;
   char* name_;
   Dart_Port main_port_;
@@ -279,6 +297,7 @@ class Isolate {
   StubCode* stub_code_;
   CodeIndexTable* code_index_table_;
   Debugger* debugger_;
+  DeferredOptimizer* deferred_optimizer_;
   LongJump* long_jump_base_;
   TimerList timer_list_;
   intptr_t ast_node_id_;
@@ -0,0 +1,104 @@
+// Copyright (c) 2012, the Dart project authors.  Please see the AUTHORS file
+// for details. All rights reserved. Use of this source code is governed by a
+// BSD-style license that can be found in the LICENSE file.
+
+#ifndef VM_LOCATIONS_H_
+#define VM_LOCATIONS_H_
+
+#include "vm/allocation.h"
+#include "vm/assembler.h"
+
+namespace dart {
+
+class Object;
+
+// The location of a value in optimized code, as assigned by the register
+// allocator: a register, a word in the stack frame of the function, or a
+// constant which is materialized at each of its uses.  Unboxed doubles are
+// kept in XMM registers or in two words of the frame.
+class Location : public ValueObject {
+ public:
+  enum Kind {
+    kInvalid,
+    kRegister,
+    kStackSlot,
+    kConstant,
+    kXmmRegister,
+    kDoubleStackSlot
+  };
+
+  Location() : kind_(kInvalid), payload_(0) { }
+
+  static Location RegisterLocation(Register reg) {
+    return Location(kRegister, static_cast<intptr_t>(reg));
+  }
+
+  // A stack slot is a word in the frame at the given index relative to the
+  // frame pointer, i.e. parameters have positive and locals negative
+  // indices.
+  static Location StackSlot(intptr_t index) {
+    return Location(kStackSlot, index);
+  }
+
+#if defined(TARGET_ARCH_IA32) || defined(TARGET_ARCH_X64)
+  static Location XmmRegisterLocation(XmmRegister reg) {
+    return Location(kXmmRegister, static_cast<intptr_t>(reg));
+  }
+#endif
+
+  // The GC visits every word of the frame, so a double spilled to the frame
+  // is split into its high and low 32 bits, each stored as a Smi: the high
+  // half at the given index and the low half at the index below.
+  static Location DoubleStackSlot(intptr_t index) {
+    return Location(kDoubleStackSlot, index);
+  }
+
+  static Location Constant(const Object& value) {
+    return Location(kConstant, reinterpret_cast<intptr_t>(&value));
+  }
+
+  Kind kind() const { return kind_; }
+
+  bool IsInvalid() const { return kind_ == kInvalid; }
+  bool IsRegister() const { return kind_ == kRegister; }
+  bool IsStackSlot() const { return kind_ == kStackSlot; }
+  bool IsConstant() const { return kind_ == kConstant; }
+  bool IsXmmRegister() const { return kind_ == kXmmRegister; }
+  bool IsDoubleStackSlot() const { return kind_ == kDoubleStackSlot; }
+
+  Register reg() const {
+    ASSERT(IsRegister());
+    return static_cast<Register>(payload_);
+  }
+
+#if defined(TARGET_ARCH_IA32) || defined(TARGET_ARCH_X64)
+  XmmRegister xmm_reg() const {
+    ASSERT(IsXmmRegister());
+    return static_cast<XmmRegister>(payload_);
+  }
+#endif
+
+  intptr_t stack_index() const {
+    ASSERT(IsStackSlot() || IsDoubleStackSlot());
+    return payload_;
+  }
+
+  const Object& constant() const {
+    ASSERT(IsConstant());
+    return *reinterpret_cast<const Object*>(payload_);
+  }
+
+  bool Equals(const Location& other) const {
+    return (kind_ == other.kind_) && (payload_ == other.payload_);
+  }
+
+ private:
+  Location(Kind kind, intptr_t payload) : kind_(kind), payload_(payload) { }
+
+  Kind kind_;
+  intptr_t payload_;
+};
+
+}  // namespace dart
+
+#endif  // VM_LOCATIONS_H_
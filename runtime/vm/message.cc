@@ -4,14 +4,65 @@
 
 #include "vm/message.h"
 
+#include "vm/atomic.h"
+#include "vm/flags.h"
+#include "vm/thread_pool.h"
+
 namespace dart {
 
+DEFINE_FLAG(int, message_handler_quantum, 100,
+            "Number of messages a handler running on a thread pool handles "
+            "before it lets the other handlers run (0 means no limit).");
 DECLARE_FLAG(bool, trace_isolates);
 
 
+void Message::SetTransfers(Transfer* transfers, intptr_t count) {
+  ASSERT(transfers_ == NULL);
+  transfers_ = transfers;
+  transfer_count_ = count;
+}
+
+
+void Message::ReleaseTransfers() {
+  for (intptr_t i = 0; i < transfer_count_; i++) {
+    Transfer* transfer = &transfers_[i];
+    if (transfer->callback != NULL) {
+      (*transfer->callback)(transfer->peer);
+    }
+  }
+  free(transfers_);
+  transfers_ = NULL;
+  transfer_count_ = 0;
+}
+
+
+class MessageHandler::HandlerTask : public ThreadPool::Task {
+ public:
+  explicit HandlerTask(MessageHandler* handler) : handler_(handler) { }
+
+  virtual void Run() {
+    handler_->TaskCallback();
+  }
+
+ private:
+  MessageHandler* handler_;
+
+  DISALLOW_COPY_AND_ASSIGN(HandlerTask);
+};
+
+
 MessageHandler::MessageHandler()
-    : live_ports_(0),
-      queue_(new MessageQueue()) {
+    : mutex_(),
+      live_ports_(0),
+      queue_(new MessageQueue()),
+      pool_(NULL),
+      max_tasks_(1),
+      tasks_running_(0),
+      stopped_(false),
+      delete_when_idle_(false),
+      start_callback_(NULL),
+      end_callback_(NULL),
+      callback_data_(0) {
   ASSERT(queue_ != NULL);
 }
 
@@ -33,11 +84,118 @@ void MessageHandler::CheckAccess() {
 #endif
 
 
+bool MessageHandler::HasLivePorts() {
+  MutexLocker ml(&mutex_);
+  return live_ports_ > 0;
+}
+
+
+void MessageHandler::increment_live_ports() {
+#if defined(DEBUG)
+  CheckAccess();
+#endif
+  MutexLocker ml(&mutex_);
+  live_ports_++;
+}
+
+
+void MessageHandler::decrement_live_ports() {
+#if defined(DEBUG)
+  CheckAccess();
+#endif
+  MutexLocker ml(&mutex_);
+  live_ports_--;
+}
+
+
 void MessageHandler::MessageNotify(Message::Priority priority) {
   // By default, there is no custom message notification.
 }
 
 
+bool MessageHandler::HandleMessage(Message* message) {
+  // Only the handlers which run on a thread pool handle their messages.
+  UNREACHABLE();
+  return false;
+}
+
+
+void MessageHandler::Run(ThreadPool* pool,
+                         StartCallback start_callback,
+                         EndCallback end_callback,
+                         CallbackData data,
+                         intptr_t max_tasks) {
+  MutexLocker ml(&mutex_);
+  ASSERT(pool_ == NULL);
+  ASSERT(max_tasks > 0);
+  ASSERT((max_tasks == 1) ||
+         ((start_callback == NULL) && (end_callback == NULL)));
+  pool_ = pool;
+  max_tasks_ = max_tasks;
+  start_callback_ = start_callback;
+  end_callback_ = end_callback;
+  callback_data_ = data;
+  // The first task runs the start callback, even if there is no message.
+  tasks_running_ = 1;
+  pool_->Run(new HandlerTask(this));
+}
+
+
+void MessageHandler::TaskCallback() {
+  bool ok = true;
+  if (start_callback_ != NULL) {
+    ok = (*start_callback_)(callback_data_);
+    start_callback_ = NULL;
+  }
+  // Handle a bounded number of messages before yielding the worker, so that
+  // the handlers sharing the workers of a bounded pool all make progress.
+  intptr_t count = 0;
+  while (ok &&
+         ((FLAG_message_handler_quantum <= 0) ||
+          (count < FLAG_message_handler_quantum))) {
+    Message* message = queue()->DequeueNoWait();
+    if (message == NULL) {
+      break;
+    }
+    ok = HandleMessage(message);
+    count++;
+  }
+  bool delete_handler = false;
+  {
+    MutexLocker ml(&mutex_);
+    if (ok && (live_ports_ > 0)) {
+      // Give up the task before looking at the queue a last time.  Both the
+      // decrement and the enqueueing of a message are full barriers, so a
+      // message posted meanwhile is either seen here or sees fewer tasks
+      // running and starts a new one.
+      AtomicOperations::FetchAndIncrementBy(&tasks_running_, -1);
+      if (!queue()->IsEmpty() && !stopped_ &&
+          (tasks_running_ < max_tasks_)) {
+        // Queue the handler again behind the tasks waiting for a worker.
+        tasks_running_++;
+        pool_->Run(new HandlerTask(this));
+      }
+      return;
+    }
+    // The handler is stopped, the messages posted until its ports are
+    // closed do not start new tasks.
+    stopped_ = true;
+    AtomicOperations::FetchAndIncrementBy(&tasks_running_, -1);
+    delete_handler = delete_when_idle_ && (tasks_running_ == 0);
+  }
+  if (delete_handler) {
+    // The port map closed the last port of the handler while the task ran.
+    delete this;
+    return;
+  }
+  EndCallback end_callback = end_callback_;
+  CallbackData data = callback_data_;
+  if (end_callback != NULL) {
+    (*end_callback)(data);  // May delete the handler.
+  }
+}
+
+
 void MessageHandler::PostMessage(Message* message) {
   if (FLAG_trace_isolates) {
     const char* source_name = "<native code>";
@@ -59,6 +217,32 @@ void MessageHandler::PostMessage(Message* message) {
 
   // Invoke any custom message notification.
   MessageNotify(priority);
+
+  // Start a task to handle the message if the handler runs on a thread pool
+  // and may run another task.  The lock is only taken to start the task,
+  // the tasks running see the message otherwise.
+  if ((pool_ != NULL) && (tasks_running_ < max_tasks_)) {
+    MutexLocker ml(&mutex_);
+    if (!stopped_ && (tasks_running_ < max_tasks_)) {
+      tasks_running_++;
+      pool_->Run(new HandlerTask(this));
+    }
+  }
+}
+
+
+void MessageHandler::DeleteWhenIdle() {
+  bool delete_handler = false;
+  {
+    MutexLocker ml(&mutex_);
+    ASSERT(!delete_when_idle_);
+    delete_when_idle_ = true;
+    // Otherwise the last task running deletes the handler when it ends.
+    delete_handler = (tasks_running_ == 0);
+  }
+  if (delete_handler) {
+    delete this;
+  }
 }
 
 
@@ -72,10 +256,11 @@ void MessageHandler::CloseAllPorts() {
 }
 
 
-MessageQueue::MessageQueue() {
+MessageQueue::MessageQueue() : waiters_(0) {
   for (int p = Message::kFirstPriority; p < Message::kNumPriorities; p++) {
     head_[p] = NULL;
     tail_[p] = NULL;
+    incoming_[p] = NULL;
   }
 }
 
@@ -85,29 +270,67 @@ MessageQueue::~MessageQueue() {
 #if defined(DEBUG)
   for (int p = Message::kFirstPriority; p < Message::kNumPriorities; p++) {
     ASSERT(head_[p] == NULL);
+    ASSERT(incoming_[p] == NULL);
   }
 #endif
 }
 
 
 void MessageQueue::Enqueue(Message* msg) {
-  MonitorLocker ml(&monitor_);
   Message::Priority p = msg->priority();
   // Make sure messages are not reused.
   ASSERT(msg->next_ == NULL);
-  if (head_[p] == NULL) {
-    // Only element in the queue.
-    head_[p] = msg;
-    tail_[p] = msg;
+  // Push the message onto the incoming messages of its priority.
+  uword* incoming = reinterpret_cast<uword*>(&incoming_[p]);
+  uword head = *incoming;
+  while (true) {
+    msg->next_ = reinterpret_cast<Message*>(head);
+    uword old_head = AtomicOperations::CompareAndSwapWord(
+        incoming, head, reinterpret_cast<uword>(msg));
+    if (old_head == head) {
+      break;
+    }
+    head = old_head;
+  }
+  // The compare-and-swap is a full barrier: either a receiver about to wait
+  // sees the message, or it is counted in waiters_ here.
+  if (waiters_ > 0) {
+    MonitorLocker ml(&monitor_);
+    ml.Notify();
+  }
+}
+
 
-    // We only need to notify if the queue was empty.
-    monitor_.Notify();
+void MessageQueue::TakeIncomingHoldsLock(Message::Priority priority) {
+  uword* incoming = reinterpret_cast<uword*>(&incoming_[priority]);
+  uword head = *incoming;
+  while (head != 0) {
+    uword old_head = AtomicOperations::CompareAndSwapWord(incoming, head, 0);
+    if (old_head == head) {
+      break;
+    }
+    head = old_head;
+  }
+  // Reverse the taken messages into the order they were enqueued in.
+  Message* first = NULL;
+  Message* last = reinterpret_cast<Message*>(head);
+  Message* cur = last;
+  while (cur != NULL) {
+    Message* next = cur->next_;
+    cur->next_ = first;
+    first = cur;
+    cur = next;
+  }
+  if (first == NULL) {
+    return;
+  }
+  if (head_[priority] == NULL) {
+    head_[priority] = first;
   } else {
-    ASSERT(tail_[p] != NULL);
-    // Append at the tail.
-    tail_[p]->next_ = msg;
-    tail_[p] = msg;
+    ASSERT(tail_[priority] != NULL);
+    tail_[priority]->next_ = first;
   }
+  tail_[priority] = last;
 }
 
 
@@ -127,6 +350,10 @@ Message* MessageQueue::DequeueNoWaitWithPriority(
 Message* MessageQueue::DequeueNoWaitHoldsLock(Message::Priority min_priority) {
   // Look for the highest priority available message.
   for (int p = Message::kNumPriorities-1; p >= min_priority; p--) {
+    Message::Priority priority = static_cast<Message::Priority>(p);
+    if (head_[p] == NULL) {
+      TakeIncomingHoldsLock(priority);
+    }
     Message* result = head_[p];
     if (result != NULL) {
       head_[p] = result->next_;
@@ -149,9 +376,16 @@ Message* MessageQueue::Dequeue(int64_t millis) {
   MonitorLocker ml(&monitor_);
   Message* result = DequeueNoWaitHoldsLock(Message::kFirstPriority);
   if (result == NULL) {
-    // No message available at any priority.
-    monitor_.Wait(millis);
+    // Announce the waiter before checking for a message again, so that a
+    // sender either is seen here or notifies the monitor.
+    AtomicOperations::FetchAndIncrementBy(&waiters_, 1);
     result = DequeueNoWaitHoldsLock(Message::kFirstPriority);
+    if (result == NULL) {
+      // No message available at any priority.
+      ml.Wait(millis);
+      result = DequeueNoWaitHoldsLock(Message::kFirstPriority);
+    }
+    AtomicOperations::FetchAndIncrementBy(&waiters_, -1);
   }
   return result;
 }
@@ -160,6 +394,7 @@ Message* MessageQueue::Dequeue(int64_t millis) {
 void MessageQueue::Flush(Dart_Port port) {
   MonitorLocker ml(&monitor_);
   for (int p = Message::kFirstPriority; p < Message::kNumPriorities; p++) {
+    TakeIncomingHoldsLock(static_cast<Message::Priority>(p));
     Message* cur = head_[p];
     Message* prev = NULL;
     while (cur != NULL) {
@@ -187,6 +422,7 @@ void MessageQueue::Flush(Dart_Port port) {
 void MessageQueue::FlushAll() {
   MonitorLocker ml(&monitor_);
   for (int p = Message::kFirstPriority; p < Message::kNumPriorities; p++) {
+    TakeIncomingHoldsLock(static_cast<Message::Priority>(p));
     Message* cur = head_[p];
     head_[p] = NULL;
     tail_[p] = NULL;
@@ -199,4 +435,16 @@ void MessageQueue::FlushAll() {
 }
 
 
+bool MessageQueue::IsEmpty() {
+  MonitorLocker ml(&monitor_);
+  for (int p = Message::kFirstPriority; p < Message::kNumPriorities; p++) {
+    TakeIncomingHoldsLock(static_cast<Message::Priority>(p));
+    if (head_[p] != NULL) {
+      return false;
+    }
+  }
+  return true;
+}
+
+
 }  // namespace dart
@@ -9,9 +9,12 @@
 
 // Duplicated from dart_api.h to avoid including the whole header.
 typedef int64_t Dart_Port;
+typedef void (*Dart_PeerFinalizer)(void* peer);
 
 namespace dart {
 
+class ThreadPool;
+
 class Message {
  public:
   typedef enum {
@@ -26,6 +29,15 @@ class Message {
   // A port number which is never used.
   static const Dart_Port kIllegalPort = 0;
 
+  // The data of a byte array handed over to the receiver of the message
+  // instead of being copied into the message.
+  typedef struct {
+    uint8_t* data;
+    intptr_t length;
+    void* peer;
+    Dart_PeerFinalizer callback;
+  } Transfer;
+
   // A new message to be sent between two isolates. The data handed to this
   // message will be disposed by calling free() once the message object is
   // being destructed (after delivery or when the receiving port is closed).
@@ -37,8 +49,11 @@ class Message {
         dest_port_(dest_port),
         reply_port_(reply_port),
         data_(data),
+        transfers_(NULL),
+        transfer_count_(0),
         priority_(priority) {}
   ~Message() {
+    ReleaseTransfers();
     free(data_);
   }
 
@@ -47,19 +62,41 @@ class Message {
   uint8_t* data() const { return data_; }
   Priority priority() const { return priority_; }
 
+  // Claims ownership of the malloc'ed 'transfers' and of the data they
+  // refer to.  The receiver claims the data of a transfer by clearing it,
+  // the data which is not claimed is released through its callback when
+  // the message is deleted, e.g., because its port was closed before the
+  // message was delivered.
+  void SetTransfers(Transfer* transfers, intptr_t count);
+  Transfer* TransferAt(intptr_t index) const {
+    ASSERT((index >= 0) && (index < transfer_count_));
+    return &transfers_[index];
+  }
+
  private:
   friend class MessageQueue;
 
+  void ReleaseTransfers();
+
   Message* next_;
   Dart_Port dest_port_;
   Dart_Port reply_port_;
   uint8_t* data_;
+  Transfer* transfers_;
+  intptr_t transfer_count_;
   Priority priority_;
 
   DISALLOW_COPY_AND_ASSIGN(Message);
 };
 
 // There is a message queue per isolate.
+//
+// Senders enqueue messages without taking a lock: each priority has a
+// stack of incoming messages, which a sender pushes its message onto with
+// a compare-and-swap.  The receiving side holds the monitor of the queue,
+// moves the incoming messages over to the queue of their priority in the
+// order they were sent, and dequeues from there.  A sender only takes the
+// monitor to wake up a receiver which waits in Dequeue.
 class MessageQueue {
  public:
   MessageQueue();
@@ -85,14 +122,28 @@ class MessageQueue {
   void Flush(Dart_Port port);
   void FlushAll();
 
+  // Returns true if there is no message in the queue.
+  bool IsEmpty();
+
  private:
   friend class MessageQueueTestPeer;
 
   Message* DequeueNoWaitHoldsLock(Message::Priority min_priority);
 
+  // Moves the incoming messages of the priority to the tail of its queue.
+  void TakeIncomingHoldsLock(Message::Priority priority);
+
   Monitor monitor_;
-  Message* head_[Message::kNumPriorities];
-  Message* tail_[Message::kNumPriorities];
+  Message* head_[Message::kNumPriorities];  // Protected by monitor_.
+  Message* tail_[Message::kNumPriorities];  // Protected by monitor_.
+
+  // Stacks of the messages enqueued since the last time they were taken,
+  // the most recent first.  Updated atomically.
+  Message* incoming_[Message::kNumPriorities];
+
+  // Number of threads waiting for a message in Dequeue.  Updated atomically
+  // while holding monitor_.
+  intptr_t waiters_;
 
   DISALLOW_COPY_AND_ASSIGN(MessageQueue);
 };
@@ -105,9 +156,31 @@ class MessageHandler {
   // Allows subclasses to provide custom message notification.
   virtual void MessageNotify(Message::Priority priority);
 
+  // Handles a message of a handler which runs on a thread pool, and claims
+  // ownership of 'message'.  Returns false to stop the handler.
+  virtual bool HandleMessage(Message* message);
+
  public:
+  typedef uword CallbackData;
+  typedef bool (*StartCallback)(CallbackData data);
+  typedef void (*EndCallback)(CallbackData data);
+
   virtual ~MessageHandler();
 
+  // Runs the handler on a thread pool.  Whenever the handler has messages
+  // and fewer than 'max_tasks' tasks running, a task of the pool is started
+  // which handles them until the queue is empty and then releases its
+  // worker.  The first task invokes 'start_callback' before handling any
+  // message.  Once the start callback or HandleMessage returns false, or the
+  // handler has no live ports left, the handler is stopped by invoking
+  // 'end_callback', which may delete it.  The callbacks are only supported
+  // for handlers running a single task at a time.
+  void Run(ThreadPool* pool,
+           StartCallback start_callback,
+           EndCallback end_callback,
+           CallbackData data,
+           intptr_t max_tasks = 1);
+
   // Allow subclasses to provide a handler name.
   virtual const char* name() const;
 
@@ -124,31 +197,47 @@ class MessageHandler {
   void ClosePort(Dart_Port port);
   void CloseAllPorts();
 
-  // A message handler tracks how many live ports it has.
-  bool HasLivePorts() const { return live_ports_ > 0; }
-  void increment_live_ports() {
-#if defined(DEBUG)
-    CheckAccess();
-#endif
-    live_ports_++;
-  }
-  void decrement_live_ports() {
-#if defined(DEBUG)
-    CheckAccess();
-#endif
-    live_ports_--;
-  }
+  // A message handler tracks how many live ports it has.  The ports of a
+  // handler are closed by other threads than the one running its tasks.
+  bool HasLivePorts();
+  void increment_live_ports();
+  void decrement_live_ports();
 
   // Returns true if the handler is owned by the PortMap.
   //
   // This is used to delete handlers when their last live port is closed.
   virtual bool OwnedByPortMap() const { return false; }
 
+  // Deletes the handler once none of its tasks is running anymore.  Used by
+  // the PortMap to delete the handlers it owns, no message may be posted to
+  // the handler anymore.
+  void DeleteWhenIdle();
+
   MessageQueue* queue() const { return queue_; }
 
  private:
-  intptr_t live_ports_;
+  class HandlerTask;
+
+  // Handles the messages of a handler which runs on a thread pool.
+  void TaskCallback();
+
+  Mutex mutex_;
+  intptr_t live_ports_;  // Protected by mutex_.
   MessageQueue* queue_;
+
+  // State of a handler which runs on a thread pool.
+  ThreadPool* pool_;
+  intptr_t max_tasks_;
+  // Protected by mutex_, but decremented atomically so that posting a
+  // message may read it without the lock.
+  intptr_t tasks_running_;
+  bool stopped_;  // Protected by mutex_.
+  bool delete_when_idle_;  // Protected by mutex_.
+  StartCallback start_callback_;
+  EndCallback end_callback_;
+  CallbackData callback_data_;
+
+  DISALLOW_COPY_AND_ASSIGN(MessageHandler);
 };
 
 }  // namespace dart
@@ -4,10 +4,13 @@
 
 #include "platform/assert.h"
 #include "vm/message.h"
+#include "vm/thread_pool.h"
 #include "vm/unit_test.h"
 
 namespace dart {
 
+DECLARE_FLAG(int, message_handler_quantum);
+
 
 // Provide access to private members of MessageQueue for testing.
 class MessageQueueTestPeer {
@@ -19,7 +22,9 @@ class MessageQueueTestPeer {
     // but it doesn't hurt.
     queue_->monitor_.Enter();
     bool result = (queue_->head_[Message::kNormalPriority] != NULL ||
-                   queue_->head_[Message::kOOBPriority] != NULL);
+                   queue_->head_[Message::kOOBPriority] != NULL ||
+                   queue_->incoming_[Message::kNormalPriority] != NULL ||
+                   queue_->incoming_[Message::kOOBPriority] != NULL);
     queue_->monitor_.Exit();
     return result;
   }
@@ -286,4 +291,307 @@ TEST_CASE(MessageQueue_Flush_EmptyQueue) {
   EXPECT(!queue_peer.HasMessage());
 }
 
+
+// Threads which enqueue a sequence of messages into a shared queue.
+static const int kNumSenders = 4;
+static const int kMessagesPerSender = 10000;
+static Monitor* senders_sync = NULL;
+static int senders_done = 0;
+void MessageSender_start(uword sender) {
+  for (int i = 0; i < kMessagesPerSender; i++) {
+    Message* msg = new Message(sender, i, NULL, (i % 10 == 0)
+                               ? Message::kOOBPriority
+                               : Message::kNormalPriority);
+    shared_queue->Enqueue(msg);
+  }
+  MonitorLocker ml(senders_sync);
+  senders_done++;
+  ml.Notify();
+}
+
+
+TEST_CASE(MessageQueue_ConcurrentSenders) {
+  MessageQueue queue;
+  shared_queue = &queue;
+  senders_sync = new Monitor();
+  senders_done = 0;
+  for (int i = 0; i < kNumSenders; i++) {
+    int result = Thread::Start(MessageSender_start, i);
+    EXPECT_EQ(0, result);
+  }
+
+  // The messages of a sender are received in the order they were sent,
+  // within each priority.
+  int next[kNumSenders][Message::kNumPriorities];
+  for (int i = 0; i < kNumSenders; i++) {
+    for (int p = Message::kFirstPriority; p < Message::kNumPriorities; p++) {
+      next[i][p] = 0;
+    }
+  }
+  for (int received = 0; received < kNumSenders * kMessagesPerSender; ) {
+    Message* msg = queue.Dequeue(0);
+    if (msg == NULL) {
+      continue;
+    }
+    intptr_t sender = msg->dest_port();
+    int p = msg->priority();
+    EXPECT(sender >= 0 && sender < kNumSenders);
+    EXPECT(msg->reply_port() >= next[sender][p]);
+    EXPECT_EQ((p == Message::kOOBPriority), (msg->reply_port() % 10 == 0));
+    next[sender][p] = msg->reply_port() + 1;
+    delete msg;
+    received++;
+  }
+  EXPECT(queue.IsEmpty());
+
+  // Wait for the senders to be done with the queue.
+  {
+    MonitorLocker ml(senders_sync);
+    while (senders_done < kNumSenders) {
+      ml.Wait();
+    }
+  }
+  delete senders_sync;
+  senders_sync = NULL;
+  shared_queue = NULL;
+}
+
+
+// The ports of the messages handled by the handlers below, in order.
+static const int kMaxHandledMessages = 8;
+static Dart_Port handled_ports[kMaxHandledMessages];
+static int handled_count = 0;
+
+
+// A handler which records the ports of the messages it handles, and closes
+// its only port after handling 'message_count' messages.
+class PoolTestMessageHandler : public MessageHandler {
+ public:
+  PoolTestMessageHandler(Monitor* sync, int message_count)
+      : sync_(sync),
+        message_count_(message_count),
+        handled_(0),
+        started_(false),
+        released_(false),
+        ended_(false) {
+    increment_live_ports();
+  }
+
+  bool HandleMessage(Message* message) {
+    MonitorLocker ml(sync_);
+    EXPECT(started_);
+    ASSERT(handled_count < kMaxHandledMessages);
+    handled_ports[handled_count++] = message->dest_port();
+    handled_++;
+    delete message;
+    if (handled_ == message_count_) {
+      decrement_live_ports();
+    }
+    return true;
+  }
+
+  static bool Start(CallbackData data) {
+    PoolTestMessageHandler* handler =
+        reinterpret_cast<PoolTestMessageHandler*>(data);
+    MonitorLocker ml(handler->sync_);
+    handler->started_ = true;
+    ml.NotifyAll();
+    while (!handler->released_) {
+      ml.Wait();
+    }
+    return true;
+  }
+
+  static void End(CallbackData data) {
+    PoolTestMessageHandler* handler =
+        reinterpret_cast<PoolTestMessageHandler*>(data);
+    MonitorLocker ml(handler->sync_);
+    handler->ended_ = true;
+    ml.NotifyAll();
+  }
+
+  Monitor* sync_;
+  int message_count_;
+  int handled_;
+  bool started_;
+  bool released_;
+  bool ended_;
+};
+
+
+UNIT_TEST_CASE(MessageHandler_RunOnThreadPool) {
+  const int kMessageCount = 3;
+  const int saved_quantum = FLAG_message_handler_quantum;
+  FLAG_message_handler_quantum = 1;
+  handled_count = 0;
+  ThreadPool thread_pool(1);
+  Monitor sync;
+  PoolTestMessageHandler handler1(&sync, kMessageCount);
+  PoolTestMessageHandler handler2(&sync, kMessageCount);
+  handler1.Run(&thread_pool,
+               PoolTestMessageHandler::Start,
+               PoolTestMessageHandler::End,
+               reinterpret_cast<uword>(&handler1));
+  handler2.Run(&thread_pool,
+               PoolTestMessageHandler::Start,
+               PoolTestMessageHandler::End,
+               reinterpret_cast<uword>(&handler2));
+  {
+    // The only worker is held by the first handler, the second one waits.
+    MonitorLocker ml(&sync);
+    while (!handler1.started_) {
+      ml.Wait();
+    }
+  }
+  EXPECT_EQ(1U, thread_pool.tasks_pending());
+  for (int i = 0; i < kMessageCount; i++) {
+    handler1.PostMessage(
+        new Message(1, Message::kIllegalPort, NULL, Message::kNormalPriority));
+    handler2.PostMessage(
+        new Message(2, Message::kIllegalPort, NULL, Message::kNormalPriority));
+  }
+  // The messages did not start more tasks.
+  EXPECT_EQ(1U, thread_pool.tasks_pending());
+  {
+    MonitorLocker ml(&sync);
+    handler1.released_ = true;
+    handler2.released_ = true;
+    ml.NotifyAll();
+    while (!handler1.ended_ || !handler2.ended_) {
+      ml.Wait();
+    }
+  }
+  // The handlers took turns on the worker.
+  EXPECT_EQ(2 * kMessageCount, handled_count);
+  for (int i = 0; i < handled_count; i++) {
+    EXPECT_EQ((i % 2) + 1, handled_ports[i]);
+  }
+  EXPECT_EQ(kMessageCount, handler1.handled_);
+  EXPECT_EQ(kMessageCount, handler2.handled_);
+  EXPECT(!handler1.HasLivePorts());
+  EXPECT(!handler2.HasLivePorts());
+  EXPECT_EQ(1U, thread_pool.workers_started());
+  FLAG_message_handler_quantum = saved_quantum;
+}
+
+
+// A handler whose messages each wait for 'concurrency' messages to be
+// handled at the same time.
+class ConcurrentTestMessageHandler : public MessageHandler {
+ public:
+  ConcurrentTestMessageHandler(Monitor* sync, int concurrency)
+      : sync_(sync), concurrency_(concurrency), entered_(0), handled_(0) {
+    increment_live_ports();
+  }
+
+  bool HandleMessage(Message* message) {
+    delete message;
+    MonitorLocker ml(sync_);
+    entered_++;
+    ml.NotifyAll();
+    while (entered_ < concurrency_) {
+      ml.Wait();
+    }
+    handled_++;
+    ml.NotifyAll();
+    return true;
+  }
+
+  Monitor* sync_;
+  int concurrency_;
+  int entered_;
+  int handled_;
+};
+
+
+UNIT_TEST_CASE(MessageHandler_RunConcurrently) {
+  const int kConcurrency = 3;
+  ThreadPool thread_pool;
+  Monitor sync;
+  ConcurrentTestMessageHandler handler(&sync, kConcurrency);
+  handler.Run(&thread_pool, NULL, NULL, 0, kConcurrency);
+  for (int i = 0; i < kConcurrency; i++) {
+    handler.PostMessage(
+        new Message(1, Message::kIllegalPort, NULL, Message::kNormalPriority));
+  }
+  {
+    MonitorLocker ml(&sync);
+    while (handler.handled_ < kConcurrency) {
+      ml.Wait();
+    }
+  }
+  EXPECT_EQ(kConcurrency, handler.handled_);
+  // Let the tasks release the handler before it is deleted.
+  while (thread_pool.workers_running() > 0) {
+    OS::Sleep(1);
+  }
+}
+
+
+// A handler whose messages wait to be released, and which records when it
+// is deleted.
+class DeletedTestMessageHandler : public MessageHandler {
+ public:
+  DeletedTestMessageHandler(Monitor* sync, bool* deleted)
+      : sync_(sync), deleted_(deleted), entered_(false), released_(false) {
+    increment_live_ports();
+  }
+
+  ~DeletedTestMessageHandler() {
+    MonitorLocker ml(sync_);
+    *deleted_ = true;
+    ml.NotifyAll();
+  }
+
+  bool HandleMessage(Message* message) {
+    delete message;
+    MonitorLocker ml(sync_);
+    entered_ = true;
+    ml.NotifyAll();
+    while (!released_) {
+      ml.Wait();
+    }
+    return true;
+  }
+
+  Monitor* sync_;
+  bool* deleted_;
+  bool entered_;
+  bool released_;
+};
+
+
+UNIT_TEST_CASE(MessageHandler_DeleteWhenIdle) {
+  ThreadPool thread_pool;
+  Monitor sync;
+  bool deleted = false;
+  DeletedTestMessageHandler* handler =
+      new DeletedTestMessageHandler(&sync, &deleted);
+  handler->Run(&thread_pool, NULL, NULL, 0);
+  handler->PostMessage(
+      new Message(1, Message::kIllegalPort, NULL, Message::kNormalPriority));
+  {
+    MonitorLocker ml(&sync);
+    while (!handler->entered_) {
+      ml.Wait();
+    }
+  }
+  // Close the last port while the task handles the message.
+  handler->decrement_live_ports();
+  handler->DeleteWhenIdle();
+  {
+    MonitorLocker ml(&sync);
+    // The handler is only deleted once its task ends.
+    EXPECT(!deleted);
+    handler->released_ = true;
+    ml.NotifyAll();
+    while (!deleted) {
+      ml.Wait();
+    }
+  }
+  while (thread_pool.workers_running() > 0) {
+    OS::Sleep(1);
+  }
+}
+
 }  // namespace dart
@@ -4,14 +4,19 @@
 
 #include "vm/native_message_handler.h"
 
+#include "vm/dart.h"
 #include "vm/dart_api_message.h"
+#include "vm/flags.h"
 #include "vm/isolate.h"
 #include "vm/message.h"
 #include "vm/snapshot.h"
-#include "vm/thread.h"
 
 namespace dart {
 
+DEFINE_FLAG(int, native_handler_concurrency, 4,
+            "Maximum number of messages handled at the same time by a native "
+            "port which handles its messages concurrently.");
+
 NativeMessageHandler::NativeMessageHandler(const char* name,
                                            Dart_NativeMessageHandler func)
     : name_(strdup(name)),
@@ -41,46 +46,40 @@ static uint8_t* zone_allocator(
 }
 
 
-static void RunWorker(uword parameter) {
-  NativeMessageHandler* handler =
-      reinterpret_cast<NativeMessageHandler*>(parameter);
+bool NativeMessageHandler::HandleMessage(Message* message) {
 #if defined(DEBUG)
-    handler->CheckAccess();
+  CheckAccess();
 #endif
-
-  while (handler->HasLivePorts()) {
-    Message* message = handler->queue()->Dequeue(0);
-    if (message != NULL) {
-      if (message->priority() >= Message::kOOBPriority) {
-        // TODO(turnidge): Out of band messages will not go through
-        // the regular message handler.  Instead they will be
-        // dispatched to special vm code.  Implement.
-        UNIMPLEMENTED();
-      }
-      // Enter a native scope for handling the message. This will create a
-      // zone for allocating the objects for decoding the message.
-      ApiNativeScope scope;
-
-      int32_t length = reinterpret_cast<int32_t*>(
-          message->data())[Snapshot::kLengthIndex];
-      ApiMessageReader reader(message->data() + Snapshot::kHeaderSize,
-                              length,
-                              zone_allocator);
-      Dart_CObject* object = reader.ReadMessage();
-      (*handler->func())(message->dest_port(),
-                         message->reply_port(),
-                         object);
-      delete message;
-    }
+  if (message->priority() >= Message::kOOBPriority) {
+    // TODO(turnidge): Out of band messages will not go through the
+    // regular message handler.  Instead they will be dispatched to
+    // special vm code.  Implement.
+    UNIMPLEMENTED();
   }
+  // Enter a native scope for handling the message. This will create a
+  // zone for allocating the objects for decoding the message.
+  ApiNativeScope scope;
+
+  int32_t length = reinterpret_cast<int32_t*>(
+      message->data())[Snapshot::kLengthIndex];
+  ApiMessageReader reader(message->data() + Snapshot::kHeaderSize,
+                          length,
+                          zone_allocator);
+  reader.set_message(message);
+  Dart_CObject* object = reader.ReadMessage();
+  (*func())(message->dest_port(), message->reply_port(), object);
+  delete message;
+  return true;
 }
 
 
-void NativeMessageHandler::StartWorker() {
-  int result = Thread::Start(RunWorker, reinterpret_cast<uword>(this));
-  if (result != 0) {
-    FATAL1("Failed to start native message handler worker thread %d", result);
+void NativeMessageHandler::Start(bool handle_concurrently) {
+  // The handler always has a live port, it is never stopped.
+  intptr_t max_tasks = 1;
+  if (handle_concurrently && (FLAG_native_handler_concurrency > 1)) {
+    max_tasks = FLAG_native_handler_concurrency;
   }
+  Run(Dart::message_handler_pool(), NULL, NULL, 0, max_tasks);
 }
 
 
@@ -28,14 +28,12 @@ class NativeMessageHandler : public MessageHandler {
   // Delete this handlers when its last live port is closed.
   virtual bool OwnedByPortMap() const { return true; }
 
-  // Start a worker thread which will service messages for this handler.
-  //
-  // TODO(turnidge): Instead of starting a worker for each
-  // NativeMessageHandler, we should instead use a shared thread pool
-  // which services a queue of ready MessageHandlers.  If we implement
-  // this correctly, the same pool will work for
-  // IsolateMessageHandlers as well.
-  void StartWorker();
+  // Start servicing the messages for this handler on the message handler
+  // pool shared with the isolates.  If 'handle_concurrently' is true,
+  // several messages may be handled at the same time, up to a limit.
+  void Start(bool handle_concurrently);
+
+  bool HandleMessage(Message* message);
 
  private:
   char* name_;
@@ -835,6 +835,15 @@ RawObject* Object::Allocate(const Class& cls,
   uword tags = 0;
   tags = RawObject::SizeTag::update(size, tags);
   raw_obj->ptr()->tags_ = tags;
+  if ((space != Heap::kExecutable) && raw_obj->IsOldObject()) {
+    heap->AllocateBlack(raw_obj, size);
+  }
+  if ((space == Heap::kNew) && raw_obj->IsOldObject()) {
+    // The object was requested in new space, but had to be allocated in old
+    // space. Its fields may be initialized by stubs and generated code
+    // without a write barrier, so remember it eagerly.
+    isolate->store_buffer()->RememberObject(raw_obj);
+  }
   return raw_obj;
 }
 
@@ -941,6 +950,7 @@ void Class::SetFunctions(const Array& value) const {
     func.set_owner(*this);
   }
   StorePointer(&raw_ptr()->functions_, value.raw());
+  StorePointer(&raw_ptr()->functions_hash_index_, Array::null());
 }
 
 
@@ -1203,6 +1213,7 @@ void Class::SetFields(const Array& value) const {
   }
   // The value of static fields is already initialized to null.
   StorePointer(&raw_ptr()->fields_, value.raw());
+  StorePointer(&raw_ptr()->fields_hash_index_, Array::null());
 }
 
 
@@ -1683,12 +1694,100 @@ static bool MatchesPrivateName(const String& name, const String& private_name) {
 }
 
 
+// The members of the larger classes are looked up in a hash index, an open
+// addressed table of the positions (as Smis) of the members in their array.
+// A member is entered under the hash of its name, and under the hash of each
+// prefix of its name ending before a private key separator, so that the
+// private names matching the looked up name are entered under its hash too.
+static const intptr_t kMinMembersForHashIndex = 16;
+
+
+static void EnterMemberHashIndex(const Array& index,
+                                 intptr_t hash,
+                                 intptr_t position) {
+  const intptr_t mask = index.Length() - 1;
+  intptr_t i = hash & mask;
+  while (index.At(i) != Object::null()) {
+    i = (i + 1) & mask;
+  }
+  index.SetAt(i, Smi::Handle(Smi::New(position)));
+}
+
+
+template<typename MemberType>
+static RawArray* NewMemberHashIndex(const Array& members) {
+  MemberType& member = MemberType::Handle();
+  String& member_name = String::Handle();
+  intptr_t num_keys = 0;
+  for (intptr_t i = 0; i < members.Length(); i++) {
+    member ^= members.At(i);
+    member_name = member.name();
+    num_keys++;
+    for (intptr_t j = 0; j < member_name.Length(); j++) {
+      if (member_name.CharAt(j) == Scanner::kPrivateKeySeparator) num_keys++;
+    }
+  }
+  // Keep the index at most half full.
+  intptr_t capacity = 1;
+  while (capacity < (2 * num_keys)) {
+    capacity *= 2;
+  }
+  const Array& index = Array::Handle(Array::New(capacity, Heap::kOld));
+  for (intptr_t i = 0; i < members.Length(); i++) {
+    member ^= members.At(i);
+    member_name = member.name();
+    EnterMemberHashIndex(index, member_name.Hash(), i);
+    for (intptr_t j = 0; j < member_name.Length(); j++) {
+      if (member_name.CharAt(j) == Scanner::kPrivateKeySeparator) {
+        EnterMemberHashIndex(index, String::Hash(member_name, 0, j), i);
+      }
+    }
+  }
+  return index.raw();
+}
+
+
+// Returns the first member of the array matching the name, as the linear
+// lookup does, or null.
+template<typename MemberType>
+static RawObject* LookupMemberHashIndex(const Array& index,
+                                        const Array& members,
+                                        const String& name) {
+  MemberType& member = MemberType::Handle();
+  String& member_name = String::Handle();
+  Smi& position = Smi::Handle();
+  intptr_t result = members.Length();
+  const intptr_t mask = index.Length() - 1;
+  for (intptr_t i = name.Hash() & mask;
+       index.At(i) != Object::null();
+       i = (i + 1) & mask) {
+    position ^= index.At(i);
+    if (position.Value() >= result) continue;
+    member ^= members.At(position.Value());
+    member_name = member.name();
+    if (member_name.Equals(name) || MatchesPrivateName(member_name, name)) {
+      result = position.Value();
+    }
+  }
+  return (result < members.Length()) ? members.At(result) : Object::null();
+}
+
+
 RawFunction* Class::LookupFunction(const String& name) const {
   Isolate* isolate = Isolate::Current();
   Array& funcs = Array::Handle(isolate, functions());
   Function& function = Function::Handle(isolate, Function::null());
   String& function_name = String::Handle(isolate, String::null());
   intptr_t len = funcs.Length();
+  if (len >= kMinMembersForHashIndex) {
+    Array& index = Array::Handle(isolate, raw_ptr()->functions_hash_index_);
+    if (index.IsNull()) {
+      index = NewMemberHashIndex<Function>(funcs);
+      StorePointer(&raw_ptr()->functions_hash_index_, index.raw());
+    }
+    function ^= LookupMemberHashIndex<Function>(index, funcs, name);
+    return function.raw();
+  }
   for (intptr_t i = 0; i < len; i++) {
     function ^= funcs.At(i);
     function_name ^= function.name();
@@ -1791,6 +1890,15 @@ RawField* Class::LookupField(const String& name) const {
   Field& field = Field::Handle(isolate, Field::null());
   String& field_name = String::Handle(isolate, String::null());
   intptr_t len = flds.Length();
+  if (len >= kMinMembersForHashIndex) {
+    Array& index = Array::Handle(isolate, raw_ptr()->fields_hash_index_);
+    if (index.IsNull()) {
+      index = NewMemberHashIndex<Field>(flds);
+      StorePointer(&raw_ptr()->fields_hash_index_, index.raw());
+    }
+    field ^= LookupMemberHashIndex<Field>(index, flds, name);
+    return field.raw();
+  }
   for (intptr_t i = 0; i < len; i++) {
     field ^= flds.At(i);
     field_name ^= field.name();
@@ -2912,7 +3020,7 @@ RawAbstractType* TypeArguments::TypeAt(intptr_t index) const {
 void TypeArguments::SetTypeAt(intptr_t index, const AbstractType& value) const {
   ASSERT(!IsCanonical());
   // TODO(iposva): Add storing NoGCScope.
-  *TypeAddr(index) = value.raw();
+  StorePointer(TypeAddr(index), value.raw());
 }
 
 
@@ -3335,6 +3443,11 @@ void Function::set_is_optimizable(bool value) const {
 }
 
 
+void Function::set_is_queued_for_optimization(bool value) const {
+  raw_ptr()->is_queued_for_optimization_ = value;
+}
+
+
 intptr_t Function::NumberOfParameters() const {
   return num_fixed_parameters() + num_optional_parameters();
 }
@@ -3593,6 +3706,7 @@ RawFunction* Function::New(const String& name,
   result.set_usage_counter(0);
   result.set_deoptimization_counter(0);
   result.set_is_optimizable(true);
+  result.set_is_queued_for_optimization(false);
   return result.raw();
 }
 
@@ -4954,9 +5068,10 @@ RawLibrary* Library::New() {
 RawLibrary* Library::NewLibraryHelper(const String& url,
                                       bool import_core_lib) {
   const Library& result = Library::Handle(Library::New());
-  result.raw_ptr()->name_ = url.raw();
-  result.raw_ptr()->url_ = url.raw();
-  result.raw_ptr()->private_key_ = Scanner::AllocatePrivateKey(result);
+  result.StorePointer(&result.raw_ptr()->name_, url.raw());
+  result.StorePointer(&result.raw_ptr()->url_, url.raw());
+  result.StorePointer(&result.raw_ptr()->private_key_,
+                      Scanner::AllocatePrivateKey(result));
   result.raw_ptr()->dictionary_ = Array::Empty();
   result.raw_ptr()->anonymous_classes_ = Array::Empty();
   result.raw_ptr()->num_anonymous_ = 0;
@@ -5689,7 +5804,7 @@ RawLocalVarDescriptors* LocalVarDescriptors::New(intptr_t num_variables) {
     result.raw_ptr()->length_ = num_variables;
   }
   const Array& names = Array::Handle(Array::New(num_variables, Heap::kOld));
-  result.raw_ptr()->names_ = names.raw();
+  result.StorePointer(&result.raw_ptr()->names_, names.raw());
   return result.raw();
 }
 
@@ -5777,15 +5892,23 @@ void Code::set_stackmaps(const Array& maps) const {
 }
 
 
-RawCode* Code::New(int pointer_offsets_length) {
+void Code::set_inlined_frames(const Array& value) const {
+  StorePointer(&raw_ptr()->inlined_frames_, value.raw());
+}
+
+
+RawCode* Code::New(int pointer_offsets_length,
+                   int immediate_offsets_length) {
   const Class& cls = Class::Handle(Object::code_class());
   Code& result = Code::Handle();
   {
-    uword size = Code::InstanceSize(pointer_offsets_length);
+    uword size = Code::InstanceSize(pointer_offsets_length,
+                                    immediate_offsets_length);
     RawObject* raw = Object::Allocate(cls, size, Heap::kOld);
     NoGCScope no_gc;
     result ^= raw;
     result.set_pointer_offsets_length(pointer_offsets_length);
+    result.set_immediate_offsets_length(immediate_offsets_length);
     result.set_is_optimized(false);
   }
   return result.raw();
@@ -5835,20 +5958,36 @@ RawCode* Code::FinalizeCode(const char* name, Assembler* assembler) {
 
   const ZoneGrowableArray<int>& pointer_offsets =
       assembler->GetPointerOffsets();
+  const ZoneGrowableArray<int>& immediate_offsets =
+      assembler->GetImmediateOffsets();
 
   // Allocate the code object.
-  Code& code = Code::ZoneHandle(Code::New(pointer_offsets.length()));
+  Code& code = Code::ZoneHandle(Code::New(pointer_offsets.length(),
+                                          immediate_offsets.length()));
   {
     NoGCScope no_gc;
 
+    for (int i = 0; i < immediate_offsets.length(); i++) {
+      code.SetImmediateEntryAt(i, immediate_offsets[i]);
+    }
+
     // Set pointer offsets list in Code object and resolve all handles in
     // the instruction stream to raw objects.
     ASSERT(code.pointer_offsets_length() == pointer_offsets.length());
+    bool has_new_pointers = false;
     for (int i = 0; i < pointer_offsets.length(); i++) {
       int offset_in_instrs = pointer_offsets[i];
       code.SetPointerOffsetAt(i, offset_in_instrs);
       const Object* object = region.Load<const Object*>(offset_in_instrs);
       region.Store<RawObject*>(offset_in_instrs, object->raw());
+      if (object->raw()->IsHeapObject() && object->raw()->IsNewObject()) {
+        has_new_pointers = true;
+      }
+    }
+    // The embedded pointers are visited through the code object, which needs
+    // to be remembered if any of them refer to new space.
+    if (has_new_pointers) {
+      Isolate::Current()->store_buffer()->RememberObject(code.raw());
     }
 
     // Hook up Code and Instruction objects.
@@ -5872,6 +6011,48 @@ intptr_t Code::GetTokenIndexOfPC(uword pc) const {
 }
 
 
+void Code::GetInlinedFramesAtPC(uword pc,
+                                const GrowableObjectArray& functions,
+                                GrowableArray<intptr_t>* token_indices) const {
+  ASSERT(!functions.IsNull());
+  ASSERT(token_indices != NULL);
+  intptr_t token_index = GetTokenIndexOfPC(pc);
+  const Array& inlined_frames = Array::Handle(this->inlined_frames());
+  if (!inlined_frames.IsNull()) {
+    Array& inlined_functions = Array::Handle();
+    inlined_functions ^= inlined_frames.At(kInlinedFunctionsIndex);
+    Array& pc_offsets = Array::Handle();
+    pc_offsets ^= inlined_frames.At(kInlinedPcOffsetsIndex);
+    const intptr_t pc_offset = pc - EntryPoint();
+    intptr_t index = -1;
+    Smi& value = Smi::Handle();
+    for (intptr_t i = 0; i < pc_offsets.Length(); i += 2) {
+      value ^= pc_offsets.At(i);
+      if (value.Value() == pc_offset) {
+        value ^= pc_offsets.At(i + 1);
+        index = value.Value();
+        break;
+      }
+    }
+    // Walk out from the innermost inlined function, which is at the token
+    // of the pc, to the optimized function, which is at the token of the
+    // outermost inlined call.
+    Function& inlined_function = Function::Handle();
+    while (index >= 0) {
+      inlined_function ^= inlined_functions.At(3 * index);
+      functions.Add(inlined_function);
+      token_indices->Add(token_index);
+      value ^= inlined_functions.At((3 * index) + 2);
+      token_index = value.Value();
+      value ^= inlined_functions.At((3 * index) + 1);
+      index = value.Value();
+    }
+  }
+  functions.Add(Function::Handle(function()));
+  token_indices->Add(token_index);
+}
+
+
 uword Code::GetDeoptPcAtNodeId(intptr_t node_id) const {
   const PcDescriptors& descriptors = PcDescriptors::Handle(pc_descriptors());
   for (intptr_t i = 0; i < descriptors.Length(); i++) {
@@ -5989,7 +6170,7 @@ RawString* ContextScope::NameAt(intptr_t scope_index) const {
 
 
 void ContextScope::SetNameAt(intptr_t scope_index, const String& name) const {
-  VariableDescAddr(scope_index)->name = name.raw();
+  StorePointer(&(VariableDescAddr(scope_index)->name), name.raw());
 }
 
 
@@ -6010,7 +6191,7 @@ RawAbstractType* ContextScope::TypeAt(intptr_t scope_index) const {
 
 void ContextScope::SetTypeAt(
     intptr_t scope_index, const AbstractType& type) const {
-  VariableDescAddr(scope_index)->type = type.raw();
+  StorePointer(&(VariableDescAddr(scope_index)->type), type.raw());
 }
 
 
@@ -6053,12 +6234,12 @@ const char* ICData::ToCString() const {
 
 
 void ICData::set_function(const Function& value) const {
-  raw_ptr()->function_ = value.raw();
+  StorePointer(&raw_ptr()->function_, value.raw());
 }
 
 
 void ICData::set_target_name(const String& value) const {
-  raw_ptr()->target_name_ = value.raw();
+  StorePointer(&raw_ptr()->target_name_, value.raw());
 }
 
 
@@ -6073,7 +6254,12 @@ void ICData::set_num_args_tested(intptr_t value) const {
 
 
 void ICData::set_ic_data(const Array& value) const {
-  raw_ptr()->ic_data_ = value.raw();
+  StorePointer(&raw_ptr()->ic_data_, value.raw());
+}
+
+
+void ICData::set_megamorphic_cache(const Array& value) const {
+  StorePointer(&raw_ptr()->megamorphic_cache_, value.raw());
 }
 
 
@@ -8448,10 +8634,12 @@ RawArray* Array::MakeArray(const GrowableObjectArray& growable_array) {
   intptr_t used_size = Array::InstanceSize(used_len);
   NoGCScope no_gc;
 
-  // Update the size in the header field and length of the array object.
-  uword tags = 0;
+  // Update the size in the header field and length of the array object. The
+  // other header bits of the array are kept.
+  uword tags = array.raw_ptr()->tags_;
   tags = RawObject::SizeTag::update(used_size, tags);
   array.raw_ptr()->tags_ = tags;
+  tags = 0;
   array.SetLength(used_len);
 
   // Null the GrowableObjectArray, we are removing it's backing array.
@@ -8763,12 +8951,12 @@ RawClosure* Closure::New(const Function& function,
 
 
 void Closure::set_context(const Context& value) const {
-  raw_ptr()->context_ = value.raw();
+  StorePointer(&raw_ptr()->context_, value.raw());
 }
 
 
 void Closure::set_function(const Function& value) const {
-  raw_ptr()->function_ = value.raw();
+  StorePointer(&raw_ptr()->function_, value.raw());
 }
 
 
@@ -8901,41 +9089,50 @@ const char* Stacktrace::ToCStringInternal(bool verbose) const {
       " %d. Function: '%s%s%s' url: '%s' line:%d col:%d code-entry: 0x%x\n" :
       " %d. Function: '%s%s%s' url: '%s' line:%d col:%d\n";
   GrowableArray<char*> frame_strings;
+  GrowableObjectArray& functions = GrowableObjectArray::Handle();
+  GrowableArray<intptr_t> token_indices;
   for (intptr_t i = 0; i < Length(); i++) {
-    function = FunctionAtFrame(i);
     code = CodeAtFrame(i);
     uword pc = code.EntryPoint() + Smi::Value(PcOffsetAtFrame(i));
-    intptr_t token_index = code.GetTokenIndexOfPC(pc);
-    function_class = function.owner();
-    script = function_class.script();
-    function_name = function.name();
-    class_name = function_class.Name();
-    url = script.url();
-    intptr_t line = -1;
-    intptr_t column = -1;
-    if (token_index >= 0) {
-      script.GetTokenLocation(token_index, &line, &column);
-    }
-    intptr_t len = OS::SNPrint(NULL, 0, kFormat,
-                               i,
-                               class_name.ToCString(),
-                               function_class.IsTopLevel() ? "" : ".",
-                               function_name.ToCString(),
-                               url.ToCString(),
-                               line, column,
-                               code.EntryPoint());
-    total_len += len;
-    char* chars = reinterpret_cast<char*>(
-        Isolate::Current()->current_zone()->Allocate(len + 1));
-    OS::SNPrint(chars, (len + 1), kFormat,
-                i,
-                class_name.ToCString(),
-                function_class.IsTopLevel() ? "" : ".",
-                function_name.ToCString(),
-                url.ToCString(),
-                line, column,
-                code.EntryPoint());
-    frame_strings.Add(chars);
+    // The frame of optimized code also stands for the functions inlined at
+    // the pc, whose frames are rebuilt in front of it.
+    functions = GrowableObjectArray::New();
+    token_indices.Clear();
+    code.GetInlinedFramesAtPC(pc, functions, &token_indices);
+    for (intptr_t j = 0; j < functions.Length(); j++) {
+      function ^= functions.At(j);
+      intptr_t token_index = token_indices[j];
+      function_class = function.owner();
+      script = function_class.script();
+      function_name = function.name();
+      class_name = function_class.Name();
+      url = script.url();
+      intptr_t line = -1;
+      intptr_t column = -1;
+      if (token_index >= 0) {
+        script.GetTokenLocation(token_index, &line, &column);
+      }
+      intptr_t len = OS::SNPrint(NULL, 0, kFormat,
+                                 frame_strings.length(),
+                                 class_name.ToCString(),
+                                 function_class.IsTopLevel() ? "" : ".",
+                                 function_name.ToCString(),
+                                 url.ToCString(),
+                                 line, column,
+                                 code.EntryPoint());
+      total_len += len;
+      char* chars = reinterpret_cast<char*>(
+          Isolate::Current()->current_zone()->Allocate(len + 1));
+      OS::SNPrint(chars, (len + 1), kFormat,
+                  frame_strings.length(),
+                  class_name.ToCString(),
+                  function_class.IsTopLevel() ? "" : ".",
+                  function_name.ToCString(),
+                  url.ToCString(),
+                  line, column,
+                  code.EntryPoint());
+      frame_strings.Add(chars);
+    }
   }
 
   // Now concatentate the frame descriptions into a single C string.
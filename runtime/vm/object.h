@@ -350,12 +350,22 @@ CLASS_LIST_NO_OBJECT(DEFINE_CLASS_TESTER);
   }
 
   template<typename type> void StorePointer(type* addr, type value) const {
-    // TODO(iposva): Implement real store barrier here.
+    // Shade the overwritten value while old space is marked incrementally.
+    if (PageSpace::IsAnySpaceMarking() && raw()->IsOldObject()) {
+      Isolate::Current()->heap()->ShadeOverwrittenValue(*addr);
+    }
     *addr = value;
     // Filter stores based on source and target.
-    if (value->IsNewObject() && raw()->IsOldObject()) {
-      uword ptr = reinterpret_cast<uword>(addr);
-      Isolate::Current()->store_buffer()->AddPointer(ptr);
+    if (value->IsHeapObject() && value->IsNewObject() &&
+        raw()->IsOldObject()) {
+      HeapPage* page = PageSpace::PageFor(raw());
+      if (page->card_table() != NULL) {
+        page->DirtyCard(reinterpret_cast<uword>(addr));
+      }
+      if (!raw()->IsRemembered()) {
+        raw()->SetRememberedBit();
+        Isolate::Current()->store_buffer()->AddObject(raw());
+      }
     }
   }
 
@@ -559,6 +569,8 @@ class Class : public Object {
     return OFFSET_OF(RawClass, functions_cache_);
   }
 
+  static intptr_t name_offset() { return OFFSET_OF(RawClass, name_); }
+
   // Check if this class represents the class of null.
   bool IsNullClass() const { return raw() == Object::null_class(); }
 
@@ -1398,6 +1410,12 @@ class Function : public Object {
   }
   void set_is_optimizable(bool value) const;
 
+  // Whether the function waits in the queue of the deferred optimizer.
+  bool is_queued_for_optimization() const {
+    return raw_ptr()->is_queued_for_optimization_;
+  }
+  void set_is_queued_for_optimization(bool value) const;
+
   bool HasOptimizedCode() const;
 
   intptr_t NumberOfParameters() const;
@@ -2044,6 +2062,8 @@ class PcDescriptors : public Object {
 
   HEAP_OBJECT_IMPLEMENTATION(PcDescriptors, Object);
   friend class Class;
+  friend class Code;  // Rebases the pcs of code read from a snapshot.
+  friend class RawPcDescriptors;  // Writes the entries to a snapshot.
 };
 
 
@@ -2144,6 +2164,8 @@ class ExceptionHandlers : public Object {
 
   HEAP_OBJECT_IMPLEMENTATION(ExceptionHandlers, Object);
   friend class Class;
+  friend class Code;  // Rebases the pcs of code read from a snapshot.
+  friend class RawExceptionHandlers;  // Writes the entries to a snapshot.
 };
 
 
@@ -2156,6 +2178,9 @@ class Code : public Object {
   intptr_t pointer_offsets_length() const {
     return raw_ptr()->pointer_offsets_length_;
   }
+  intptr_t immediate_offsets_length() const {
+    return raw_ptr()->immediate_offsets_length_;
+  }
   bool is_optimized() const {
     return (raw_ptr()->is_optimized_ == 1);
   }
@@ -2190,6 +2215,21 @@ class Code : public Object {
     StorePointer(&raw_ptr()->var_descriptors_, value.raw());
   }
 
+  // The functions inlined into optimized code, null if there are none: the
+  // array of the inlined functions, each followed by the index of the
+  // inlined function it is inlined in (or -1) and the token index of the
+  // call, and the array of the pc offsets of the calls in inlined code, each
+  // followed by the index of its inlined function.
+  enum {
+    kInlinedFunctionsIndex = 0,
+    kInlinedPcOffsetsIndex,
+    kInlinedFramesLength
+  };
+  RawArray* inlined_frames() const {
+    return raw_ptr()->inlined_frames_;
+  }
+  void set_inlined_frames(const Array& value) const;
+
   RawExceptionHandlers* exception_handlers() const {
     return raw_ptr()->exception_handlers_;
   }
@@ -2211,17 +2251,37 @@ class Code : public Object {
     ASSERT(sizeof(RawCode) == OFFSET_OF(RawCode, data_));
     return 0;
   }
-  static intptr_t InstanceSize(intptr_t pointer_offsets_length) {
+  static intptr_t InstanceSize(intptr_t pointer_offsets_length,
+                               intptr_t immediate_offsets_length) {
     return RoundedAllocationSize(
-        sizeof(RawCode) + (pointer_offsets_length * kEntrySize));
+        sizeof(RawCode) +
+        ((pointer_offsets_length + immediate_offsets_length) * kEntrySize));
   }
   static RawCode* FinalizeCode(const char* name, Assembler* assembler);
 
   int32_t GetPointerOffsetAt(int index) const {
     return *PointerOffsetAddrAt(index);
   }
+
+  // The 64-bit immediates in the instructions which may hold absolute
+  // addresses (stub entries, runtime entries, isolate fields). They are
+  // relocated when code is loaded from a snapshot.
+  int32_t GetImmediateOffsetAt(int index) const {
+    return *ImmediateOffsetAddrAt(index) >> 1;
+  }
+  // Whether the immediate is the target of a call or a jump.
+  bool IsCallTargetImmediateAt(int index) const {
+    return (*ImmediateOffsetAddrAt(index) & 1) != 0;
+  }
   intptr_t GetTokenIndexOfPC(uword pc) const;
 
+  // Add the functions whose frames are active at the return address 'pc',
+  // innermost first, and the token index each of them is at: the functions
+  // inlined at the pc, if any, and the function of the code.
+  void GetInlinedFramesAtPC(uword pc,
+                            const GrowableObjectArray& functions,
+                            GrowableArray<intptr_t>* token_indices) const;
+
   // Find pc of patch code buffer. Return 0 if not found.
   uword GetPatchCodePc() const;
 
@@ -2255,12 +2315,27 @@ class Code : public Object {
   void SetPointerOffsetAt(int index, int32_t offset_in_instructions) {
     *PointerOffsetAddrAt(index) = offset_in_instructions;
   }
+  void set_immediate_offsets_length(intptr_t value) {
+    ASSERT(value >= 0);
+    raw_ptr()->immediate_offsets_length_ = value;
+  }
+  int32_t* ImmediateOffsetAddrAt(int index) const {
+    ASSERT(index >= 0);
+    ASSERT(index < immediate_offsets_length());
+    return &raw_ptr()->data_[pointer_offsets_length() + index];
+  }
+  // The entry is the offset shifted left by one, tagged with whether the
+  // immediate is a call target.
+  void SetImmediateEntryAt(int index, int32_t entry) {
+    *ImmediateOffsetAddrAt(index) = entry;
+  }
 
   // New is a private method as RawInstruction and RawCode objects should
   // only be created using the Code::FinalizeCode method. This method creates
   // the RawInstruction and RawCode objects, sets up the pointer offsets
   // and links the two in a GC safe manner.
-  static RawCode* New(int pointer_offsets_length);
+  static RawCode* New(int pointer_offsets_length,
+                      int immediate_offsets_length);
 
   HEAP_OBJECT_IMPLEMENTATION(Code, Object);
   friend class Class;
@@ -2428,6 +2503,21 @@ class ICData : public Object {
     return OFFSET_OF(RawICData, function_);
   }
 
+  // The cache of the selector shared by the megamorphic calls, see class
+  // MegamorphicCache.  Calls switch to it when they have seen too many
+  // receiver classes, and do not add checks anymore.
+  RawArray* megamorphic_cache() const {
+    return raw_ptr()->megamorphic_cache_;
+  }
+  void set_megamorphic_cache(const Array& value) const;
+  bool IsMegamorphic() const {
+    return megamorphic_cache() != Object::null();
+  }
+
+  static intptr_t megamorphic_cache_offset() {
+    return OFFSET_OF(RawICData, megamorphic_cache_);
+  }
+
   void AddCheck(const GrowableArray<const Class*>& classes,
                 const Function& target) const;
   void GetCheckAt(intptr_t index,
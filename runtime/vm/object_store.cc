@@ -58,6 +58,8 @@ ObjectStore::ObjectStore()
     empty_context_(Context::null()),
     stack_overflow_(Instance::null()),
     out_of_memory_(Instance::null()),
+    megamorphic_cache_table_(GrowableObjectArray::null()),
+    selector_implementations_(Array::null()),
     keyword_symbols_(Array::null()) {
 }
 
@@ -333,6 +333,20 @@ class ObjectStore {
     out_of_memory_ = value.raw();
   }
 
+  RawGrowableObjectArray* megamorphic_cache_table() const {
+    return megamorphic_cache_table_;
+  }
+  void set_megamorphic_cache_table(const GrowableObjectArray& value) {
+    megamorphic_cache_table_ = value.raw();
+  }
+
+  RawArray* selector_implementations() const {
+    return selector_implementations_;
+  }
+  void set_selector_implementations(const Array& value) {
+    selector_implementations_ = value.raw();
+  }
+
   RawArray* keyword_symbols() const { return keyword_symbols_; }
   void set_keyword_symbols(const Array& value) {
     keyword_symbols_ = value.raw();
@@ -407,6 +421,8 @@ class ObjectStore {
   RawContext* empty_context_;
   RawInstance* stack_overflow_;
   RawInstance* out_of_memory_;
+  RawGrowableObjectArray* megamorphic_cache_table_;
+  RawArray* selector_implementations_;
   RawArray* keyword_symbols_;
   RawObject** to() { return reinterpret_cast<RawObject**>(&keyword_symbols_); }
 
@@ -112,6 +112,63 @@ TEST_CASE(Class) {
 }
 
 
+TEST_CASE(ClassMemberHashIndex) {
+  const String& class_name = String::Handle(String::NewSymbol("MyClass"));
+  const Script& script = Script::Handle();
+  const Class& cls = Class::Handle(
+      Class::New(class_name, script, Scanner::kDummyTokenIndex));
+
+  // Enough members for the lookups to use the hash index, with private
+  // names mangled as by the parser.
+  const intptr_t kNumMembers = 40;
+  const Array& functions = Array::Handle(Array::New(kNumMembers));
+  const Array& fields = Array::Handle(Array::New(kNumMembers));
+  Function& function = Function::Handle();
+  Field& field = Field::Handle();
+  String& name = String::Handle();
+  char buffer[32];
+  for (intptr_t i = 0; i < kNumMembers; i++) {
+    const char* format = ((i % 2) == 0) ? "m%d" : "_m%d@1234";
+    OS::SNPrint(buffer, sizeof(buffer), format, static_cast<int>(i));
+    name = String::NewSymbol(buffer);
+    function = Function::New(name, RawFunction::kFunction, false, false, 0);
+    functions.SetAt(i, function);
+    field = Field::New(name, false, false, 0);
+    fields.SetAt(i, field);
+  }
+  cls.SetFunctions(functions);
+  cls.SetFields(fields);
+
+  for (intptr_t i = 0; i < kNumMembers; i++) {
+    const char* format = ((i % 2) == 0) ? "m%d" : "_m%d";
+    OS::SNPrint(buffer, sizeof(buffer), format, static_cast<int>(i));
+    name = String::New(buffer);
+    function = cls.LookupFunction(name);
+    EXPECT_EQ(functions.At(i), function.raw());
+    field = cls.LookupField(name);
+    EXPECT_EQ(fields.At(i), field.raw());
+  }
+  name = String::New("_m1@1234");
+  EXPECT_EQ(functions.At(1), cls.LookupFunction(name));
+  name = String::New("_m1@");
+  EXPECT(cls.LookupFunction(name) == Function::null());
+  name = String::New("m1");
+  EXPECT(cls.LookupFunction(name) == Function::null());
+  EXPECT(cls.LookupField(name) == Field::null());
+
+  // Setting the members again drops the index.
+  const Array& more_functions = Array::Handle(Array::New(kNumMembers + 1));
+  for (intptr_t i = 0; i < kNumMembers; i++) {
+    more_functions.SetAt(i, Object::Handle(functions.At(i)));
+  }
+  name = String::NewSymbol("m1");
+  function = Function::New(name, RawFunction::kFunction, false, false, 0);
+  more_functions.SetAt(kNumMembers, function);
+  cls.SetFunctions(more_functions);
+  EXPECT_EQ(function.raw(), cls.LookupFunction(name));
+}
+
+
 TEST_CASE(TypeArguments) {
   const Type& type1 = Type::Handle(Type::DoubleInterface());
   const Type& type2 = Type::Handle(Type::StringInterface());
@@ -11,7 +11,7 @@
 #if defined(TARGET_ARCH_IA32)
 #include "vm/opt_code_generator_ia32.h"
 #elif defined(TARGET_ARCH_X64)
-#include "vm/opt_code_generator_x64.h"
+// The flow graph compiler generates the optimized code on x64.
 #elif defined(TARGET_ARCH_ARM)
 #include "vm/opt_code_generator_arm.h"
 #else
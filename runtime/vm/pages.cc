@@ -5,13 +5,39 @@
 #include "vm/pages.h"
 
 #include "platform/assert.h"
+#include "vm/atomic.h"
+#include "vm/flags.h"
+#include "vm/gc_compactor.h"
 #include "vm/gc_marker.h"
 #include "vm/gc_sweeper.h"
+#include "vm/gc_tracer.h"
+#include "vm/heap.h"
 #include "vm/object.h"
 #include "vm/virtual_memory.h"
 
 namespace dart {
 
+DEFINE_FLAG(bool, lazy_sweep, true,
+            "Sweep old space pages on demand during allocation instead of "
+            "during the MarkSweep pause.");
+DEFINE_FLAG(int, compaction_threshold, 50,
+            "Compact old space instead of sweeping it when more than this "
+            "percentage of its pages is free, 100 disables compaction.");
+DEFINE_FLAG(bool, incremental_marking, false,
+            "Mark old space incrementally in steps interleaved with the "
+            "allocation in old space.");
+DEFINE_FLAG(int, incremental_marking_start, 50,
+            "Start incremental marking once old space uses this percentage of "
+            "its maximum size.");
+DEFINE_FLAG(int, marking_step_factor, 4,
+            "Bytes of objects scanned per byte allocated in old space during "
+            "incremental marking.");
+
+// Amount of memory allocated in old space between incremental marking steps.
+static const intptr_t kMarkingStepSize = 64 * KB;
+
+intptr_t PageSpace::num_marking_spaces_ = 0;
+
 HeapPage* HeapPage::Initialize(VirtualMemory* memory, bool is_executable) {
   ASSERT(memory->size() > VirtualMemory::PageSize());
   memory->Commit(is_executable);
@@ -21,6 +47,8 @@ HeapPage* HeapPage::Initialize(VirtualMemory* memory, bool is_executable) {
   result->next_ = NULL;
   result->used_ = 0;
   result->top_ = result->first_object_start();
+  result->card_table_ = NULL;
+  result->forwarding_page_ = NULL;
   return result;
 }
 
@@ -33,11 +61,38 @@ HeapPage* HeapPage::Allocate(intptr_t size, bool is_executable) {
 
 
 void HeapPage::Deallocate() {
+  delete[] card_table_;
   // The memory for this object will become unavailable after the delete below.
   delete memory_;
 }
 
 
+void HeapPage::AllocateCardTable() {
+  ASSERT(card_table_ == NULL);
+  intptr_t num_cards = NumCards();
+  card_table_ = new uint8_t[num_cards];
+  memset(card_table_, 0, num_cards);
+}
+
+
+void HeapPage::DirtyAllCards() {
+  ASSERT(card_table_ != NULL);
+  memset(card_table_, 1, NumCards());
+}
+
+
+void HeapPage::VisitObjects(ObjectVisitor* visitor) const {
+  uword obj_addr = first_object_start();
+  uword end_addr = top();
+  while (obj_addr < end_addr) {
+    RawObject* raw_obj = RawObject::FromAddr(obj_addr);
+    visitor->VisitObject(raw_obj);
+    obj_addr += raw_obj->Size();
+  }
+  ASSERT(obj_addr == end_addr);
+}
+
+
 void HeapPage::VisitObjectPointers(ObjectPointerVisitor* visitor) const {
   uword obj_addr = first_object_start();
   uword end_addr = top();
@@ -49,28 +104,69 @@ void HeapPage::VisitObjectPointers(ObjectPointerVisitor* visitor) const {
 }
 
 
+void HeapPage::VisitMarkedObjects(ObjectVisitor* visitor) const {
+  uword obj_addr = first_object_start();
+  uword end_addr = top();
+  while (obj_addr < end_addr) {
+    RawObject* raw_obj = RawObject::FromAddr(obj_addr);
+    if (raw_obj->IsMarked()) {
+      visitor->VisitObject(raw_obj);
+    }
+    obj_addr += raw_obj->Size();
+  }
+  ASSERT(obj_addr == end_addr);
+}
+
+
+void HeapPage::VisitMarkedObjectPointers(ObjectPointerVisitor* visitor) const {
+  uword obj_addr = first_object_start();
+  uword end_addr = top();
+  while (obj_addr < end_addr) {
+    RawObject* raw_obj = RawObject::FromAddr(obj_addr);
+    if (raw_obj->IsMarked()) {
+      obj_addr += raw_obj->VisitPointers(visitor);
+    } else {
+      obj_addr += raw_obj->Size();
+    }
+  }
+  ASSERT(obj_addr == end_addr);
+}
+
+
 PageSpace::PageSpace(Heap* heap, intptr_t max_capacity, bool is_executable)
     : freelist_(),
       heap_(heap),
       pages_(NULL),
       pages_tail_(NULL),
       large_pages_(NULL),
+      unswept_pages_(NULL),
+      allocation_top_(0),
+      allocation_end_(0),
       max_capacity_(max_capacity),
       capacity_(0),
       in_use_(0),
       count_(0),
       is_executable_(is_executable),
-      sweeping_(false) { }
+      sweeping_(false),
+      incremental_marker_(NULL),
+      next_marking_step_(kIntptrMax) {
+  SetMarkingStartThreshold();
+}
 
 
 PageSpace::~PageSpace() {
+  if (IsMarking()) {
+    delete incremental_marker_;
+    AtomicOperations::FetchAndIncrementBy(&num_marking_spaces_, -1);
+  }
   FreePages(pages_);
   FreePages(large_pages_);
+  FreePages(unswept_pages_);
 }
 
 
 intptr_t PageSpace::LargePageSizeFor(intptr_t size) {
-  intptr_t page_size = Utils::RoundUp(size + sizeof(HeapPage),
+  intptr_t page_size = Utils::RoundUp(size + HeapPage::ObjectStartOffset(),
                                       VirtualMemory::PageSize());
   return page_size;
 }
@@ -91,6 +187,9 @@ void PageSpace::AllocatePage() {
 HeapPage* PageSpace::AllocateLargePage(intptr_t size) {
   intptr_t page_size = LargePageSizeFor(size);
   HeapPage* page = HeapPage::Allocate(page_size, is_executable_);
+  if (!is_executable_) {
+    page->AllocateCardTable();
+  }
   page->set_next(large_pages_);
   large_pages_ = page;
   capacity_ += page_size;
@@ -120,34 +219,55 @@ void PageSpace::FreePages(HeapPage* pages) {
 }
 
 
-uword PageSpace::TryBumpAllocate(intptr_t size) {
-  HeapPage* page = pages_tail_;
-  if (page == NULL) {
-    return 0;
+void PageSpace::SetAllocationBuffer(uword start, uword end) {
+  if (allocation_top_ < allocation_end_) {
+    freelist_.Free(allocation_top_, allocation_end_ - allocation_top_);
   }
-  uword result = page->top();
-  intptr_t remaining_space = page->end() - result;
-  if (remaining_space < size) {
-    return 0;
+  allocation_top_ = start;
+  allocation_end_ = end;
+  if (start < end) {
+    FreeListElement::AsElement(start, end - start);
   }
-  page->set_top(result + size);
-  return result;
 }
 
 
-uword PageSpace::TryAllocate(intptr_t size) {
-  ASSERT(size >= kObjectAlignment);
-  ASSERT(Utils::IsAligned(size, kObjectAlignment));
+void PageSpace::SetAllocationBufferToPage(HeapPage* page) {
+  // The rest of the page is covered by the buffer.
+  uword top = page->top();
+  page->set_top(page->end());
+  SetAllocationBuffer(top, page->end());
+}
+
+
+bool PageSpace::TryRefillAllocationBuffer(intptr_t size) {
+  intptr_t chunk_size = 0;
+  uword chunk = freelist_.TryAllocateChunk(size, &chunk_size);
+  if (chunk == 0) {
+    return false;
+  }
+  SetAllocationBuffer(chunk, chunk + chunk_size);
+  return true;
+}
+
+
+uword PageSpace::TryAllocateSlow(intptr_t size) {
   uword result = 0;
   if (size < kAllocatablePageSize) {
-    result = TryBumpAllocate(size);
-    if (result == 0) {
-      result = freelist_.TryAllocate(size);
-      if ((result == 0) && CanIncreaseCapacity(kPageSize)) {
-        AllocatePage();
-        result = TryBumpAllocate(size);
+    // Prefer a large freelist element as the next allocation buffer over
+    // allocating the object on its own from the freelist.
+    do {
+      if (TryRefillAllocationBuffer(size)) {
+        result = TryAllocateInBuffer(size);
         ASSERT(result != 0);
+      } else {
+        result = freelist_.TryAllocate(size);
       }
+    } while ((result == 0) && SweepNextPage());
+    if ((result == 0) && CanIncreaseCapacity(kPageSize)) {
+      AllocatePage();
+      SetAllocationBufferToPage(pages_tail_);
+      result = TryAllocateInBuffer(size);
+      ASSERT(result != 0);
     }
   } else {
     // Large page allocation.
@@ -187,10 +307,38 @@ bool PageSpace::Contains(uword addr) const {
     }
     page = page->next();
   }
+
+  page = unswept_pages_;
+  while (page != NULL) {
+    if (page->Contains(addr)) {
+      return true;
+    }
+    page = page->next();
+  }
   return false;
 }
 
 
+void PageSpace::VisitObjects(ObjectVisitor* visitor) const {
+  HeapPage* page = pages_;
+  while (page != NULL) {
+    page->VisitObjects(visitor);
+    page = page->next();
+  }
+
+  page = large_pages_;
+  while (page != NULL) {
+    page->VisitObjects(visitor);
+    page = page->next();
+  }
+  page = unswept_pages_;
+  while (page != NULL) {
+    page->VisitMarkedObjects(visitor);
+    page = page->next();
+  }
+}
+
+
 void PageSpace::VisitObjectPointers(ObjectPointerVisitor* visitor) const {
   HeapPage* page = pages_;
   while (page != NULL) {
@@ -203,10 +351,112 @@ void PageSpace::VisitObjectPointers(ObjectPointerVisitor* visitor) const {
     page->VisitObjectPointers(visitor);
     page = page->next();
   }
+  page = unswept_pages_;
+  while (page != NULL) {
+    page->VisitMarkedObjectPointers(visitor);
+    page = page->next();
+  }
+}
+
+
+bool PageSpace::SweepNextPage() {
+  HeapPage* page = unswept_pages_;
+  if (page == NULL) {
+    return false;
+  }
+  unswept_pages_ = page->next();
+  GCSweeper sweeper(heap_);
+  sweeper.SweepPage(page, &freelist_);
+  // Keep the bump allocation page at the tail of the page list.
+  ASSERT(pages_tail_ != NULL);
+  page->set_next(pages_);
+  pages_ = page;
+  return true;
+}
+
+
+void PageSpace::FinishSweeping() {
+  while (SweepNextPage()) {
+  }
+}
+
+
+bool PageSpace::ShouldCompact() const {
+  if (is_executable_ || (FLAG_compaction_threshold >= 100)) {
+    // Code is never moved.
+    return false;
+  }
+  // The marker accounted for the live objects on each page.
+  intptr_t used = 0;
+  intptr_t capacity = 0;
+  for (HeapPage* page = pages_; page != NULL; page = page->next()) {
+    used += page->used();
+    capacity += page->end() - page->first_object_start();
+  }
+  if (capacity == 0) {
+    return false;
+  }
+  intptr_t free_percentage = 100 - ((used * 100) / capacity);
+  return free_percentage > FLAG_compaction_threshold;
+}
+
+
+void PageSpace::SetMarkingStartThreshold() {
+  if (!FLAG_incremental_marking || is_executable_) {
+    next_marking_step_ = kIntptrMax;
+    return;
+  }
+  // Allocate at least one marking step worth of memory before the next
+  // incremental marking starts.
+  intptr_t threshold = (max_capacity_ / 100) * FLAG_incremental_marking_start;
+  next_marking_step_ = Utils::Maximum(threshold, in_use_ + kMarkingStepSize);
+}
+
+
+void PageSpace::StartIncrementalMarking() {
+  ASSERT(!IsMarking());
+  ASSERT(!is_executable_);
+  if (FLAG_verbose_gc) {
+    OS::PrintErr("Start incremental marking[%d]: %dK\n",
+                 count_, (in_use_ + (KB / 2)) / KB);
+  }
+  // The mark bits left behind on pages which were not swept lazily yet have to
+  // be cleared before marking.
+  FinishSweeping();
+  incremental_marker_ = new IncrementalMarker(heap_, this);
+  AtomicOperations::FetchAndIncrementBy(&num_marking_spaces_, 1);
+  incremental_marker_->Start(Isolate::Current());
+  next_marking_step_ = in_use_ + kMarkingStepSize;
+}
+
+
+bool PageSpace::IncrementalMarkingStep(intptr_t work) {
+  ASSERT(IsMarking());
+  next_marking_step_ = in_use_ + kMarkingStepSize;
+  return incremental_marker_->Step(work);
+}
+
+
+void PageSpace::TakeIncrementalMarkingStep() {
+  if (!IsMarking()) {
+    StartIncrementalMarking();
+    return;
+  }
+  intptr_t allocated = in_use_ - (next_marking_step_ - kMarkingStepSize);
+  if (IncrementalMarkingStep(allocated * FLAG_marking_step_factor)) {
+    MarkSweep(true, kGcIncrementalMarkingDone);
+  }
+}
+
+
+void PageSpace::ShadeOverwrittenValue(RawObject* raw_obj) {
+  if (IsMarking()) {
+    incremental_marker_->Shade(raw_obj);
+  }
 }
 
 
-void PageSpace::MarkSweep(bool invoke_api_callbacks) {
+void PageSpace::MarkSweep(bool invoke_api_callbacks, Dart_GcReason reason) {
   // MarkSweep is not reentrant. Make sure that is the case.
   ASSERT(!sweeping_);
   sweeping_ = true;
@@ -221,24 +471,41 @@ void PageSpace::MarkSweep(bool invoke_api_callbacks) {
 
   Timer timer(FLAG_verbose_gc, "MarkSweep");
   timer.Start();
+  GCTracer* tracer = heap_->tracer();
+  tracer->StartEvent(reason);
+
+  // The rest of the allocation buffer is formatted as a freelist element and
+  // reclaimed like any other free memory.
+  allocation_top_ = 0;
+  allocation_end_ = 0;
 
   // Mark all reachable old-gen objects.
   GCMarker marker(heap_);
-  marker.MarkObjects(isolate, this, invoke_api_callbacks);
+  bool incremental = IsMarking();
+  if (incremental) {
+    // Only the final pause of the incremental marking is left.
+    marker.FinishMarking(isolate, this, incremental_marker_,
+                         invoke_api_callbacks);
+    delete incremental_marker_;
+    incremental_marker_ = NULL;
+    AtomicOperations::FetchAndIncrementBy(&num_marking_spaces_, -1);
+  } else {
+    // The mark bits left behind on pages which were not swept lazily yet have
+    // to be cleared before marking.
+    FinishSweeping();
+    marker.MarkObjects(isolate, this, invoke_api_callbacks);
+  }
 
   // Reset the freelists and setup sweeping.
+  int64_t sweep_start = OS::GetCurrentTimeMicros();
   freelist_.Reset();
   GCSweeper sweeper(heap_);
   intptr_t in_use = 0;
 
-  HeapPage* page = pages_;
-  while (page != NULL) {
-    in_use += sweeper.SweepPage(page, &freelist_);
-    page = page->next();
-  }
-
+  // The dead large objects are released first, so that the live objects only
+  // refer to live objects in case the remaining pages are compacted.
   HeapPage* prev_page = NULL;
-  page = large_pages_;
+  HeapPage* page = large_pages_;
   while (page != NULL) {
     intptr_t page_in_use = sweeper.SweepLargePage(page);
     HeapPage* next_page = page->next();
@@ -252,19 +519,61 @@ void PageSpace::MarkSweep(bool invoke_api_callbacks) {
     page = next_page;
   }
 
+  bool compact = ShouldCompact();
+  page = pages_;
+  if (compact) {
+    GCCompactor compactor(heap_);
+    in_use += compactor.CompactPages(isolate, this);
+  } else if (FLAG_lazy_sweep && (page != NULL)) {
+    // Only sweep the bump allocation page now. The marker accounted for the
+    // live objects on each page, so the remaining pages can be swept on
+    // demand by TryAllocate. Sweeping a page needs the size of its dead
+    // objects, which is still available as classes with instances are
+    // reachable through their library and never die.
+    ASSERT(unswept_pages_ == NULL);
+    while (page != pages_tail_) {
+      in_use += page->used();
+      HeapPage* next_page = page->next();
+      page->set_next(unswept_pages_);
+      unswept_pages_ = page;
+      page = next_page;
+    }
+    pages_ = pages_tail_;
+    in_use += sweeper.SweepPage(pages_tail_, &freelist_);
+  } else {
+    while (page != NULL) {
+      in_use += sweeper.SweepPage(page, &freelist_);
+      page = page->next();
+    }
+  }
+
+  // Continue allocating at the end of the last page.
+  if (pages_tail_ != NULL) {
+    SetAllocationBufferToPage(pages_tail_);
+  }
+
+  tracer->AddPhaseTime(compact ? kGcCompactPhase : kGcSweepPhase,
+                       OS::GetCurrentTimeMicros() - sweep_start);
+
   // Record data and print if requested.
   intptr_t in_use_before = in_use_;
   in_use_ = in_use;
+  SetMarkingStartThreshold();
 
   timer.Stop();
+  tracer->EndEvent(compact ? kGcMarkCompact : kGcMarkSweep,
+                   in_use_before, in_use, capacity_, 0);
   if (FLAG_verbose_gc) {
     const intptr_t KB2 = KB / 2;
-    OS::PrintErr("Mark-Sweep[%d]: %lldus (%dK -> %dK, %dK)\n",
+    OS::PrintErr("%s[%d]%s: %lldus (%dK -> %dK, %dK)\n",
+                 compact ? "Mark-Compact" : "Mark-Sweep",
                  count_,
+                 incremental ? " after incremental marking" : "",
                  timer.TotalElapsedTime(),
                  (in_use_before + (KB2)) / KB,
                  (in_use + (KB2)) / KB,
                  (capacity_ + KB2) / KB);
+    freelist_.Print();
   }
 
   if (FLAG_verify_after_gc) {
@@ -5,6 +5,9 @@
 #ifndef VM_PAGES_H_
 #define VM_PAGES_H_
 
+#include "include/dart_api.h"
+#include "platform/utils.h"
+#include "vm/atomic.h"
 #include "vm/freelist.h"
 #include "vm/globals.h"
 #include "vm/virtual_memory.h"
@@ -12,8 +15,11 @@
 namespace dart {
 
 // Forward declarations.
+class ForwardingPage;
 class Heap;
 class ObjectPointerVisitor;
+class IncrementalMarker;
+class ObjectVisitor;
 
 // An aligned page containing old generation objects. Alignment is used to be
 // able to get to a HeapPage header quickly based on a pointer to an object.
@@ -33,17 +39,61 @@ class HeapPage {
   void set_top(uword top) { top_ = top; }
 
   uword first_object_start() const {
-    return (reinterpret_cast<uword>(this) + sizeof(HeapPage));
+    return (reinterpret_cast<uword>(this) + ObjectStartOffset());
+  }
+
+  // Offset of the first object, the page header is padded to keep objects
+  // aligned.
+  static intptr_t ObjectStartOffset() {
+    return Utils::RoundUp(sizeof(HeapPage), kObjectAlignment);
   }
 
   void set_used(uword used) { used_ = used; }
   uword used() const { return used_; }
+  // Parallel marking tasks account for the marked objects concurrently.
   void AddUsed(uword size) {
-    used_ += size;
+    AtomicOperations::FetchAndIncrementBy(reinterpret_cast<intptr_t*>(&used_),
+                                          size);
   }
 
+  void VisitObjects(ObjectVisitor* visitor) const;
   void VisitObjectPointers(ObjectPointerVisitor* visitor) const;
 
+  // Visit only the marked objects of a page which has not been swept yet. The
+  // unmarked objects on such a page are garbage which may still refer to
+  // reclaimed memory.
+  void VisitMarkedObjects(ObjectVisitor* visitor) const;
+  void VisitMarkedObjectPointers(ObjectPointerVisitor* visitor) const;
+
+  // Large data pages have a card table. A card is dirtied when a pointer to a
+  // new object is stored into it, so that a scavenge only needs to visit the
+  // dirty cards of a large remembered object.
+  static const intptr_t kCardBits = 9;
+  static const intptr_t kCardSize = 1 << kCardBits;
+
+  uint8_t* card_table() const { return card_table_; }
+  static intptr_t card_table_offset() {
+    return OFFSET_OF(HeapPage, card_table_);
+  }
+  intptr_t NumCards() const { return (end() - start()) >> kCardBits; }
+  intptr_t CardIndexFor(uword addr) const {
+    ASSERT((addr >= start()) && (addr < end()));
+    return (addr - start()) >> kCardBits;
+  }
+  uword CardStart(intptr_t card_index) const {
+    return start() + (card_index << kCardBits);
+  }
+  void DirtyCard(uword addr) {
+    ASSERT(card_table_ != NULL);
+    card_table_[CardIndexFor(addr)] = 1;
+  }
+  void DirtyAllCards();
+
+  // The forwarding information of the objects on this page, only present
+  // while the page is being compacted.
+  ForwardingPage* forwarding_page() const { return forwarding_page_; }
+  void set_forwarding_page(ForwardingPage* value) { forwarding_page_ = value; }
+
  private:
   static HeapPage* Initialize(VirtualMemory* memory, bool is_executable);
   static HeapPage* Allocate(intptr_t size, bool is_executable);
@@ -52,10 +102,14 @@ class HeapPage {
   // page becomes immediately inaccessible.
   void Deallocate();
 
+  void AllocateCardTable();
+
   VirtualMemory* memory_;
   HeapPage* next_;
   uword used_;
   uword top_;
+  uint8_t* card_table_;
+  ForwardingPage* forwarding_page_;
 
   friend class PageSpace;
 
@@ -73,9 +127,19 @@ class PageSpace {
   PageSpace(Heap* heap, intptr_t max_capacity, bool is_executable = false);
   ~PageSpace();
 
-  uword TryAllocate(intptr_t size);
+  uword TryAllocate(intptr_t size) {
+    ASSERT(size >= kObjectAlignment);
+    ASSERT(Utils::IsAligned(size, kObjectAlignment));
+    uword result = TryAllocateInBuffer(size);
+    if (result == 0) {
+      return TryAllocateSlow(size);
+    }
+    in_use_ += size;
+    return result;
+  }
 
   intptr_t in_use() const { return in_use_; }
+  intptr_t capacity() const { return capacity_; }
   bool Contains(uword addr) const;
   bool IsValidAddress(uword addr) const {
     return Contains(addr);
@@ -84,10 +148,43 @@ class PageSpace {
     return size <= kAllocatablePageSize;
   }
 
+  void VisitObjects(ObjectVisitor* visitor) const;
   void VisitObjectPointers(ObjectPointerVisitor* visitor) const;
 
-  // Collect the garbage in the page space using mark-sweep.
-  void MarkSweep(bool invoke_api_callbacks);
+  // Collect the garbage in the page space using mark-sweep. Finishes the
+  // incremental marking if it is in progress.
+  void MarkSweep(bool invoke_api_callbacks, Dart_GcReason reason);
+
+  // Incremental marking: old space is marked in steps paced by the allocation
+  // in old space, the collection is finished by MarkSweep.
+  bool IsMarking() const { return incremental_marker_ != NULL; }
+  void StartIncrementalMarking();
+  // Scans at least work bytes of gray objects. Returns true once no gray
+  // objects are left and only MarkSweep remains to be done.
+  bool IncrementalMarkingStep(intptr_t work);
+  // Starts incremental marking or takes a step if enough was allocated since.
+  bool NeedsIncrementalMarkingStep() const {
+    return in_use_ >= next_marking_step_;
+  }
+  void TakeIncrementalMarkingStep();
+  // The write barrier of a field overwritten during marking.
+  void ShadeOverwrittenValue(RawObject* raw_obj);
+  // Objects allocated or promoted during marking are marked right away. The
+  // size is passed in as the fields of a new object are not initialized yet.
+  void AllocateBlack(RawObject* raw_obj, intptr_t size) {
+    ASSERT(IsMarking());
+    if (!raw_obj->IsMarked()) {
+      raw_obj->SetMarkBit();
+      PageFor(raw_obj)->AddUsed(size);
+    }
+  }
+
+  // The write barrier only needs to shade the overwritten values while any
+  // page space is being marked incrementally.
+  static bool IsAnySpaceMarking() { return num_marking_spaces_ != 0; }
+  static uword num_marking_spaces_address() {
+    return reinterpret_cast<uword>(&num_marking_spaces_);
+  }
 
   static HeapPage* PageFor(RawObject* raw_obj) {
     return reinterpret_cast<HeapPage*>(
@@ -95,7 +192,9 @@ class PageSpace {
   }
 
  private:
-  static const intptr_t kAllocatablePageSize = kPageSize - sizeof(HeapPage);
+  static const intptr_t kAllocatablePageSize =
+      kPageSize - ((sizeof(HeapPage) + kObjectAlignment - 1) &
+                   ~(kObjectAlignment - 1));
 
   void AllocatePage();
   HeapPage* AllocateLargePage(intptr_t size);
@@ -108,7 +207,41 @@ class PageSpace {
     return increase <= (max_capacity_ - capacity_);
   }
 
-  uword TryBumpAllocate(intptr_t size);
+  // Objects are bump allocated in an allocation buffer, which is either the
+  // remainder of the last page or a chunk taken from the freelist. The unused
+  // part of the buffer is kept formatted as a freelist element, so that the
+  // page it is on stays iterable.
+  uword TryAllocateInBuffer(intptr_t size) {
+    uword result = allocation_top_;
+    intptr_t remaining = allocation_end_ - result;
+    if (remaining < size) {
+      return 0;
+    }
+    allocation_top_ = result + size;
+    if (remaining > size) {
+      FreeListElement::AsElement(allocation_top_, remaining - size);
+    }
+    return result;
+  }
+  // Returns the unused part of the current allocation buffer to the freelist
+  // and continues allocating in [start, end).
+  void SetAllocationBuffer(uword start, uword end);
+  void SetAllocationBufferToPage(HeapPage* page);
+  bool TryRefillAllocationBuffer(intptr_t size);
+  uword TryAllocateSlow(intptr_t size);
+
+  // Lazy sweeping: the pages left unswept by the last MarkSweep are swept one
+  // at a time when the freelist runs dry. Returns false if there are no
+  // unswept pages left.
+  bool SweepNextPage();
+  void FinishSweeping();
+
+  // Decides after marking whether to compact the pages instead of sweeping
+  // them, based on the amount of free memory on the pages.
+  bool ShouldCompact() const;
+
+  // Sets the amount of memory in use at which incremental marking starts.
+  void SetMarkingStartThreshold();
 
   FreeList freelist_;
 
@@ -117,6 +250,10 @@ class PageSpace {
   HeapPage* pages_;
   HeapPage* pages_tail_;
   HeapPage* large_pages_;
+  HeapPage* unswept_pages_;
+
+  uword allocation_top_;
+  uword allocation_end_;
 
   // Various sizes being tracked for this generation.
   intptr_t max_capacity_;
@@ -131,6 +268,15 @@ class PageSpace {
   // Keep track whether a MarkSweep is currently running.
   bool sweeping_;
 
+  // The state of incremental marking, NULL while not marking.
+  IncrementalMarker* incremental_marker_;
+  // Memory in use at which the next marking step is taken.
+  intptr_t next_marking_step_;
+
+  static intptr_t num_marking_spaces_;
+
+  friend class GCCompactor;
+
   DISALLOW_IMPLICIT_CONSTRUCTORS(PageSpace);
 };
 
@@ -5,137 +5,186 @@
 #include "vm/port.h"
 
 #include "platform/utils.h"
+#include "vm/atomic.h"
 #include "vm/dart_api_impl.h"
 #include "vm/isolate.h"
 #include "vm/message.h"
+#include "vm/os.h"
 #include "vm/thread.h"
 
 namespace dart {
 
 DECLARE_FLAG(bool, trace_isolates);
 
-Mutex* PortMap::mutex_ = NULL;
-PortMap::Entry* PortMap::map_ = NULL;
+PortMap::Shard* PortMap::shards_ = NULL;
 MessageHandler* PortMap::deleted_entry_ = reinterpret_cast<MessageHandler*>(1);
-intptr_t PortMap::capacity_ = 0;
-intptr_t PortMap::used_ = 0;
-intptr_t PortMap::deleted_ = 0;
-Dart_Port PortMap::next_port_ = 7111;
+intptr_t PortMap::next_shard_ = 0;
 
 
-intptr_t PortMap::FindPort(Dart_Port port) {
-  intptr_t index = port % capacity_;
+intptr_t PortMap::FindPort(Table* table, Dart_Port port) {
+  // The low bits of the ports of a shard are all the same.
+  const intptr_t capacity = table->capacity;
+  intptr_t index = (static_cast<uint64_t>(port) / kNumShards) % capacity;
   intptr_t start_index = index;
-  Entry entry = map_[index];
+  Entry entry = table->entries[index];
   while (entry.handler != NULL) {
     if (entry.port == port) {
       return index;
     }
-    index = (index + 1) % capacity_;
+    index = (index + 1) % capacity;
     // Prevent endless loops.
     ASSERT(index != start_index);
-    entry = map_[index];
+    entry = table->entries[index];
   }
   return -1;
 }
 
 
-void PortMap::Rehash(intptr_t new_capacity) {
-  Entry* new_ports = new Entry[new_capacity];
-  memset(new_ports, 0, new_capacity * sizeof(Entry));
+void PortMap::Rehash(Shard* shard, intptr_t new_capacity) {
+  Table* old_table = shard->table;
+  Table* new_table = new Table();
+  new_table->entries = new Entry[new_capacity];
+  new_table->capacity = new_capacity;
+  memset(new_table->entries, 0, new_capacity * sizeof(Entry));
 
-  for (intptr_t i = 0; i < capacity_; i++) {
-    Entry entry = map_[i];
+  for (intptr_t i = 0; i < old_table->capacity; i++) {
+    Entry entry = old_table->entries[i];
     // Skip free and deleted entries.
     if (entry.port != 0) {
-      intptr_t new_index = entry.port % new_capacity;
-      while (new_ports[new_index].port != 0) {
+      intptr_t new_index =
+          (static_cast<uint64_t>(entry.port) / kNumShards) % new_capacity;
+      while (new_table->entries[new_index].port != 0) {
         new_index = (new_index + 1) % new_capacity;
       }
-      new_ports[new_index] = entry;
+      new_table->entries[new_index] = entry;
     }
   }
-  delete[] map_;
-  map_ = new_ports;
-  capacity_ = new_capacity;
-  deleted_ = 0;
+  // Publish the filled table to the senders before freeing the old one.
+  AtomicOperations::CompareAndSwapWord(
+      reinterpret_cast<uword*>(&shard->table),
+      reinterpret_cast<uword>(old_table),
+      reinterpret_cast<uword>(new_table));
+  shard->deleted = 0;
+  WaitForReaders(shard);
+  delete[] old_table->entries;
+  delete old_table;
 }
 
 
-Dart_Port PortMap::AllocatePort() {
-  Dart_Port result = next_port_;
+intptr_t* PortMap::EnterReader(Shard* shard) {
+  while (true) {
+    intptr_t epoch = shard->epoch;
+    intptr_t* readers = &shard->readers[epoch & 1];
+    AtomicOperations::FetchAndIncrementBy(readers, 1);
+    // Unless the epoch was switched meanwhile, an update either waits for
+    // this reader or is seen by it.
+    if (shard->epoch == epoch) {
+      return readers;
+    }
+    AtomicOperations::FetchAndIncrementBy(readers, -1);
+  }
+}
+
+
+void PortMap::ExitReader(intptr_t* readers) {
+  AtomicOperations::FetchAndIncrementBy(readers, -1);
+}
+
+
+void PortMap::WaitForReaders(Shard* shard) {
+  // The readers entering from now on see the updates made so far.
+  intptr_t epoch = AtomicOperations::FetchAndIncrementBy(&shard->epoch, 1);
+  intptr_t* readers = &shard->readers[epoch & 1];
+  // Senders only stay readers while they enqueue a message.
+  while (*readers > 0) {
+    OS::Sleep(0);
+  }
+}
+
+
+Dart_Port PortMap::AllocatePort(Shard* shard) {
+  Dart_Port result = shard->next_port;
 
   do {
     // TODO(iposva): Use an approved hashing function to have less predictable
     // port ids, or make them not accessible from Dart code or both.
-    next_port_++;
-  } while (FindPort(next_port_) >= 0);
+    shard->next_port += kNumShards;
+  } while (FindPort(shard->table, shard->next_port) >= 0);
 
   ASSERT(result != 0);
+  ASSERT(ShardOf(result) == shard);
   return result;
 }
 
 
 void PortMap::SetLive(Dart_Port port) {
-  MutexLocker ml(mutex_);
-  intptr_t index = FindPort(port);
+  Shard* shard = ShardOf(port);
+  MutexLocker ml(shard->mutex);
+  Entry* entries = shard->table->entries;
+  intptr_t index = FindPort(shard->table, port);
   ASSERT(index >= 0);
-  map_[index].live = true;
-  map_[index].handler->increment_live_ports();
+  entries[index].live = true;
+  entries[index].handler->increment_live_ports();
 }
 
 
-void PortMap::MaintainInvariants() {
-  intptr_t empty = capacity_ - used_ - deleted_;
-  if (used_ > ((capacity_ / 4) * 3)) {
+void PortMap::MaintainInvariants(Shard* shard) {
+  const intptr_t capacity = shard->table->capacity;
+  intptr_t empty = capacity - shard->used - shard->deleted;
+  if (shard->used > ((capacity / 4) * 3)) {
     // Grow the port map.
-    Rehash(capacity_ * 2);
-  } else if (empty < deleted_) {
+    Rehash(shard, capacity * 2);
+  } else if (empty < shard->deleted) {
     // Rehash without growing the table to flush the deleted slots out of the
     // map.
-    Rehash(capacity_);
+    Rehash(shard, capacity);
   }
 }
 
 
 Dart_Port PortMap::CreatePort(MessageHandler* handler) {
   ASSERT(handler != NULL);
-  MutexLocker ml(mutex_);
+  // Spread the ports over the shards.
+  uword shard_index = AtomicOperations::FetchAndIncrementBy(&next_shard_, 1);
+  Shard* shard = &shards_[shard_index % kNumShards];
+  MutexLocker ml(shard->mutex);
 #if defined(DEBUG)
   handler->CheckAccess();
 #endif
 
   Entry entry;
-  entry.port = AllocatePort();
+  entry.port = AllocatePort(shard);
   entry.handler = handler;
   entry.live = false;
 
   // Search for the first unused slot. Make use of the knowledge that here is
   // currently no port with this id in the port map.
-  ASSERT(FindPort(entry.port) < 0);
-  intptr_t index = entry.port % capacity_;
-  Entry cur = map_[index];
+  Table* table = shard->table;
+  ASSERT(FindPort(table, entry.port) < 0);
+  intptr_t index =
+      (static_cast<uint64_t>(entry.port) / kNumShards) % table->capacity;
+  Entry cur = table->entries[index];
   // Stop the search at the first found unused (free or deleted) slot.
   while (cur.port != 0) {
-    index = (index + 1) % capacity_;
-    cur = map_[index];
+    index = (index + 1) % table->capacity;
+    cur = table->entries[index];
   }
 
   // Insert the newly created port at the index.
   ASSERT(index >= 0);
-  ASSERT(index < capacity_);
-  ASSERT(map_[index].port == 0);
-  ASSERT((map_[index].handler == NULL) ||
-         (map_[index].handler == deleted_entry_));
-  if (map_[index].handler == deleted_entry_) {
+  ASSERT(index < table->capacity);
+  ASSERT(table->entries[index].port == 0);
+  ASSERT((table->entries[index].handler == NULL) ||
+         (table->entries[index].handler == deleted_entry_));
+  if (table->entries[index].handler == deleted_entry_) {
     // Consuming a deleted entry.
-    deleted_--;
+    shard->deleted--;
   }
-  map_[index] = entry;
+  table->entries[index] = entry;
 
   // Increment number of used slots and grow if necessary.
-  used_++;
-  MaintainInvariants();
+  shard->used++;
+  MaintainInvariants(shard);
 
   return entry.port;
 }
@@ -144,90 +193,123 @@ Dart_Port PortMap::CreatePort(MessageHandler* handler) {
 bool PortMap::ClosePort(Dart_Port port) {
   MessageHandler* handler = NULL;
   {
-    MutexLocker ml(mutex_);
-    intptr_t index = FindPort(port);
+    Shard* shard = ShardOf(port);
+    MutexLocker ml(shard->mutex);
+    Entry* entries = shard->table->entries;
+    intptr_t index = FindPort(shard->table, port);
     if (index < 0) {
       return false;
     }
-    ASSERT(index < capacity_);
-    ASSERT(map_[index].port != 0);
-    ASSERT(map_[index].handler != deleted_entry_);
-    ASSERT(map_[index].handler != NULL);
+    ASSERT(index < shard->table->capacity);
+    ASSERT(entries[index].port != 0);
+    ASSERT(entries[index].handler != deleted_entry_);
+    ASSERT(entries[index].handler != NULL);
 
-    handler = map_[index].handler;
+    handler = entries[index].handler;
 #if defined(DEBUG)
     handler->CheckAccess();
 #endif
     // Before releasing the lock mark the slot in the map as deleted. This makes
     // it possible to release the port map lock before flushing all of its
     // pending messages below.
-    map_[index].port = 0;
-    map_[index].handler = deleted_entry_;
-    if (map_[index].live) {
+    entries[index].port = 0;
+    entries[index].handler = deleted_entry_;
+    if (entries[index].live) {
       handler->decrement_live_ports();
     }
 
-    used_--;
-    deleted_++;
-    MaintainInvariants();
+    shard->used--;
+    shard->deleted++;
+    MaintainInvariants(shard);
+    // No message is posted to the port once the senders which found it are
+    // done.
+    WaitForReaders(shard);
   }
   handler->ClosePort(port);
   if (!handler->HasLivePorts() && handler->OwnedByPortMap()) {
-    delete handler;
+    // A task of the handler may still be queued or running.
+    handler->DeleteWhenIdle();
   }
   return true;
 }
 
 
 void PortMap::ClosePorts(MessageHandler* handler) {
-  {
-    MutexLocker ml(mutex_);
-    for (intptr_t i = 0; i < capacity_; i++) {
-      if (map_[i].handler == handler) {
+  for (intptr_t s = 0; s < kNumShards; s++) {
+    Shard* shard = &shards_[s];
+    MutexLocker ml(shard->mutex);
+    Entry* entries = shard->table->entries;
+    bool found = false;
+    for (intptr_t i = 0; i < shard->table->capacity; i++) {
+      if (entries[i].handler == handler) {
         // Mark the slot as deleted.
-        map_[i].port = 0;
-        map_[i].handler = deleted_entry_;
-        if (map_[i].live) {
+        entries[i].port = 0;
+        entries[i].handler = deleted_entry_;
+        if (entries[i].live) {
           handler->decrement_live_ports();
         }
-        used_--;
-        deleted_++;
+        shard->used--;
+        shard->deleted++;
+        found = true;
       }
     }
-    MaintainInvariants();
+    if (found) {
+      MaintainInvariants(shard);
+      WaitForReaders(shard);
+    }
   }
   handler->CloseAllPorts();
 }
 
 
 bool PortMap::PostMessage(Message* message) {
-  MutexLocker ml(mutex_);
-  intptr_t index = FindPort(message->dest_port());
-  if (index < 0) {
+  // The lock of the shard is not taken, the sender stays a reader of the
+  // shard while the message is enqueued instead.  This keeps the handler
+  // from being deleted and its port from being flushed meanwhile.
+  // Enqueueing does not block.
+  Shard* shard = ShardOf(message->dest_port());
+  intptr_t* readers = EnterReader(shard);
+  Table* table = shard->table;
+  MessageHandler* handler = NULL;
+  intptr_t index = FindPort(table, message->dest_port());
+  if (index >= 0) {
+    ASSERT(index < table->capacity);
+    // The port may be closed meanwhile.
+    handler = table->entries[index].handler;
+  }
+  if ((handler == NULL) || (handler == deleted_entry_)) {
+    ExitReader(readers);
     delete message;
     return false;
   }
-  ASSERT(index >= 0);
-  ASSERT(index < capacity_);
-  MessageHandler* handler = map_[index].handler;
-  ASSERT(map_[index].port != 0);
-  ASSERT((handler != NULL) && (handler != deleted_entry_));
   handler->PostMessage(message);
+  ExitReader(readers);
   return true;
 }
 
 
 void PortMap::InitOnce() {
-  mutex_ = new Mutex();
-
   static const intptr_t kInitialCapacity = 8;
+  static const Dart_Port kFirstPort = 7111;
   // TODO(iposva): Verify whether we want to keep exponentially growing.
   ASSERT(Utils::IsPowerOfTwo(kInitialCapacity));
-  map_ = new Entry[kInitialCapacity];
-  memset(map_, 0, kInitialCapacity * sizeof(Entry));
-  capacity_ = kInitialCapacity;
-  used_ = 0;
-  deleted_ = 0;
+  shards_ = new Shard[kNumShards];
+  for (intptr_t s = 0; s < kNumShards; s++) {
+    Shard* shard = &shards_[s];
+    shard->mutex = new Mutex();
+    shard->table = new Table();
+    shard->table->entries = new Entry[kInitialCapacity];
+    shard->table->capacity = kInitialCapacity;
+    memset(shard->table->entries, 0, kInitialCapacity * sizeof(Entry));
+    shard->used = 0;
+    shard->deleted = 0;
+    shard->epoch = 0;
+    shard->readers[0] = 0;
+    shard->readers[1] = 0;
+    // The first port of the shard which has the index of the shard as its
+    // id modulo kNumShards.
+    shard->next_port = kFirstPort * kNumShards + s;
+  }
 }
 
 }  // namespace dart
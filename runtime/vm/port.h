@@ -55,28 +55,69 @@ class PortMap: public AllStatic {
     bool live;
   } Entry;
 
+  // Hashmap of ports.  A table is replaced as a whole when it is rehashed,
+  // and only freed once no sender looks up a port in it anymore.
+  typedef struct {
+    Entry* entries;
+    intptr_t capacity;
+  } Table;
+
+  // The ports are spread over shards by their id.  Each shard is a hashmap
+  // of its own with its own lock, so that ports created and closed in
+  // different shards do not contend for the same lock.  The ports of a
+  // shard are allocated by the shard, their id modulo kNumShards is the
+  // index of the shard.
+  //
+  // Posting a message does not take the lock.  The sender counts itself in
+  // the readers of the current epoch instead, and the updates which remove
+  // a port or free a table switch the epoch and wait for the readers of the
+  // previous one before they flush the port or free the table.
+  typedef struct {
+    // Lock serializing the updates of the shard.
+    Mutex* mutex;
+
+    Table* table;
+    intptr_t used;
+    intptr_t deleted;
+
+    Dart_Port next_port;
+
+    // Updated atomically.
+    intptr_t epoch;
+    intptr_t readers[2];
+  } Shard;
+
+  static const intptr_t kNumShards = 16;
+
+  static Shard* ShardOf(Dart_Port port) {
+    return &shards_[static_cast<uint64_t>(port) % kNumShards];
+  }
+
   // Allocate a new unique port.
-  static Dart_Port AllocatePort();
+  static Dart_Port AllocatePort(Shard* shard);
 
   static bool IsActivePort(Dart_Port id);
   static bool IsLivePort(Dart_Port id);
 
-  static intptr_t FindPort(Dart_Port port);
-  static void Rehash(intptr_t new_capacity);
+  static intptr_t FindPort(Table* table, Dart_Port port);
+  static void Rehash(Shard* shard, intptr_t new_capacity);
+
+  // Counts a sender looking up a port in the readers of the shard, and
+  // returns the counter to decrement in ExitReader.
+  static intptr_t* EnterReader(Shard* shard);
+  static void ExitReader(intptr_t* readers);
 
-  static void MaintainInvariants();
+  // Waits for the senders which may have looked up a port before the last
+  // update of the shard.  Called while holding the lock of the shard.
+  static void WaitForReaders(Shard* shard);
 
-  // Lock protecting access to the port map.
-  static Mutex* mutex_;
+  static void MaintainInvariants(Shard* shard);
 
-  // Hashmap of ports.
-  static Entry* map_;
+  static Shard* shards_;
   static MessageHandler* deleted_entry_;
-  static intptr_t capacity_;
-  static intptr_t used_;
-  static intptr_t deleted_;
 
-  static Dart_Port next_port_;
+  // Index of the shard of the next port created, updated atomically.
+  static intptr_t next_shard_;
 };
 
 }  // namespace dart
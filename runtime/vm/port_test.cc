@@ -14,17 +14,19 @@ namespace dart {
 class PortMapTestPeer {
  public:
   static bool IsActivePort(Dart_Port port) {
-    MutexLocker ml(PortMap::mutex_);
-    return (PortMap::FindPort(port) >= 0);
+    PortMap::Shard* shard = PortMap::ShardOf(port);
+    MutexLocker ml(shard->mutex);
+    return (PortMap::FindPort(shard->table, port) >= 0);
   }
 
   static bool IsLivePort(Dart_Port port) {
-    MutexLocker ml(PortMap::mutex_);
-    intptr_t index = PortMap::FindPort(port);
+    PortMap::Shard* shard = PortMap::ShardOf(port);
+    MutexLocker ml(shard->mutex);
+    intptr_t index = PortMap::FindPort(shard->table, port);
     if (index < 0) {
       return false;
     }
-    return PortMap::map_[index].live;
+    return shard->table->entries[index].live;
   }
 };
 
@@ -97,6 +99,22 @@ TEST_CASE(PortMap_CreateManyPorts) {
 }
 
 
+TEST_CASE(PortMap_CreateManyOpenPorts) {
+  TestMessageHandler handler;
+  const int kNumPorts = 256;
+  Dart_Port ports[kNumPorts];
+  for (int i = 0; i < kNumPorts; i++) {
+    ports[i] = PortMap::CreatePort(&handler);
+    EXPECT(PortMapTestPeer::IsActivePort(ports[i]));
+  }
+  for (int i = 0; i < kNumPorts; i++) {
+    EXPECT(PortMapTestPeer::IsActivePort(ports[i]));
+    EXPECT(PortMap::ClosePort(ports[i]));
+    EXPECT(!PortMapTestPeer::IsActivePort(ports[i]));
+  }
+}
+
+
 TEST_CASE(PortMap_SetLive) {
   TestMessageHandler handler;
   intptr_t port = PortMap::CreatePort(&handler);
@@ -136,6 +154,67 @@ TEST_CASE(PortMap_PostMessageInvalidPort) {
 }
 
 
+static const intptr_t kRehashMessages = 10000;
+static Dart_Port rehash_port = 0;
+static intptr_t rehash_failed_posts = 0;
+static bool rehash_posted = false;
+
+
+static void PostWhileRehashing(uword parameter) {
+  Monitor* sync = reinterpret_cast<Monitor*>(parameter);
+  for (intptr_t i = 0; i < kRehashMessages; i++) {
+    if (!PortMap::PostMessage(
+            new Message(rehash_port, 0, NULL, Message::kNormalPriority))) {
+      rehash_failed_posts++;
+    }
+  }
+  MonitorLocker ml(sync);
+  rehash_posted = true;
+  ml.Notify();
+}
+
+
+// Messages are posted without taking the lock of the port map, while the
+// tables they are looked up in are rehashed.
+TEST_CASE(PortMap_PostMessageWhileRehashing) {
+  TestMessageHandler handler;
+  rehash_port = PortMap::CreatePort(&handler);
+  rehash_failed_posts = 0;
+  rehash_posted = false;
+  Monitor sync;
+  int result =
+      Thread::Start(PostWhileRehashing, reinterpret_cast<uword>(&sync));
+  EXPECT_EQ(0, result);
+  // Grow the tables of all the shards and flush their deleted entries.
+  const int kNumPorts = 1024;
+  Dart_Port ports[kNumPorts];
+  for (int round = 0; round < 10; round++) {
+    for (int i = 0; i < kNumPorts; i++) {
+      ports[i] = PortMap::CreatePort(&handler);
+    }
+    for (int i = 0; i < kNumPorts; i++) {
+      EXPECT(PortMap::ClosePort(ports[i]));
+    }
+  }
+  {
+    MonitorLocker ml(&sync);
+    while (!rehash_posted) {
+      ml.Wait();
+    }
+  }
+  EXPECT_EQ(0, rehash_failed_posts);
+  intptr_t received = 0;
+  Message* message = handler.queue()->DequeueNoWait();
+  while (message != NULL) {
+    EXPECT_EQ(rehash_port, message->dest_port());
+    delete message;
+    received++;
+    message = handler.queue()->DequeueNoWait();
+  }
+  EXPECT_EQ(kRehashMessages, received);
+  PortMap::ClosePort(rehash_port);
+}
+
 // End-of-test marker.
 static const intptr_t kEOT = 0xFFFF;
 
@@ -31,13 +31,11 @@ void RawObject::Validate() const {
 
   // Validate that the tags_ field is sensible.
   intptr_t tags = ptr()->tags_;
-  ASSERT((tags & 0xffff00f0) == 0);
+  ASSERT((tags & 0xffff0080) == 0);
 }
 
 
 intptr_t RawObject::SizeFromClass() const {
-  NoHandleScope no_handles(Isolate::Current());
-
   // Only reasonable to be called on heap objects.
   ASSERT(IsHeapObject());
 
@@ -58,7 +56,10 @@ intptr_t RawObject::SizeFromClass() const {
         const RawCode* raw_code = reinterpret_cast<const RawCode*>(this);
         intptr_t pointer_offsets_length =
             raw_code->ptr()->pointer_offsets_length_;
-        instance_size = Code::InstanceSize(pointer_offsets_length);
+        intptr_t immediate_offsets_length =
+            raw_code->ptr()->immediate_offsets_length_;
+        instance_size = Code::InstanceSize(pointer_offsets_length,
+                                           immediate_offsets_length);
         break;
       }
       case kInstructions: {
@@ -187,8 +188,6 @@ intptr_t RawObject::SizeFromClass() const {
 
 intptr_t RawObject::VisitPointers(ObjectPointerVisitor* visitor) {
   intptr_t size = 0;
-  NoHandleScope no_handles(Isolate::Current());
-
   // Only reasonable to be called on heap objects.
   ASSERT(IsHeapObject());
 
@@ -196,8 +195,11 @@ intptr_t RawObject::VisitPointers(ObjectPointerVisitor* visitor) {
   RawClass* raw_class = ptr()->class_;
   ObjectKind kind = raw_class->ptr()->instance_kind_;
 
-  // Visit the class before visting the fields.
-  visitor->VisitPointer(reinterpret_cast<RawObject**>(&ptr()->class_));
+  // Visit the class before visting the fields. The fake classes of free list
+  // elements are not allocated in the heap.
+  if (kind != kFreeListElement) {
+    visitor->VisitPointer(reinterpret_cast<RawObject**>(&ptr()->class_));
+  }
 
   switch (kind) {
 #define RAW_VISITPOINTERS(clazz) \
@@ -357,7 +359,7 @@ intptr_t RawCode::VisitCodePointers(RawCode* raw_obj,
     int32_t offset = obj->data_[i];
     visitor->VisitPointer(reinterpret_cast<RawObject**>(entry_point + offset));
   }
-  return Code::InstanceSize(length);
+  return Code::InstanceSize(length, obj->immediate_offsets_length_);
 }
 
 
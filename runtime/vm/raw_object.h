@@ -6,6 +6,7 @@
 #define VM_RAW_OBJECT_H_
 
 #include "platform/assert.h"
+#include "vm/atomic.h"
 #include "vm/globals.h"
 #include "vm/token.h"
 #include "vm/snapshot.h"
@@ -153,9 +154,9 @@ class RawObject {
     kMarkBit = 1,
     kCanonicalBit = 2,
     kFromSnapshotBit = 3,
-    kReservedBit10K = 4,
-    kReservedBit100K = 5,
-    kReservedBit1M = 6,
+    kRememberedBit = 4,
+    kAgeBit = 5,
+    kAgeSize = 2,
     kReservedBit10M = 7,
     kSizeTagBit = 8,
     kSizeTagSize = 8,
@@ -206,6 +207,18 @@ class RawObject {
     return (addr & kNewObjectAlignmentOffset) == kOldObjectAlignmentOffset;
   }
 
+  // Support for aging new objects. The age is the number of scavenges a new
+  // object survived, saturating at kMaxAge.
+  static const intptr_t kMaxAge = (1 << kAgeSize) - 1;
+  intptr_t Age() const {
+    return AgeTag::decode(ptr()->tags_);
+  }
+  void SetAge(intptr_t age) {
+    ASSERT((age >= 0) && (age <= kMaxAge));
+    uword tags = ptr()->tags_;
+    ptr()->tags_ = AgeTag::update(age, tags);
+  }
+
   // Support for GC marking bit.
   bool IsMarked() const {
     return MarkBit::decode(ptr()->tags_);
@@ -215,12 +228,47 @@ class RawObject {
     uword tags = ptr()->tags_;
     ptr()->tags_ = MarkBit::update(true, tags);
   }
+  // Atomically sets the mark bit. Returns false if the object was already
+  // marked, e.g. by a different marking task.
+  bool TryAcquireMarkBit() {
+    uword tags = ptr()->tags_;
+    while (!MarkBit::decode(tags)) {
+      uword old_tags = AtomicOperations::CompareAndSwapWord(
+          &ptr()->tags_, tags, MarkBit::update(true, tags));
+      if (old_tags == tags) {
+        return true;
+      }
+      tags = old_tags;
+    }
+    return false;
+  }
   void ClearMarkBit() {
     ASSERT(IsMarked());
     uword tags = ptr()->tags_;
     ptr()->tags_ = MarkBit::update(false, tags);
   }
 
+  // Support for the remembered bit used by the store buffer. An old object is
+  // remembered if it may contain pointers into new space.
+  bool IsRemembered() const {
+    return RememberedBit::decode(ptr()->tags_);
+  }
+  void SetRememberedBit() {
+    ASSERT(!IsRemembered());
+    uword tags = ptr()->tags_;
+    ptr()->tags_ = RememberedBit::update(true, tags);
+  }
+  void ClearRememberedBit() {
+    ASSERT(IsRemembered());
+    uword tags = ptr()->tags_;
+    ptr()->tags_ = RememberedBit::update(false, tags);
+  }
+
+  // Free list elements reuse the tags field, which has the free bit set.
+  bool IsFreeListElement() const {
+    return FreeBit::decode(ptr()->tags_);
+  }
+
   // Support for object tags.
   bool IsCanonical() const {
     return CanonicalObjectTag::decode(ptr()->tags_);
@@ -279,6 +327,10 @@ class RawObject {
 
   class MarkBit : public BitField<bool, kMarkBit, 1> {};
 
+  class RememberedBit : public BitField<bool, kRememberedBit, 1> {};
+
+  class AgeTag : public BitField<intptr_t, kAgeBit, kAgeSize> {};
+
   class CanonicalObjectTag : public BitField<bool, kCanonicalBit, 1> {};
 
   class CreatedFromSnapshotTag : public BitField<bool, kFromSnapshotBit, 1> {};
@@ -296,6 +348,8 @@ class RawObject {
   friend class SnapshotWriter;
   friend class SnapshotReader;
   friend class MarkingVisitor;
+  friend class GCCompactor;
+  friend class ForwardPointersVisitor;
 
   DISALLOW_ALLOCATION();
   DISALLOW_IMPLICIT_CONSTRUCTORS(RawObject);
@@ -329,6 +383,8 @@ class RawClass : public RawObject {
   RawArray* functions_cache_;  // See class FunctionsCache.
   RawArray* constants_;  // Canonicalized values of this class.
   RawArray* canonical_types_;  // Canonicalized types of this class.
+  RawArray* functions_hash_index_;  // Lazily built index of functions_.
+  RawArray* fields_hash_index_;  // Lazily built index of fields_.
   RawCode* allocation_stub_;  // Stub code for allocation of instances.
   RawObject** to() {
     return reinterpret_cast<RawObject**>(&ptr()->allocation_stub_);
@@ -518,6 +574,7 @@ class RawFunction : public RawObject {
   bool is_static_;
   bool is_const_;
   bool is_optimizable_;
+  bool is_queued_for_optimization_;  // Not written into snapshots.
 };
 
 
@@ -658,16 +715,21 @@ class RawCode : public RawObject {
   RawPcDescriptors* pc_descriptors_;
   RawArray* stackmaps_;
   RawLocalVarDescriptors* var_descriptors_;
+  RawArray* inlined_frames_;
   RawObject** to() {
-    return reinterpret_cast<RawObject**>(&ptr()->var_descriptors_);
+    return reinterpret_cast<RawObject**>(&ptr()->inlined_frames_);
   }
 
   intptr_t pointer_offsets_length_;
+  intptr_t immediate_offsets_length_;
   // This cannot be boolean because of alignment issues on x64 architectures.
   intptr_t is_optimized_;
 
-  // Variable length data follows here.
+  // Variable length data follows here: the pointer offsets followed by the
+  // immediate offsets.
   int32_t data_[0];
+
+  friend class SnapshotReader;
 };
 
 
@@ -681,6 +743,7 @@ class RawInstructions : public RawObject {
   uint8_t data_[0];
 
   friend class RawCode;
+  friend class SnapshotReader;
 };
 
 
@@ -691,6 +754,8 @@ class RawPcDescriptors : public RawObject {
 
   // Variable length data follows here.
   intptr_t data_[0];
+
+  friend class SnapshotReader;
 };
 
 
@@ -734,6 +799,8 @@ class RawLocalVarDescriptors : public RawObject {
   RawArray* names_;  // Array of [length_] variable names.
 
   VarInfo data_[0];   // Variable info with [length_] entries.
+
+  friend class SnapshotReader;
 };
 
 
@@ -744,6 +811,8 @@ class RawExceptionHandlers : public RawObject {
 
   // Variable length data follows here.
   intptr_t data_[0];
+
+  friend class SnapshotReader;
 };
 
 
@@ -789,6 +858,8 @@ class RawContextScope : public RawObject {
     intptr_t data_length = num_vars * (sizeof(VariableDesc)/kWordSize);
     return reinterpret_cast<RawObject**>(&ptr()->data_[data_length - 1]);
   }
+
+  friend class SnapshotReader;
 };
 
 
@@ -801,8 +872,9 @@ class RawICData : public RawObject {
   RawFunction* function_;  // Parent/calling function of this IC.
   RawString* target_name_;  // Name of target function.
   RawArray* ic_data_;  // Contains test classes and target function.
+  RawArray* megamorphic_cache_;  // Null unless the call is megamorphic.
   RawObject** to() {
-    return reinterpret_cast<RawObject**>(&ptr()->ic_data_);
+    return reinterpret_cast<RawObject**>(&ptr()->megamorphic_cache_);
   }
   intptr_t id_;  // Parser node id corresponding to this IC.
   intptr_t num_args_tested_;  // Number of arguments tested in IC.
@@ -912,6 +984,7 @@ class RawBigint : public RawInteger {
   // A sequence of Chunks (typedef in Bignum) representing bignum digits.
   // Bignum::Chunk chunks_[Utils::Abs(signed_length_)];
   uint8_t data_[0];
+  friend class SnapshotReader;
 };
 
 
@@ -1101,6 +1174,17 @@ class ExternalByteArrayData {
   void* peer() {
     return peer_;
   }
+  Dart_PeerFinalizer callback() {
+    return callback_;
+  }
+
+  // Give up the data when it is handed over to another owner, which is
+  // then responsible for invoking the callback.
+  void Release() {
+    data_ = NULL;
+    peer_ = NULL;
+    callback_ = NULL;
+  }
 
  private:
   uint8_t* data_;
@@ -1169,6 +1253,8 @@ class RawJSRegExp : public RawInstance {
 
   // Variable length data follows here.
   uint8_t data_[0];
+
+  friend class SnapshotReader;
 };
 
 }  // namespace dart
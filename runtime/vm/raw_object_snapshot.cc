@@ -3,6 +3,7 @@
 // BSD-style license that can be found in the LICENSE file.
 
 #include "vm/bigint_operations.h"
+#include "vm/flags.h"
 #include "vm/object.h"
 #include "vm/object_store.h"
 #include "vm/snapshot.h"
@@ -10,6 +11,11 @@
 
 namespace dart {
 
+DEFINE_FLAG(int, message_external_byte_array_length, 0,
+            "Send the byte arrays of at least this length to other isolates "
+            "as external byte arrays, copying their data only once "
+            "(0 means never).");
+
 #define NEW_OBJECT(type)                                                       \
   ((kind == Snapshot::kFull) ? reader->New##type() : type::New())
 
@@ -473,6 +479,7 @@ RawFunction* Function::ReadFrom(SnapshotReader* reader,
   func.set_is_static(reader->Read<bool>());
   func.set_is_const(reader->Read<bool>());
   func.set_is_optimizable(reader->Read<bool>());
+  func.set_is_queued_for_optimization(false);
 
   // Set all the object fields.
   // TODO(5411462): Need to assert No GC can happen here, even though
@@ -858,17 +865,108 @@ RawCode* Code::ReadFrom(SnapshotReader* reader,
                         intptr_t object_id,
                         intptr_t tags,
                         Snapshot::Kind kind) {
-  UNREACHABLE();
-  return Code::null();
+  ASSERT(reader != NULL);
+  ASSERT(kind == Snapshot::kFull);
+
+  // Allocate code object.
+  intptr_t pointer_offsets_length = reader->ReadIntptrValue();
+  intptr_t immediate_offsets_length = reader->ReadIntptrValue();
+  Code& code = Code::ZoneHandle(
+      reader->isolate(),
+      reader->NewCode(pointer_offsets_length, immediate_offsets_length));
+  reader->AddBackwardReference(object_id, &code);
+
+  // Set the object tags.
+  code.set_tags(tags);
+
+  // Set all the non object fields.
+  code.set_is_optimized(reader->ReadIntptrValue() != 0);
+  for (intptr_t i = 0; i < pointer_offsets_length; i++) {
+    code.SetPointerOffsetAt(i, reader->Read<int32_t>());
+  }
+  for (intptr_t i = 0; i < immediate_offsets_length; i++) {
+    code.SetImmediateEntryAt(i, reader->Read<int32_t>());
+  }
+  uword written_entry_point = reader->ReadIntptrValue();
+
+  // Set all the object fields.
+  intptr_t num_flds = (code.raw()->to() - code.raw()->from());
+  for (intptr_t i = 0; i <= num_flds; i++) {
+    *(code.raw()->from() + i) = reader->ReadObject();
+  }
+  Instructions& instructions = Instructions::Handle(code.instructions());
+  instructions.set_code(code.raw());
+
+  // The descriptors hold absolute pcs.
+  const intptr_t delta = code.EntryPoint() - written_entry_point;
+  const PcDescriptors& descriptors =
+      PcDescriptors::Handle(code.pc_descriptors());
+  if (!descriptors.IsNull()) {
+    for (intptr_t i = 0; i < descriptors.Length(); i++) {
+      descriptors.SetPC(i, descriptors.PC(i) + delta);
+    }
+  }
+  const ExceptionHandlers& handlers =
+      ExceptionHandlers::Handle(code.exception_handlers());
+  if (!handlers.IsNull()) {
+    for (intptr_t i = 0; i < handlers.Length(); i++) {
+      handlers.SetHandlerPC(i, handlers.HandlerPC(i) + delta);
+    }
+  }
+
+  // Store the embedded objects and relocate the immediates.
+  for (intptr_t i = 0; i < pointer_offsets_length; i++) {
+    *reinterpret_cast<RawObject**>(
+        code.EntryPoint() + code.GetPointerOffsetAt(i)) = reader->ReadObject();
+  }
+  for (intptr_t i = 0; i < immediate_offsets_length; i++) {
+    reader->ReadCodeImmediate(code, i);
+  }
+  return code.raw();
 }
 
 
 void RawCode::WriteTo(SnapshotWriter* writer,
                       intptr_t object_id,
                       Snapshot::Kind kind) {
-  // We have already checked for this and written a NULL object, hence we
-  // should not reach here.
-  UNREACHABLE();
+  // Only reached for the code included in a full snapshot, other code
+  // objects are written as null, see SnapshotWriter::CanWriteCode.
+  ASSERT(writer != NULL);
+  ASSERT(kind == Snapshot::kFull);
+
+  // Write out the serialization header value for this object.
+  writer->WriteSerializationMarker(kInlined, object_id);
+
+  // Write out the class and tags information.
+  writer->WriteObjectHeader(Object::kCodeClass, ptr()->tags_);
+
+  // Write out all the non object fields.
+  intptr_t pointer_offsets_length = ptr()->pointer_offsets_length_;
+  intptr_t immediate_offsets_length = ptr()->immediate_offsets_length_;
+  writer->WriteIntptrValue(pointer_offsets_length);
+  writer->WriteIntptrValue(immediate_offsets_length);
+  writer->WriteIntptrValue(ptr()->is_optimized_);
+  for (intptr_t i = 0;
+       i < (pointer_offsets_length + immediate_offsets_length);
+       i++) {
+    writer->Write<int32_t>(ptr()->data_[i]);
+  }
+  uword entry_point = reinterpret_cast<uword>(ptr()->instructions_->ptr()) +
+      Instructions::HeaderSize();
+  writer->WriteIntptrValue(entry_point);
+
+  // Write out all the object pointer fields.
+  SnapshotWriterVisitor visitor(writer);
+  visitor.VisitPointers(from(), to());
+
+  // Write out the objects embedded in the instructions and the immediates.
+  for (intptr_t i = 0; i < pointer_offsets_length; i++) {
+    writer->WriteObject(*reinterpret_cast<RawObject**>(
+        entry_point + ptr()->data_[i]));
+  }
+  for (intptr_t i = 0; i < immediate_offsets_length; i++) {
+    writer->WriteCodeImmediate(this, i);
+  }
 }
 
 
@@ -876,15 +974,48 @@ RawInstructions* Instructions::ReadFrom(SnapshotReader* reader,
                                         intptr_t object_id,
                                         intptr_t tags,
                                         Snapshot::Kind kind) {
-  UNREACHABLE();
-  return Instructions::null();
+  ASSERT(reader != NULL);
+  ASSERT(kind == Snapshot::kFull);
+
+  // Allocate instructions object, it is linked to its code object by
+  // Code::ReadFrom.
+  intptr_t size = reader->ReadIntptrValue();
+  Instructions& instructions = Instructions::ZoneHandle(
+      reader->isolate(), reader->NewInstructions(size));
+  reader->AddBackwardReference(object_id, &instructions);
+
+  // Set the object tags.
+  instructions.set_tags(tags);
+
+  // Read the instructions, the embedded objects and the immediates are
+  // stored by Code::ReadFrom.
+  uint8_t* data = reinterpret_cast<uint8_t*>(instructions.EntryPoint());
+  for (intptr_t i = 0; i < size; i++) {
+    data[i] = reader->Read<uint8_t>();
+  }
+  return instructions.raw();
 }
 
 
 void RawInstructions::WriteTo(SnapshotWriter* writer,
                               intptr_t object_id,
                               Snapshot::Kind kind) {
-  UNREACHABLE();
+  ASSERT(writer != NULL);
+  ASSERT(kind == Snapshot::kFull);
+
+  // Write out the serialization header value for this object.
+  writer->WriteSerializationMarker(kInlined, object_id);
+
+  // Write out the class and tags information.
+  writer->WriteObjectHeader(Object::kInstructionsClass, ptr()->tags_);
+
+  // Write out the size and the instructions.
+  writer->WriteIntptrValue(ptr()->size_);
+  uint8_t* data = reinterpret_cast<uint8_t*>(
+      reinterpret_cast<uword>(ptr()) + Instructions::HeaderSize());
+  for (intptr_t i = 0; i < ptr()->size_; i++) {
+    writer->Write<uint8_t>(data[i]);
+  }
 }
 
 
@@ -892,15 +1023,44 @@ RawPcDescriptors* PcDescriptors::ReadFrom(SnapshotReader* reader,
                                           intptr_t object_id,
                                           intptr_t tags,
                                           Snapshot::Kind kind) {
-  UNREACHABLE();
-  return PcDescriptors::null();
+  ASSERT(reader != NULL);
+  ASSERT(kind == Snapshot::kFull);
+
+  // Allocate descriptors object.
+  intptr_t len = reader->ReadSmiValue();
+  PcDescriptors& descriptors = PcDescriptors::ZoneHandle(
+      reader->isolate(), reader->NewPcDescriptors(len));
+  reader->AddBackwardReference(object_id, &descriptors);
+
+  // Set the object tags.
+  descriptors.set_tags(tags);
+
+  // Read the descriptors, the pcs are rebased by Code::ReadFrom.
+  for (intptr_t i = 0; i < (len * kNumberOfEntries); i++) {
+    descriptors.raw_ptr()->data_[i] = reader->ReadIntptrValue();
+  }
+  return descriptors.raw();
 }
 
 
 void RawPcDescriptors::WriteTo(SnapshotWriter* writer,
                                intptr_t object_id,
                                Snapshot::Kind kind) {
-  UNREACHABLE();
+  ASSERT(writer != NULL);
+  ASSERT(kind == Snapshot::kFull);
+
+  // Write out the serialization header value for this object.
+  writer->WriteSerializationMarker(kInlined, object_id);
+
+  // Write out the class and tags information.
+  writer->WriteObjectHeader(Object::kPcDescriptorsClass, ptr()->tags_);
+
+  // Write out the length field and the descriptors.
+  writer->Write<RawObject*>(ptr()->length_);
+  intptr_t len = Smi::Value(ptr()->length_);
+  for (intptr_t i = 0; i < (len * PcDescriptors::kNumberOfEntries); i++) {
+    writer->WriteIntptrValue(ptr()->data_[i]);
+  }
 }
 
 
@@ -924,15 +1084,53 @@ RawLocalVarDescriptors* LocalVarDescriptors::ReadFrom(SnapshotReader* reader,
                                                       intptr_t object_id,
                                                       intptr_t tags,
                                                       Snapshot::Kind kind) {
-  UNREACHABLE();
-  return LocalVarDescriptors::null();
+  ASSERT(reader != NULL);
+  ASSERT(kind == Snapshot::kFull);
+
+  // Allocate descriptors object.
+  intptr_t num_vars = reader->ReadIntptrValue();
+  LocalVarDescriptors& descriptors = LocalVarDescriptors::ZoneHandle(
+      reader->isolate(), reader->NewLocalVarDescriptors(num_vars));
+  reader->AddBackwardReference(object_id, &descriptors);
+
+  // Set the object tags.
+  descriptors.set_tags(tags);
+
+  // Read the variable info and the names.
+  for (intptr_t i = 0; i < num_vars; i++) {
+    RawLocalVarDescriptors::VarInfo* info = &descriptors.raw_ptr()->data_[i];
+    info->index = reader->ReadIntptrValue();
+    info->scope_id = reader->ReadIntptrValue();
+    info->begin_pos = reader->ReadIntptrValue();
+    info->end_pos = reader->ReadIntptrValue();
+  }
+  descriptors.raw_ptr()->names_ = reinterpret_cast<RawArray*>(
+      reader->ReadObject());
+  return descriptors.raw();
 }
 
 
 void RawLocalVarDescriptors::WriteTo(SnapshotWriter* writer,
                                      intptr_t object_id,
                                      Snapshot::Kind kind) {
-  UNREACHABLE();
+  ASSERT(writer != NULL);
+  ASSERT(kind == Snapshot::kFull);
+
+  // Write out the serialization header value for this object.
+  writer->WriteSerializationMarker(kInlined, object_id);
+
+  // Write out the class and tags information.
+  writer->WriteObjectHeader(Object::kLocalVarDescriptorsClass, ptr()->tags_);
+
+  // Write out the variable info and the names.
+  writer->WriteIntptrValue(ptr()->length_);
+  for (intptr_t i = 0; i < ptr()->length_; i++) {
+    writer->WriteIntptrValue(ptr()->data_[i].index);
+    writer->WriteIntptrValue(ptr()->data_[i].scope_id);
+    writer->WriteIntptrValue(ptr()->data_[i].begin_pos);
+    writer->WriteIntptrValue(ptr()->data_[i].end_pos);
+  }
+  writer->WriteObject(ptr()->names_);
 }
 
 
@@ -940,15 +1138,44 @@ RawExceptionHandlers* ExceptionHandlers::ReadFrom(SnapshotReader* reader,
                                                   intptr_t object_id,
                                                   intptr_t tags,
                                                   Snapshot::Kind kind) {
-  UNREACHABLE();
-  return ExceptionHandlers::null();
+  ASSERT(reader != NULL);
+  ASSERT(kind == Snapshot::kFull);
+
+  // Allocate exception handlers object.
+  intptr_t len = reader->ReadSmiValue();
+  ExceptionHandlers& handlers = ExceptionHandlers::ZoneHandle(
+      reader->isolate(), reader->NewExceptionHandlers(len));
+  reader->AddBackwardReference(object_id, &handlers);
+
+  // Set the object tags.
+  handlers.set_tags(tags);
+
+  // Read the handlers, the pcs are rebased by Code::ReadFrom.
+  for (intptr_t i = 0; i < (len * kNumberOfEntries); i++) {
+    handlers.raw_ptr()->data_[i] = reader->ReadIntptrValue();
+  }
+  return handlers.raw();
 }
 
 
 void RawExceptionHandlers::WriteTo(SnapshotWriter* writer,
                                    intptr_t object_id,
                                    Snapshot::Kind kind) {
-  UNREACHABLE();
+  ASSERT(writer != NULL);
+  ASSERT(kind == Snapshot::kFull);
+
+  // Write out the serialization header value for this object.
+  writer->WriteSerializationMarker(kInlined, object_id);
+
+  // Write out the class and tags information.
+  writer->WriteObjectHeader(Object::kExceptionHandlersClass, ptr()->tags_);
+
+  // Write out the length field and the handlers.
+  writer->Write<RawObject*>(ptr()->length_);
+  intptr_t len = Smi::Value(ptr()->length_);
+  for (intptr_t i = 0; i < (len * ExceptionHandlers::kNumberOfEntries); i++) {
+    writer->WriteIntptrValue(ptr()->data_[i]);
+  }
 }
 
 
@@ -1013,12 +1240,14 @@ RawContextScope* ContextScope::ReadFrom(SnapshotReader* reader,
                                         intptr_t tags,
                                         Snapshot::Kind kind) {
   ASSERT(reader != NULL);
-  ASSERT(kind == Snapshot::kMessage);
+  ASSERT(kind != Snapshot::kScript);
 
   // Allocate context scope object.
   intptr_t num_vars = reader->ReadIntptrValue();
-  ContextScope& scope = ContextScope::ZoneHandle(reader->isolate(),
-                                                 ContextScope::New(num_vars));
+  ContextScope& scope = ContextScope::ZoneHandle(
+      reader->isolate(), ((kind == Snapshot::kFull) ?
+                          reader->NewContextScope(num_vars) :
+                          ContextScope::New(num_vars)));
   reader->AddBackwardReference(object_id, &scope);
 
   // Set the object tags.
@@ -1040,7 +1269,7 @@ void RawContextScope::WriteTo(SnapshotWriter* writer,
                               intptr_t object_id,
                               Snapshot::Kind kind) {
   ASSERT(writer != NULL);
-  ASSERT(kind == Snapshot::kMessage);
+  ASSERT(kind != Snapshot::kScript);
 
   // Write out the serialization header value for this object.
   writer->WriteSerializationMarker(kInlined, object_id);
@@ -1061,15 +1290,59 @@ RawICData* ICData::ReadFrom(SnapshotReader* reader,
                             intptr_t object_id,
                             intptr_t tags,
                             Snapshot::Kind kind) {
-  UNREACHABLE();
-  return NULL;
+  ASSERT(reader != NULL);
+  ASSERT(kind == Snapshot::kFull);
+
+  // Allocate IC data object.
+  ICData& result = ICData::ZoneHandle(reader->isolate(), reader->NewICData());
+  reader->AddBackwardReference(object_id, &result);
+
+  // Set the object tags.
+  result.set_tags(tags);
+
+  // Set all non object fields.
+  result.set_id(reader->ReadIntptrValue());
+  result.set_num_args_tested(reader->ReadIntptrValue());
+
+  // Set all the object fields, the inline cache starts out empty.
+  Function& function = Function::Handle();
+  function ^= reader->ReadObject();
+  result.set_function(function);
+  *reader->StringHandle() ^= reader->ReadObject();
+  result.set_target_name(*reader->StringHandle());
+  intptr_t len = result.TestEntryLength();
+  const Array& ic_data = Array::Handle(reader->NewArray(len));
+  ic_data.SetTypeArguments(AbstractTypeArguments::Handle());
+  for (intptr_t i = 0; i < len; i++) {
+    ic_data.SetAt(i, Object::Handle());
+  }
+  result.set_ic_data(ic_data);
+  result.set_megamorphic_cache(Array::Handle());
+
+  return result.raw();
 }
 
 
 void RawICData::WriteTo(SnapshotWriter* writer,
                         intptr_t object_id,
                         Snapshot::Kind kind) {
-  UNREACHABLE();
+  ASSERT(writer != NULL);
+  ASSERT(kind == Snapshot::kFull);
+
+  // Write out the serialization header value for this object.
+  writer->WriteSerializationMarker(kInlined, object_id);
+
+  // Write out the class and tags information.
+  writer->WriteObjectHeader(Object::kICDataClass, ptr()->tags_);
+
+  // Write out all the non object fields.
+  writer->WriteIntptrValue(ptr()->id_);
+  writer->WriteIntptrValue(ptr()->num_args_tested_);
+
+  // Write out the function and the target name. The checks are not written
+  // as their targets may be functions of which the code is not included.
+  writer->WriteObject(ptr()->function_);
+  writer->WriteObject(ptr()->target_name_);
 }
 
 
@@ -1821,8 +2094,25 @@ RawExternalByteArray* ExternalByteArray::ReadFrom(SnapshotReader* reader,
                                                   intptr_t object_id,
                                                   intptr_t tags,
                                                   Snapshot::Kind kind) {
-  UNREACHABLE();
-  return ExternalByteArray::null();
+  ASSERT(reader != NULL);
+  ASSERT(kind == Snapshot::kMessage);
+
+  // The receiving isolate adopts the data handed over by the sender.
+  intptr_t len = reader->ReadSmiValue();
+  Message::Transfer* transfer = reader->TransferAt(reader->ReadIntptrValue());
+  ASSERT(transfer->length == len);
+  ExternalByteArray& result = ExternalByteArray::ZoneHandle(
+      reader->isolate(),
+      ExternalByteArray::New(transfer->data,
+                             len,
+                             transfer->peer,
+                             transfer->callback));
+  // The data is claimed, the message does not release it anymore.
+  transfer->data = NULL;
+  transfer->peer = NULL;
+  transfer->callback = NULL;
+  reader->AddBackwardReference(object_id, &result);
+  return result.raw();
 }
 
 
@@ -1852,6 +2142,29 @@ static void ByteArrayWriteTo(SnapshotWriter* writer,
 }
 
 
+// Write a reference to the data of a byte array handed over to the receiver
+// of a message, which adopts it as an external byte array.
+static void ExternalByteArrayTransferTo(SnapshotWriter* writer,
+                                        intptr_t object_id,
+                                        intptr_t tags,
+                                        RawSmi* length,
+                                        intptr_t transfer_index) {
+  ASSERT(writer != NULL);
+
+  // Write out the serialization header value for this object.
+  writer->WriteSerializationMarker(kInlined, object_id);
+
+  // Write out the class and tags information.
+  writer->WriteObjectHeader(ObjectStore::kExternalByteArrayClass, tags);
+
+  // Write out the length field.
+  writer->Write<RawObject*>(length);
+
+  // Write out the index of the transfer in the message.
+  writer->WriteIntptrValue(transfer_index);
+}
+
+
 void RawByteArray::WriteTo(SnapshotWriter* writer,
                            intptr_t object_id,
                            Snapshot::Kind kind) {
@@ -1862,6 +2175,23 @@ void RawByteArray::WriteTo(SnapshotWriter* writer,
 void RawInternalByteArray::WriteTo(SnapshotWriter* writer,
                                    intptr_t object_id,
                                    Snapshot::Kind kind) {
+  intptr_t len = Smi::Value(ptr()->length_);
+  if ((kind == Snapshot::kMessage) &&
+      (writer->transfer_byte_arrays() ||
+       ((FLAG_message_external_byte_array_length > 0) &&
+        (len >= FLAG_message_external_byte_array_length)))) {
+    // Copy the data into external storage adopted by the receiver, instead
+    // of copying it into the snapshot and out of it again.
+    intptr_t transfer_index = writer->TransferByteArray(this, false);
+    if (transfer_index >= 0) {
+      ExternalByteArrayTransferTo(writer,
+                                  object_id,
+                                  ptr()->tags_,
+                                  ptr()->length_,
+                                  transfer_index);
+      return;
+    }
+  }
   ByteArrayWriteTo(writer,
                    object_id,
                    kind,
@@ -1875,6 +2205,19 @@ void RawInternalByteArray::WriteTo(SnapshotWriter* writer,
 void RawExternalByteArray::WriteTo(SnapshotWriter* writer,
                                    intptr_t object_id,
                                    Snapshot::Kind kind) {
+  if (kind == Snapshot::kMessage) {
+    // Hand the data over to the receiver without copying it, if the sender
+    // asked for it.
+    intptr_t transfer_index = writer->TransferByteArray(this, true);
+    if (transfer_index >= 0) {
+      ExternalByteArrayTransferTo(writer,
+                                  object_id,
+                                  ptr()->tags_,
+                                  ptr()->length_,
+                                  transfer_index);
+      return;
+    }
+  }
   // Serialize as an internal byte array.
   ByteArrayWriteTo(writer,
                    object_id,
@@ -1923,15 +2266,16 @@ RawJSRegExp* JSRegExp::ReadFrom(SnapshotReader* reader,
                                 intptr_t tags,
                                 Snapshot::Kind kind) {
   ASSERT(reader != NULL);
-  ASSERT(kind == Snapshot::kMessage);
+  ASSERT(kind != Snapshot::kScript);
 
   // Read the length so that we can determine instance size to allocate.
   intptr_t len = reader->ReadSmiValue();
 
   // Allocate JSRegExp object.
   JSRegExp& regex = JSRegExp::ZoneHandle(
-      reader->isolate(),
-      JSRegExp::New(len, (kind == Snapshot::kFull) ? Heap::kOld : Heap::kNew));
+      reader->isolate(), ((kind == Snapshot::kFull) ?
+                          reader->NewJSRegExp(len) :
+                          JSRegExp::New(len, Heap::kNew)));
   reader->AddBackwardReference(object_id, &regex);
 
   // Set the object tags.
@@ -1944,6 +2288,16 @@ RawJSRegExp* JSRegExp::ReadFrom(SnapshotReader* reader,
   regex.raw_ptr()->type_ = reader->ReadIntptrValue();
   regex.raw_ptr()->flags_ = reader->ReadIntptrValue();
 
+  // The compiled regex does not depend on its address and is included in
+  // full snapshots, which may have been compiled at compile time as a
+  // constant.
+  if (kind == Snapshot::kFull) {
+    uint8_t* data = reinterpret_cast<uint8_t*>(regex.GetDataStartAddress());
+    for (intptr_t i = 0; i < len; i++) {
+      data[i] = reader->Read<uint8_t>();
+    }
+  }
+
   // TODO(5411462): Need to implement a way of recompiling the regex.
 
   return regex.raw();
@@ -1954,7 +2308,7 @@ void RawJSRegExp::WriteTo(SnapshotWriter* writer,
                           intptr_t object_id,
                           Snapshot::Kind kind) {
   ASSERT(writer != NULL);
-  ASSERT(kind == Snapshot::kMessage);
+  ASSERT(kind != Snapshot::kScript);
 
   // Write out the serialization header value for this object.
   writer->WriteSerializationMarker(kInlined, object_id);
@@ -1971,7 +2325,14 @@ void RawJSRegExp::WriteTo(SnapshotWriter* writer,
   writer->WriteIntptrValue(ptr()->type_);
   writer->WriteIntptrValue(ptr()->flags_);
 
-  // Do not write out the data part which is native.
+  // Do not write out the data part which is native, except in a full
+  // snapshot (see JSRegExp::ReadFrom).
+  if (kind == Snapshot::kFull) {
+    intptr_t len = Smi::Value(ptr()->data_length_);
+    for (intptr_t i = 0; i < len; i++) {
+      writer->Write<uint8_t>(ptr()->data_[i]);
+    }
+  }
 }
 
 
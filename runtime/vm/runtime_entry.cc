@@ -0,0 +1,35 @@
+// Copyright (c) 2012, the Dart project authors.  Please see the AUTHORS file
+// for details. All rights reserved. Use of this source code is governed by a
+// BSD-style license that can be found in the LICENSE file.
+
+#include "vm/runtime_entry.h"
+
+namespace dart {
+
+const RuntimeEntry* RuntimeEntry::list_ = NULL;
+
+
+const RuntimeEntry* RuntimeEntry::LookupByEntryPoint(uword entry_point) {
+  for (const RuntimeEntry* entry = list_;
+       entry != NULL;
+       entry = entry->next_) {
+    if (entry->GetEntryPoint() == entry_point) {
+      return entry;
+    }
+  }
+  return NULL;
+}
+
+
+const RuntimeEntry* RuntimeEntry::LookupByName(const char* name) {
+  for (const RuntimeEntry* entry = list_;
+       entry != NULL;
+       entry = entry->next_) {
+    if (strcmp(entry->name(), name) == 0) {
+      return entry;
+    }
+  }
+  return NULL;
+}
+
+}  // namespace dart
@@ -25,7 +25,10 @@ class RuntimeEntry : public ValueObject {
   RuntimeEntry(const char* name, RuntimeFunction function, int argument_count)
       : name_(name),
         function_(function),
-        argument_count_(argument_count) { }
+        argument_count_(argument_count),
+        next_(list_) {
+    list_ = this;
+  }
   ~RuntimeEntry() {}
 
   const char* name() const { return name_; }
@@ -37,11 +40,21 @@ class RuntimeEntry : public ValueObject {
   void CallFromDart(Assembler* assembler) const;
   void CallFromStub(Assembler* assembler) const;
 
+  // Find the runtime entry with the given entry point or name among all the
+  // runtime entries defined in the VM. Returns NULL if there is none.
+  // Code in snapshots refers to runtime entries by name.
+  static const RuntimeEntry* LookupByEntryPoint(uword entry_point);
+  static const RuntimeEntry* LookupByName(const char* name);
+
  private:
   const char* name_;
   RuntimeFunction function_;
   int argument_count_;
 
+  // All runtime entries are statically allocated and linked at startup.
+  const RuntimeEntry* next_;
+  static const RuntimeEntry* list_;
+
   DISALLOW_COPY_AND_ASSIGN(RuntimeEntry);
 };
 
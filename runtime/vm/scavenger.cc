@@ -6,14 +6,33 @@
 
 #include "vm/dart.h"
 #include "vm/dart_api_state.h"
+#include "vm/flags.h"
+#include "vm/gc_tracer.h"
+#include "vm/heap.h"
 #include "vm/isolate.h"
 #include "vm/object.h"
+#include "vm/pages.h"
 #include "vm/stack_frame.h"
 #include "vm/verifier.h"
 #include "vm/visitor.h"
 
 namespace dart {
 
+DEFINE_FLAG(int, tenuring_age, 2,
+            "Number of scavenges a new object survives before it is promoted "
+            "to old space, at most 3.");
+DEFINE_FLAG(int, new_gen_min_heap_size, 2,
+            "Minimum size in MB the new gen heap shrinks to.");
+DEFINE_FLAG(int, new_gen_grow_survival, 20,
+            "Grow new space when more than this percentage of it survives a "
+            "scavenge.");
+DEFINE_FLAG(int, new_gen_shrink_survival, 2,
+            "Shrink new space when less than this percentage of it survives a "
+            "scavenge.");
+DEFINE_FLAG(int, scavenge_pause_target, 10000,
+            "Shrink new space when a scavenge takes longer than this many "
+            "microseconds.");
+
 enum {
   kForwardingMask = 3,
   kNotForwarded = 1,  // Tagged pointer.
@@ -46,7 +65,10 @@ class ScavengerVisitor : public ObjectPointerVisitor {
   explicit ScavengerVisitor(Scavenger* scavenger)
       : scavenger_(scavenger),
         heap_(scavenger->heap_),
-        vm_heap_(Dart::vm_isolate()->heap()) {}
+        vm_heap_(Dart::vm_isolate()->heap()),
+        store_buffer_(Isolate::Current()->store_buffer()),
+        visiting_old_object_(NULL),
+        visiting_card_page_(NULL) {}
 
   void VisitPointers(RawObject** first, RawObject** last) {
     for (RawObject** current = first; current <= last; current++) {
@@ -54,9 +76,31 @@ class ScavengerVisitor : public ObjectPointerVisitor {
     }
   }
 
+  // Set while visiting the pointers of an old object, so that the object can
+  // be remembered again if it still refers to new objects after the scavenge.
+  void VisitingOldObject(RawObject* obj) {
+    ASSERT((obj == NULL) || obj->IsOldObject());
+    visiting_old_object_ = obj;
+    visiting_card_page_ = NULL;
+    if (obj != NULL) {
+      HeapPage* page = PageSpace::PageFor(obj);
+      if (page->card_table() != NULL) {
+        visiting_card_page_ = page;
+      }
+    }
+  }
+
  private:
   void UpdateStoreBuffer(RawObject** p, RawObject* obj) {
-    // TODO(iposva): Implement store buffers.
+    if ((visiting_old_object_ != NULL) && obj->IsNewObject()) {
+      if (visiting_card_page_ != NULL) {
+        visiting_card_page_->DirtyCard(reinterpret_cast<uword>(p));
+      }
+      if (!visiting_old_object_->IsRemembered()) {
+        visiting_old_object_->SetRememberedBit();
+        store_buffer_->AddObject(visiting_old_object_);
+      }
+    }
   }
 
   void ScavengePointer(RawObject** p) {
@@ -83,23 +127,22 @@ class ScavengerVisitor : public ObjectPointerVisitor {
       new_addr = ForwardedAddr(header);
     } else {
       intptr_t size = raw_obj->Size();
+      intptr_t age = raw_obj->Age();
       // Check whether object should be promoted.
-      if (scavenger_->survivor_end_ <= raw_addr) {
-        // Not a survivor of a previous scavenge. Just copy the object into the
-        // to space.
+      if (age < Utils::Minimum<intptr_t>(FLAG_tenuring_age,
+                                         RawObject::kMaxAge)) {
+        // Not old enough to be promoted. Just copy the object into the to
+        // space.
         new_addr = scavenger_->TryAllocate(size);
       } else {
-        // TODO(iposva): Experiment with less aggressive promotion. For example
-        // a coin toss determines if an object is promoted or whether it should
-        // survive in this generation.
-        //
-        // This object is a survivor of a previous scavenge. Attempt to promote
-        // the object.
+        // This object survived enough scavenges. Attempt to promote the
+        // object.
         new_addr = heap_->TryAllocate(size, Heap::kOld);
         if (new_addr != 0) {
           // If promotion succeeded then we need to remember it so that it can
           // be traversed later.
           scavenger_->PushToPromotedStack(new_addr);
+          scavenger_->promoted_ += size;
         } else {
           // Promotion did not succeed. Copy into the to space instead.
           scavenger_->had_promotion_failure_ = true;
@@ -113,6 +156,14 @@ class ScavengerVisitor : public ObjectPointerVisitor {
       memmove(reinterpret_cast<void*>(new_addr),
               reinterpret_cast<void*>(raw_addr),
               size);
+      // Age the copy in new space, old objects do not carry an age.
+      RawObject* copied_obj = RawObject::FromAddr(new_addr);
+      if (copied_obj->IsNewObject()) {
+        copied_obj->SetAge(Utils::Minimum(age + 1, RawObject::kMaxAge));
+      } else {
+        copied_obj->SetAge(0);
+        heap_->AllocateBlack(copied_obj, size);
+      }
       // Remember forwarding address.
       ForwardTo(raw_addr, new_addr);
     }
@@ -126,11 +177,78 @@ class ScavengerVisitor : public ObjectPointerVisitor {
   Scavenger* scavenger_;
   Heap* heap_;
   Heap* vm_heap_;
+  StoreBuffer* store_buffer_;
+  RawObject* visiting_old_object_;
+  HeapPage* visiting_card_page_;
 
   DISALLOW_COPY_AND_ASSIGN(ScavengerVisitor);
 };
 
 
+// Visits only the pointers of a remembered object on a card marked page which
+// are located in the dirty cards.
+class ScavengerCardVisitor : public ObjectPointerVisitor {
+ public:
+  ScavengerCardVisitor(ScavengerVisitor* visitor,
+                       HeapPage* page,
+                       const uint8_t* dirty_cards)
+      : visitor_(visitor), page_(page), dirty_cards_(dirty_cards) {}
+
+  void VisitPointers(RawObject** first, RawObject** last) {
+    intptr_t first_card = page_->CardIndexFor(reinterpret_cast<uword>(first));
+    intptr_t last_card = page_->CardIndexFor(reinterpret_cast<uword>(last));
+    for (intptr_t card = first_card; card <= last_card; card++) {
+      if (dirty_cards_[card] == 0) {
+        continue;
+      }
+      RawObject** card_first =
+          reinterpret_cast<RawObject**>(page_->CardStart(card));
+      RawObject** card_last =
+          reinterpret_cast<RawObject**>(page_->CardStart(card + 1)) - 1;
+      visitor_->VisitPointers((card_first < first) ? first : card_first,
+                              (card_last > last) ? last : card_last);
+    }
+  }
+
+ private:
+  ScavengerVisitor* visitor_;
+  HeapPage* page_;
+  const uint8_t* dirty_cards_;
+
+  DISALLOW_COPY_AND_ASSIGN(ScavengerCardVisitor);
+};
+
+
+// Visits all objects in old space when the store buffer has overflowed and
+// rebuilds the remembered set along the way.
+class ScavengerOldObjectVisitor : public ObjectVisitor {
+ public:
+  explicit ScavengerOldObjectVisitor(ScavengerVisitor* visitor)
+      : visitor_(visitor) {}
+
+  void VisitObject(RawObject* raw_obj) {
+    if (raw_obj->IsFreeListElement()) {
+      return;
+    }
+    if (raw_obj->IsRemembered()) {
+      raw_obj->ClearRememberedBit();
+    }
+    HeapPage* page = PageSpace::PageFor(raw_obj);
+    if (page->card_table() != NULL) {
+      memset(page->card_table(), 0, page->NumCards());
+    }
+    visitor_->VisitingOldObject(raw_obj);
+    raw_obj->VisitPointers(visitor_);
+    visitor_->VisitingOldObject(NULL);
+  }
+
+ private:
+  ScavengerVisitor* visitor_;
+
+  DISALLOW_COPY_AND_ASSIGN(ScavengerOldObjectVisitor);
+};
+
+
 class ScavengerWeakVisitor : public HandleVisitor {
  public:
   explicit ScavengerWeakVisitor(Scavenger* scavenger) : scavenger_(scavenger) {
@@ -182,11 +300,11 @@ Scavenger::Scavenger(Heap* heap, intptr_t max_capacity, uword object_alignment)
   ASSERT(Utils::IsAligned(to_->start(), kObjectAlignment));
   ASSERT(Utils::IsAligned(from_->start(), kObjectAlignment));
 
-  // Setup local fields.
+  // Setup local fields. New space starts out using all of its semi-spaces.
+  capacity_ = semi_space_size;
+  promoted_ = 0;
   top_ = FirstObjectStart();
-  end_ = to_->end();
-
-  survivor_end_ = FirstObjectStart();
+  end_ = to_->start() + capacity_;
 
 #if defined(DEBUG)
   memset(to_->pointer(), 0xf3, to_->size());
@@ -212,15 +330,14 @@ void Scavenger::Prologue(Isolate* isolate, bool invoke_api_callbacks) {
   from_ = to_;
   to_ = temp;
   top_ = FirstObjectStart();
+  // The whole to space is available while scavenging, the promoted stack
+  // grows down from its end.
   end_ = to_->end();
+  promoted_ = 0;
 }
 
 
 void Scavenger::Epilogue(Isolate* isolate, bool invoke_api_callbacks) {
-  // All objects in the to space have been copied from the from space at this
-  // moment.
-  survivor_end_ = top_;
-
 #if defined(DEBUG)
   memset(from_->pointer(), 0xf3, from_->size());
 #endif  // defined(DEBUG)
@@ -230,13 +347,99 @@ void Scavenger::Epilogue(Isolate* isolate, bool invoke_api_callbacks) {
 }
 
 
+void Scavenger::AdaptCapacity(intptr_t in_use_before, int64_t elapsed) {
+  intptr_t survived = in_use() + promoted_;
+  intptr_t survival_rate =
+      (in_use_before == 0) ? 0 : ((survived * 100) / in_use_before);
+  intptr_t min_capacity = Utils::Minimum<intptr_t>(
+      to_->size(),
+      Utils::RoundUp(FLAG_new_gen_min_heap_size * MB / 2,
+                     VirtualMemory::PageSize()));
+  intptr_t new_capacity = capacity_;
+  if ((elapsed > FLAG_scavenge_pause_target) ||
+      (survival_rate < FLAG_new_gen_shrink_survival)) {
+    // Most objects die young or the scavenge took too long, less new space
+    // suffices.
+    new_capacity = Utils::Maximum(capacity_ / 2, min_capacity);
+  } else if (survival_rate > FLAG_new_gen_grow_survival) {
+    // Give the surviving objects more time to die before they get promoted.
+    new_capacity = Utils::Minimum<intptr_t>(capacity_ * 2, to_->size());
+  }
+  // The surviving objects have to fit.
+  new_capacity = Utils::Maximum<intptr_t>(
+      new_capacity, Utils::RoundUp(in_use(), VirtualMemory::PageSize()));
+  if (FLAG_verbose_gc && (new_capacity != capacity_)) {
+    OS::PrintErr("Scavenge[%d]: %s new space %dK -> %dK (survival %d%%)\n",
+                 count_,
+                 (new_capacity > capacity_) ? "growing" : "shrinking",
+                 capacity_ / KB,
+                 new_capacity / KB,
+                 survival_rate);
+  }
+  capacity_ = new_capacity;
+  end_ = to_->start() + capacity_;
+  ASSERT(top_ <= end_);
+}
+
+
+void Scavenger::VisitDirtyCards(RawObject* raw_object,
+                                HeapPage* page,
+                                ScavengerVisitor* visitor) {
+  // Clean the cards before visiting, the visitor dirties the cards which
+  // still refer to new space afterwards.
+  intptr_t num_cards = page->NumCards();
+  uint8_t* dirty_cards = new uint8_t[num_cards];
+  memmove(dirty_cards, page->card_table(), num_cards);
+  memset(page->card_table(), 0, num_cards);
+  ScavengerCardVisitor card_visitor(visitor, page, dirty_cards);
+  raw_object->VisitPointers(&card_visitor);
+  delete[] dirty_cards;
+}
+
+
+void Scavenger::IterateStoreBuffers(Isolate* isolate,
+                                    ScavengerVisitor* visitor) {
+  StoreBuffer* buffer = isolate->store_buffer();
+  if (buffer->Overflowed()) {
+    // The remembered set is incomplete. Drop it and visit all of old space,
+    // remembering the objects which still refer to new space afterwards.
+    buffer->Reset();
+    ScavengerOldObjectVisitor old_visitor(visitor);
+    heap_->IterateOldObjects(&old_visitor);
+    return;
+  }
+  // Objects only get remembered again while visiting the taken blocks if they
+  // still refer to new space.
+  StoreBufferBlock* blocks = buffer->TakeBlocks();
+  for (StoreBufferBlock* block = blocks;
+       block != NULL;
+       block = block->next()) {
+    intptr_t count = block->Count();
+    for (intptr_t i = 0; i < count; i++) {
+      RawObject* raw_object = block->At(i);
+      ASSERT(raw_object->IsRemembered());
+      raw_object->ClearRememberedBit();
+      visitor->VisitingOldObject(raw_object);
+      HeapPage* page = PageSpace::PageFor(raw_object);
+      if (page->card_table() == NULL) {
+        raw_object->VisitPointers(visitor);
+      } else {
+        VisitDirtyCards(raw_object, page, visitor);
+      }
+    }
+    visitor->VisitingOldObject(NULL);
+  }
+  buffer->ReleaseBlocks(blocks);
+}
+
+
 void Scavenger::IterateRoots(Isolate* isolate,
-                             ObjectPointerVisitor* visitor,
+                             ScavengerVisitor* visitor,
                              bool visit_prologue_weak_persistent_handles) {
+  IterateStoreBuffers(isolate, visitor);
   isolate->VisitObjectPointers(visitor,
                                visit_prologue_weak_persistent_handles,
                                StackFrameIterator::kDontValidateFrames);
-  heap_->IterateOldPointers(visitor);
 }
 
 
@@ -248,7 +451,7 @@ void Scavenger::IterateWeakRoots(Isolate* isolate,
 }
 
 
-void Scavenger::ProcessToSpace(ObjectPointerVisitor* visitor) {
+void Scavenger::ProcessToSpace(ScavengerVisitor* visitor) {
   uword resolved_top = FirstObjectStart();
   // Iterate until all work has been drained.
   while ((resolved_top < top_) || PromotedStackHasMore()) {
@@ -261,8 +464,10 @@ void Scavenger::ProcessToSpace(ObjectPointerVisitor* visitor) {
       // Resolve or copy all objects referred to by the current object. This
       // can potentially push more objects on this stack as well as add more
       // objects to be resolved in the to space.
+      visitor->VisitingOldObject(raw_object);
       raw_object->VisitPointers(visitor);
     }
+    visitor->VisitingOldObject(NULL);
   }
 }
 
@@ -276,14 +481,24 @@ void Scavenger::VisitObjectPointers(ObjectPointerVisitor* visitor) const {
 }
 
 
+void Scavenger::VisitObjects(ObjectVisitor* visitor) const {
+  uword cur = FirstObjectStart();
+  while (cur < top_) {
+    RawObject* raw_obj = RawObject::FromAddr(cur);
+    visitor->VisitObject(raw_obj);
+    cur += raw_obj->Size();
+  }
+}
+
+
 void Scavenger::Scavenge() {
   // TODO(cshapiro): Add a decision procedure for determining when the
   // the API callbacks should be invoked.
-  Scavenge(false);
+  Scavenge(false, kGcNewSpaceFull);
 }
 
 
-void Scavenger::Scavenge(bool invoke_api_callbacks) {
+void Scavenger::Scavenge(bool invoke_api_callbacks, Dart_GcReason reason) {
   // Scavenging is not reentrant. Make sure that is the case.
   ASSERT(!scavenging_);
   scavenging_ = true;
@@ -296,20 +511,42 @@ void Scavenger::Scavenge(bool invoke_api_callbacks) {
     OS::PrintErr(" done.\n");
   }
 
-  Timer timer(FLAG_verbose_gc, "Scavenge");
+  // The timer is always enabled as the scavenge time drives the sizing of new
+  // space.
+  Timer timer(true, "Scavenge");
   timer.Start();
+  GCTracer* tracer = heap_->tracer();
+  tracer->StartEvent(reason);
+  intptr_t in_use_before = in_use();
   // Setup the visitor and run a scavenge.
   ScavengerVisitor visitor(this);
   Prologue(isolate, invoke_api_callbacks);
-  IterateRoots(isolate, &visitor, !invoke_api_callbacks);
-  ProcessToSpace(&visitor);
-  ScavengerWeakVisitor weak_visitor(this);
-  IterateWeakRoots(isolate, &weak_visitor, invoke_api_callbacks);
+  {
+    GCPhaseScope phase(tracer, kGcRootsPhase);
+    IterateRoots(isolate, &visitor, !invoke_api_callbacks);
+  }
+  {
+    GCPhaseScope phase(tracer, kGcProcessToSpacePhase);
+    ProcessToSpace(&visitor);
+  }
+  {
+    GCPhaseScope phase(tracer, kGcWeakHandlesPhase);
+    ScavengerWeakVisitor weak_visitor(this);
+    IterateWeakRoots(isolate, &weak_visitor, invoke_api_callbacks);
+  }
   Epilogue(isolate, invoke_api_callbacks);
   timer.Stop();
+  tracer->EndEvent(kGcScavenge, in_use_before, in_use(), capacity(), promoted_);
   if (FLAG_verbose_gc) {
-    OS::PrintErr("Scavenge[%d]: %dus\n", count_, timer.TotalElapsedTime());
+    const intptr_t KB2 = KB / 2;
+    OS::PrintErr("Scavenge[%d]: %lldus (%dK -> %dK, %dK promoted)\n",
+                 count_,
+                 timer.TotalElapsedTime(),
+                 (in_use_before + KB2) / KB,
+                 (in_use() + KB2) / KB,
+                 (promoted_ + KB2) / KB);
   }
+  AdaptCapacity(in_use_before, timer.TotalElapsedTime());
 
   if (FLAG_verify_after_gc) {
     OS::PrintErr("Verifying after Scavenge... ");
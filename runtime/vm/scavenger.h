@@ -5,6 +5,7 @@
 #ifndef VM_SCAVENGER_H_
 #define VM_SCAVENGER_H_
 
+#include "include/dart_api.h"
 #include "platform/assert.h"
 #include "platform/utils.h"
 #include "vm/flags.h"
@@ -17,7 +18,9 @@ namespace dart {
 
 // Forward declarations.
 class Heap;
+class HeapPage;
 class Isolate;
+class ScavengerVisitor;
 
 DECLARE_FLAG(bool, gc_at_alloc);
 
@@ -60,7 +63,7 @@ class Scavenger {
 
   // Collect the garbage in this scavenger.
   void Scavenge();
-  void Scavenge(bool invoke_api_callbacks);
+  void Scavenge(bool invoke_api_callbacks, Dart_GcReason reason);
 
   // Accessors to generate code for inlined allocation.
   uword* TopAddress() { return &top_; }
@@ -69,20 +72,30 @@ class Scavenger {
   static intptr_t end_offset() { return OFFSET_OF(Scavenger, end_); }
 
   intptr_t in_use() const { return (top_ - FirstObjectStart()); }
+  // The usable part of a semi-space, adapted to the survival rate.
+  intptr_t capacity() const { return capacity_; }
 
   void VisitObjectPointers(ObjectPointerVisitor* visitor) const;
+  void VisitObjects(ObjectVisitor* visitor) const;
 
  private:
   uword FirstObjectStart() const { return to_->start() | object_alignment_; }
   void Prologue(Isolate* isolate, bool invoke_api_callbacks);
+  void VisitDirtyCards(RawObject* raw_object,
+                       HeapPage* page,
+                       ScavengerVisitor* visitor);
+  void IterateStoreBuffers(Isolate* isolate, ScavengerVisitor* visitor);
   void IterateRoots(Isolate* isolate,
-                    ObjectPointerVisitor* visitor,
+                    ScavengerVisitor* visitor,
                     bool visit_prologue_weak_persistent_handles);
   void IterateWeakRoots(Isolate* isolate,
                         HandleVisitor* visitor,
                         bool visit_prologue_weak_persistent_handles);
-  void ProcessToSpace(ObjectPointerVisitor* visitor);
+  void ProcessToSpace(ScavengerVisitor* visitor);
   void Epilogue(Isolate* isolate, bool invoke_api_callbacks);
+  // Grows or shrinks the usable part of the semi-spaces based on how much of
+  // new space survived the last scavenge and how long it took.
+  void AdaptCapacity(intptr_t in_use_before, int64_t elapsed);
 
   // During a scavenge we need to remember the promoted objects.
   // This is implemented as a stack of objects at the end of the to space. As
@@ -114,8 +127,10 @@ class Scavenger {
   uword top_;
   uword end_;
 
-  // Objects below this address have survived a scavenge.
-  uword survivor_end_;
+  // The usable size of the semi-spaces.
+  intptr_t capacity_;
+  // Size of the objects promoted during the current scavenge.
+  intptr_t promoted_;
 
   // All object are aligned to this value.
   uword object_alignment_;
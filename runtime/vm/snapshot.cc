@@ -7,10 +7,14 @@
 #include "platform/assert.h"
 #include "vm/bigint_operations.h"
 #include "vm/bootstrap.h"
+#include "vm/code_index_table.h"
 #include "vm/exceptions.h"
 #include "vm/heap.h"
 #include "vm/object.h"
 #include "vm/object_store.h"
+#include "vm/pages.h"
+#include "vm/runtime_entry.h"
+#include "vm/stub_code.h"
 
 namespace dart {
 
@@ -70,7 +74,7 @@ intptr_t BaseReader::ReadSmiValue() {
 
 SnapshotReader::SnapshotReader(const Snapshot* snapshot, Isolate* isolate)
     : BaseReader(snapshot->content(), snapshot->length()),
-      kind_(snapshot->kind()),
+      kind_(snapshot->IsFullSnapshot() ? Snapshot::kFull : snapshot->kind()),
       isolate_(isolate),
       cls_(Class::Handle()),
       obj_(Object::Handle()),
@@ -78,9 +82,10 @@ SnapshotReader::SnapshotReader(const Snapshot* snapshot, Isolate* isolate)
       library_(Library::Handle()),
       type_(AbstractType::Handle()),
       type_arguments_(AbstractTypeArguments::Handle()),
-      backward_references_((snapshot->kind() == Snapshot::kFull) ?
+      backward_references_(snapshot->IsFullSnapshot() ?
                            kNumInitialReferencesInFullSnapshot :
-                           kNumInitialReferences) {
+                           kNumInitialReferences),
+      stub_immediates_() {
 }
 
 
@@ -143,6 +148,110 @@ void SnapshotReader::ReadFullSnapshot() {
 }
 
 
+void SnapshotReader::InstallCode() {
+  ASSERT(kind_ == Snapshot::kFull);
+  ASSERT(isolate()->stub_code() != NULL);
+  for (intptr_t i = 0; i < stub_immediates_.length(); i++) {
+    StubImmediate* immediate = stub_immediates_[i];
+    uword address = immediate->code()->EntryPoint() + immediate->offset();
+    *reinterpret_cast<uword*>(address) =
+        StubCode::IsolateStubEntryPointAt(immediate->stub_index());
+  }
+
+  // The stubs of the code read from the snapshot have no function and are
+  // not looked up by pc.
+  CodeIndexTable* code_index_table = isolate()->code_index_table();
+  ASSERT(code_index_table != NULL);
+  Code& code = Code::Handle();
+  for (intptr_t i = 0; i < backward_references_.length(); i++) {
+    const Object& obj = *backward_references_[i];
+    if (obj.IsCode()) {
+      code ^= obj.raw();
+      if (code.function() != Function::null()) {
+        code_index_table->AddCode(code);
+      }
+    }
+  }
+}
+
+
+void SnapshotReader::ReadCodeImmediate(const Code& code, intptr_t index) {
+  ASSERT(kind_ == Snapshot::kFull);
+  const intptr_t offset = code.GetImmediateOffsetAt(index);
+  uword value = 0;
+  switch (static_cast<CodeImmediateKind>(ReadIntptrValue())) {
+    case kImmediateConstant:
+      value = ReadIntptrValue();
+      break;
+    case kImmediateNull:
+      value = reinterpret_cast<uword>(Object::null());
+      break;
+    case kImmediateVMStub:
+      value = StubCode::VMStubEntryPointAt(ReadIntptrValue());
+      break;
+    case kImmediateIsolateStub: {
+      // The isolate stubs are generated after the snapshot is read, the code
+      // handle is a backward reference and stays valid until then.
+      intptr_t stub_index = ReadIntptrValue();
+      stub_immediates_.Add(new StubImmediate(&code, offset, stub_index));
+      return;
+    }
+    case kImmediateCode: {
+      Code& target = Code::Handle();
+      target ^= ReadObject();
+      value = target.EntryPoint();
+      break;
+    }
+    case kImmediateRuntimeEntry: {
+      const char* name = ReadCString();
+      const RuntimeEntry* entry = RuntimeEntry::LookupByName(name);
+      if (entry == NULL) {
+        FATAL1("Runtime entry '%s' of the snapshot not found.", name);
+      }
+      value = entry->GetEntryPoint();
+      break;
+    }
+    case kImmediateStackLimit:
+      value = isolate()->stack_limit_address();
+      break;
+    case kImmediateHeapTop:
+      value = heap()->TopAddress();
+      break;
+    case kImmediateHeapEnd:
+      value = heap()->EndAddress();
+      break;
+    case kImmediateMarkingSpaces:
+      value = PageSpace::num_marking_spaces_address();
+      break;
+    case kImmediateStopMessage: {
+      // The code may outlive the snapshot buffer, the message is only used
+      // when the code stops and is never freed.
+      const char* message = ReadCString();
+      intptr_t len = strlen(message);
+      char* copy = reinterpret_cast<char*>(malloc(len + 1));
+      memmove(copy, message, len + 1);
+      value = reinterpret_cast<uword>(copy);
+      break;
+    }
+    default:
+      UNREACHABLE();
+  }
+  *reinterpret_cast<uword*>(code.EntryPoint() + offset) = value;
+}
+
+
+const char* SnapshotReader::ReadCString() {
+  intptr_t len = ReadIntptrValue();
+  char* str = reinterpret_cast<char*>(
+      isolate()->current_zone()->Allocate(len + 1));
+  for (intptr_t i = 0; i < len; i++) {
+    str[i] = Read<uint8_t>();
+  }
+  str[len] = '\0';
+  return str;
+}
+
+
 #define ALLOC_NEW_OBJECT_WITH_LEN(type, class_obj, length)                     \
   ASSERT(kind_ == Snapshot::kFull);                                            \
   ASSERT(isolate()->no_gc_scope_depth() != 0);                                 \
@@ -248,10 +357,20 @@ RawBigint* SnapshotReader::NewBigint(const char* hex_string) {
   ASSERT(kind_ == Snapshot::kFull);
   ASSERT(isolate()->no_gc_scope_depth() != 0);
   cls_ = object_store()->bigint_class();
-  intptr_t bigint_length = BigintOperations::ComputeChunkLength(hex_string);
-  const Bigint& result = Bigint::Handle(reinterpret_cast<RawBigint*>(
-      AllocateUninitialized(cls_, Bigint::InstanceSize(bigint_length))));
-  BigintOperations::FromHexCString(hex_string, result);
+  // The digits are read without the sign, see
+  // BigintOperations::FromHexCString.
+  const bool is_negative = (hex_string[0] == '-');
+  const char* digits = is_negative ? &hex_string[1] : hex_string;
+  intptr_t bigint_length = BigintOperations::ComputeChunkLength(digits);
+  RawBigint* obj = reinterpret_cast<RawBigint*>(
+      AllocateUninitialized(cls_, Bigint::InstanceSize(bigint_length)));
+  obj->ptr()->allocated_length_ = bigint_length;
+  obj->ptr()->signed_length_ = bigint_length;
+  const Bigint& result = Bigint::Handle(obj);
+  BigintOperations::FromHexCString(digits, result);
+  if (is_negative) {
+    obj->ptr()->signed_length_ = -obj->ptr()->signed_length_;
+  }
   return result.raw();
 }
 
@@ -326,6 +445,86 @@ RawGrowableObjectArray* SnapshotReader::NewGrowableObjectArray() {
 }
 
 
+RawICData* SnapshotReader::NewICData() {
+  ALLOC_NEW_OBJECT(ICData, Object::icdata_class());
+}
+
+
+RawPcDescriptors* SnapshotReader::NewPcDescriptors(intptr_t len) {
+  ALLOC_NEW_OBJECT_WITH_LEN(PcDescriptors,
+                            Object::pc_descriptors_class(),
+                            len);
+}
+
+
+RawExceptionHandlers* SnapshotReader::NewExceptionHandlers(intptr_t len) {
+  ALLOC_NEW_OBJECT_WITH_LEN(ExceptionHandlers,
+                            Object::exception_handlers_class(),
+                            len);
+}
+
+
+RawLocalVarDescriptors* SnapshotReader::NewLocalVarDescriptors(
+    intptr_t num_variables) {
+  ASSERT(kind_ == Snapshot::kFull);
+  ASSERT(isolate()->no_gc_scope_depth() != 0);
+  cls_ = Object::var_descriptors_class();
+  RawLocalVarDescriptors* obj = reinterpret_cast<RawLocalVarDescriptors*>(
+      AllocateUninitialized(cls_,
+                            LocalVarDescriptors::InstanceSize(num_variables)));
+  obj->ptr()->length_ = num_variables;
+  return obj;
+}
+
+
+RawContextScope* SnapshotReader::NewContextScope(intptr_t num_variables) {
+  ASSERT(kind_ == Snapshot::kFull);
+  ASSERT(isolate()->no_gc_scope_depth() != 0);
+  cls_ = Object::context_scope_class();
+  RawContextScope* obj = reinterpret_cast<RawContextScope*>(
+      AllocateUninitialized(cls_, ContextScope::InstanceSize(num_variables)));
+  obj->ptr()->num_variables_ = num_variables;
+  return obj;
+}
+
+
+RawCode* SnapshotReader::NewCode(intptr_t pointer_offsets_length,
+                                 intptr_t immediate_offsets_length) {
+  ASSERT(kind_ == Snapshot::kFull);
+  ASSERT(isolate()->no_gc_scope_depth() != 0);
+  cls_ = Object::code_class();
+  RawCode* obj = reinterpret_cast<RawCode*>(
+      AllocateUninitialized(cls_,
+                            Code::InstanceSize(pointer_offsets_length,
+                                               immediate_offsets_length)));
+  obj->ptr()->pointer_offsets_length_ = pointer_offsets_length;
+  obj->ptr()->immediate_offsets_length_ = immediate_offsets_length;
+  return obj;
+}
+
+
+RawInstructions* SnapshotReader::NewInstructions(intptr_t size) {
+  ASSERT(kind_ == Snapshot::kFull);
+  ASSERT(isolate()->no_gc_scope_depth() != 0);
+  cls_ = Object::instructions_class();
+  RawInstructions* obj = reinterpret_cast<RawInstructions*>(
+      AllocateUninitialized(cls_, Instructions::InstanceSize(size)));
+  obj->ptr()->size_ = size;
+  return obj;
+}
+
+
+RawJSRegExp* SnapshotReader::NewJSRegExp(intptr_t len) {
+  ASSERT(kind_ == Snapshot::kFull);
+  ASSERT(isolate()->no_gc_scope_depth() != 0);
+  cls_ = object_store()->jsregexp_class();
+  RawJSRegExp* obj = reinterpret_cast<RawJSRegExp*>(
+      AllocateUninitialized(cls_, JSRegExp::InstanceSize(len)));
+  obj->ptr()->data_length_ = Smi::New(len);
+  return obj;
+}
+
+
 RawClass* SnapshotReader::LookupInternalClass(intptr_t class_header) {
   SerializedHeaderType header_type = SerializedHeaderTag::decode(class_header);
 
@@ -349,7 +548,11 @@ RawObject* SnapshotReader::AllocateUninitialized(const Class& cls,
   ASSERT(Utils::IsAligned(size, kObjectAlignment));
   Heap* heap = isolate()->heap();
 
-  uword address = heap->TryAllocate(size, Heap::kOld);
+  // Instructions are allocated in the code pages, which are not marked.
+  const Heap::Space space = (cls.raw() == Object::instructions_class()) ?
+      Heap::kExecutable : Heap::kOld;
+
+  uword address = heap->TryAllocate(size, space);
   if (address == 0) {
     // Use the preallocated out of memory exception to avoid calling
     // into dart code or allocating any code.
@@ -363,6 +566,9 @@ RawObject* SnapshotReader::AllocateUninitialized(const Class& cls,
   uword tags = 0;
   tags = RawObject::SizeTag::update(size, tags);
   raw_obj->ptr()->tags_ = tags;
+  if (space != Heap::kExecutable) {
+    heap->AllocateBlack(raw_obj, size);
+  }
   return raw_obj;
 }
 
@@ -456,6 +662,17 @@ RawObject* SnapshotReader::ReadInlinedObject(intptr_t object_id) {
   }
   if (kind_ == Snapshot::kFull) {
     obj_.SetCreatedFromSnapshot();
+  } else {
+    // The fields of internal objects are read in without a write barrier.
+    // Conservatively remember old objects as they may now point into new
+    // space.
+    RawObject* raw_obj = obj_.raw();
+    if (raw_obj->IsHeapObject() &&
+        raw_obj->IsOldObject() &&
+        !raw_obj->IsRemembered() &&
+        isolate()->heap()->Contains(RawObject::ToAddr(raw_obj))) {
+      isolate()->store_buffer()->RememberObject(raw_obj);
+    }
   }
   return obj_.raw();
 }
@@ -514,8 +731,9 @@ void SnapshotWriter::WriteObject(RawObject* rawobj) {
   }
 
   // Check if it is a code object in that case just write a Null object
-  // as we do not want code objects in the snapshot.
-  if (rawobj->ptr()->class_ == Object::code_class()) {
+  // unless the code is included in the snapshot.
+  if ((rawobj->ptr()->class_ == Object::code_class()) &&
+      !CanWriteCode(reinterpret_cast<RawCode*>(rawobj))) {
     WriteIndexedObject(Object::kNullObject);
     return;
   }
@@ -535,6 +753,246 @@ void SnapshotWriter::WriteObject(RawObject* rawobj) {
 }
 
 
+bool SnapshotWriter::CanWriteCode(RawCode* code) {
+#if defined(TARGET_ARCH_X64)
+  if (!include_code_) {
+    return false;
+  }
+  NoGCScope no_gc;
+  RawClass* cls = code->ptr()->class_;
+  if (SerializedHeaderTag::decode(reinterpret_cast<uword>(cls)) == kObjectId) {
+    return true;  // Already written.
+  }
+
+  // Optimized code and the code it replaced, which is patched to jump to it,
+  // are not included; neither is code with stack maps, which would refer to
+  // the code object.
+  if ((code->ptr()->is_optimized_ != 0) ||
+      (code->ptr()->stackmaps_ != Array::null())) {
+    return false;
+  }
+  RawFunction* function = code->ptr()->function_;
+  if ((function != Function::null()) &&
+      ((function->ptr()->code_ != code) ||
+       (function->ptr()->unoptimized_code_ != code))) {
+    return false;
+  }
+
+  uword entry_point = reinterpret_cast<uword>(
+      code->ptr()->instructions_->ptr()) + Instructions::HeaderSize();
+  for (intptr_t i = 0; i < code->ptr()->pointer_offsets_length_; i++) {
+    RawObject* raw = *reinterpret_cast<RawObject**>(
+        entry_point + code->ptr()->data_[i]);
+    if (!CanWriteEmbeddedObject(raw)) {
+      return false;
+    }
+  }
+  for (intptr_t i = 0; i < code->ptr()->immediate_offsets_length_; i++) {
+    uword value = 0;
+    intptr_t stub_index = -1;
+    RawCode* target = Code::null();
+    if (ClassifyImmediate(code, i, &value, &stub_index, &target) ==
+        kImmediateInvalid) {
+      return false;
+    }
+  }
+  return true;
+#else
+  // The immediates are only recorded by the x64 assembler.
+  return false;
+#endif
+}
+
+
+bool SnapshotWriter::CanWriteEmbeddedObject(RawObject* raw) {
+  if (!raw->IsHeapObject() ||
+      (raw == Object::null()) ||
+      (raw == Object::sentinel())) {
+    return true;
+  }
+  RawClass* cls = raw->ptr()->class_;
+  if (SerializedHeaderTag::decode(reinterpret_cast<uword>(cls)) == kObjectId) {
+    return true;  // Already written.
+  }
+  if (Object::GetSingletonClassIndex(reinterpret_cast<RawClass*>(raw)) !=
+      Object::kInvalidIndex) {
+    return true;
+  }
+  if (!Isolate::Current()->heap()->Contains(RawObject::ToAddr(raw))) {
+    return false;
+  }
+  switch (cls->ptr()->instance_kind_) {
+    case kClass:
+    case kType:
+    case kTypeParameter:
+    case kTypeArguments:
+    case kFunction:
+    case kField:
+    case kLiteralToken:
+    case kTokenStream:
+    case kScript:
+    case kLibrary:
+    case kLocalVarDescriptors:
+    case kContextScope:
+    case kICData:
+    case kInstance:
+    case kMint:
+    case kBigint:
+    case kDouble:
+    case kOneByteString:
+    case kTwoByteString:
+    case kFourByteString:
+    case kBool:
+    case kArray:
+    case kImmutableArray:
+    case kGrowableObjectArray:
+      return true;
+    default:
+      return false;
+  }
+}
+
+
+uword SnapshotWriter::ImmediateAt(RawCode* code,
+                                  intptr_t index,
+                                  bool* is_call_target) {
+  // See Code::GetImmediateOffsetAt, the code may be marked.
+  int32_t entry = code->ptr()->data_[code->ptr()->pointer_offsets_length_ +
+                                     index];
+  *is_call_target = (entry & 1) != 0;
+  uword entry_point = reinterpret_cast<uword>(
+      code->ptr()->instructions_->ptr()) + Instructions::HeaderSize();
+  return *reinterpret_cast<uword*>(entry_point + (entry >> 1));
+}
+
+
+CodeImmediateKind SnapshotWriter::ClassifyImmediate(RawCode* code,
+                                                    intptr_t index,
+                                                    uword* value_ptr,
+                                                    intptr_t* stub_index,
+                                                    RawCode** target) {
+  bool is_call_target = false;
+  uword value = ImmediateAt(code, index, &is_call_target);
+  *value_ptr = value;
+  Isolate* isolate = Isolate::Current();
+  Heap* heap = isolate->heap();
+  if (value == reinterpret_cast<uword>(Object::null())) {
+    return kImmediateNull;
+  }
+  if (value == isolate->stack_limit_address()) {
+    return kImmediateStackLimit;
+  }
+  if (value == heap->TopAddress()) {
+    return kImmediateHeapTop;
+  }
+  if (value == heap->EndAddress()) {
+    return kImmediateHeapEnd;
+  }
+  if (value == PageSpace::num_marking_spaces_address()) {
+    return kImmediateMarkingSpaces;
+  }
+  *stub_index = StubCode::IndexOfVMStub(value);
+  if (*stub_index >= 0) {
+    // Native calls pass the address of the C function, and breakpoints are
+    // specific to this run.
+    if ((value == StubCode::CallNativeCFunctionEntryPoint()) ||
+        (value == StubCode::BreakpointStaticEntryPoint()) ||
+        (value == StubCode::BreakpointReturnEntryPoint())) {
+      return kImmediateInvalid;
+    }
+    return kImmediateVMStub;
+  }
+  *stub_index = StubCode::IndexOfIsolateStub(value);
+  if (*stub_index >= 0) {
+    if (value == StubCode::BreakpointDynamicEntryPoint()) {
+      return kImmediateInvalid;
+    }
+    return kImmediateIsolateStub;
+  }
+  if (RuntimeEntry::LookupByEntryPoint(value) != NULL) {
+    return kImmediateRuntimeEntry;
+  }
+  if (!is_call_target) {
+    // The message of a stop, see Assembler::Stop, is passed right before
+    // calling the stub printing it.
+    if ((index + 1) < code->ptr()->immediate_offsets_length_) {
+      bool is_next_call_target = false;
+      uword next_value = ImmediateAt(code, index + 1, &is_next_call_target);
+      if (is_next_call_target &&
+          (next_value == StubCode::PrintStopMessageEntryPoint())) {
+        return kImmediateStopMessage;
+      }
+    }
+    return kImmediateConstant;
+  }
+
+  // Calls into other code of the isolate.
+  if (heap->CodeContains(value) &&
+      heap->CodeContains(value - Instructions::HeaderSize())) {
+    RawInstructions* instructions = Instructions::FromEntryPoint(value);
+    RawCode* target_code = instructions->ptr()->code_;
+    if (target_code->ptr()->instructions_ == instructions) {
+      if (target_code->ptr()->function_ != Function::null()) {
+        // A static call patched to its target is reset to resolve the target
+        // again.
+        *stub_index = StubCode::IndexOfVMStub(
+            StubCode::CallStaticFunctionEntryPoint());
+        return kImmediateVMStub;
+      }
+      // A stub, e.g. the allocation stub of a class.
+      if (CanWriteCode(target_code)) {
+        *target = target_code;
+        return kImmediateCode;
+      }
+    }
+  }
+  return kImmediateInvalid;
+}
+
+
+void SnapshotWriter::WriteCodeImmediate(RawCode* code, intptr_t index) {
+  uword value = 0;
+  intptr_t stub_index = -1;
+  RawCode* target = Code::null();
+  CodeImmediateKind immediate_kind =
+      ClassifyImmediate(code, index, &value, &stub_index, &target);
+  ASSERT(immediate_kind != kImmediateInvalid);
+  WriteIntptrValue(immediate_kind);
+  switch (immediate_kind) {
+    case kImmediateConstant:
+      WriteIntptrValue(value);
+      break;
+    case kImmediateVMStub:
+    case kImmediateIsolateStub:
+      WriteIntptrValue(stub_index);
+      break;
+    case kImmediateCode:
+      WriteObject(target);
+      break;
+    case kImmediateRuntimeEntry: {
+      // Runtime entries are written by name, as their addresses differ
+      // between the VM writing and the VM reading the snapshot.
+      WriteCString(RuntimeEntry::LookupByEntryPoint(value)->name());
+      break;
+    }
+    case kImmediateStopMessage:
+      WriteCString(reinterpret_cast<const char*>(value));
+      break;
+    default:
+      break;
+  }
+}
+
+
+void SnapshotWriter::WriteCString(const char* str) {
+  intptr_t len = strlen(str);
+  WriteIntptrValue(len);
+  for (intptr_t i = 0; i < len; i++) {
+    Write<uint8_t>(str[i]);
+  }
+}
+
+
 void SnapshotWriter::UnmarkAll() {
   NoGCScope no_gc;
   for (intptr_t i = 0; i < forward_list_.length(); i++) {
@@ -544,6 +1002,89 @@ void SnapshotWriter::UnmarkAll() {
 }
 
 
+SnapshotWriter::~SnapshotWriter() {
+  if (transfers_ != NULL) {
+    // The buffer was not sent in a message, release the data handed over.
+    for (intptr_t i = 0; i < transfer_list_.length(); i++) {
+      if (transfers_[i].callback != NULL) {
+        (*transfers_[i].callback)(transfers_[i].peer);
+      }
+    }
+    free(transfers_);
+  }
+}
+
+
+void SnapshotWriter::AllowTransfers(bool transfer_byte_arrays) {
+  ASSERT(kind_ == Snapshot::kMessage);
+  transfers_allowed_ = true;
+  transfer_byte_arrays_ = transfer_byte_arrays;
+}
+
+
+intptr_t SnapshotWriter::TransferByteArray(RawByteArray* raw,
+                                           bool is_external) {
+  if (!transfers_allowed_ ||
+      (is_external && !transfer_byte_arrays_)) {
+    return -1;
+  }
+  TransferNode* node = new TransferNode(raw, is_external);
+  ASSERT(node != NULL);
+  transfer_list_.Add(node);
+  return transfer_list_.length() - 1;
+}
+
+
+static void FreeTransferredData(void* peer) {
+  free(peer);
+}
+
+
+void SnapshotWriter::CompleteTransfers() {
+  NoGCScope no_gc;
+  const intptr_t count = transfer_list_.length();
+  if (count == 0) {
+    return;
+  }
+  ASSERT(transfers_ == NULL);
+  transfers_ = reinterpret_cast<Message::Transfer*>(
+      malloc(count * sizeof(Message::Transfer)));
+  for (intptr_t i = 0; i < count; i++) {
+    RawByteArray* raw = transfer_list_[i]->raw();
+    Message::Transfer* transfer = &transfers_[i];
+    transfer->length = Smi::Value(raw->ptr()->length_);
+    if (transfer_list_[i]->is_external()) {
+      // Hand the data over as is, the array of the sender is left empty.
+      RawExternalByteArray* external =
+          reinterpret_cast<RawExternalByteArray*>(raw);
+      ExternalByteArrayData* external_data = external->ptr()->external_data_;
+      transfer->data = external_data->data();
+      transfer->peer = external_data->peer();
+      transfer->callback = external_data->callback();
+      external_data->Release();
+      external->ptr()->length_ = Smi::New(0);
+    } else {
+      // Copy the data once, instead of into the message and out of it.
+      RawInternalByteArray* internal =
+          reinterpret_cast<RawInternalByteArray*>(raw);
+      uint8_t* data = reinterpret_cast<uint8_t*>(malloc(transfer->length));
+      memmove(data, internal->ptr()->data(), transfer->length);
+      transfer->data = data;
+      transfer->peer = data;
+      transfer->callback = FreeTransferredData;
+    }
+  }
+}
+
+
+void SnapshotWriter::AttachTransfers(Message* message) {
+  if (transfers_ != NULL) {
+    message->SetTransfers(transfers_, transfer_list_.length());
+    transfers_ = NULL;
+  }
+}
+
+
 void SnapshotWriter::WriteFullSnapshot() {
   ASSERT(kind_ == Snapshot::kFull);
   Isolate* isolate = Isolate::Current();
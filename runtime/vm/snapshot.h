@@ -11,6 +11,7 @@
 #include "vm/globals.h"
 #include "vm/growable_array.h"
 #include "vm/isolate.h"
+#include "vm/message.h"
 #include "vm/visitor.h"
 
 namespace dart {
@@ -19,26 +20,36 @@ namespace dart {
 class AbstractType;
 class AbstractTypeArguments;
 class Class;
+class Code;
 class Heap;
 class Library;
 class Object;
 class ObjectStore;
 class RawArray;
 class RawBigint;
+class RawByteArray;
 class RawClass;
+class RawCode;
 class RawContext;
+class RawContextScope;
 class RawDouble;
+class RawExceptionHandlers;
 class RawField;
 class RawFourByteString;
 class RawFunction;
 class RawGrowableObjectArray;
+class RawICData;
 class RawImmutableArray;
+class RawInstructions;
+class RawJSRegExp;
 class RawLibrary;
 class RawLibraryPrefix;
 class RawLiteralToken;
+class RawLocalVarDescriptors;
 class RawMint;
 class RawObject;
 class RawOneByteString;
+class RawPcDescriptors;
 class RawScript;
 class RawSmi;
 class RawTokenStream;
@@ -84,6 +95,25 @@ class SerializedHeaderData : public BitField<intptr_t,
 };
 
 
+// Kinds of the 64-bit immediates of the code in a full snapshot, see
+// Code::GetImmediateOffsetAt. All but constants are absolute addresses which
+// are relocated when the code is read.
+enum CodeImmediateKind {
+  kImmediateConstant,       // Not an address, written as is.
+  kImmediateNull,           // Object::null().
+  kImmediateVMStub,         // Entry point of a VM stub, written as index.
+  kImmediateIsolateStub,    // Entry point of an isolate stub, written as index.
+  kImmediateCode,           // Entry point of a stub written as code object.
+  kImmediateRuntimeEntry,   // Entry point of a runtime entry, written as name.
+  kImmediateStackLimit,     // Address of the stack limit of the isolate.
+  kImmediateHeapTop,        // Address of the top of the new space.
+  kImmediateHeapEnd,        // Address of the end of the new space.
+  kImmediateMarkingSpaces,  // Address of the number of marking spaces.
+  kImmediateStopMessage,    // Message of Assembler::Stop, written as string.
+  kImmediateInvalid,        // Cannot be relocated.
+};
+
+
 // Structure capturing the raw snapshot.
 class Snapshot {
  public:
@@ -91,6 +121,7 @@ class Snapshot {
     kFull = 0,  // Full snapshot of the current dart heap.
     kScript,    // A partial snapshot of only the application script.
     kMessage,   // A partial snapshot used only for isolate messaging.
+    kFullWithCode,  // A full snapshot which includes the unoptimized code.
   };
 
   static const int kHeaderSize = 2 * sizeof(int32_t);
@@ -106,7 +137,9 @@ class Snapshot {
 
   bool IsMessageSnapshot() const { return kind_ == kMessage; }
   bool IsScriptSnapshot() const { return kind_ == kScript; }
-  bool IsFullSnapshot() const { return kind_ == kFull; }
+  bool IsFullSnapshot() const {
+    return (kind_ == kFull) || (kind_ == kFullWithCode);
+  }
   int32_t Size() const { return length_ + sizeof(Snapshot); }
   uint8_t* Addr() { return reinterpret_cast<uint8_t*>(this); }
 
@@ -305,7 +338,8 @@ class WriteStream : public ValueObject {
 
 class BaseReader {
  public:
-  BaseReader(const uint8_t* buffer, intptr_t size) : stream_(buffer, size) {}
+  BaseReader(const uint8_t* buffer, intptr_t size)
+      : stream_(buffer, size), message_(NULL) {}
   // Reads raw data (for basic types).
   // sizeof(T) must be in {1,2,4,8}.
   template <typename T>
@@ -323,8 +357,17 @@ class BaseReader {
   RawSmi* ReadAsSmi();
   intptr_t ReadSmiValue();
 
+  // The message read, which holds the data handed over by its sender, see
+  // SnapshotWriter::AllowTransfers.
+  void set_message(Message* message) { message_ = message; }
+  Message::Transfer* TransferAt(intptr_t index) const {
+    ASSERT(message_ != NULL);
+    return message_->TransferAt(index);
+  }
+
  private:
   ReadStream stream_;  // input stream.
+  Message* message_;
 };
 
 
@@ -353,6 +396,15 @@ class SnapshotReader : public BaseReader {
   // Read a full snap shot.
   void ReadFullSnapshot();
 
+  // Patch the calls of the code read from a full snapshot into the stubs of
+  // the isolate and register the code in the code index table. Called once
+  // the isolate stubs are generated.
+  void InstallCode();
+
+  // Read the value of the immediate of the code at the given index, and store
+  // it in the instructions.
+  void ReadCodeImmediate(const Code& code, intptr_t index);
+
   // Helper functions for creating uninitialized versions
   // of various object types. These are used when reading a
   // full snapshot.
@@ -378,11 +430,41 @@ class SnapshotReader : public BaseReader {
   RawScript* NewScript();
   RawLiteralToken* NewLiteralToken();
   RawGrowableObjectArray* NewGrowableObjectArray();
+  RawCode* NewCode(intptr_t pointer_offsets_length,
+                   intptr_t immediate_offsets_length);
+  RawInstructions* NewInstructions(intptr_t size);
+  RawPcDescriptors* NewPcDescriptors(intptr_t len);
+  RawExceptionHandlers* NewExceptionHandlers(intptr_t len);
+  RawLocalVarDescriptors* NewLocalVarDescriptors(intptr_t num_variables);
+  RawContextScope* NewContextScope(intptr_t num_variables);
+  RawJSRegExp* NewJSRegExp(intptr_t len);
+  RawICData* NewICData();
 
  private:
+  // An immediate of code which calls an isolate stub, patched once the
+  // stubs are generated.
+  class StubImmediate : public ZoneAllocated {
+   public:
+    StubImmediate(const Code* code, intptr_t offset, intptr_t stub_index)
+        : code_(code), offset_(offset), stub_index_(stub_index) {}
+    const Code* code() const { return code_; }
+    intptr_t offset() const { return offset_; }
+    intptr_t stub_index() const { return stub_index_; }
+
+   private:
+    const Code* code_;
+    intptr_t offset_;
+    intptr_t stub_index_;
+
+    DISALLOW_COPY_AND_ASSIGN(StubImmediate);
+  };
+
   // Allocate uninitialized objects, this is used when reading a full snapshot.
   RawObject* AllocateUninitialized(const Class& cls, intptr_t size);
 
+  // Read a string written with SnapshotWriter::WriteCString into the zone.
+  const char* ReadCString();
+
   // Internal implementation of ReadObject once the header value is read.
   RawObject* ReadObjectImpl(intptr_t header);
 
@@ -405,6 +487,7 @@ class SnapshotReader : public BaseReader {
   AbstractType& type_;  // Temporary type handle.
   AbstractTypeArguments& type_arguments_;  // Temporary type argument handle.
   GrowableArray<Object*> backward_references_;
+  GrowableArray<StubImmediate*> stub_immediates_;
 
   DISALLOW_COPY_AND_ASSIGN(SnapshotReader);
 };
@@ -475,13 +558,20 @@ class BaseWriter {
 
 class SnapshotWriter : public BaseWriter {
  public:
+  // A snapshot of kind kFullWithCode is written as a full snapshot which
+  // includes the code objects.
   SnapshotWriter(Snapshot::Kind kind, uint8_t** buffer, ReAlloc alloc)
       : BaseWriter(buffer, alloc),
-        kind_(kind),
+        kind_((kind == Snapshot::kFullWithCode) ? Snapshot::kFull : kind),
+        include_code_(kind == Snapshot::kFullWithCode),
         object_store_(Isolate::Current()->object_store()),
-        forward_list_() {
+        forward_list_(),
+        transfers_allowed_(false),
+        transfer_byte_arrays_(false),
+        transfer_list_(),
+        transfers_(NULL) {
   }
-  ~SnapshotWriter() { }
+  ~SnapshotWriter();
 
   // Snapshot kind.
   Snapshot::Kind kind() const { return kind_; }
@@ -490,10 +580,31 @@ class SnapshotWriter : public BaseWriter {
   // which comprises of a flag(full/partial snaphot) and the length of
   // serialzed bytes.
   void FinalizeBuffer() {
-    BaseWriter::FinalizeBuffer(kind_);
+    BaseWriter::FinalizeBuffer(include_code_ ? Snapshot::kFullWithCode : kind_);
     UnmarkAll();
+    CompleteTransfers();
   }
 
+  // Allows the byte arrays written into a message to be handed over to its
+  // receiver instead of being copied into the message.  The internal byte
+  // arrays of at least --message_external_byte_array_length bytes are
+  // copied once.  If 'transfer_byte_arrays' is true, all the internal byte
+  // arrays are copied once and the data of the external byte arrays is
+  // handed over as is, leaving the arrays of the sender empty.  The
+  // receiver gets external byte arrays for the arrays handed over.  Nothing
+  // is handed over before FinalizeBuffer, and no GC may happen between
+  // writing the objects and finalizing the buffer.
+  void AllowTransfers(bool transfer_byte_arrays);
+  bool transfer_byte_arrays() const { return transfer_byte_arrays_; }
+
+  // Returns the index of the transfer which hands the data of the byte array
+  // over, or -1 if its data is to be written into the message.
+  intptr_t TransferByteArray(RawByteArray* raw, bool is_external);
+
+  // Hands the data of the byte arrays over to 'message' which carries the
+  // finalized buffer.
+  void AttachTransfers(Message* message);
+
   // Serialize an object into the buffer.
   void WriteObject(RawObject* raw);
 
@@ -505,6 +616,10 @@ class SnapshotWriter : public BaseWriter {
   // Writes a full snapshot of the Isolate.
   void WriteFullSnapshot();
 
+  // Write the value of the immediate of the code at the given index, see
+  // SnapshotReader::ReadCodeImmediate.
+  void WriteCodeImmediate(RawCode* code, intptr_t index);
+
  private:
   class ForwardObjectNode : public ZoneAllocated {
    public:
@@ -519,15 +634,54 @@ class SnapshotWriter : public BaseWriter {
     DISALLOW_COPY_AND_ASSIGN(ForwardObjectNode);
   };
 
+  class TransferNode : public ZoneAllocated {
+   public:
+    TransferNode(RawByteArray* raw, bool is_external)
+        : raw_(raw), is_external_(is_external) {}
+    RawByteArray* raw() const { return raw_; }
+    bool is_external() const { return is_external_; }
+
+   private:
+    RawByteArray* raw_;
+    bool is_external_;
+
+    DISALLOW_COPY_AND_ASSIGN(TransferNode);
+  };
+
   intptr_t MarkObject(RawObject* raw, RawClass* cls);
 
+  // Copies or detaches the data of the byte arrays handed over.
+  void CompleteTransfers();
+
   void WriteInlinedObject(RawObject* raw);
 
+  // Whether the code object is written, or replaced with null. Only
+  // unpatched unoptimized code of which all the embedded objects and the
+  // absolute addresses can be written is included in the snapshot.
+  bool CanWriteCode(RawCode* code);
+  void WriteCString(const char* str);
+  bool CanWriteEmbeddedObject(RawObject* raw);
+  static uword ImmediateAt(RawCode* code,
+                           intptr_t index,
+                           bool* is_call_target);
+  CodeImmediateKind ClassifyImmediate(RawCode* code,
+                                      intptr_t index,
+                                      uword* value,
+                                      intptr_t* stub_index,
+                                      RawCode** target);
+
   ObjectStore* object_store() const { return object_store_; }
 
   Snapshot::Kind kind_;
+  bool include_code_;
   ObjectStore* object_store_;  // Object store for common classes.
   GrowableArray<ForwardObjectNode*> forward_list_;
+  bool transfers_allowed_;
+  bool transfer_byte_arrays_;
+  GrowableArray<TransferNode*> transfer_list_;
+  // The data handed over, owned by the writer until it is attached to a
+  // message.
+  Message::Transfer* transfers_;
 
   DISALLOW_COPY_AND_ASSIGN(SnapshotWriter);
 };
@@ -6,6 +6,7 @@
 #include "platform/assert.h"
 #include "vm/bigint_operations.h"
 #include "vm/class_finalizer.h"
+#include "vm/code_index_table.h"
 #include "vm/dart_api_impl.h"
 #include "vm/dart_api_message.h"
 #include "vm/dart_api_state.h"
@@ -14,6 +15,9 @@
 
 namespace dart {
 
+DECLARE_FLAG(int, message_external_byte_array_length);
+
+
 // Check if serialized and deserialized objects are equal.
 static bool Equals(const Object& expected, const Object& actual) {
   if (expected.IsNull()) {
@@ -719,6 +723,266 @@ TEST_CASE(SerializeEmptyByteArray) {
 }
 
 
+static int transferred_finalizer_count = 0;
+
+
+static void TransferredByteArrayFinalizer(void* peer) {
+  transferred_finalizer_count++;
+}
+
+
+TEST_CASE(SerializeExternalByteArray) {
+  Zone zone(Isolate::Current());
+
+  // Write snapshot with object content.
+  uint8_t* buffer;
+  SnapshotWriter writer(Snapshot::kMessage, &buffer, &malloc_allocator);
+  writer.AllowTransfers(true);
+  const int kByteArrayLength = 256;
+  uint8_t data[kByteArrayLength];
+  for (int i = 0; i < kByteArrayLength; i++) {
+    data[i] = i;
+  }
+  int peer = 0;
+  transferred_finalizer_count = 0;
+  ExternalByteArray& byte_array = ExternalByteArray::Handle(
+      ExternalByteArray::New(data,
+                             kByteArrayLength,
+                             &peer,
+                             TransferredByteArrayFinalizer));
+  writer.WriteObject(byte_array.raw());
+  writer.FinalizeBuffer();
+  Message* message = new Message(Message::kIllegalPort,
+                                 Message::kIllegalPort,
+                                 buffer,
+                                 Message::kNormalPriority);
+  writer.AttachTransfers(message);
+
+  // The data was handed over, the array of the sender is left empty.
+  EXPECT_EQ(0, byte_array.Length());
+  EXPECT(byte_array.GetPeer() == NULL);
+
+  // Create a snapshot object using the buffer.
+  const Snapshot* snapshot = Snapshot::SetupFromBuffer(buffer);
+
+  // Read object back from the snapshot, which adopts the data.
+  SnapshotReader reader(snapshot, Isolate::Current());
+  reader.set_message(message);
+  ExternalByteArray& serialized_byte_array = ExternalByteArray::Handle();
+  serialized_byte_array ^= reader.ReadObject();
+  EXPECT_EQ(kByteArrayLength, serialized_byte_array.Length());
+  EXPECT(serialized_byte_array.GetPeer() == &peer);
+  for (int i = 0; i < kByteArrayLength; i++) {
+    EXPECT_EQ(i, serialized_byte_array.At<uint8_t>(i));
+  }
+  serialized_byte_array.SetAt<uint8_t>(0, 42);
+  EXPECT_EQ(42, data[0]);
+
+  // The data adopted by the receiver is not released with the message.
+  delete message;
+  EXPECT_EQ(0, transferred_finalizer_count);
+}
+
+
+TEST_CASE(SerializeExternalByteArrayCopy) {
+  Zone zone(Isolate::Current());
+
+  // Write snapshot with object content, without handing data over.
+  uint8_t* buffer;
+  SnapshotWriter writer(Snapshot::kMessage, &buffer, &zone_allocator);
+  writer.AllowTransfers(false);
+  const int kByteArrayLength = 256;
+  uint8_t data[kByteArrayLength];
+  for (int i = 0; i < kByteArrayLength; i++) {
+    data[i] = i;
+  }
+  int peer = 0;
+  ExternalByteArray& byte_array = ExternalByteArray::Handle(
+      ExternalByteArray::New(data, kByteArrayLength, &peer, NULL));
+  writer.WriteObject(byte_array.raw());
+  writer.FinalizeBuffer();
+
+  // The array of the sender keeps its data.
+  EXPECT_EQ(kByteArrayLength, byte_array.Length());
+  EXPECT(byte_array.GetPeer() == &peer);
+
+  // Read object back from the snapshot as a copy.
+  const Snapshot* snapshot = Snapshot::SetupFromBuffer(buffer);
+  SnapshotReader reader(snapshot, Isolate::Current());
+  InternalByteArray& serialized_byte_array = InternalByteArray::Handle();
+  serialized_byte_array ^= reader.ReadObject();
+  EXPECT_EQ(kByteArrayLength, serialized_byte_array.Length());
+  for (int i = 0; i < kByteArrayLength; i++) {
+    EXPECT_EQ(i, serialized_byte_array.At<uint8_t>(i));
+  }
+}
+
+
+TEST_CASE(SerializeExternalByteArrayUndelivered) {
+  Zone zone(Isolate::Current());
+
+  // Write a message which hands the data over.
+  uint8_t* buffer;
+  SnapshotWriter writer(Snapshot::kMessage, &buffer, &malloc_allocator);
+  writer.AllowTransfers(true);
+  const int kByteArrayLength = 256;
+  uint8_t data[kByteArrayLength];
+  int peer = 0;
+  transferred_finalizer_count = 0;
+  ExternalByteArray& byte_array = ExternalByteArray::Handle(
+      ExternalByteArray::New(data,
+                             kByteArrayLength,
+                             &peer,
+                             TransferredByteArrayFinalizer));
+  writer.WriteObject(byte_array.raw());
+  writer.FinalizeBuffer();
+  Message* message = new Message(Message::kIllegalPort,
+                                 Message::kIllegalPort,
+                                 buffer,
+                                 Message::kNormalPriority);
+  writer.AttachTransfers(message);
+  EXPECT_EQ(0, transferred_finalizer_count);
+
+  // The data of a message which is never delivered is released with it.
+  delete message;
+  EXPECT_EQ(1, transferred_finalizer_count);
+}
+
+
+TEST_CASE(SerializeLargeByteArray) {
+  Zone zone(Isolate::Current());
+  const int saved_length = FLAG_message_external_byte_array_length;
+  FLAG_message_external_byte_array_length = 64 * KB;
+
+  // Write snapshots with object content.
+  uint8_t* buffer;
+  SnapshotWriter writer(Snapshot::kMessage, &buffer, &malloc_allocator);
+  writer.AllowTransfers(false);
+  uint8_t* api_buffer;
+  SnapshotWriter api_writer(Snapshot::kMessage,
+                            &api_buffer,
+                            &malloc_allocator);
+  api_writer.AllowTransfers(false);
+  const int kByteArrayLength = FLAG_message_external_byte_array_length;
+  InternalByteArray& byte_array =
+      InternalByteArray::Handle(InternalByteArray::New(kByteArrayLength));
+  for (int i = 0; i < kByteArrayLength; i++) {
+    byte_array.SetAt<uint8_t>(i, i & 0xff);
+  }
+  writer.WriteObject(byte_array.raw());
+  writer.FinalizeBuffer();
+  Message* message = new Message(Message::kIllegalPort,
+                                 Message::kIllegalPort,
+                                 buffer,
+                                 Message::kNormalPriority);
+  writer.AttachTransfers(message);
+  api_writer.WriteObject(byte_array.raw());
+  api_writer.FinalizeBuffer();
+  Message* api_message = new Message(Message::kIllegalPort,
+                                     Message::kIllegalPort,
+                                     api_buffer,
+                                     Message::kNormalPriority);
+  api_writer.AttachTransfers(api_message);
+
+  // The data is not written into the snapshot.
+  EXPECT_LT(writer.BytesWritten(), kByteArrayLength);
+  EXPECT_EQ(kByteArrayLength, byte_array.Length());
+
+  // Read object back from the snapshot, as an external byte array.
+  const Snapshot* snapshot = Snapshot::SetupFromBuffer(buffer);
+  SnapshotReader reader(snapshot, Isolate::Current());
+  reader.set_message(message);
+  ExternalByteArray& serialized_byte_array = ExternalByteArray::Handle();
+  serialized_byte_array ^= reader.ReadObject();
+  EXPECT_EQ(kByteArrayLength, serialized_byte_array.Length());
+  for (int i = 0; i < kByteArrayLength; i++) {
+    EXPECT_EQ(i & 0xff, serialized_byte_array.At<uint8_t>(i));
+  }
+  delete message;
+
+  // Read object back from the other snapshot into a C structure.
+  ApiNativeScope scope;
+  ApiMessageReader api_reader(api_buffer + Snapshot::kHeaderSize,
+                              api_writer.BytesWritten(),
+                              &zone_allocator);
+  api_reader.set_message(api_message);
+  Dart_CObject* root = api_reader.ReadMessage();
+  EXPECT_EQ(Dart_CObject::kByteArray, root->type);
+  EXPECT_EQ(kByteArrayLength, root->value.as_byte_array.length);
+  for (int i = 0; i < kByteArrayLength; i++) {
+    EXPECT_EQ(i & 0xff, root->value.as_byte_array.values[i]);
+  }
+  delete api_message;
+
+  FLAG_message_external_byte_array_length = saved_length;
+}
+
+
+// Only ia32 and x64 can run execution tests.
+#if defined(TARGET_ARCH_IA32) || defined(TARGET_ARCH_X64)
+TEST_CASE(SendPortTransferByteArray) {
+  const char* kScriptChars =
+      "#import('dart:isolate');\n"
+      "var sent;\n"
+      "var received;\n"
+      "send(transfer) {\n"
+      "  var port = new ReceivePort();\n"
+      "  port.receive((message, replyTo) {\n"
+      "    received = message;\n"
+      "    port.close();\n"
+      "  });\n"
+      "  sent = new ByteArray(4);\n"
+      "  for (var i = 0; i < 4; i++) {\n"
+      "    sent[i] = i + 1;\n"
+      "  }\n"
+      "  port.toSendPort().send(sent, transfer: transfer);\n"
+      "}\n"
+      "getReceived() {\n"
+      "  return received;\n"
+      "}\n"
+      "checkReceived() {\n"
+      "  var sum = 0;\n"
+      "  for (var i = 0; i < received.length; i++) {\n"
+      "    sum += received[i];\n"
+      "  }\n"
+      "  return (sent.length == 4) && (sum == 10);\n"
+      "}\n";
+  Dart_Handle lib = TestCase::LoadTestScript(kScriptChars, NULL);
+  for (intptr_t i = 0; i < 2; i++) {
+    const bool transfer = (i == 1);
+    Dart_Handle args[1];
+    args[0] = transfer ? Dart_True() : Dart_False();
+    EXPECT_VALID(Dart_InvokeStatic(lib,
+                                   Dart_NewString(""),
+                                   Dart_NewString("send"),
+                                   1,
+                                   args));
+    EXPECT_VALID(Dart_HandleMessage());
+    Dart_Handle received = Dart_InvokeStatic(lib,
+                                             Dart_NewString(""),
+                                             Dart_NewString("getReceived"),
+                                             0,
+                                             NULL);
+    EXPECT_VALID(received);
+    // The data handed over arrives in an external byte array.
+    const Object& object = Object::Handle(Api::UnwrapHandle(received));
+    EXPECT_EQ(transfer, object.IsExternalByteArray());
+    EXPECT_EQ(!transfer, object.IsInternalByteArray());
+    Dart_Handle result = Dart_InvokeStatic(lib,
+                                           Dart_NewString(""),
+                                           Dart_NewString("checkReceived"),
+                                           0,
+                                           NULL);
+    EXPECT_VALID(result);
+    EXPECT(Dart_IsBoolean(result));
+    bool value = false;
+    EXPECT_VALID(Dart_BooleanValue(result, &value));
+    EXPECT(value);
+  }
+}
+#endif  // defined(TARGET_ARCH_IA32) || defined(TARGET_ARCH_X64)
+
+
 TEST_CASE(SerializeScript) {
   const char* kScriptChars =
       "class A {\n"
@@ -839,6 +1103,94 @@ UNIT_TEST_CASE(FullSnapshot) {
 }
 
 
+// Only the x64 assembler records the immediates which are relocated.
+#if defined(TARGET_ARCH_X64)
+UNIT_TEST_CASE(FullSnapshotWithCode) {
+  const char* kScriptChars =
+      "class Counter {\n"
+      "  Counter(this.start);\n"
+      "  var start;\n"
+      "  next(n) { return start + n; }\n"
+      "}\n"
+      "class CodeTest {\n"
+      "  static var calls = 0;\n"
+      "  static add(a, b) { calls++; return a + b; }\n"
+      "  static testMain() {\n"
+      "    var c = new Counter(1);\n"
+      "    var s = 0;\n"
+      "    for (var i = 0; i < 10; i++) {\n"
+      "      s = add(s, c.next(i));\n"
+      "    }\n"
+      "    try {\n"
+      "      throw 'x';\n"
+      "    } catch (var e) {\n"
+      "      s = s + 100;\n"
+      "    }\n"
+      "    var f = (x) => x * 2;\n"
+      "    return f(s) + calls;\n"
+      "  }\n"
+      "}\n";
+
+  uint8_t* buffer;
+
+  // Start an Isolate, load a script, compile it and create a full snapshot
+  // including the code.
+  {
+    TestIsolateScope __test_isolate__;
+
+    Isolate* isolate = Isolate::Current();
+    Zone zone(isolate);
+    HandleScope scope(isolate);
+
+    // Create a test library and Load up a test script in it.
+    TestCase::LoadTestScript(kScriptChars, NULL);
+    EXPECT_VALID(Dart_CompileAll());
+
+    // Write snapshot with object content and code.
+    SnapshotWriter writer(Snapshot::kFullWithCode, &buffer, &malloc_allocator);
+    writer.WriteFullSnapshot();
+  }
+
+  // Now Create another isolate using the snapshot and execute a method
+  // from the script, which runs without compiling it again.
+  TestCase::CreateTestIsolateFromSnapshot(buffer);
+  {
+    Dart_EnterScope();  // Start a Dart API scope for invoking API functions.
+    Isolate* isolate = Isolate::Current();
+    Zone zone(isolate);
+    HandleScope scope(isolate);
+
+    Library& library = Library::Handle();
+    library ^= Api::UnwrapHandle(TestCase::lib());
+    const Class& cls = Class::Handle(
+        library.LookupClass(String::Handle(String::NewSymbol("CodeTest"))));
+    EXPECT(!cls.IsNull());
+    const Function& test_main = Function::Handle(
+        cls.LookupStaticFunction(String::Handle(String::New("testMain"))));
+    EXPECT(!test_main.IsNull());
+    EXPECT(test_main.HasCode());
+    const Code& code = Code::Handle(test_main.CurrentCode());
+    EXPECT(isolate->code_index_table()->LookupCode(code.EntryPoint()) ==
+           code.raw());
+
+    Dart_Handle result = Dart_InvokeStatic(TestCase::lib(),
+                                           Dart_NewString("CodeTest"),
+                                           Dart_NewString("testMain"),
+                                           0,
+                                           NULL);
+    EXPECT_VALID(result);
+    int64_t value = 0;
+    EXPECT_VALID(Dart_IntegerToInt64(result, &value));
+    EXPECT_EQ(2 * (55 + 100) + 10, value);
+    EXPECT(test_main.CurrentCode() == code.raw());
+    Dart_ExitScope();
+  }
+  Dart_ShutdownIsolate();
+  free(buffer);
+}
+#endif  // defined(TARGET_ARCH_X64)
+
+
 UNIT_TEST_CASE(FullSnapshot1) {
   // This buffer has to be static for this to compile with Visual Studio.
   // If it is not static compilation of this file with Visual Studio takes
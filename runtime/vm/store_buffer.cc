@@ -5,12 +5,131 @@
 #include "vm/store_buffer.h"
 
 #include "platform/assert.h"
+#include "vm/pages.h"
+#include "vm/raw_object.h"
 
 namespace dart {
 
-void StoreBufferBlock::ProcessBuffer() {
-  // TODO(iposva): Do the right thing for store buffer overflow.
-  top_ = 0;  // Currently just reset back to the beginning.
+static void DeleteBlocks(StoreBufferBlock* blocks) {
+  while (blocks != NULL) {
+    StoreBufferBlock* next = blocks->next();
+    delete blocks;
+    blocks = next;
+  }
+}
+
+
+StoreBuffer::StoreBuffer()
+    : current_(new StoreBufferBlock()),
+      full_blocks_(NULL),
+      full_count_(0),
+      empty_blocks_(NULL),
+      empty_count_(0),
+      overflowed_(false) {
+}
+
+
+StoreBuffer::~StoreBuffer() {
+  delete current_;
+  DeleteBlocks(full_blocks_);
+  DeleteBlocks(empty_blocks_);
+}
+
+
+StoreBufferBlock* StoreBuffer::PopEmptyBlock() {
+  if (empty_blocks_ == NULL) {
+    return new StoreBufferBlock();
+  }
+  StoreBufferBlock* result = empty_blocks_;
+  empty_blocks_ = result->next();
+  empty_count_--;
+  result->set_next(NULL);
+  ASSERT(result->IsEmpty());
+  return result;
+}
+
+
+void StoreBuffer::PushEmptyBlock(StoreBufferBlock* block) {
+  if (empty_count_ >= kMaxEmptyBlocks) {
+    delete block;
+    return;
+  }
+  block->Reset();
+  block->set_next(empty_blocks_);
+  empty_blocks_ = block;
+  empty_count_++;
+}
+
+
+void StoreBuffer::ProcessBlock() {
+  ASSERT(current_->IsFull());
+  if (overflowed_ || (full_count_ >= kMaxFullBlocks)) {
+    // The remembered set has grown too large to be worth recording. Drop the
+    // recorded objects, they keep their remembered bit and will be found by
+    // the next scavenge when it visits all of old space.
+    overflowed_ = true;
+    ReleaseBlocks(full_blocks_);
+    full_blocks_ = NULL;
+    full_count_ = 0;
+    current_->Reset();
+    return;
+  }
+  current_->set_next(full_blocks_);
+  full_blocks_ = current_;
+  full_count_++;
+  current_ = PopEmptyBlock();
+}
+
+
+void StoreBuffer::RememberObject(RawObject* obj) {
+  ASSERT(obj->IsOldObject());
+  HeapPage* page = PageSpace::PageFor(obj);
+  if (page->card_table() != NULL) {
+    page->DirtyAllCards();
+  }
+  if (!obj->IsRemembered()) {
+    obj->SetRememberedBit();
+    AddObject(obj);
+  }
+}
+
+
+StoreBufferBlock* StoreBuffer::TakeBlocks() {
+  StoreBufferBlock* result = full_blocks_;
+  full_blocks_ = NULL;
+  full_count_ = 0;
+  if (!current_->IsEmpty()) {
+    current_->set_next(result);
+    result = current_;
+    current_ = PopEmptyBlock();
+  }
+  return result;
+}
+
+
+void StoreBuffer::ReleaseBlocks(StoreBufferBlock* blocks) {
+  while (blocks != NULL) {
+    StoreBufferBlock* next = blocks->next();
+    PushEmptyBlock(blocks);
+    blocks = next;
+  }
+}
+
+
+void StoreBuffer::Reset() {
+  ReleaseBlocks(TakeBlocks());
+  overflowed_ = false;
+}
+
+
+intptr_t StoreBuffer::Count() const {
+  intptr_t count = current_->Count();
+  StoreBufferBlock* block = full_blocks_;
+  while (block != NULL) {
+    count += block->Count();
+    block = block->next();
+  }
+  return count;
 }
 
 }  // namespace dart
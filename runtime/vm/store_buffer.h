@@ -10,34 +10,120 @@
 
 namespace dart {
 
+// Forward declarations.
+class RawObject;
+
 class StoreBufferBlock {
  public:
   // Each block contains kSize pointers.
   static const int32_t kSize = 1024;
 
-  StoreBufferBlock() : top_(0) {}
+  StoreBufferBlock() : next_(NULL), top_(0) {}
 
   static int top_offset() { return OFFSET_OF(StoreBufferBlock, top_); }
   static int pointers_offset() {
     return OFFSET_OF(StoreBufferBlock, pointers_);
   }
 
-  // Add a pointer to the block of pointers. The buffer will be processed if it
-  // has been filled by this operation.
-  void AddPointer(uword pointer) {
+  StoreBufferBlock* next() const { return next_; }
+  void set_next(StoreBufferBlock* next) { next_ = next; }
+
+  intptr_t Count() const { return top_; }
+  bool IsEmpty() const { return top_ == 0; }
+  bool IsFull() const { return top_ == kSize; }
+  void Reset() { top_ = 0; }
+
+  RawObject* At(intptr_t i) const {
+    ASSERT(i >= 0);
+    ASSERT(i < top_);
+    return pointers_[i];
+  }
+
+  // Add an object to the block of pointers. The caller is responsible for
+  // processing the block once it is full.
+  void Add(RawObject* obj) {
     ASSERT(top_ < kSize);
-    pointers_[top_++] = pointer;
-    if (top_ == kSize) {
-      ProcessBuffer();
+    pointers_[top_++] = obj;
+  }
+
+ private:
+  StoreBufferBlock* next_;
+  int32_t top_;
+  RawObject* pointers_[kSize];
+
+  DISALLOW_COPY_AND_ASSIGN(StoreBufferBlock);
+};
+
+
+// The StoreBuffer implements the remembered set of an isolate: the old space
+// objects which may contain pointers into new space. An object is added at most
+// once between scavenges as its remembered bit filters repeated stores.
+// Filled blocks are queued until the next scavenge, which visits the recorded
+// objects and releases the blocks back into a pool of empty blocks.
+//
+// If too many blocks are queued the store buffer overflows. The recorded
+// objects are dropped and the next scavenge has to rebuild the remembered set
+// by visiting all of old space.
+class StoreBuffer {
+ public:
+  // Maximum number of full blocks queued before the store buffer overflows.
+  static const intptr_t kMaxFullBlocks = 1024;
+  // Maximum number of empty blocks kept in the pool.
+  static const intptr_t kMaxEmptyBlocks = 64;
+
+  StoreBuffer();
+  ~StoreBuffer();
+
+  // Add an old object with its remembered bit set to the store buffer.
+  void AddObject(RawObject* obj) {
+    current_->Add(obj);
+    if (current_->IsFull()) {
+      ProcessBlock();
     }
   }
 
-  // Process this store buffer and remember its contents in the heap.
-  void ProcessBuffer();
+  // Remember an old object whose fields were written without a write barrier.
+  // All cards of an object on a card marked page are dirtied.
+  void RememberObject(RawObject* obj);
+
+  // Queue the full current block and continue with an empty block. Generated
+  // code adds objects to the current block directly and calls this when the
+  // block is full.
+  void ProcessBlock();
+
+  // Remove all recorded blocks from the store buffer and return them as a
+  // linked list. The store buffer continues recording into fresh blocks.
+  StoreBufferBlock* TakeBlocks();
+
+  // Return a list of processed blocks into the pool of empty blocks.
+  void ReleaseBlocks(StoreBufferBlock* blocks);
+
+  // Drop all recorded objects and clear the overflow state. The caller is
+  // responsible for rebuilding the remembered set.
+  void Reset();
+
+  // Whether recorded objects were dropped since the last reset.
+  bool Overflowed() const { return overflowed_; }
+
+  // Number of objects currently recorded.
+  intptr_t Count() const;
+
+  static intptr_t current_offset() {
+    return OFFSET_OF(StoreBuffer, current_);
+  }
 
  private:
-  int32_t top_;
-  uword pointers_[kSize];
+  StoreBufferBlock* PopEmptyBlock();
+  void PushEmptyBlock(StoreBufferBlock* block);
+
+  StoreBufferBlock* current_;
+  StoreBufferBlock* full_blocks_;
+  intptr_t full_count_;
+  StoreBufferBlock* empty_blocks_;
+  intptr_t empty_count_;
+  bool overflowed_;
+
+  DISALLOW_COPY_AND_ASSIGN(StoreBuffer);
 };
 
 }  // namespace dart
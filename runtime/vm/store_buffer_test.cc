@@ -0,0 +1,165 @@
+// Copyright (c) 2012, the Dart project authors.  Please see the AUTHORS file
+// for details. All rights reserved. Use of this source code is governed by a
+// BSD-style license that can be found in the LICENSE file.
+
+#include "platform/assert.h"
+#include "vm/flags.h"
+#include "vm/globals.h"
+#include "vm/heap.h"
+#include "vm/pages.h"
+#include "vm/store_buffer.h"
+#include "vm/unit_test.h"
+
+namespace dart {
+
+DECLARE_FLAG(int, tenuring_age);
+
+static RawObject* FakeObject(intptr_t i) {
+  return reinterpret_cast<RawObject*>((i << kObjectAlignmentLog2) |
+                                      kHeapObjectTag);
+}
+
+
+UNIT_TEST_CASE(StoreBuffer_Blocks) {
+  StoreBuffer buffer;
+  const intptr_t kCount = 2 * StoreBufferBlock::kSize + 3;
+  for (intptr_t i = 0; i < kCount; i++) {
+    buffer.AddObject(FakeObject(i));
+  }
+  EXPECT_EQ(kCount, buffer.Count());
+  EXPECT(!buffer.Overflowed());
+
+  StoreBufferBlock* blocks = buffer.TakeBlocks();
+  EXPECT_EQ(0, buffer.Count());
+  intptr_t num_blocks = 0;
+  intptr_t num_objects = 0;
+  for (StoreBufferBlock* block = blocks;
+       block != NULL;
+       block = block->next()) {
+    num_blocks++;
+    num_objects += block->Count();
+  }
+  EXPECT_EQ(3, num_blocks);
+  EXPECT_EQ(kCount, num_objects);
+  buffer.ReleaseBlocks(blocks);
+
+  // Released blocks are reused.
+  buffer.AddObject(FakeObject(0));
+  EXPECT_EQ(1, buffer.Count());
+  buffer.Reset();
+  EXPECT_EQ(0, buffer.Count());
+}
+
+
+UNIT_TEST_CASE(StoreBuffer_Overflow) {
+  StoreBuffer buffer;
+  const intptr_t kCount =
+      (StoreBuffer::kMaxFullBlocks + 1) * StoreBufferBlock::kSize;
+  for (intptr_t i = 0; i < kCount; i++) {
+    buffer.AddObject(FakeObject(i));
+  }
+  EXPECT(buffer.Overflowed());
+  EXPECT(buffer.Count() < kCount);
+  buffer.Reset();
+  EXPECT(!buffer.Overflowed());
+  EXPECT_EQ(0, buffer.Count());
+}
+
+
+TEST_CASE(StoreBuffer_RememberOldToNew) {
+  Isolate* isolate = Isolate::Current();
+  Heap* heap = isolate->heap();
+  const Array& old_array = Array::Handle(Array::New(1, Heap::kOld));
+  EXPECT(!old_array.raw()->IsRemembered());
+  old_array.SetAt(0, String::Handle(String::New("new string")));
+  EXPECT(old_array.raw()->IsRemembered());
+
+  // The string survives the scavenges in new space until it reaches the
+  // tenuring age and is only reachable through the remembered array.
+  String& str = String::Handle();
+  for (intptr_t i = 0; i < FLAG_tenuring_age; i++) {
+    heap->CollectGarbage(Heap::kNew);
+    str ^= old_array.At(0);
+    EXPECT(str.raw()->IsNewObject());
+    EXPECT(str.Equals("new string"));
+    EXPECT(old_array.raw()->IsRemembered());
+  }
+
+  // The string is promoted by the next scavenge and the array is forgotten.
+  heap->CollectGarbage(Heap::kNew);
+  str ^= old_array.At(0);
+  EXPECT(str.raw()->IsOldObject());
+  EXPECT(str.Equals("new string"));
+  EXPECT(!old_array.raw()->IsRemembered());
+}
+
+
+TEST_CASE(StoreBuffer_ScavengeAfterOverflow) {
+  Isolate* isolate = Isolate::Current();
+  Heap* heap = isolate->heap();
+  StoreBuffer* buffer = isolate->store_buffer();
+  const Array& old_array = Array::Handle(Array::New(1, Heap::kOld));
+  old_array.SetAt(0, String::Handle(String::New("new string")));
+  EXPECT(old_array.raw()->IsRemembered());
+
+  // Overflow the store buffer. The scavenge has to find the remembered array
+  // by visiting all of old space.
+  const intptr_t kCount =
+      (StoreBuffer::kMaxFullBlocks + 1) * StoreBufferBlock::kSize;
+  for (intptr_t i = 0; i < kCount; i++) {
+    buffer->AddObject(old_array.raw());
+  }
+  EXPECT(buffer->Overflowed());
+
+  heap->CollectGarbage(Heap::kNew);
+  EXPECT(!buffer->Overflowed());
+  String& str = String::Handle();
+  str ^= old_array.At(0);
+  EXPECT(str.raw()->IsNewObject());
+  EXPECT(str.Equals("new string"));
+  EXPECT(old_array.raw()->IsRemembered());
+}
+
+static intptr_t CountDirtyCards(HeapPage* page) {
+  intptr_t count = 0;
+  for (intptr_t i = 0; i < page->NumCards(); i++) {
+    if (page->card_table()[i] != 0) {
+      count++;
+    }
+  }
+  return count;
+}
+
+
+TEST_CASE(StoreBuffer_CardMarking) {
+  Heap* heap = Isolate::Current()->heap();
+  const intptr_t kLength = 128 * KB;
+  const Array& large_array = Array::Handle(Array::New(kLength, Heap::kOld));
+  HeapPage* page = PageSpace::PageFor(large_array.raw());
+  EXPECT(page->card_table() != NULL);
+  EXPECT_EQ(0, CountDirtyCards(page));
+
+  large_array.SetAt(kLength - 1, String::Handle(String::New("new string")));
+  EXPECT(large_array.raw()->IsRemembered());
+  EXPECT_EQ(1, CountDirtyCards(page));
+
+  // Only the dirty card is visited and it stays dirty as long as the string
+  // is in new space.
+  String& str = String::Handle();
+  for (intptr_t i = 0; i < FLAG_tenuring_age; i++) {
+    heap->CollectGarbage(Heap::kNew);
+    str ^= large_array.At(kLength - 1);
+    EXPECT(str.raw()->IsNewObject());
+    EXPECT(str.Equals("new string"));
+    EXPECT(large_array.raw()->IsRemembered());
+    EXPECT_EQ(1, CountDirtyCards(page));
+  }
+
+  heap->CollectGarbage(Heap::kNew);
+  str ^= large_array.At(kLength - 1);
+  EXPECT(str.raw()->IsOldObject());
+  EXPECT(!large_array.raw()->IsRemembered());
+  EXPECT_EQ(0, CountDirtyCards(page));
+}
+
+}  // namespace dart
@@ -178,4 +178,55 @@ const char* StubCode::NameOfStub(uword entry_point) {
   return NULL;
 }
 
+
+#define STUB_CODE_INDEX(name)                                                  \
+  if ((name##_entry() != NULL) && (entry_point == name##EntryPoint())) {       \
+    return index;                                                              \
+  }                                                                            \
+  index++;
+
+
+intptr_t StubCode::IndexOfVMStub(uword entry_point) {
+  intptr_t index = 0;
+  VM_STUB_CODE_LIST(STUB_CODE_INDEX);
+  return -1;
+}
+
+
+intptr_t StubCode::IndexOfIsolateStub(uword entry_point) {
+  Isolate* isolate = Isolate::Current();
+  if ((isolate == NULL) || (isolate->stub_code() == NULL)) {
+    return -1;
+  }
+  intptr_t index = 0;
+  STUB_CODE_LIST(STUB_CODE_INDEX);
+  return -1;
+}
+
+#undef STUB_CODE_INDEX
+
+
+#define STUB_CODE_ENTRY_POINT(name)                                            \
+  if (index == 0) {                                                            \
+    return name##EntryPoint();                                                 \
+  }                                                                            \
+  index--;
+
+
+uword StubCode::VMStubEntryPointAt(intptr_t index) {
+  VM_STUB_CODE_LIST(STUB_CODE_ENTRY_POINT);
+  UNREACHABLE();
+  return 0;
+}
+
+
+uword StubCode::IsolateStubEntryPointAt(intptr_t index) {
+  ASSERT(Isolate::Current()->stub_code() != NULL);
+  STUB_CODE_LIST(STUB_CODE_ENTRY_POINT);
+  UNREACHABLE();
+  return 0;
+}
+
+#undef STUB_CODE_ENTRY_POINT
+
 }  // namespace dart
@@ -23,6 +23,8 @@ class RawCode;
   V(DartCallToRuntime)                                                         \
   V(StubCallToRuntime)                                                         \
   V(PrintStopMessage)                                                          \
+  V(UpdateStoreBuffer)                                                         \
+  V(MarkingBarrier)                                                            \
   V(CallNativeCFunction)                                                       \
   V(AllocateArray)                                                             \
   V(CallNoSuchMethodFunction)                                                  \
@@ -49,6 +51,7 @@ class RawCode;
   V(AllocateContext)                                                           \
   V(OneArgCheckInlineCache)                                                    \
   V(TwoArgsCheckInlineCache)                                                   \
+  V(MegamorphicCall)                                                           \
   V(BreakpointDynamic)                                                         \
 
 
@@ -108,6 +111,13 @@ class StubCode {
   // Returns NULL if no stub found.
   static const char* NameOfStub(uword entry_point);
 
+  // Returns the position of the stub in VM_STUB_CODE_LIST or STUB_CODE_LIST,
+  // or -1 if no stub found. Code in snapshots refers to stubs by position.
+  static intptr_t IndexOfVMStub(uword entry_point);
+  static intptr_t IndexOfIsolateStub(uword entry_point);
+  static uword VMStubEntryPointAt(intptr_t index);
+  static uword IsolateStubEntryPointAt(intptr_t index);
+
   // Define the shared stub code accessors.
 #define STUB_CODE_ACCESSOR(name)                                               \
   static StubEntry* name##_entry() {                                           \
@@ -21,6 +21,16 @@ void StubCode::GenerateStubCallToRuntimeStub(Assembler* assembler) {
 }
 
 
+void StubCode::GenerateUpdateStoreBufferStub(Assembler* assembler) {
+  __ Unimplemented("UpdateStoreBuffer stub");
+}
+
+
+void StubCode::GenerateMarkingBarrierStub(Assembler* assembler) {
+  __ Unimplemented("MarkingBarrier stub");
+}
+
+
 void StubCode::GenerateCallNativeCFunctionStub(Assembler* assembler) {
   __ Unimplemented("CallNativeCFunction stub");
 }
@@ -93,6 +103,11 @@ void StubCode::GenerateTwoArgsCheckInlineCacheStub(Assembler* assembler) {
 }
 
 
+void StubCode::GenerateMegamorphicCallStub(Assembler* assembler) {
+  __ Unimplemented("MegamorphicCall stub");
+}
+
+
 void StubCode::GenerateBreakpointStaticStub(Assembler* assembler) {
   __ Unimplemented("BreakpointStatic stub");
 }
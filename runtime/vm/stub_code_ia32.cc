@@ -152,6 +152,173 @@ void StubCode::GeneratePrintStopMessageStub(Assembler* assembler) {
 }
 
 
+// Queue the full current block of the isolate's store buffer.
+static void ProcessStoreBufferBlock(Isolate* isolate) {
+  isolate->store_buffer()->ProcessBlock();
+}
+
+
+// Helper stub to implement Assembler::StoreIntoObject.
+// Input parameters:
+//   ESP : points to return address.
+//   EDX : old object being stored into.
+//   ECX : address of the updated slot in the object.
+// Must preserve all registers.
+void StubCode::GenerateUpdateStoreBufferStub(Assembler* assembler) {
+  Label no_card_table;
+  Label add_to_buffer;
+  Label block_full;
+  // Dirty the card of the updated slot if the page of the object has a card
+  // table.
+  __ pushl(EAX);
+  __ pushl(ECX);
+  __ movl(EAX, EDX);
+  __ andl(EAX, Immediate(~(PageSpace::kPageSize - 1)));
+  __ subl(ECX, EAX);
+  __ shrl(ECX, Immediate(HeapPage::kCardBits));
+  __ movl(EAX, Address(EAX, HeapPage::card_table_offset()));
+  __ testl(EAX, EAX);
+  __ j(ZERO, &no_card_table, Assembler::kNearJump);
+  __ movb(Address(EAX, ECX, TIMES_1, 0), Immediate(1));
+  __ Bind(&no_card_table);
+  __ popl(ECX);
+  __ popl(EAX);
+
+  // Skip adding the object to the store buffer if it has already been
+  // remembered.
+  __ pushl(ECX);
+  __ movl(ECX, FieldAddress(EDX, Object::tags_offset()));
+  __ testl(ECX, Immediate(1 << RawObject::kRememberedBit));
+  __ j(ZERO, &add_to_buffer, Assembler::kNearJump);
+  __ popl(ECX);
+  __ ret();
+
+  __ Bind(&add_to_buffer);
+  __ orl(ECX, Immediate(1 << RawObject::kRememberedBit));
+  __ movl(FieldAddress(EDX, Object::tags_offset()), ECX);
+
+  // Load the current block of the store buffer out of the isolate.
+  __ pushl(EAX);
+  __ movl(EAX, FieldAddress(CTX, Context::isolate_offset()));
+  __ movl(EAX, Address(EAX,
+                       Isolate::store_buffer_offset() +
+                       StoreBuffer::current_offset()));
+
+  // Add the object to the block and bump its top.
+  __ movl(ECX, Address(EAX, StoreBufferBlock::top_offset()));
+  __ movl(Address(EAX, ECX, TIMES_4, StoreBufferBlock::pointers_offset()),
+          EDX);
+  __ incl(ECX);
+  __ movl(Address(EAX, StoreBufferBlock::top_offset()), ECX);
+  __ cmpl(ECX, Immediate(StoreBufferBlock::kSize));
+  __ popl(EAX);
+  __ popl(ECX);
+  __ j(EQUAL, &block_full, Assembler::kNearJump);
+  __ ret();
+
+  // The block is full, queue it in the runtime.
+  __ Bind(&block_full);
+  // Preserve caller-saved registers.
+  __ pushl(EAX);
+  __ pushl(ECX);
+  __ pushl(EDX);
+
+  __ EnterFrame(0);
+
+  // Reserve space for the argument and align frame before entering
+  // the C++ world.
+  __ AddImmediate(ESP, Immediate(-kWordSize));
+  if (OS::ActivationFrameAlignment() > 0) {
+    __ andl(ESP, Immediate(~(OS::ActivationFrameAlignment() - 1)));
+  }
+
+  __ movl(EAX, FieldAddress(CTX, Context::isolate_offset()));
+  __ movl(Address(ESP, 0), EAX);
+  __ movl(EAX, Immediate(reinterpret_cast<uword>(&ProcessStoreBufferBlock)));
+  __ call(EAX);
+
+  __ LeaveFrame();
+
+  // Restore caller-saved registers.
+  __ popl(EDX);
+  __ popl(ECX);
+  __ popl(EAX);
+
+  __ ret();
+}
+
+
+// Shade the value of a field overwritten while old space is marked
+// incrementally.
+static void ShadeOverwrittenValue(Isolate* isolate, RawObject* value) {
+  isolate->heap()->ShadeOverwrittenValue(value);
+}
+
+
+// Helper stub to implement the incremental marking barrier of
+// Assembler::StoreIntoObject.
+// Input parameters:
+//   ESP : points to return address.
+//   EDX : value of the field being overwritten.
+// Must preserve all registers.
+void StubCode::GenerateMarkingBarrierStub(Assembler* assembler) {
+  Label done;
+  const Immediate raw_null =
+      Immediate(reinterpret_cast<intptr_t>(Object::null()));
+  // Only unmarked old objects have to be shaded.
+  __ testl(EDX, Immediate(kSmiTagMask));
+  __ j(ZERO, &done);
+  __ testl(EDX, Immediate(kNewObjectAlignmentOffset));
+  __ j(NOT_ZERO, &done);
+  __ cmpl(EDX, raw_null);
+  __ j(EQUAL, &done);
+  __ pushl(ECX);
+  __ movl(ECX, FieldAddress(EDX, Object::tags_offset()));
+  __ testl(ECX, Immediate(1 << RawObject::kMarkBit));
+  __ popl(ECX);
+  __ j(NOT_ZERO, &done);
+
+  // Preserve caller-saved registers.
+  __ pushl(EAX);
+  __ pushl(ECX);
+  __ pushl(EDX);
+  const intptr_t kXmmRegistersSize = kNumberOfXmmRegisters * sizeof(double);
+  __ AddImmediate(ESP, Immediate(-kXmmRegistersSize));
+  for (intptr_t i = 0; i < kNumberOfXmmRegisters; i++) {
+    __ movsd(Address(ESP, i * sizeof(double)), static_cast<XmmRegister>(i));
+  }
+
+  __ EnterFrame(0);
+
+  // Reserve space for the arguments and align frame before entering
+  // the C++ world.
+  __ AddImmediate(ESP, Immediate(-2 * kWordSize));
+  if (OS::ActivationFrameAlignment() > 0) {
+    __ andl(ESP, Immediate(~(OS::ActivationFrameAlignment() - 1)));
+  }
+
+  __ movl(EAX, FieldAddress(CTX, Context::isolate_offset()));
+  __ movl(Address(ESP, 0), EAX);
+  __ movl(Address(ESP, kWordSize), EDX);
+  __ movl(EAX, Immediate(reinterpret_cast<uword>(&ShadeOverwrittenValue)));
+  __ call(EAX);
+
+  __ LeaveFrame();
+
+  // Restore caller-saved registers.
+  for (intptr_t i = 0; i < kNumberOfXmmRegisters; i++) {
+    __ movsd(static_cast<XmmRegister>(i), Address(ESP, i * sizeof(double)));
+  }
+  __ AddImmediate(ESP, Immediate(kXmmRegistersSize));
+  __ popl(EDX);
+  __ popl(ECX);
+  __ popl(EAX);
+
+  __ Bind(&done);
+  __ ret();
+}
+
+
 // Input parameters:
 //   ESP : points to return address.
 //   ESP + 4 : address of return value.
@@ -1694,6 +1861,122 @@ void StubCode::GenerateTwoArgsCheckInlineCacheStub(Assembler* assembler) {
   return GenerateNArgsCheckInlineCacheStub(assembler, 2);
 }
 
+
+// Probe the megamorphic cache of the selector of a call, see class
+// MegamorphicCache.
+//  ECX: Inline cache data object, whose megamorphic cache is set.
+//  EDX: Arguments array.
+//  TOS(0): return address
+// Control flow:
+// - If receiver is null -> jump to cache miss.
+// - If receiver is Smi -> load Smi class.
+// - Probe the buckets from the hash of the name of the receiver's class.
+// - Class found -> jump to target.
+// - Empty bucket found -> jump to cache miss, which adds the class.
+void StubCode::GenerateMegamorphicCallStub(Assembler* assembler) {
+  // The calls keep counting towards the optimization of the caller.
+  __ movl(EBX, FieldAddress(ECX, ICData::function_offset()));
+  __ incl(FieldAddress(EBX, Function::usage_counter_offset()));
+  if (CodeGenerator::CanOptimize()) {
+    __ cmpl(FieldAddress(EBX, Function::usage_counter_offset()),
+        Immediate(FLAG_optimization_counter_threshold));
+    Label not_yet_hot;
+    __ j(LESS_EQUAL, &not_yet_hot);
+    __ EnterFrame(0);
+    __ pushl(ECX);  // Preserve inline cache data object.
+    __ pushl(EDX);  // Preserve arguments array.
+    __ pushl(EBX);  // Argument for runtime: function object.
+    __ CallRuntimeFromStub(kOptimizeInvokedFunctionRuntimeEntry);
+    __ popl(EBX);  // Remove argument.
+    __ popl(EDX);  // Restore arguments array.
+    __ popl(ECX);  // Restore inline cache data object.
+    __ LeaveFrame();
+    __ Bind(&not_yet_hot);
+  }
+
+  const Immediate raw_null =
+      Immediate(reinterpret_cast<intptr_t>(Object::null()));
+  // Get receiver.
+  __ movl(EAX, FieldAddress(EDX, Array::data_offset()));
+  __ movl(EAX, Address(ESP, EAX, TIMES_2, 0));  // EAX (argument_count) is Smi.
+
+  Label class_in_eax, not_smi, loop, found, cache_miss, null_receiver;
+  __ testl(EAX, Immediate(kSmiTagMask));
+  __ j(NOT_ZERO, &not_smi, Assembler::kNearJump);
+  const Class& smi_class =
+      Class::ZoneHandle(Isolate::Current()->object_store()->smi_class());
+  __ LoadObject(EAX, smi_class);
+  __ jmp(&class_in_eax, Assembler::kNearJump);
+  __ Bind(&not_smi);
+  __ cmpl(EAX, raw_null);
+  __ j(EQUAL, &null_receiver);
+  __ movl(EAX, FieldAddress(EAX, Object::class_offset()));
+
+  __ Bind(&class_in_eax);
+  // EAX: receiver's class.
+  // ECX: IC data object (preserved).
+  // EDX: arguments array (preserved).
+  __ pushl(EDX);  // Preserve arguments array.
+  __ movl(EBX, FieldAddress(ECX, ICData::megamorphic_cache_offset()));
+  __ movl(EDX, FieldAddress(
+      EBX, Array::data_offset() + MegamorphicCache::kMask * kWordSize));
+  __ movl(EBX, FieldAddress(
+      EBX, Array::data_offset() + MegamorphicCache::kBuckets * kWordSize));
+  // EBX: buckets array.
+  // EDX: mask as Smi.
+  __ movl(EDI, FieldAddress(EAX, Class::name_offset()));
+  __ cmpl(EDI, raw_null);  // Named lazily?
+  __ j(EQUAL, &cache_miss);
+  __ movl(EDI, FieldAddress(EDI, String::hash_offset()));
+  __ Bind(&loop);
+  __ andl(EDI, EDX);
+  // EDI: bucket index as Smi, scaled by 4 to the two words of a bucket.
+  ASSERT(MegamorphicCache::kBucketSize * kWordSize == 4 * (1 << kSmiTagSize));
+  __ cmpl(EAX, FieldAddress(EBX, EDI, TIMES_4, Array::data_offset()));
+  __ j(EQUAL, &found, Assembler::kNearJump);
+  __ cmpl(FieldAddress(EBX, EDI, TIMES_4, Array::data_offset()), raw_null);
+  __ j(EQUAL, &cache_miss, Assembler::kNearJump);
+  __ addl(EDI, Immediate(Smi::RawValue(1)));  // Next bucket.
+  __ jmp(&loop, Assembler::kNearJump);
+
+  __ Bind(&cache_miss);
+  __ popl(EDX);  // Restore arguments array.
+  __ Bind(&null_receiver);
+  // Get receiver, again.
+  __ movl(EAX, FieldAddress(EDX, Array::data_offset()));
+  __ movl(EAX, Address(ESP, EAX, TIMES_2, 0));  // EAX is Smi.
+  __ EnterFrame(0);
+  __ pushl(EDX);  // Preserve arguments array.
+  __ pushl(ECX);  // Preserve IC data object.
+  __ pushl(raw_null);  // Setup space on stack for result (target function).
+  __ pushl(EAX);  // Push receiver.
+  __ CallRuntimeFromStub(kMegamorphicCacheMissHandlerRuntimeEntry);
+  __ popl(EAX);  // Remove receiver pushed earlier.
+  __ popl(EAX);  // Pop returned function object into EAX (null if not found).
+  __ popl(ECX);  // Restore IC data object.
+  __ popl(EDX);  // Restore arguments array.
+  __ LeaveFrame();
+  Label call_target_function;
+  __ cmpl(EAX, raw_null);
+  __ j(NOT_EQUAL, &call_target_function, Assembler::kNearJump);
+  // NoSuchMethod or closure.
+  __ jmp(&StubCode::MegamorphicLookupLabel());
+
+  __ Bind(&found);
+  // EDI: bucket index as Smi.
+  __ popl(EDX);  // Restore arguments array.
+  __ movl(EAX, FieldAddress(EBX, EDI, TIMES_4,
+                            Array::data_offset() +
+                            MegamorphicCache::kTarget * kWordSize));
+
+  __ Bind(&call_target_function);
+  // EAX: Target function.
+  __ movl(EAX, FieldAddress(EAX, Function::code_offset()));
+  __ movl(EAX, FieldAddress(EAX, Code::instructions_offset()));
+  __ addl(EAX, Immediate(Instructions::HeaderSize() - kHeapObjectTag));
+  __ jmp(EAX);
+}
+
 //  ECX: Function object.
 //  EDX: Arguments array.
 //  TOS(0): return address (Dart code).
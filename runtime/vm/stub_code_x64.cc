@@ -158,6 +158,191 @@ void StubCode::GeneratePrintStopMessageStub(Assembler* assembler) {
 }
 
 
+// Queue the full current block of the isolate's store buffer.
+static void ProcessStoreBufferBlock(Isolate* isolate) {
+  isolate->store_buffer()->ProcessBlock();
+}
+
+
+// Helper stub to implement Assembler::StoreIntoObject.
+// Input parameters:
+//   RSP : points to return address.
+//   RDX : old object being stored into.
+//   RCX : address of the updated slot in the object.
+// Must preserve all registers.
+void StubCode::GenerateUpdateStoreBufferStub(Assembler* assembler) {
+  Label no_card_table;
+  Label add_to_buffer;
+  Label block_full;
+  // Dirty the card of the updated slot if the page of the object has a card
+  // table.
+  __ pushq(RAX);
+  __ pushq(RCX);
+  __ movq(RAX, RDX);
+  __ andq(RAX, Immediate(~(PageSpace::kPageSize - 1)));
+  __ subq(RCX, RAX);
+  __ shrq(RCX, Immediate(HeapPage::kCardBits));
+  __ movq(RAX, Address(RAX, HeapPage::card_table_offset()));
+  __ testq(RAX, RAX);
+  __ j(ZERO, &no_card_table, Assembler::kNearJump);
+  __ movb(Address(RAX, RCX, TIMES_1, 0), Immediate(1));
+  __ Bind(&no_card_table);
+  __ popq(RCX);
+  __ popq(RAX);
+
+  // Skip adding the object to the store buffer if it has already been
+  // remembered.
+  __ pushq(RCX);
+  __ movq(RCX, FieldAddress(RDX, Object::tags_offset()));
+  __ testq(RCX, Immediate(1 << RawObject::kRememberedBit));
+  __ j(ZERO, &add_to_buffer, Assembler::kNearJump);
+  __ popq(RCX);
+  __ ret();
+
+  __ Bind(&add_to_buffer);
+  __ orq(RCX, Immediate(1 << RawObject::kRememberedBit));
+  __ movq(FieldAddress(RDX, Object::tags_offset()), RCX);
+
+  // Load the current block of the store buffer out of the isolate.
+  __ pushq(RAX);
+  __ movq(RAX, FieldAddress(CTX, Context::isolate_offset()));
+  __ movq(RAX, Address(RAX,
+                       Isolate::store_buffer_offset() +
+                       StoreBuffer::current_offset()));
+
+  // Add the object to the block and bump its top.
+  __ movl(RCX, Address(RAX, StoreBufferBlock::top_offset()));
+  __ movq(Address(RAX, RCX, TIMES_8, StoreBufferBlock::pointers_offset()),
+          RDX);
+  __ incq(RCX);
+  __ movl(Address(RAX, StoreBufferBlock::top_offset()), RCX);
+  __ cmpl(RCX, Immediate(StoreBufferBlock::kSize));
+  __ popq(RAX);
+  __ popq(RCX);
+  __ j(EQUAL, &block_full, Assembler::kNearJump);
+  __ ret();
+
+  // The block is full, queue it in the runtime.
+  __ Bind(&block_full);
+  // Preserve caller-saved registers.
+  __ pushq(RAX);
+  __ pushq(RCX);
+  __ pushq(RDX);
+  __ pushq(RSI);
+  __ pushq(RDI);
+  __ pushq(R8);
+  __ pushq(R9);
+  __ pushq(R10);
+  __ pushq(R11);
+
+  __ EnterFrame(0);
+
+  // Align frame before entering C++ world.
+  if (OS::ActivationFrameAlignment() > 0) {
+    __ andq(RSP, Immediate(~(OS::ActivationFrameAlignment() - 1)));
+  }
+
+  __ movq(RDI, FieldAddress(CTX, Context::isolate_offset()));
+  __ movq(RAX, Immediate(reinterpret_cast<uword>(&ProcessStoreBufferBlock)));
+  __ call(RAX);
+
+  __ LeaveFrame();
+
+  // Restore caller-saved registers.
+  __ popq(R11);
+  __ popq(R10);
+  __ popq(R9);
+  __ popq(R8);
+  __ popq(RDI);
+  __ popq(RSI);
+  __ popq(RDX);
+  __ popq(RCX);
+  __ popq(RAX);
+
+  __ ret();
+}
+
+
+// Shade the value of a field overwritten while old space is marked
+// incrementally.
+static void ShadeOverwrittenValue(Isolate* isolate, RawObject* value) {
+  isolate->heap()->ShadeOverwrittenValue(value);
+}
+
+
+// Helper stub to implement the incremental marking barrier of
+// Assembler::StoreIntoObject.
+// Input parameters:
+//   RSP : points to return address.
+//   RDX : value of the field being overwritten.
+// Must preserve all registers.
+void StubCode::GenerateMarkingBarrierStub(Assembler* assembler) {
+  Label done;
+  const Immediate raw_null =
+      Immediate(reinterpret_cast<intptr_t>(Object::null()));
+  // Only unmarked old objects have to be shaded.
+  __ testq(RDX, Immediate(kSmiTagMask));
+  __ j(ZERO, &done);
+  __ testq(RDX, Immediate(kNewObjectAlignmentOffset));
+  __ j(NOT_ZERO, &done);
+  __ cmpq(RDX, raw_null);
+  __ j(EQUAL, &done);
+  __ pushq(RCX);
+  __ movq(RCX, FieldAddress(RDX, Object::tags_offset()));
+  __ testq(RCX, Immediate(1 << RawObject::kMarkBit));
+  __ popq(RCX);
+  __ j(NOT_ZERO, &done);
+
+  // Preserve caller-saved registers.
+  __ pushq(RAX);
+  __ pushq(RCX);
+  __ pushq(RDX);
+  __ pushq(RSI);
+  __ pushq(RDI);
+  __ pushq(R8);
+  __ pushq(R9);
+  __ pushq(R10);
+  __ pushq(R11);
+  const intptr_t kXmmRegistersSize = kNumberOfXmmRegisters * sizeof(double);
+  __ AddImmediate(RSP, Immediate(-kXmmRegistersSize));
+  for (intptr_t i = 0; i < kNumberOfXmmRegisters; i++) {
+    __ movsd(Address(RSP, i * sizeof(double)), static_cast<XmmRegister>(i));
+  }
+
+  __ EnterFrame(0);
+
+  // Align frame before entering C++ world.
+  if (OS::ActivationFrameAlignment() > 0) {
+    __ andq(RSP, Immediate(~(OS::ActivationFrameAlignment() - 1)));
+  }
+
+  __ movq(RDI, FieldAddress(CTX, Context::isolate_offset()));
+  __ movq(RSI, RDX);
+  __ movq(RAX, Immediate(reinterpret_cast<uword>(&ShadeOverwrittenValue)));
+  __ call(RAX);
+
+  __ LeaveFrame();
+
+  // Restore caller-saved registers.
+  for (intptr_t i = 0; i < kNumberOfXmmRegisters; i++) {
+    __ movsd(static_cast<XmmRegister>(i), Address(RSP, i * sizeof(double)));
+  }
+  __ AddImmediate(RSP, Immediate(kXmmRegistersSize));
+  __ popq(R11);
+  __ popq(R10);
+  __ popq(R9);
+  __ popq(R8);
+  __ popq(RDI);
+  __ popq(RSI);
+  __ popq(RDX);
+  __ popq(RCX);
+  __ popq(RAX);
+
+  __ Bind(&done);
+  __ ret();
+}
+
+
 // Input parameters:
 //   RSP : points to return address.
 //   RSP + 8 : address of return value.
@@ -278,7 +463,6 @@ void StubCode::GenerateCallStaticFunctionStub(Assembler* assembler) {
 // RBX: function object.
 // R10: arguments descriptor array (num_args is first Smi element).
 void StubCode::GenerateFixCallersTargetStub(Assembler* assembler) {
-  __ Untested("FixCallersTarget stub");
   __ EnterFrame(0);
   __ pushq(R10);  // Preserve arguments descriptor array.
   __ pushq(RBX);  // Preserve target function.
@@ -1671,6 +1855,98 @@ void StubCode::GenerateTwoArgsCheckInlineCacheStub(Assembler* assembler) {
 }
 
 
+// Probe the megamorphic cache of the selector of a call, see class
+// MegamorphicCache.
+//  RBX: Inline cache data object, whose megamorphic cache is set.
+//  R10: Arguments array.
+//  TOS(0): return address
+// Control flow:
+// - If receiver is null -> jump to cache miss.
+// - If receiver is Smi -> load Smi class.
+// - Probe the buckets from the hash of the name of the receiver's class.
+// - Class found -> jump to target.
+// - Empty bucket found -> jump to cache miss, which adds the class.
+void StubCode::GenerateMegamorphicCallStub(Assembler* assembler) {
+  const Immediate raw_null =
+      Immediate(reinterpret_cast<intptr_t>(Object::null()));
+  // Get receiver.
+  __ movq(RAX, FieldAddress(R10, Array::data_offset()));
+  __ movq(RAX, Address(RSP, RAX, TIMES_4, 0));  // RAX (argument count) is Smi.
+
+  Label class_in_rax, not_smi, loop, found, cache_miss;
+  __ testq(RAX, Immediate(kSmiTagMask));
+  __ j(NOT_ZERO, &not_smi, Assembler::kNearJump);
+  const Class& smi_class =
+      Class::ZoneHandle(Isolate::Current()->object_store()->smi_class());
+  __ LoadObject(RAX, smi_class);
+  __ jmp(&class_in_rax, Assembler::kNearJump);
+  __ Bind(&not_smi);
+  __ cmpq(RAX, raw_null);
+  __ j(EQUAL, &cache_miss);
+  __ movq(RAX, FieldAddress(RAX, Object::class_offset()));
+
+  __ Bind(&class_in_rax);
+  // RAX: receiver's class.
+  // RBX: IC data object (preserved).
+  __ movq(RCX, FieldAddress(RBX, ICData::megamorphic_cache_offset()));
+  __ movq(RDX, FieldAddress(
+      RCX, Array::data_offset() + MegamorphicCache::kMask * kWordSize));
+  __ movq(RCX, FieldAddress(
+      RCX, Array::data_offset() + MegamorphicCache::kBuckets * kWordSize));
+  // RCX: buckets array.
+  // RDX: mask as Smi.
+  __ movq(R12, FieldAddress(RAX, Class::name_offset()));
+  __ cmpq(R12, raw_null);  // Named lazily?
+  __ j(EQUAL, &cache_miss);
+  __ movq(R12, FieldAddress(R12, String::hash_offset()));
+  __ Bind(&loop);
+  __ andq(R12, RDX);
+  // R12: bucket index as Smi, scaled by 8 to the two words of a bucket.
+  ASSERT(MegamorphicCache::kBucketSize * kWordSize == 8 * (1 << kSmiTagSize));
+  __ movq(R13, FieldAddress(RCX, R12, TIMES_8, Array::data_offset()));
+  __ cmpq(R13, RAX);  // Match?
+  __ j(EQUAL, &found, Assembler::kNearJump);
+  __ cmpq(R13, raw_null);  // Empty bucket?
+  __ j(EQUAL, &cache_miss, Assembler::kNearJump);
+  __ addq(R12, Immediate(Smi::RawValue(1)));  // Next bucket.
+  __ jmp(&loop, Assembler::kNearJump);
+
+  __ Bind(&cache_miss);
+  // Get receiver, again.
+  __ movq(RAX, FieldAddress(R10, Array::data_offset()));
+  __ movq(RAX, Address(RSP, RAX, TIMES_4, 0));  // RAX is Smi.
+  __ EnterFrame(0);
+  __ pushq(R10);  // Preserve arguments array.
+  __ pushq(RBX);  // Preserve IC data object.
+  __ pushq(raw_null);  // Setup space on stack for result (target function).
+  __ pushq(RAX);  // Push receiver.
+  __ CallRuntimeFromStub(kMegamorphicCacheMissHandlerRuntimeEntry);
+  __ popq(RAX);  // Remove receiver pushed earlier.
+  __ popq(RAX);  // Pop returned function object into RAX (null if not found).
+  __ popq(RBX);  // Restore IC data object.
+  __ popq(R10);  // Restore arguments array.
+  __ LeaveFrame();
+  Label call_target_function;
+  __ cmpq(RAX, raw_null);
+  __ j(NOT_EQUAL, &call_target_function, Assembler::kNearJump);
+  // NoSuchMethod or closure.
+  __ jmp(&StubCode::MegamorphicLookupLabel());
+
+  __ Bind(&found);
+  // R12: bucket index as Smi.
+  __ movq(RAX, FieldAddress(RCX, R12, TIMES_8,
+                            Array::data_offset() +
+                            MegamorphicCache::kTarget * kWordSize));
+
+  __ Bind(&call_target_function);
+  // RAX: Target function.
+  __ movq(RAX, FieldAddress(RAX, Function::code_offset()));
+  __ movq(RAX, FieldAddress(RAX, Code::instructions_offset()));
+  __ addq(RAX, Immediate(Instructions::HeaderSize() - kHeapObjectTag));
+  __ jmp(RAX);
+}
+
+
 //  RBX: Function object.
 //  R10: Arguments array.
 //  TOS(0): return address (Dart code).
@@ -12,14 +12,18 @@ DEFINE_FLAG(int, worker_timeout_millis, 5000,
 Monitor* ThreadPool::exit_monitor_ = NULL;
 int* ThreadPool::exit_count_ = NULL;
 
-ThreadPool::ThreadPool()
+ThreadPool::ThreadPool(intptr_t max_workers)
   : shutting_down_(false),
+    max_workers_(max_workers),
+    pending_head_(NULL),
+    pending_tail_(NULL),
     all_workers_(NULL),
     idle_workers_(NULL),
     count_started_(0),
     count_stopped_(0),
     count_running_(0),
-    count_idle_(0) {
+    count_idle_(0),
+    count_pending_(0) {
 }
 
 
@@ -38,6 +42,21 @@ void ThreadPool::Run(Task* task) {
     if (shutting_down_) {
       return;
     }
+    if ((idle_workers_ == NULL) &&
+        (max_workers_ > 0) &&
+        (count_started_ - count_stopped_ >=
+         static_cast<uint64_t>(max_workers_))) {
+      // All the workers are busy, the task waits for one of them.
+      task->next_ = NULL;
+      if (pending_tail_ == NULL) {
+        pending_head_ = task;
+      } else {
+        pending_tail_->next_ = task;
+      }
+      pending_tail_ = task;
+      count_pending_++;
+      return;
+    }
     if (idle_workers_ == NULL) {
       worker = new Worker(this);
       ASSERT(worker != NULL);
@@ -69,12 +88,17 @@ void ThreadPool::Run(Task* task) {
 
 void ThreadPool::Shutdown() {
   Worker* saved = NULL;
+  Task* pending = NULL;
   {
     MutexLocker ml(&mutex_);
     shutting_down_ = true;
     saved = all_workers_;
     all_workers_ = NULL;
     idle_workers_ = NULL;
+    pending = pending_head_;
+    pending_head_ = NULL;
+    pending_tail_ = NULL;
+    count_pending_ = 0;
 
     Worker* current = saved;
     while (current != NULL) {
@@ -91,6 +115,13 @@ void ThreadPool::Shutdown() {
   }
   // Release ThreadPool::mutex_ before calling Worker functions.
 
+  // The tasks which were waiting for a worker are never run.
+  while (pending != NULL) {
+    Task* next = pending->next_;
+    delete pending;
+    pending = next;
+  }
+
   Worker* current = saved;
   while (current != NULL) {
     // We may access all_next_ without holding ThreadPool::mutex_ here
@@ -171,16 +202,28 @@ bool ThreadPool::RemoveWorkerFromAllList(Worker* worker) {
 }
 
 
-void ThreadPool::SetIdle(Worker* worker) {
+ThreadPool::Task* ThreadPool::NextTaskOrSetIdle(Worker* worker) {
   MutexLocker ml(&mutex_);
   if (shutting_down_) {
-    return;
+    return NULL;
   }
   ASSERT(worker->owned_ && !IsIdle(worker));
+  if (pending_head_ != NULL) {
+    // The worker stays busy with the task which has waited the longest.
+    Task* task = pending_head_;
+    pending_head_ = task->next_;
+    if (pending_head_ == NULL) {
+      pending_tail_ = NULL;
+    }
+    task->next_ = NULL;
+    count_pending_--;
+    return task;
+  }
   worker->idle_next_ = idle_workers_;
   idle_workers_ = worker;
   count_idle_++;
   count_running_--;
+  return NULL;
 }
 
 
@@ -203,7 +246,7 @@ bool ThreadPool::ReleaseIdleWorker(Worker* worker) {
 }
 
 
-ThreadPool::Task::Task() {
+ThreadPool::Task::Task() : next_(NULL) {
 }
 
 
@@ -277,7 +320,10 @@ void ThreadPool::Worker::Loop() {
       return;
     }
     ASSERT(pool_ != NULL);
-    pool_->SetIdle(this);
+    task_ = pool_->NextTaskOrSetIdle(this);
+    if (task_ != NULL) {
+      continue;
+    }
     idle_start = OS::GetCurrentTimeMillis();
     while (true) {
       Monitor::WaitResult result = ml.Wait(ComputeTimeout(idle_start));
@@ -23,10 +23,17 @@ class ThreadPool {
     virtual void Run() = 0;
 
    private:
+    friend class ThreadPool;
+
+    Task* next_;  // Protected by ThreadPool::mutex_
+
     DISALLOW_COPY_AND_ASSIGN(Task);
   };
 
-  ThreadPool();
+  // A pool with a positive 'max_workers' runs at most that many workers at
+  // a time.  The tasks run while all of them are busy wait in the order
+  // they were run for a worker to finish its task.
+  explicit ThreadPool(intptr_t max_workers = 0);
 
   // Shuts down this thread pool.  Causes workers to terminate
   // themselves when they are active again.
@@ -40,6 +47,7 @@ class ThreadPool {
   uint64_t workers_idle() const { return count_idle_; }
   uint64_t workers_started() const { return count_started_; }
   uint64_t workers_stopped() const { return count_stopped_; }
+  uint64_t tasks_pending() const { return count_pending_; }
 
  private:
   friend class ThreadPoolTestPeer;
@@ -92,17 +100,24 @@ class ThreadPool {
   bool RemoveWorkerFromAllList(Worker* worker);
 
   // Worker operations.
-  void SetIdle(Worker* worker);
+
+  // Returns the next waiting task for the worker, or adds the worker to the
+  // idle list and returns NULL if no task is waiting.
+  Task* NextTaskOrSetIdle(Worker* worker);
   bool ReleaseIdleWorker(Worker* worker);
 
   Mutex mutex_;
   bool shutting_down_;
+  const intptr_t max_workers_;
+  Task* pending_head_;
+  Task* pending_tail_;
   Worker* all_workers_;
   Worker* idle_workers_;
   uint64_t count_started_;
   uint64_t count_stopped_;
   uint64_t count_running_;
   uint64_t count_idle_;
+  uint64_t count_pending_;
 
   static Monitor* exit_monitor_;  // Used only in testing.
   static int* exit_count_;        // Used only in testing.
@@ -215,4 +215,54 @@ UNIT_TEST_CASE(ThreadPool_RecursiveSpawn) {
 }
 
 
+class BlockingTask : public ThreadPool::Task {
+ public:
+  BlockingTask(Monitor* sync, bool* released, int* done)
+      : sync_(sync), released_(released), done_(done) {
+  }
+
+  void Run() {
+    MonitorLocker ml(sync_);
+    while (!*released_) {
+      ml.Wait();
+    }
+    (*done_)++;
+    ml.NotifyAll();
+  }
+
+ private:
+  Monitor* sync_;
+  bool* released_;
+  int* done_;
+};
+
+
+UNIT_TEST_CASE(ThreadPool_MaxWorkers) {
+  const int kMaxWorkers = 2;
+  const int kTaskCount = 5;
+  ThreadPool thread_pool(kMaxWorkers);
+  Monitor sync;
+  bool released = false;
+  int done = 0;
+  for (int i = 0; i < kTaskCount; i++) {
+    thread_pool.Run(new BlockingTask(&sync, &released, &done));
+  }
+  // The tasks which do not get a worker wait for one.
+  EXPECT_EQ(static_cast<uint64_t>(kMaxWorkers), thread_pool.workers_started());
+  EXPECT_EQ(static_cast<uint64_t>(kTaskCount - kMaxWorkers),
+            thread_pool.tasks_pending());
+  {
+    MonitorLocker ml(&sync);
+    released = true;
+    ml.NotifyAll();
+    while (done < kTaskCount) {
+      ml.Wait();
+    }
+  }
+  EXPECT_EQ(kTaskCount, done);
+  EXPECT_EQ(static_cast<uint64_t>(kMaxWorkers), thread_pool.workers_started());
+  EXPECT_EQ(0U, thread_pool.tasks_pending());
+}
+
+
 }  // namespace dart
@@ -37,6 +37,20 @@
   }                                                                            \
   static void Dart_TestHelper##name()
 
+// The BENCHMARK macro is used for benchmarks that need an isolate and zone.
+// Benchmarks are not run as part of the tests, they are run by name or with
+// --benchmarks and report their score.
+#define BENCHMARK(name)                                                        \
+  static void Dart_BenchmarkHelper##name(dart::Benchmark* benchmark);          \
+  void Dart_Benchmark##name(dart::Benchmark* benchmark) {                      \
+    TestIsolateScope __test_isolate__;                                         \
+    Zone __zone__(__test_isolate__.isolate());                                 \
+    HandleScope __hs__(__test_isolate__.isolate());                            \
+    Dart_BenchmarkHelper##name(benchmark);                                     \
+  }                                                                            \
+  static const dart::Benchmark kRegister##name(Dart_Benchmark##name, #name);   \
+  static void Dart_BenchmarkHelper##name(dart::Benchmark* benchmark)
+
 // The ASSEMBLER_TEST_GENERATE macro is used to generate a unit test
 // for the assembler.
 #define ASSEMBLER_TEST_GENERATE(name, assembler)                               \
@@ -142,6 +156,7 @@ class TestCaseBase {
 
   const char* name() const { return name_; }
 
+  virtual bool IsBenchmark() const { return false; }
   virtual void Run() = 0;
   void RunTest();
 
@@ -197,6 +212,28 @@ class TestCase : TestCaseBase {
 };
 
 
+class Benchmark : TestCaseBase {
+ public:
+  typedef void (RunEntry)(Benchmark* benchmark);
+
+  Benchmark(RunEntry* run, const char* name)
+      : TestCaseBase(name), run_(run), score_(0) { }
+
+  // Score of the benchmark in microseconds, lower is better.
+  int64_t score() const { return score_; }
+  void set_score(int64_t value) { score_ = value; }
+
+  virtual bool IsBenchmark() const { return true; }
+  virtual void Run();
+
+ private:
+  RunEntry* const run_;
+  int64_t score_;
+
+  DISALLOW_COPY_AND_ASSIGN(Benchmark);
+};
+
+
 class TestIsolateScope {
  public:
   TestIsolateScope() {
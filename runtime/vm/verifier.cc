@@ -11,6 +11,7 @@
 #include "vm/heap.h"
 #include "vm/isolate.h"
 #include "vm/object.h"
+#include "vm/pages.h"
 #include "vm/raw_object.h"
 #include "vm/stack_frame.h"
 
@@ -40,6 +41,56 @@ void VerifyPointersVisitor::VisitPointers(RawObject** first, RawObject** last) {
 }
 
 
+class FindNewPointersVisitor : public ObjectPointerVisitor {
+ public:
+  explicit FindNewPointersVisitor(HeapPage* card_page)
+      : card_page_(card_page), has_new_pointers_(false) {}
+
+  virtual void VisitPointers(RawObject** first, RawObject** last) {
+    for (RawObject** current = first; current <= last; current++) {
+      RawObject* raw_obj = *current;
+      if (raw_obj->IsHeapObject() && raw_obj->IsNewObject()) {
+        has_new_pointers_ = true;
+        uword addr = reinterpret_cast<uword>(current);
+        if ((card_page_ != NULL) &&
+            (card_page_->card_table()[card_page_->CardIndexFor(addr)] == 0)) {
+          FATAL1("Pointer to new space at 0x%lx is not in a dirty card\n",
+                 addr);
+        }
+      }
+    }
+  }
+
+  bool has_new_pointers() const { return has_new_pointers_; }
+
+ private:
+  HeapPage* card_page_;
+  bool has_new_pointers_;
+
+  DISALLOW_COPY_AND_ASSIGN(FindNewPointersVisitor);
+};
+
+
+void VerifyRememberedSetVisitor::VisitObject(RawObject* raw_obj) {
+  if (raw_obj->IsFreeListElement()) {
+    return;
+  }
+  HeapPage* page = PageSpace::PageFor(raw_obj);
+  if (page->card_table() == NULL) {
+    page = NULL;
+  }
+  if (raw_obj->IsRemembered() && (page == NULL)) {
+    return;
+  }
+  FindNewPointersVisitor visitor(page);
+  raw_obj->VisitPointers(&visitor);
+  if (visitor.has_new_pointers() && !raw_obj->IsRemembered()) {
+    FATAL1("Old object 0x%lx refers to new space but is not remembered\n",
+           RawObject::ToAddr(raw_obj));
+  }
+}
+
+
 void VerifyWeakPointersVisitor::VisitHandle(uword addr) {
   FinalizablePersistentHandle* handle =
       reinterpret_cast<FinalizablePersistentHandle*>(addr);
@@ -38,6 +38,18 @@ class VerifyPointersVisitor : public ObjectPointerVisitor {
   DISALLOW_COPY_AND_ASSIGN(VerifyPointersVisitor);
 };
 
+// Verifies that all old objects containing pointers into new space have their
+// remembered bit set.
+class VerifyRememberedSetVisitor : public ObjectVisitor {
+ public:
+  VerifyRememberedSetVisitor() {}
+
+  virtual void VisitObject(RawObject* raw_obj);
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(VerifyRememberedSetVisitor);
+};
+
 class VerifyWeakPointersVisitor : public HandleVisitor {
  public:
   explicit VerifyWeakPointersVisitor(VerifyPointersVisitor* visitor)
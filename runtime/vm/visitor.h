@@ -28,6 +28,16 @@ class ObjectPointerVisitor {
   void VisitPointer(RawObject** p) { VisitPointers(p , p); }
 };
 
+
+// An object visitor interface.
+class ObjectVisitor {
+ public:
+  virtual ~ObjectVisitor() {}
+
+  // Invoked for each object.
+  virtual void VisitObject(RawObject* obj) = 0;
+};
+
 }  // namespace dart
 
 #endif  // VM_VISITOR_H_